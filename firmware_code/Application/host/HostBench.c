@@ -0,0 +1,228 @@
+/**
+ * @file    HostBench.c
+ * @brief   Runs the firmware's own benchmark functions on the host.
+ *
+ * Usage: hostbench [section...]
+ *
+ * The functions behind the benchmark CLI commands are called unchanged.
+ * Only CycleCounter differs (HostCycles.c), so timings are host ns per
+ * call rather than M0+ cycles. Use them to compare kernels against each
+ * other and across changes, not as target timings: the CLI command named
+ * with each section gives the on-target number. The phase model is not
+ * timed and matches the target exactly.
+ */
+
+#include "Sim.h"
+#include "ControlTask.h"
+#include "MotionPlayer.h"
+#include "MotionRegistry.h"
+#include "MotionVm.h"
+#include "MotionGait.h"
+#include "ServoCal.h"
+#include "PCA9685.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_ITERATIONS    100000  // Calls per run
+#define BENCH_RUNS          5       // Runs per figure, the fastest is reported
+
+typedef struct {
+	const char *name;
+	const char *command;            // CLI command giving the on-target figure
+	void (*run)(void);
+} BenchSection;
+
+/**
+ * @fn      static void HostBench_Interp(void)
+ * @brief   Interpolation kernel per easing curve, as the motionbench command.
+ */
+static void HostBench_Interp(void) {
+	static const struct {
+		MotionEase ease;
+		const char *name;
+	} curves[] = {
+		{ MOTION_EASE_LINEAR, "linear" },
+		{ MOTION_EASE_IN_OUT, "in-out" },
+		{ MOTION_EASE_CUBIC, "cubic" },
+	};
+
+	for (size_t c = 0; c < sizeof(curves) / sizeof(curves[0]); ++c) {
+		uint32_t best = UINT32_MAX;
+		for (int run = 0; run < BENCH_RUNS; ++run) {
+			uint32_t ns = MotionPlayer_Benchmark(curves[c].ease, BENCH_ITERATIONS);
+			best = (ns < best) ? ns : best;
+		}
+		printf("  %-8s %6lu ns/frame for %d servos\n", curves[c].name, (unsigned long)best, PCA9685_SERVO_CHANNELS);
+	}
+}
+
+/**
+ * @fn      static void HostBench_Decode(void)
+ * @brief   Table size per sequence and keyframe decode, int[9] vs packed, as the motionsize command.
+ * @details int[9] rows are counted at the target's 4-byte int.
+ */
+static void HostBench_Decode(void) {
+	uint32_t map = UINT32_MAX;
+	uint32_t packed = UINT32_MAX;
+	uint32_t steps = 0;
+
+	for (int state = 0; state < STATE_COUNT; ++state) {
+		const MotionEntry *entry = MotionRegistry_Get((RobotState)state);
+		printf("  %-10s %3u steps: int[9] %5lu B, packed %5lu B\n", entry->name, entry->count,
+		       (unsigned long)(entry->count * 9 * sizeof(int32_t)), (unsigned long)(entry->count * sizeof(MotionStep)));
+		steps += entry->count;
+	}
+	printf("  %-10s %3lu steps: int[9] %5lu B, packed %5lu B\n", "total", (unsigned long)steps,
+	       (unsigned long)(steps * 9 * sizeof(int32_t)), (unsigned long)(steps * sizeof(MotionStep)));
+
+	for (int run = 0; run < BENCH_RUNS; ++run) {
+		uint32_t mapNs, packedNs;
+		MotionPlayer_BenchmarkDecode(BENCH_ITERATIONS, &mapNs, &packedNs);
+		map = (mapNs < map) ? mapNs : map;
+		packed = (packedNs < packed) ? packedNs : packed;
+	}
+	printf("  decode   %6lu ns/keyframe through map(), %lu ns packed\n", (unsigned long)map, (unsigned long)packed);
+}
+
+/**
+ * @fn      static void HostBench_Vm(void)
+ * @brief   Interpreter cost per opcode, as the vmbench command.
+ * @details Control-flow opcodes are timed in chains net of the closing wait, as on the
+ *          target, so they resolve below one host clock tick.
+ */
+static void HostBench_Vm(void) {
+	static const char *const names[MOTION_OP_COUNT] = {
+		[MOTION_OP_END] = "end", [MOTION_OP_FRAME] = "frame", [MOTION_OP_MOVE] = "move",
+		[MOTION_OP_WAIT] = "wait", [MOTION_OP_LOOP] = "loop", [MOTION_OP_NEXT] = "next",
+		[MOTION_OP_IF] = "if", [MOTION_OP_CALL] = "call", [MOTION_OP_RET] = "ret",
+		[MOTION_OP_JUMP] = "jump", [MOTION_OP_PLAY] = "play",
+	};
+	uint32_t best[MOTION_OP_COUNT];
+	uint32_t ns[MOTION_OP_COUNT];
+	uint16_t neutral[PCA9685_SERVO_CHANNELS];
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		neutral[ch] = pca9685_angle_to_pulse(90);
+	}
+	MotionPlayer_Init(neutral);
+	for (int op = 0; op < MOTION_OP_COUNT; ++op) {
+		best[op] = UINT32_MAX;
+	}
+	for (int run = 0; run < BENCH_RUNS; ++run) {
+		MotionVm_Benchmark(BENCH_ITERATIONS, ns);
+		for (int op = 0; op < MOTION_OP_COUNT; ++op) {
+			best[op] = (ns[op] < best[op]) ? ns[op] : best[op];
+		}
+	}
+	for (int op = 0; op < MOTION_OP_COUNT; ++op) {
+		printf("  %-8s %6lu.%02lu ns\n", names[op], (unsigned long)(best[op] / MOTION_VM_BENCH_SCALE),
+		       (unsigned long)(best[op] % MOTION_VM_BENCH_SCALE));
+	}
+}
+
+/**
+ * @fn      static void HostBench_Gait(void)
+ * @brief   Gait frame generation with IK for 8 servos, as the gaitbench command.
+ */
+static void HostBench_Gait(void) {
+	static const struct {
+		MotionGaitType type;
+		const char *name;
+	} gaits[] = {
+		{ MOTION_GAIT_CREEP, "creep" },
+		{ MOTION_GAIT_TROT, "trot" },
+	};
+
+	for (size_t g = 0; g < sizeof(gaits) / sizeof(gaits[0]); ++g) {
+		uint32_t best = UINT32_MAX;
+		for (int run = 0; run < BENCH_RUNS; ++run) {
+			uint32_t ns = MotionGait_Benchmark(gaits[g].type, BENCH_ITERATIONS);
+			best = (ns < best) ? ns : best;
+		}
+		printf("  %-8s %6lu ns/frame of a %d ms frame\n", gaits[g].name, (unsigned long)best, MOTION_FRAME_MS);
+	}
+}
+
+/**
+ * @fn      static void HostBench_Phase(void)
+ * @brief   Modelled pulse overlap per sequence, aligned vs staggered, as the servophase command.
+ * @details Every keyframe goes through the default calibration and
+ *          pca9685_phase_model(); nothing is timed, so these figures are
+ *          the ones the target reports.
+ */
+static void HostBench_Phase(void) {
+	uint32_t peakAll[2] = { 0, 0 };
+	uint64_t overlapAll[2] = { 0, 0 };
+	uint32_t excessAll[2] = { 0, 0 };
+	uint32_t framesAll = 0;
+	uint16_t counts[PCA9685_SERVO_CHANNELS];
+	PCA9685PhaseModel model;
+
+	printf("  %-10s %5s  %-12s %-16s %s\n", "", "keys", "peak servos", "overlap us/T", "worst excess servo-us");
+	for (int state = 0; state < STATE_COUNT; ++state) {
+		const MotionEntry *entry = MotionRegistry_Get((RobotState)state);
+		uint32_t peak[2] = { 0, 0 };
+		uint32_t overlap[2] = { 0, 0 };
+		uint32_t excess[2] = { 0, 0 };
+
+		for (uint16_t i = 0; i < entry->count; ++i) {
+			ServoCal_Map(entry->steps[i].pulse, counts);
+			for (int m = 0; m < 2; ++m) {
+				pca9685_phase_model(counts, (m == 0) ? PCA9685_PHASE_ALIGNED : PCA9685_PHASE_STAGGER, &model);
+				peak[m] = (model.peak > peak[m]) ? model.peak : peak[m];
+				overlap[m] += model.overlapUs;
+				excess[m] = (model.excessUs > excess[m]) ? model.excessUs : excess[m];
+			}
+		}
+		printf("  %-10s %5u  %2lu -> %-6lu %5lu -> %-7lu %6lu -> %lu\n", entry->name, entry->count,
+		       (unsigned long)peak[0], (unsigned long)peak[1],
+		       (unsigned long)(overlap[0] / entry->count), (unsigned long)(overlap[1] / entry->count),
+		       (unsigned long)excess[0], (unsigned long)excess[1]);
+		for (int m = 0; m < 2; ++m) {
+			peakAll[m] = (peak[m] > peakAll[m]) ? peak[m] : peakAll[m];
+			overlapAll[m] += overlap[m];
+			excessAll[m] = (excess[m] > excessAll[m]) ? excess[m] : excessAll[m];
+		}
+		framesAll += entry->count;
+	}
+	printf("  %-10s %5lu  %2lu -> %-6lu %5lu -> %-7lu %6lu -> %lu\n", "all", (unsigned long)framesAll,
+	       (unsigned long)peakAll[0], (unsigned long)peakAll[1],
+	       (unsigned long)(overlapAll[0] / framesAll), (unsigned long)(overlapAll[1] / framesAll),
+	       (unsigned long)excessAll[0], (unsigned long)excessAll[1]);
+}
+
+static const BenchSection sections[] = {
+	{ "interp", "motionbench", HostBench_Interp },
+	{ "decode", "motionsize", HostBench_Decode },
+	{ "vm", "vmbench", HostBench_Vm },
+	{ "gait", "gaitbench", HostBench_Gait },
+	{ "phase", "servophase", HostBench_Phase },
+};
+
+int main(int argc, char **argv) {
+	size_t count = sizeof(sections) / sizeof(sections[0]);
+	int failed = 0;
+
+	ServoCal_Reset();
+	for (size_t s = 0; s < count; ++s) {
+		bool wanted = (argc == 1);
+		for (int arg = 1; arg < argc && !wanted; ++arg) {
+			wanted = strcmp(argv[arg], sections[s].name) == 0;
+		}
+		if (wanted) {
+			printf("%s (on target: %s)\n", sections[s].name, sections[s].command);
+			sections[s].run();
+		}
+	}
+	for (int arg = 1; arg < argc; ++arg) {
+		size_t s = 0;
+		while (s < count && strcmp(argv[arg], sections[s].name) != 0) {
+			++s;
+		}
+		if (s == count) {
+			fprintf(stderr, "hostbench: no section named %s\n", argv[arg]);
+			failed = 1;
+		}
+	}
+	return failed;
+}
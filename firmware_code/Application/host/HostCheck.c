@@ -0,0 +1,110 @@
+/**
+ * @file    HostCheck.c
+ * @brief   Consistency checks of firmware tables and mappings, run on the host.
+ *
+ * Usage: hostcheck [section...]
+ *
+ * Each section prints the cases that fail and a pass/fail line; the exit
+ * status is non-zero if any section failed.
+ */
+
+#include "Sim.h"
+#include "ServoCal.h"
+#include "MotionRegistry.h"
+#include "PCA9685.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+	const char *name;
+	int (*run)(void);               // Returns the number of failed cases
+} CheckSection;
+
+/**
+ * @fn      static int HostCheck_ServoCal(void)
+ * @brief   The default calibration maps every nominal pulse to itself.
+ */
+static int HostCheck_ServoCal(void) {
+	int failed = 0;
+
+	ServoCal_Reset();
+	for (uint8_t ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		for (uint16_t p = PCA9685_SERVO_MIN; p <= PCA9685_SERVO_MAX; ++p) {
+			uint16_t out = ServoCal_MapChannel(ch, p);
+			if (out != p) {
+				printf("  channel %u: nominal %u mapped to %u\n", ch, p, out);
+				failed++;
+			}
+		}
+	}
+	return failed;
+}
+
+/**
+ * @fn      static int HostCheck_Registry(void)
+ * @brief   Every alias resolves through the hash to its own entry, and so does every canonical name.
+ * @details The alias slots are placed by hand for MOTION_HASH_SEED; a name in
+ *          the wrong slot is simply never found.
+ */
+static int HostCheck_Registry(void) {
+	int failed = 0;
+
+	for (uint8_t slot = 0; slot < MOTION_REGISTRY_SLOTS; ++slot) {
+		RobotState state;
+		const char *alias = MotionRegistry_Alias(slot, &state);
+		if (alias == NULL) {
+			continue;
+		}
+		const MotionEntry *entry = MotionRegistry_FindN(alias, strlen(alias));
+		if (entry != MotionRegistry_Get(state)) {
+			printf("  slot %u: %s found %s, expected %s\n", slot, alias, entry ? entry->name : "nothing",
+			       MotionRegistry_Get(state)->name);
+			failed++;
+		}
+	}
+	for (int state = 0; state < STATE_COUNT; ++state) {
+		const MotionEntry *entry = MotionRegistry_Get((RobotState)state);
+		if (MotionRegistry_Find(entry->name) != entry) {
+			printf("  state %d: canonical name %s is not an alias\n", state, entry->name);
+			failed++;
+		}
+	}
+	return failed;
+}
+
+static const CheckSection sections[] = {
+	{ "servocal", HostCheck_ServoCal },
+	{ "registry", HostCheck_Registry },
+};
+
+int main(int argc, char **argv) {
+	size_t count = sizeof(sections) / sizeof(sections[0]);
+	int failed = 0;
+
+	for (size_t s = 0; s < count; ++s) {
+		bool wanted = (argc == 1);
+		for (int arg = 1; arg < argc && !wanted; ++arg) {
+			wanted = strcmp(argv[arg], sections[s].name) == 0;
+		}
+		if (wanted) {
+			int cases = sections[s].run();
+			printf("%-10s %s", sections[s].name, cases ? "FAILED" : "ok");
+			if (cases) {
+				printf(" (%d cases)", cases);
+			}
+			printf("\n");
+			failed |= (cases != 0);
+		}
+	}
+	for (int arg = 1; arg < argc; ++arg) {
+		size_t s = 0;
+		while (s < count && strcmp(argv[arg], sections[s].name) != 0) {
+			++s;
+		}
+		if (s == count) {
+			fprintf(stderr, "hostcheck: no section named %s\n", argv[arg]);
+			failed = 1;
+		}
+	}
+	return failed;
+}
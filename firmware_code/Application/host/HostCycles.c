@@ -0,0 +1,27 @@
+/**
+ * @file    HostCycles.c
+ * @brief   CycleCounter on the host's monotonic clock, for motionbench.
+ *
+ * One count is one nanosecond of host time, so the firmware benchmarks
+ * return ns per call here instead of M0+ cycles. The counter wraps after
+ * about 4 s; every benchmark run is far shorter.
+ */
+
+#include "FreeRTOS.h"
+#include "CycleCounter/CycleCounter.h"
+#include <time.h>
+
+uint32_t CycleCounterNow(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec);
+}
+
+uint32_t CycleCounterToUs(uint32_t cycles) {
+	return cycles / 1000u;
+}
+
+uint32_t CycleCounterAtTick(uint32_t tick) {
+	return tick * (1000000000UL / configTICK_RATE_HZ);
+}
@@ -0,0 +1,205 @@
+/**
+ * @file    MotionSim.c
+ * @brief   Plays motion tables through the firmware motion path on the host.
+ *
+ * Usage: motionsim [-o dir] [-s speed] [-n] [motion...]
+ *
+ * Each named motion (all of the registry by default) starts from the Idle
+ * pose, as after a command on the robot, and is played at the given speed
+ * with the trace armed. Per motion the run writes, to dir (out by default):
+ *
+ *   <name>.csv          the simtrace CSV, one row per step
+ *   <name>_frames.csv   every servo write seen on the mocked bus, as angles
+ *   <name>.json         both of the above plus the trace summary
+ *
+ * and prints one summary line. -n skips the files.
+ */
+
+#include "Sim.h"
+#include "ControlTask.h"
+#include "MotionPlayer.h"
+#include "MotionRegistry.h"
+#include "MotionTrace.h"
+#include "ServoCal.h"
+#include "PCA9685.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/**
+ * @fn      static FILE *MotionSim_Open(const char *dir, const char *name, const char *suffix)
+ * @brief   Opens <dir>/<name><suffix> for writing, reporting a failure.
+ */
+static FILE *MotionSim_Open(const char *dir, const char *name, const char *suffix) {
+	char path[256];
+	FILE *file;
+
+	snprintf(path, sizeof(path), "%s/%s%s", dir, name, suffix);
+	file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "motionsim: %s: %s\n", path, strerror(errno));
+	}
+	return file;
+}
+
+/**
+ * @fn      static void MotionSim_WriteSteps(FILE *csv, FILE *json)
+ * @brief   Writes the traced steps in the simtrace CSV columns and as a JSON array.
+ */
+static void MotionSim_WriteSteps(FILE *csv, FILE *json) {
+	MotionTraceStep step;
+
+	fprintf(csv, "step,planned_ms,actual_ms,error_ms,frames,transactions,bytes,a0,a1,a2,a3,a4,a5,a6,a7\n");
+	fprintf(json, "  \"steps\": [");
+	for (uint16_t row = 0; MotionTrace_GetStep(row, &step); ++row) {
+		long errorMs = ((long)step.actualUs - (long)step.plannedMs * 1000L) / 1000L;
+		fprintf(csv, "%u,%u,%lu,%ld,%u,%u,%u", row, step.plannedMs, (unsigned long)(step.actualUs / 1000UL), errorMs,
+		        step.frames, step.transactions, step.bytes);
+		fprintf(json, "%s\n    {\"step\": %u, \"planned_ms\": %u, \"actual_us\": %lu, \"frames\": %u, "
+		        "\"transactions\": %u, \"bytes\": %u, \"angles\": [", row ? "," : "", row, step.plannedMs,
+		        (unsigned long)step.actualUs, step.frames, step.transactions, step.bytes);
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			int angle = pca9685_pulse_to_angle(step.pulse[ch]);
+			fprintf(csv, ",%d", angle);
+			fprintf(json, "%s%d", ch ? ", " : "", angle);
+		}
+		fprintf(csv, "\n");
+		fprintf(json, "]}");
+	}
+	fprintf(json, "\n  ],\n");
+}
+
+/**
+ * @fn      static void MotionSim_WriteFrames(FILE *csv, FILE *json, uint64_t startUs)
+ * @brief   Writes the bus timeline since startUs, one row per servo write.
+ */
+static void MotionSim_WriteFrames(FILE *csv, FILE *json, uint64_t startUs) {
+	uint32_t count = SimI2c_TimelineCount();
+
+	fprintf(csv, "t_ms,a0,a1,a2,a3,a4,a5,a6,a7\n");
+	fprintf(json, "  \"frames\": [");
+	for (uint32_t i = 0; i < count; ++i) {
+		const SimFrame *frame = SimI2c_TimelineRow(i);
+		double ms = (double)(frame->us - startUs) / 1000.0;
+		fprintf(csv, "%.3f", ms);
+		fprintf(json, "%s\n    {\"t_ms\": %.3f, \"angles\": [", i ? "," : "", ms);
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			int angle = pca9685_pulse_to_angle(frame->pulse[ch]);
+			fprintf(csv, ",%d", angle);
+			fprintf(json, "%s%d", ch ? ", " : "", angle);
+		}
+		fprintf(csv, "\n");
+		fprintf(json, "]}");
+	}
+	fprintf(json, "\n  ]\n");
+}
+
+/**
+ * @fn      static int MotionSim_Run(const MotionEntry *entry, uint16_t speed, const char *dir)
+ * @brief   Plays one motion from the Idle pose with the trace armed and reports it.
+ * @return  0 on success, 1 if the player failed or an output could not be written
+ */
+static int MotionSim_Run(const MotionEntry *entry, uint16_t speed, const char *dir) {
+	const MotionEntry *idle = MotionRegistry_Get(STATE_IDLE);
+	MotionTraceSummary sum;
+	SimBusStats before, after;
+	int32_t error;
+
+	MotionPlayer_SetSpeed(MOTION_SPEED_ONE);
+	PlayMotion(idle->steps, idle->count);
+	SimI2c_ClearTimeline();
+	SimI2c_GetStats(&before);
+	uint64_t startUs = Sim_NowUs();
+
+	MotionTrace_Arm(false);
+	MotionPlayer_SetSpeed(speed);
+	error = PlayMotion(entry->steps, entry->count);
+	MotionTrace_GetSummary(&sum);
+	SimI2c_GetStats(&after);
+
+	printf("%-10s %3u steps: planned %6lu ms, actual %6lu ms, %5lu transactions, %6lu bytes, bus busy %5.1f%%%s\n",
+	       entry->name, sum.steps, (unsigned long)sum.plannedMs, (unsigned long)(sum.actualUs / 1000UL),
+	       (unsigned long)sum.transactions, (unsigned long)sum.bytes,
+	       (Sim_NowUs() > startUs) ? 100.0 * (double)(after.busyUs - before.busyUs) / (double)(Sim_NowUs() - startUs) : 0.0,
+	       (error != ERROR_NONE) ? " FAILED" : "");
+	if (error != ERROR_NONE) {
+		return 1;
+	}
+	if (dir == NULL) {
+		return 0;
+	}
+
+	FILE *steps = MotionSim_Open(dir, entry->name, ".csv");
+	FILE *frames = MotionSim_Open(dir, entry->name, "_frames.csv");
+	FILE *json = MotionSim_Open(dir, entry->name, ".json");
+	int result = (steps == NULL || frames == NULL || json == NULL);
+	if (!result) {
+		fprintf(json, "{\n  \"motion\": \"%s\",\n  \"speed\": %.3f,\n", entry->name, speed / (double)MOTION_SPEED_ONE);
+		fprintf(json, "  \"summary\": {\"steps\": %u, \"kept\": %u, \"planned_ms\": %lu, \"actual_us\": %lu, "
+		        "\"transactions\": %lu, \"bytes\": %lu, \"bus_busy_us\": %llu},\n", sum.steps, sum.kept,
+		        (unsigned long)sum.plannedMs, (unsigned long)sum.actualUs, (unsigned long)sum.transactions,
+		        (unsigned long)sum.bytes, (unsigned long long)(after.busyUs - before.busyUs));
+		MotionSim_WriteSteps(steps, json);
+		MotionSim_WriteFrames(frames, json, startUs);
+		fprintf(json, "}\n");
+	}
+	if (steps != NULL) fclose(steps);
+	if (frames != NULL) fclose(frames);
+	if (json != NULL) fclose(json);
+	return result;
+}
+
+int main(int argc, char **argv) {
+	const char *dir = "out";
+	uint16_t speed = MOTION_SPEED_ONE;
+	uint16_t neutral[PCA9685_SERVO_CHANNELS];
+	int failed = 0;
+	int arg = 1;
+
+	for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+		if (strcmp(argv[arg], "-o") == 0 && arg + 1 < argc) {
+			dir = argv[++arg];
+		} else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc &&
+		           MotionPlayer_ParseSpeed(argv[arg + 1], strlen(argv[arg + 1]), &speed)) {
+			++arg;
+		} else if (strcmp(argv[arg], "-n") == 0) {
+			dir = NULL;
+		} else {
+			fprintf(stderr, "usage: motionsim [-o dir] [-s speed] [-n] [motion...]\n");
+			return 2;
+		}
+	}
+	if (dir != NULL && mkdir(dir, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "motionsim: %s: %s\n", dir, strerror(errno));
+		return 1;
+	}
+
+	// Same bring-up as ControlTask(), calibration at its defaults
+	ServoCal_Reset();
+	pca9685_init(PCA9685_PHASE_STAGGER);
+	PCA9685_SetPWMFreq(50);
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		neutral[ch] = pca9685_angle_to_pulse(90);
+	}
+	pca9685_set_frame(neutral);
+	MotionPlayer_Init(neutral);
+
+	if (arg == argc) {
+		for (int state = 0; state < STATE_COUNT; ++state) {
+			failed |= MotionSim_Run(MotionRegistry_Get((RobotState)state), speed, dir);
+		}
+	}
+	for (; arg < argc; ++arg) {
+		const MotionEntry *entry = MotionRegistry_Find(argv[arg]);
+		if (entry == NULL) {
+			fprintf(stderr, "motionsim: no motion named %s\n", argv[arg]);
+			failed = 1;
+			continue;
+		}
+		failed |= MotionSim_Run(entry, speed, dir);
+	}
+	return failed;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file    Sim.h
+ * @brief   Host simulation of the servo side of the board: clock and mocked I2C bus.
+ *
+ * The firmware sources of the motion path are compiled unchanged against
+ * the headers in stub/. Time only moves when the code blocks (vTaskDelay,
+ * vTaskDelayUntil, event group waits) or waits for the mocked bus, which
+ * takes the time the bytes would need on the wire. CPU time is not
+ * modelled, so every run of the same sequence gives the same trace.
+ *
+ * The mocked bus holds a PCA9685 register image. Every write to it is
+ * decoded register by register, and each write that touches the servo
+ * channels adds a row of per-channel pulses to the bus timeline.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include "PCA9685.h"
+
+#define SIM_TIMELINE_MAX    4096    // Timeline rows kept per sequence, later writes are counted only
+
+typedef struct {
+	uint64_t us;                                // When the write finished on the bus
+	uint16_t pulse[PCA9685_SERVO_CHANNELS];     // Pulse widths decoded from the registers after it
+} SimFrame;
+
+typedef struct {
+	uint32_t transactions;      // Requests put on the bus, reads included
+	uint32_t bytes;             // Bytes on the wire, address bytes included
+	uint64_t busyUs;            // Time the bus was busy
+	uint32_t frameWrites;       // Writes that touched the servo channels
+} SimBusStats;
+
+uint64_t Sim_NowUs(void);
+void Sim_WaitUntilUs(uint64_t us);
+
+void SimI2c_ClearTimeline(void);
+uint32_t SimI2c_TimelineCount(void);
+const SimFrame *SimI2c_TimelineRow(uint32_t index);
+void SimI2c_GetStats(SimBusStats *stats);
+void SimI2c_GetPulses(uint16_t pulse[PCA9685_SERVO_CHANNELS]);
+
+#endif // SIM_H
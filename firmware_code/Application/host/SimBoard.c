@@ -0,0 +1,77 @@
+/**
+ * @file    SimBoard.c
+ * @brief   The rest of the board as the host build sees it.
+ *
+ * Stand-ins for the modules the motion path links against but does not
+ * exercise here: sensors read as idle, SD and streaming are absent, and
+ * flash is never written.
+ */
+
+#include "Sim.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "asf.h"
+#include "AT42QT1010.h"
+#include "EnvTask/EnvSensorTask.h"
+#include "MotionRecord.h"
+#include "MotionFile.h"
+#include "MotionStream.h"
+#include "SerialConsole.h"
+#include "I2cDriver/I2cDriver.h"
+#include <stdio.h>
+
+volatile bool distance_safe = true;
+volatile int distance_reading = -1;  // No echo, nothing in range
+
+void AT42QT1010_Init(void) {
+}
+
+bool AT42QT1010_IsTouched(void) {
+	return false;
+}
+
+void MotionRecord_Sample(const uint16_t pose[PCA9685_SERVO_CHANNELS], TickType_t tick) {
+}
+
+bool MotionRecord_Active(void) {
+	return false;
+}
+
+int32_t MotionRecord_RunJog(void) {
+	return ERROR_NONE;
+}
+
+int32_t MotionFile_PlayRequested(void) {
+	return ERROR_NOT_FOUND;
+}
+
+int32_t MotionStream_Run(void) {
+	return ERROR_NONE;
+}
+
+void SerialConsoleWriteString(char *string) {
+	fputs(string, stderr);
+}
+
+void LogMessage(enum eDebugLogLevels level, const char *format, ...) {
+}
+
+void nvm_get_config_defaults(struct nvm_config *config) {
+	config->manual_page_write = true;
+}
+
+enum status_code nvm_set_config(const struct nvm_config *config) {
+	return STATUS_OK;
+}
+
+enum status_code nvm_erase_row(uint32_t address) {
+	return STATUS_ERR_IO;
+}
+
+enum status_code nvm_write_buffer(uint32_t address, const uint8_t *buffer, uint16_t length) {
+	return STATUS_ERR_IO;
+}
+
+enum status_code crc32_calculate(const void *data, size_t length, crc32_t *crc) {
+	return STATUS_ERR_IO;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file    SimCycles.c
+ * @brief   CycleCounter on simulated time, for motionsim.
+ *
+ * Counts at configCPU_CLOCK_HZ like the SysTick-based counter on the
+ * board, so the player's own cycle stamps line up with the mocked tick.
+ */
+
+#include "Sim.h"
+#include "FreeRTOS.h"
+#include "CycleCounter/CycleCounter.h"
+
+uint32_t CycleCounterNow(void) {
+	return (uint32_t)(Sim_NowUs() * (configCPU_CLOCK_HZ / 1000000UL));
+}
+
+uint32_t CycleCounterToUs(uint32_t cycles) {
+	return cycles / (configCPU_CLOCK_HZ / 1000000UL);
+}
+
+uint32_t CycleCounterAtTick(uint32_t tick) {
+	return tick * (configCPU_CLOCK_HZ / configTICK_RATE_HZ);
+}
@@ -0,0 +1,313 @@
+/**
+ * @file    SimI2c.c
+ * @brief   Mocked I2C bus for the host build, with a PCA9685 on it.
+ *
+ * Requests run one after another on a single simulated bus, each taking
+ * 9 clocks per byte plus START and STOP at the clock of its device.
+ * I2cSubmit() only books the bus; I2cWait() moves simulated time to when
+ * the request is done, so bursts queued back to back overlap with the
+ * task as they do on the board. Writes to the PCA9685 are decoded into
+ * its register image as they are booked, with the time they finish.
+ */
+
+#include "Sim.h"
+#include "I2cDriver/I2cDriver.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define SIM_PENDING_MAX     16      // Submitted requests not yet waited for
+
+typedef struct {
+	const I2C_Request *req;
+	uint64_t doneUs;
+} SimPending;
+
+typedef struct {
+	uint8_t address;
+	uint16_t khz;
+} SimSpeed;
+
+static uint8_t pcaRegs[256];
+static uint8_t pcaPointer;
+static bool pcaPowered;
+static SimFrame *timeline;
+static uint32_t timelineCount;
+static uint64_t busFreeUs;
+static SimBusStats busStats;
+static SimPending pending[SIM_PENDING_MAX];
+static SimSpeed speeds[I2C_SPEED_PROFILES];
+
+/**
+ * @fn      static void SimI2c_PowerOn(void)
+ * @brief   Puts the PCA9685 register image in its power-on state.
+ */
+static void SimI2c_PowerOn(void) {
+	memset(pcaRegs, 0, sizeof(pcaRegs));
+	pcaRegs[PCA9685_MODE1] = PCA9685_MODE1_SLEEP | PCA9685_MODE1_ALLCALL;
+	pcaRegs[PCA9685_PRE_SCALE] = 0x1E;
+	for (int ch = 0; ch < 16; ++ch) {
+		pcaRegs[PCA9685_LED0_ON_L + 4 * ch + 3] = 0x10;  // LEDn full off
+	}
+	pcaPointer = 0;
+	pcaPowered = true;
+}
+
+/**
+ * @fn      static uint16_t SimI2c_Pulse(int channel)
+ * @brief   Pulse width of a channel in the register image, 0 when fully off.
+ */
+static uint16_t SimI2c_Pulse(int channel) {
+	const uint8_t *led = &pcaRegs[PCA9685_LED0_ON_L + 4 * channel];
+	uint16_t on = (uint16_t)(led[0] | ((led[1] & 0x0F) << 8));
+	uint16_t off = (uint16_t)(led[2] | ((led[3] & 0x0F) << 8));
+
+	if (led[3] & 0x10) {
+		return 0;
+	}
+	if (led[1] & 0x10) {
+		return PCA9685_PWM_COUNTS;
+	}
+	return (uint16_t)((off - on) & (PCA9685_PWM_COUNTS - 1));
+}
+
+/**
+ * @fn      static void SimI2c_PcaWrite(const uint8_t *data, uint16_t len, uint64_t doneUs)
+ * @brief   Applies a write (register pointer, then values) to the PCA9685.
+ * @details The pointer advances after each value only with MODE1.AI set.
+ *          PRE_SCALE only takes a value while the oscillator sleeps, and
+ *          writing RESTART clears it, as on the chip.
+ */
+static void SimI2c_PcaWrite(const uint8_t *data, uint16_t len, uint64_t doneUs) {
+	bool servos = false;
+
+	if (len == 0) {
+		return;
+	}
+	pcaPointer = data[0];
+	for (uint16_t i = 1; i < len; ++i) {
+		uint8_t reg = pcaPointer;
+		if (reg == PCA9685_MODE1) {
+			pcaRegs[reg] = data[i] & (uint8_t)~PCA9685_MODE1_RESTART;
+		} else if (reg == PCA9685_PRE_SCALE) {
+			if (pcaRegs[PCA9685_MODE1] & PCA9685_MODE1_SLEEP) {
+				pcaRegs[reg] = data[i];
+			}
+		} else {
+			pcaRegs[reg] = data[i];
+		}
+		if (reg >= PCA9685_LED0_ON_L && reg < PCA9685_LED0_ON_L + 4 * PCA9685_SERVO_CHANNELS) {
+			servos = true;
+		}
+		if (pcaRegs[PCA9685_MODE1] & PCA9685_MODE1_AI) {
+			pcaPointer++;
+		}
+	}
+	if (!servos) {
+		return;
+	}
+	busStats.frameWrites++;
+	if (timelineCount < SIM_TIMELINE_MAX) {
+		if (timeline == NULL) {
+			timeline = malloc(sizeof(SimFrame) * SIM_TIMELINE_MAX);
+		}
+		SimFrame *row = &timeline[timelineCount++];
+		row->us = doneUs;
+		SimI2c_GetPulses(row->pulse);
+	}
+}
+
+/**
+ * @fn      static uint16_t SimI2c_Khz(uint8_t address)
+ * @brief   Clock a device's requests run at: its speed profile, else the servo bus clock.
+ */
+static uint16_t SimI2c_Khz(uint8_t address) {
+	for (int i = 0; i < I2C_SPEED_PROFILES; ++i) {
+		if (speeds[i].khz != 0 && speeds[i].address == address) {
+			return speeds[i].khz;
+		}
+	}
+	return I2C_SERVO_BUS_KHZ;
+}
+
+/**
+ * @fn      static int32_t SimI2c_Run(const I2C_Data *data, uint64_t *doneUs)
+ * @brief   Books one request on the bus and carries it out on the device model.
+ * @return  ERROR_NONE, or ERROR_ABORTED for an address nobody answers
+ */
+static int32_t SimI2c_Run(const I2C_Data *data, uint64_t *doneUs) {
+	uint32_t bits = 2;  // START and STOP
+	uint64_t start = (busFreeUs > Sim_NowUs()) ? busFreeUs : Sim_NowUs();
+	uint16_t khz = SimI2c_Khz(data->address);
+
+	if (data->lenOut != 0) bits += 9u * (1u + data->lenOut);
+	if (data->lenIn != 0) bits += 9u * (1u + data->lenIn) + 1u;  // Repeated START
+	busStats.transactions++;
+	busStats.bytes += (data->lenOut ? 1u + data->lenOut : 0u) + (data->lenIn ? 1u + data->lenIn : 0u);
+	uint32_t us = (bits * 1000u + khz - 1u) / khz;
+	busStats.busyUs += us;
+	busFreeUs = start + us;
+	*doneUs = busFreeUs;
+
+	if (data->address != PCA9685_I2C_ADDRESS) {
+		return ERROR_ABORTED;  // NACK
+	}
+	if (!pcaPowered) {
+		SimI2c_PowerOn();
+	}
+	SimI2c_PcaWrite(data->msgOut, data->lenOut, busFreeUs);
+	for (uint16_t i = 0; i < data->lenIn; ++i) {
+		data->msgIn[i] = pcaRegs[pcaPointer];
+		if (pcaRegs[PCA9685_MODE1] & PCA9685_MODE1_AI) {
+			pcaPointer++;
+		}
+	}
+	return ERROR_NONE;
+}
+
+int32_t I2cSubmit(I2C_Request *req) {
+	uint64_t doneUs;
+	int slot;
+
+	if (req == NULL || (req->data.lenOut == 0 && req->data.lenIn == 0)) {
+		return ERROR_INVALID_ARG;
+	}
+	for (slot = 0; slot < SIM_PENDING_MAX && pending[slot].req != NULL; ++slot) {
+	}
+	if (slot == SIM_PENDING_MAX) {
+		return ERROR_NO_MEMORY;
+	}
+	req->next = NULL;
+	req->done = false;
+	req->result = SimI2c_Run(&req->data, &doneUs);
+	pending[slot].req = req;
+	pending[slot].doneUs = doneUs;
+	return ERROR_NONE;
+}
+
+int32_t I2cWait(I2C_Request *req, const TickType_t xMaxBlockTime) {
+	for (int slot = 0; slot < SIM_PENDING_MAX; ++slot) {
+		if (pending[slot].req == req) {
+			Sim_WaitUntilUs(pending[slot].doneUs);
+			pending[slot].req = NULL;
+			req->done = true;
+			if (req->callback != NULL) {
+				req->callback(req, req->result);
+			}
+			break;
+		}
+	}
+	return req->result;
+}
+
+void I2cCancel(I2C_Request *req) {
+	I2cWait(req, 0);
+}
+
+int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime) {
+	I2C_Request req;
+
+	if (data == NULL) {
+		return ERROR_INVALID_ARG;
+	}
+	memset(&req, 0, sizeof(req));
+	req.data = *data;
+	req.data.lenIn = 0;
+	int32_t error = I2cSubmit(&req);
+	return (error != ERROR_NONE) ? error : I2cWait(&req, xMaxBlockTime);
+}
+
+int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime) {
+	I2C_Request req;
+	int32_t error;
+
+	if (data == NULL || data->msgOut == NULL) {
+		return ERROR_INVALID_ARG;
+	}
+	memset(&req, 0, sizeof(req));
+	req.data = *data;
+	if (delay != 0) {
+		req.data.lenIn = 0;
+		error = I2cSubmit(&req);
+		if (error == ERROR_NONE) error = I2cWait(&req, xMaxBlockTime);
+		if (error != ERROR_NONE) {
+			return error;
+		}
+		vTaskDelay(delay);
+		req.data = *data;
+		req.data.lenOut = 0;
+	}
+	error = I2cSubmit(&req);
+	return (error != ERROR_NONE) ? error : I2cWait(&req, xMaxBlockTime);
+}
+
+int32_t I2cSetDeviceSpeed(eI2cBuses bus, uint8_t address, uint16_t khz) {
+	SimSpeed *free = NULL;
+
+	if (khz > I2C_FM_PLUS_KHZ) {
+		return ERROR_INVALID_ARG;
+	}
+	for (int i = 0; i < I2C_SPEED_PROFILES; ++i) {
+		if (speeds[i].khz != 0 && speeds[i].address == address) {
+			speeds[i].khz = khz;
+			return ERROR_NONE;
+		}
+		if (speeds[i].khz == 0 && free == NULL) {
+			free = &speeds[i];
+		}
+	}
+	if (khz == 0) {
+		return ERROR_NONE;
+	}
+	if (free == NULL) {
+		return ERROR_NO_MEMORY;
+	}
+	free->address = address;
+	free->khz = khz;
+	return ERROR_NONE;
+}
+
+int32_t I2cBenchmark(const I2C_Data *data, uint16_t khz, uint16_t count, I2C_Bench_Result *result) {
+	return ERROR_UNSUPPORTED_OP;  // Bus timing is what the mock assumes, there is nothing to measure
+}
+
+/**
+ * @fn      void SimI2c_ClearTimeline(void)
+ * @brief   Starts a new bus timeline, for the next sequence.
+ */
+void SimI2c_ClearTimeline(void) {
+	timelineCount = 0;
+}
+
+/**
+ * @fn      uint32_t SimI2c_TimelineCount(void)
+ * @brief   Rows in the bus timeline, at most SIM_TIMELINE_MAX.
+ */
+uint32_t SimI2c_TimelineCount(void) {
+	return timelineCount;
+}
+
+/**
+ * @fn      const SimFrame *SimI2c_TimelineRow(uint32_t index)
+ * @brief   One row of the bus timeline, NULL past the last.
+ */
+const SimFrame *SimI2c_TimelineRow(uint32_t index) {
+	return (index < timelineCount) ? &timeline[index] : NULL;
+}
+
+/**
+ * @fn      void SimI2c_GetStats(SimBusStats *stats)
+ * @brief   Copies the bus counters since start.
+ */
+void SimI2c_GetStats(SimBusStats *stats) {
+	*stats = busStats;
+}
+
+/**
+ * @fn      void SimI2c_GetPulses(uint16_t pulse[PCA9685_SERVO_CHANNELS])
+ * @brief   Pulse widths of the servo channels in the PCA9685 register image.
+ */
+void SimI2c_GetPulses(uint16_t pulse[PCA9685_SERVO_CHANNELS]) {
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		pulse[ch] = SimI2c_Pulse(ch);
+	}
+}
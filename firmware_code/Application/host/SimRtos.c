@@ -0,0 +1,104 @@
+/**
+ * @file    SimRtos.c
+ * @brief   Mocked FreeRTOS tick for the host build: one task, simulated time.
+ *
+ * The tick is the simulated time in ms. A blocking call moves it forward to
+ * where the task would wake on the board; nothing else runs meanwhile, so
+ * an event group is only ever set by the task itself.
+ */
+
+#include "Sim.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "event_groups.h"
+#include <stdlib.h>
+
+struct SimEventGroup {
+	EventBits_t bits;
+};
+
+static uint64_t simUs;
+
+/**
+ * @fn      uint64_t Sim_NowUs(void)
+ * @brief   Simulated time since start.
+ */
+uint64_t Sim_NowUs(void) {
+	return simUs;
+}
+
+/**
+ * @fn      void Sim_WaitUntilUs(uint64_t us)
+ * @brief   Moves simulated time forward to us; earlier times are already past.
+ */
+void Sim_WaitUntilUs(uint64_t us) {
+	if (us > simUs) {
+		simUs = us;
+	}
+}
+
+TickType_t xTaskGetTickCount(void) {
+	return (TickType_t)(simUs / 1000);
+}
+
+void vTaskDelay(TickType_t ticks) {
+	if (ticks != 0) {
+		Sim_WaitUntilUs((uint64_t)(xTaskGetTickCount() + ticks) * 1000);
+	}
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment) {
+	TickType_t wake = *previousWake + increment;
+
+	if ((int32_t)(wake - xTaskGetTickCount()) > 0) {
+		Sim_WaitUntilUs((uint64_t)wake * 1000);  // Still ahead: block until then
+	}
+	*previousWake = wake;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+	return (TaskHandle_t)&simUs;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+	return 1;  // The mocked bus completes requests in I2cWait()
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+	return calloc(1, sizeof(struct SimEventGroup));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+	group->bits |= bits;
+	return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+	EventBits_t before = group->bits;
+
+	group->bits &= ~bits;
+	return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+	return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t ticks) {
+	EventBits_t now = group->bits;
+	bool met = waitForAll ? (now & bits) == bits : (now & bits) != 0;
+
+	if (!met) {
+		if (ticks != portMAX_DELAY) {
+			vTaskDelay(ticks);  // No other task can set them: the wait times out
+		}
+		return group->bits;
+	}
+	if (clearOnExit) {
+		group->bits &= ~bits;
+	}
+	return now;
+}
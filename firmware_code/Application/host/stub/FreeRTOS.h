@@ -0,0 +1,36 @@
+/**
+ * @file    FreeRTOS.h
+ * @brief   Host build: the FreeRTOS types and macros the motion path uses.
+ *
+ * There is one task and no preemption. The tick is simulated time,
+ * advanced only by blocking calls and by the mocked bus (see Sim.h).
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef TickType_t portTickType;
+
+#define configTICK_RATE_HZ      ((TickType_t)1000)
+#define configCPU_CLOCK_HZ      48000000UL      // SAMD21 at 48 MHz, the rate CycleCounter counts at
+#define configASSERT(x)         ((void)0)
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_EMPTY          ((BaseType_t)0)
+#define errQUEUE_FULL           ((BaseType_t)0)
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFUL)
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / (TickType_t)1000))
+
+#define portYIELD_FROM_ISR(x)   ((void)(x))
+
+#endif // HOST_FREERTOS_H
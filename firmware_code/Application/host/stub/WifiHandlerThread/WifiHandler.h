@@ -0,0 +1,11 @@
+/**
+ * @file    WifiHandler.h
+ * @brief   Host build: ControlTask.c only needs the logging it gets through this header.
+ */
+
+#ifndef HOST_WIFI_HANDLER_H
+#define HOST_WIFI_HANDLER_H
+
+#include "SerialConsole.h"
+
+#endif // HOST_WIFI_HANDLER_H
@@ -0,0 +1,39 @@
+/**
+ * @file    asf.h
+ * @brief   Host build: the few ASF declarations the motion path compiles against.
+ *
+ * ServoCal reads its record from flash only in ServoCal_Init(), which the
+ * host never calls; it starts from ServoCal_Reset() instead.
+ */
+
+#ifndef HOST_ASF_H
+#define HOST_ASF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+enum status_code {
+	STATUS_OK = 0,
+	STATUS_BUSY = 0x05,
+	STATUS_ERR_IO = 0x10,
+};
+
+#define FLASH_SIZE              0x40000UL
+#define NVMCTRL_ROW_SIZE        256
+#define NVMCTRL_PAGE_SIZE       64
+#define PIN_PA10                10
+
+struct nvm_config {
+	bool manual_page_write;
+};
+
+typedef uint32_t crc32_t;
+
+void nvm_get_config_defaults(struct nvm_config *config);
+enum status_code nvm_set_config(const struct nvm_config *config);
+enum status_code nvm_erase_row(uint32_t address);
+enum status_code nvm_write_buffer(uint32_t address, const uint8_t *buffer, uint16_t length);
+enum status_code crc32_calculate(const void *data, size_t length, crc32_t *crc);
+
+#endif // HOST_ASF_H
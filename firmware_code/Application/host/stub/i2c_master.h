@@ -0,0 +1,11 @@
+/**
+ * @file    i2c_master.h
+ * @brief   Host build: I2cDriver.h only names the ASF module type.
+ */
+
+#ifndef HOST_I2C_MASTER_H
+#define HOST_I2C_MASTER_H
+
+struct i2c_master_module;
+
+#endif // HOST_I2C_MASTER_H
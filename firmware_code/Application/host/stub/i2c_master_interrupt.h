@@ -0,0 +1,11 @@
+/**
+ * @file    i2c_master_interrupt.h
+ * @brief   Host build: nothing needed beyond i2c_master.h.
+ */
+
+#ifndef HOST_I2C_MASTER_INTERRUPT_H
+#define HOST_I2C_MASTER_INTERRUPT_H
+
+#include "i2c_master.h"
+
+#endif // HOST_I2C_MASTER_INTERRUPT_H
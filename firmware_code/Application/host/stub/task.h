@@ -0,0 +1,24 @@
+/**
+ * @file    task.h
+ * @brief   Host build: task API on the simulated tick (SimRtos.c).
+ */
+
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+
+#define taskENTER_CRITICAL()    ((void)0)
+#define taskEXIT_CRITICAL()     ((void)0)
+#define taskYIELD()             ((void)0)
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+#endif // HOST_TASK_H
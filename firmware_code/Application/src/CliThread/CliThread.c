@@ -16,6 +16,20 @@
 #include "task.h"
 #include "WifiHandlerThread/WifiHandler.h"
 #include "ControlTask/ControlTask.h"
+#include "ControlTask/MotionQueue.h"
+#include "ControlTask/MotionRegistry.h"
+#include "ControlTask/MotionPlayer.h"
+#include "ControlTask/MotionFile.h"
+#include "ControlTask/MotionVm.h"
+#include "ControlTask/MotionTiming.h"
+#include "ControlTask/ServoCal.h"
+#include "ControlTask/MotionGait.h"
+#include "ControlTask/MotionStream.h"
+#include "ControlTask/MotionRecord.h"
+#include "ControlTask/MotionTrace.h"
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
+#include "GesTask/APDS9960.h"
 
 /******************************************************************************
  * Defines
@@ -32,18 +46,39 @@ BaseType_t CLI_GetVersion(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const i
 BaseType_t CLI_GetTicks(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 BaseType_t CLI_FirmwareUpdate(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 // --- Motion CLI Command Function Declarations ---
-BaseType_t CLI_Forward(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Backward(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_LeftShift(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_RightShift(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_SayHi(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Lie(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Fighting(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Pushup(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Sleep(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Dance1(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Dance2(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
-BaseType_t CLI_Dance3(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Motion(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_MotionEase(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_MotionBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_MotionSize(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Reaction(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_MotionQueue(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_SdPlay(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_SdSave(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_SdStats(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_VmRun(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_VmAssemble(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_VmDisassemble(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_VmExport(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_VmBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Timing(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_ServoBus(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_ServoCal(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Gait(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_GaitBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Stream(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Jog(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Record(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_SpeedCheck(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Slew(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_ServoPhase(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_Transition(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_ServoHealth(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_SimTrace(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_I2cQueue(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_I2cDma(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_I2cRepeatedStart(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_I2cSpeed(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
+BaseType_t CLI_I2cBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString);
 
 /******************************************************************************
  * Variables
@@ -107,90 +142,249 @@ static const CLI_Command_Definition_t xGoldCommand = {
 	 0
 };
 	
-static const CLI_Command_Definition_t xForwardCommand = {
-	"forward",
-	"forward: Move Forward\r\n",
-	CLI_Forward,
+// Motion commands all share CLI_Motion, which resolves the name through the motion registry
+static const CLI_Command_Definition_t xMotionCommands[] = {
+	{ "forward", "forward: Move Forward\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "backward", "backward: Move Backward\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "left", "left: Shift Left\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "right", "right: Shift Right\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "hi", "hi: Say Hi\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "lie", "lie: Lie Down\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "fight", "fight: Fighting Mode\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "pushup", "pushup: Do Push-up\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "sleep", "sleep: Sleep Mode\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "dance1", "dance1: Perform Dance 1\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "dance2", "dance2: Perform Dance 2\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "dance3", "dance3: Perform Dance 3\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+	{ "motion", "motion <name> [speed]: Play a motion by CLI or MQTT name (e.g. turn_left, wiggle, idle), speed 0.25-4\r\n", (const pdCOMMAND_LINE_CALLBACK)CLI_Motion, -1 },
+};
+
+static const CLI_Command_Definition_t xMotionEaseCommand = {
+	"ease",
+	"ease <linear|inout|cubic>: Select keyframe easing curve\r\n",
+	CLI_MotionEase,
+	1
+};
+
+static const CLI_Command_Definition_t xMotionBenchCommand = {
+	"motionbench",
+	"motionbench: Cycles per interpolation tick on this CPU\r\n",
+	CLI_MotionBench,
 	0
 };
 
-static const CLI_Command_Definition_t xBackwardCommand = {
-	"backward",
-	"backward: Move Backward\r\n",
-	CLI_Backward,
+static const CLI_Command_Definition_t xMotionSizeCommand = {
+	"motionsize",
+	"motionsize: Motion table flash use and keyframe decode cycles, int[9] vs packed\r\n",
+	CLI_MotionSize,
 	0
 };
 
-static const CLI_Command_Definition_t xLeftShiftCommand = {
-	"left",
-	"left: Shift Left\r\n",
-	CLI_LeftShift,
+static const CLI_Command_Definition_t xReactionCommand = {
+	"reaction",
+	"reaction: Obstacle alarm to evasive motion latency and preempted motions\r\n",
+	CLI_Reaction,
 	0
 };
 
-static const CLI_Command_Definition_t xRightShiftCommand = {
-	"right",
-	"right: Shift Right\r\n",
-	CLI_RightShift,
+static const CLI_Command_Definition_t xMotionQueueCommand = {
+	"mq",
+	"mq: Motion command queue depth per class (safety/user/gesture/idle), drops and coalescing\r\n",
+	CLI_MotionQueue,
 	0
 };
 
-static const CLI_Command_Definition_t xSayHiCommand = {
-	"hi",
-	"hi: Say Hi\r\n",
-	CLI_SayHi,
+static const CLI_Command_Definition_t xSdPlayCommand = {
+	"sdplay",
+	"sdplay <file> [speed]: Play 0:/motions/<file>.bmo from the SD card\r\n",
+	CLI_SdPlay,
+	-1
+};
+
+static const CLI_Command_Definition_t xSdSaveCommand = {
+	"sdsave",
+	"sdsave <motion> <file>: Write a built-in motion to 0:/motions/<file>.bmo\r\n",
+	CLI_SdSave,
+	2
+};
+
+static const CLI_Command_Definition_t xSdStatsCommand = {
+	"sdstats",
+	"sdstats: SD motion cache hits, streamed plays, refill time and underruns\r\n",
+	CLI_SdStats,
+	0
+};
+
+static const CLI_Command_Definition_t xVmRunCommand = {
+	"vm",
+	"vm [file]: Run the loaded motion program, or load 0:/motions/<file>.bvm first\r\n",
+	CLI_VmRun,
+	-1
+};
+
+static const CLI_Command_Definition_t xVmAssembleCommand = {
+	"vmasm",
+	"vmasm <source>: Assemble and run a motion program, e.g. vmasm loop 3; play hi; next\r\n",
+	CLI_VmAssemble,
+	-1
+};
+
+static const CLI_Command_Definition_t xVmDisassembleCommand = {
+	"vmdis",
+	"vmdis: List the loaded motion program\r\n",
+	CLI_VmDisassemble,
 	0
 };
 
-static const CLI_Command_Definition_t xLieCommand = {
-	"lie",
-	"lie: Lie Down\r\n",
-	CLI_Lie,
+static const CLI_Command_Definition_t xVmExportCommand = {
+	"vmexport",
+	"vmexport <motion> <file>: Compile a built-in motion to 0:/motions/<file>.bvm\r\n",
+	CLI_VmExport,
+	2
+};
+
+static const CLI_Command_Definition_t xVmBenchCommand = {
+	"vmbench",
+	"vmbench: Motion interpreter cycles per opcode on this CPU\r\n",
+	CLI_VmBench,
 	0
 };
 
-static const CLI_Command_Definition_t xFightingCommand = {
-	"fight",
-	"fight: Fighting Mode\r\n",
-	CLI_Fighting,
+static const CLI_Command_Definition_t xTimingCommand = {
+	"timing",
+	"timing [reset|hist]: Servo frame lateness min/mean/p99/max and sequence budget overruns\r\n",
+	CLI_Timing,
+	-1
+};
+
+static const CLI_Command_Definition_t xServoBusCommand = {
+	"servobus",
+	"servobus: Servo frame bursts and I2C bytes sent versus full-frame writes\r\n",
+	CLI_ServoBus,
 	0
 };
 
-static const CLI_Command_Definition_t xPushupCommand = {
-	"pushup",
-	"pushup: Do Push-up\r\n",
-	CLI_Pushup,
+static const CLI_Command_Definition_t xServoCalCommand = {
+	"servocal",
+	"servocal [<ch> <offset> <min> <max> <inv>|save|reset]: Show or trim per-servo calibration (applies next frame)\r\n",
+	CLI_ServoCal,
+	-1
+};
+
+static const CLI_Command_Definition_t xGaitCommand = {
+	"gait",
+	"gait <creep|trot> [speed_mm_s stride_mm turn_mm height_mm cycles]: Walk a generated gait, 0 cycles = until next command\r\n",
+	CLI_Gait,
+	-1
+};
+
+static const CLI_Command_Definition_t xGaitBenchCommand = {
+	"gaitbench",
+	"gaitbench: CPU cycles to generate one creep and one trot frame with IK\r\n",
+	CLI_GaitBench,
 	0
 };
 
-static const CLI_Command_Definition_t xSleepCommand = {
-	"sleep",
-	"sleep: Sleep Mode\r\n",
-	CLI_Sleep,
+static const CLI_Command_Definition_t xStreamCommand = {
+	"stream",
+	"stream [reset]: Live servo stream frames, concealment, latency and jitter\r\n",
+	CLI_Stream,
+	-1
+};
+
+static const CLI_Command_Definition_t xJogCommand = {
+	"jog",
+	"jog <ch> <angle> [ms]: Move one servo and hold the pose (for teaching)\r\n",
+	CLI_Jog,
+	-1
+};
+
+static const CLI_Command_Definition_t xRecordCommand = {
+	"record",
+	"record [start [tol]|stop|save <file>]: Teach a sequence from jogged or streamed poses\r\n",
+	CLI_Record,
+	-1
+};
+
+static const CLI_Command_Definition_t xSpeedCheckCommand = {
+	"speedcheck",
+	"speedcheck [speed]: Check servo frame writes fit every step of the built-in motions (default max speed)\r\n",
+	CLI_SpeedCheck,
+	-1
+};
+
+static const CLI_Command_Definition_t xSlewCommand = {
+	"slew",
+	"slew [<ch|all> <deg/s>|cap <servos> <deg/s>]: Servo speed limits and last sequence slew peaks\r\n",
+	CLI_Slew,
+	-1
+};
+
+static const CLI_Command_Definition_t xServoPhaseCommand = {
+	"servophase",
+	"servophase [aligned|stagger]: Servo pulse start offsets and modeled pulse overlap over the built-in motions\r\n",
+	CLI_ServoPhase,
+	-1
+};
+
+static const CLI_Command_Definition_t xTransitionCommand = {
+	"transition",
+	"transition [on|off]: Planned entry into each sequence from the current pose, and what it saved\r\n",
+	CLI_Transition,
+	-1
+};
+
+static const CLI_Command_Definition_t xServoHealthCommand = {
+	"servohealth",
+	"servohealth: Servo driver brownout resets detected and recovery times\r\n",
+	CLI_ServoHealth,
 	0
 };
 
-static const CLI_Command_Definition_t xDance1Command = {
-	"dance1",
-	"dance1: Perform Dance 1\r\n",
-	CLI_Dance1,
+static const CLI_Command_Definition_t xSimTraceCommand = {
+	"simtrace",
+	"simtrace [<motion> [speed] [dry]]: Trace a motion per step (dry: servo bus mocked); no args prints the last trace as CSV\r\n",
+	CLI_SimTrace,
+	-1
+};
+
+static const CLI_Command_Definition_t xI2cQueueCommand = {
+	"i2cqueue",
+	"i2cqueue: Sensor bus transaction queue counters\r\n",
+	CLI_I2cQueue,
 	0
 };
 
-static const CLI_Command_Definition_t xDance2Command = {
-	"dance2",
-	"dance2: Perform Dance 2\r\n",
-	CLI_Dance2,
+static const CLI_Command_Definition_t xI2cDmaCommand = {
+	"i2cdma",
+	"i2cdma: Sensor bus DMA transfers and the CPU time they saved\r\n",
+	CLI_I2cDma,
 	0
 };
 
-static const CLI_Command_Definition_t xDance3Command = {
-	"dance3",
-	"dance3: Perform Dance 3\r\n",
-	CLI_Dance3,
+static const CLI_Command_Definition_t xI2cRepeatedStartCommand = {
+	"i2crs",
+	"i2crs [on|off]: Repeated START between register address and read, and the register read latency with and without it\r\n",
+	CLI_I2cRepeatedStart,
+	-1
+};
+
+static const CLI_Command_Definition_t xI2cSpeedCommand = {
+	"i2cspeed",
+	"i2cspeed: Clock of each bus and of each device with a speed profile, BAUD switches and NACK fallbacks\r\n",
+	CLI_I2cSpeed,
 	0
 };
 
+static const CLI_Command_Definition_t xI2cBenchCommand = {
+	"i2cbench",
+	"i2cbench [count]: Time PCA9685 frame writes and APDS9960 FIFO reads at 100, 400 and 1000 kHz (robot idle, no hand over the sensor)\r\n",
+	CLI_I2cBench,
+	-1
+};
+
+static uint8_t vmScratch[MOTION_VM_PROGRAM_MAX];    // Program buffer for the vm commands, off the CLI stack
+
 
 /******************************************************************************
  * Forward Declarations
@@ -221,18 +415,41 @@ void vCommandConsoleTask(void *pvParameters)
     FreeRTOS_CLIRegisterCommand(&xOtauCommand);     // Register OTAU command
     FreeRTOS_CLIRegisterCommand(&xFirmwareUpdateCommand);  // Register fw command
 	FreeRTOS_CLIRegisterCommand(&xGoldCommand);
-	FreeRTOS_CLIRegisterCommand(&xForwardCommand);
-    FreeRTOS_CLIRegisterCommand(&xBackwardCommand);
-    FreeRTOS_CLIRegisterCommand(&xLeftShiftCommand);
-    FreeRTOS_CLIRegisterCommand(&xRightShiftCommand);
-    FreeRTOS_CLIRegisterCommand(&xSayHiCommand);
-    FreeRTOS_CLIRegisterCommand(&xLieCommand);
-    FreeRTOS_CLIRegisterCommand(&xFightingCommand);
-    FreeRTOS_CLIRegisterCommand(&xPushupCommand);
-    FreeRTOS_CLIRegisterCommand(&xSleepCommand);
-    FreeRTOS_CLIRegisterCommand(&xDance1Command);
-    FreeRTOS_CLIRegisterCommand(&xDance2Command);
-    FreeRTOS_CLIRegisterCommand(&xDance3Command);
+    for (size_t i = 0; i < sizeof(xMotionCommands) / sizeof(xMotionCommands[0]); ++i) {
+        FreeRTOS_CLIRegisterCommand(&xMotionCommands[i]);
+    }
+    FreeRTOS_CLIRegisterCommand(&xMotionEaseCommand);
+    FreeRTOS_CLIRegisterCommand(&xMotionBenchCommand);
+    FreeRTOS_CLIRegisterCommand(&xMotionSizeCommand);
+    FreeRTOS_CLIRegisterCommand(&xReactionCommand);
+    FreeRTOS_CLIRegisterCommand(&xMotionQueueCommand);
+    FreeRTOS_CLIRegisterCommand(&xSdPlayCommand);
+    FreeRTOS_CLIRegisterCommand(&xSdSaveCommand);
+    FreeRTOS_CLIRegisterCommand(&xSdStatsCommand);
+    FreeRTOS_CLIRegisterCommand(&xVmRunCommand);
+    FreeRTOS_CLIRegisterCommand(&xVmAssembleCommand);
+    FreeRTOS_CLIRegisterCommand(&xVmDisassembleCommand);
+    FreeRTOS_CLIRegisterCommand(&xVmExportCommand);
+    FreeRTOS_CLIRegisterCommand(&xVmBenchCommand);
+    FreeRTOS_CLIRegisterCommand(&xTimingCommand);
+    FreeRTOS_CLIRegisterCommand(&xServoBusCommand);
+    FreeRTOS_CLIRegisterCommand(&xServoCalCommand);
+    FreeRTOS_CLIRegisterCommand(&xGaitCommand);
+    FreeRTOS_CLIRegisterCommand(&xGaitBenchCommand);
+    FreeRTOS_CLIRegisterCommand(&xStreamCommand);
+    FreeRTOS_CLIRegisterCommand(&xJogCommand);
+    FreeRTOS_CLIRegisterCommand(&xRecordCommand);
+    FreeRTOS_CLIRegisterCommand(&xSpeedCheckCommand);
+    FreeRTOS_CLIRegisterCommand(&xSlewCommand);
+    FreeRTOS_CLIRegisterCommand(&xServoPhaseCommand);
+    FreeRTOS_CLIRegisterCommand(&xTransitionCommand);
+    FreeRTOS_CLIRegisterCommand(&xServoHealthCommand);
+    FreeRTOS_CLIRegisterCommand(&xSimTraceCommand);
+    FreeRTOS_CLIRegisterCommand(&xI2cQueueCommand);
+    FreeRTOS_CLIRegisterCommand(&xI2cDmaCommand);
+    FreeRTOS_CLIRegisterCommand(&xI2cRepeatedStartCommand);
+    FreeRTOS_CLIRegisterCommand(&xI2cSpeedCommand);
+    FreeRTOS_CLIRegisterCommand(&xI2cBenchCommand);
 
     uint8_t cRxedChar[2], cInputIndex = 0;
     BaseType_t xMoreDataToFollow;
@@ -607,99 +824,1001 @@ BaseType_t CLI_Gold(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t
 	return pdFALSE;
 }
 
-// Forward
-BaseType_t CLI_Forward(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Queue a motion by name: "forward" or "motion turn_left"
+BaseType_t CLI_Motion(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_FORWARD;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Forward\r\n");
+	BaseType_t nameLen = 0;
+	BaseType_t speedLen = 0;
+	const char *name = (const char *)pcCommandString;
+	const char *speedArg;
+	uint16_t speed = MOTION_SPEED_ONE;
+
+	if (strncmp(name, "motion ", 7) == 0) {
+		name = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &nameLen);
+		speedArg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &speedLen);
+	} else {
+		// Bare motion command: the command word is the motion name
+		nameLen = (BaseType_t)strcspn(name, " ");
+		speedArg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &speedLen);
+	}
+
+	const MotionEntry *entry = (name != NULL) ? MotionRegistry_FindN(name, (size_t)nameLen) : NULL;
+	if (entry == NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown motion\r\n");
+	} else if (speedArg != NULL && !MotionPlayer_ParseSpeed(speedArg, (size_t)speedLen, &speed)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid speed (%d.%02d-%d.%02d)\r\n",
+		         MOTION_SPEED_MIN / MOTION_SPEED_ONE, MOTION_SPEED_MIN * 100 / MOTION_SPEED_ONE % 100,
+		         MOTION_SPEED_MAX / MOTION_SPEED_ONE, MOTION_SPEED_MAX * 100 / MOTION_SPEED_ONE % 100);
+	} else if (MotionQueue_PostSpeed(entry->state, MOTION_CLASS_USER, speed) != pdPASS) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, %s dropped\r\n", entry->label);
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: %s x%u.%02u\r\n", entry->label, speed / MOTION_SPEED_ONE,
+		         (speed % MOTION_SPEED_ONE) * 100 / MOTION_SPEED_ONE);
+	}
 	return pdFALSE;
 }
 
-// Backward
-BaseType_t CLI_Backward(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Select easing curve used between keyframes
+BaseType_t CLI_MotionEase(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_BACKWARD;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Backward\r\n");
+	static const char *const easeNames[MOTION_EASE_COUNT] = { "linear", "inout", "cubic" };
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+
+	for (int i = 0; i < MOTION_EASE_COUNT; ++i) {
+		if (param != NULL && strlen(easeNames[i]) == (size_t)paramLen && strncmp(param, easeNames[i], paramLen) == 0) {
+			MotionPlayer_SetEase((MotionEase)i);
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Ease: %s\r\n", easeNames[i]);
+			return pdFALSE;
+		}
+	}
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown ease, current: %s\r\n", easeNames[MotionPlayer_GetEase()]);
 	return pdFALSE;
 }
 
-// Left Shift
-BaseType_t CLI_LeftShift(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Benchmark the interpolation kernel and report live playback cost
+BaseType_t CLI_MotionBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_LEFT_SHIFT;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Left Shift\r\n");
+	MotionPlayerStats stats;
+	uint32_t linear = MotionPlayer_Benchmark(MOTION_EASE_LINEAR, 1000);
+	uint32_t inOut = MotionPlayer_Benchmark(MOTION_EASE_IN_OUT, 1000);
+	uint32_t cubic = MotionPlayer_Benchmark(MOTION_EASE_CUBIC, 1000);
+
+	MotionPlayer_GetStats(&stats);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "Cycles/tick lin %lu inout %lu cubic %lu; live max %lu, frames %lu, err %lu\r\n",
+	         (unsigned long)linear, (unsigned long)inOut, (unsigned long)cubic,
+	         (unsigned long)stats.kernelCyclesMax, (unsigned long)stats.frames, (unsigned long)stats.frameErrors);
 	return pdFALSE;
 }
 
-// Right Shift
-BaseType_t CLI_RightShift(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Compare the packed motion format against the original int[][9] tables
+BaseType_t CLI_MotionSize(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_RIGHT_SHIFT;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Right Shift\r\n");
+	uint32_t sequences = 0;
+	uint32_t steps = ControlTask_MotionStepCount(&sequences);
+	uint32_t mapCycles = 0;
+	uint32_t packedCycles = 0;
+
+	MotionPlayer_BenchmarkDecode(1000, &mapCycles, &packedCycles);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%lu seqs/%lu steps: int[9] %lu B, packed %lu B; decode cyc/step %lu vs %lu\r\n",
+	         (unsigned long)sequences, (unsigned long)steps,
+	         (unsigned long)(steps * 9 * sizeof(int)), (unsigned long)(steps * sizeof(MotionStep)),
+	         (unsigned long)mapCycles, (unsigned long)packedCycles);
 	return pdFALSE;
 }
 
-// Say Hi
-BaseType_t CLI_SayHi(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Report how quickly obstacle alarms preempt the motion player
+BaseType_t CLI_Reaction(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_SAY_HI;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Say Hi\r\n");
+	ControlReactionStats reaction;
+	MotionPlayerStats player;
+
+	ControlTask_GetReactionStats(&reaction);
+	MotionPlayer_GetStats(&player);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "Obstacles %lu, latency last %lu us max %lu us, motions aborted %lu\r\n",
+	         (unsigned long)reaction.obstacles, (unsigned long)reaction.latencyLastUs,
+	         (unsigned long)reaction.latencyMaxUs, (unsigned long)player.aborts);
 	return pdFALSE;
 }
 
-// Lie
-BaseType_t CLI_Lie(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Report motion command queue occupancy and counters
+BaseType_t CLI_MotionQueue(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_LIE;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Lie Down\r\n");
+	MotionQueueStats stats;
+
+	MotionQueue_GetStats(&stats);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "Depth %u/%u/%u/%u max %u, posted %lu coalesced %lu preempt %lu, drops %lu/%lu/%lu/%lu\r\n",
+	         stats.depth[MOTION_CLASS_SAFETY], stats.depth[MOTION_CLASS_USER],
+	         stats.depth[MOTION_CLASS_GESTURE], stats.depth[MOTION_CLASS_IDLE], stats.depthMax,
+	         (unsigned long)stats.posted, (unsigned long)stats.coalesced, (unsigned long)stats.preemptions,
+	         (unsigned long)stats.dropped[MOTION_CLASS_SAFETY], (unsigned long)stats.dropped[MOTION_CLASS_USER],
+	         (unsigned long)stats.dropped[MOTION_CLASS_GESTURE], (unsigned long)stats.dropped[MOTION_CLASS_IDLE]);
 	return pdFALSE;
 }
 
-// Fighting
-BaseType_t CLI_Fighting(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Queue a motion file from the SD card
+BaseType_t CLI_SdPlay(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_FIGHTING;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Fighting Mode\r\n");
+	BaseType_t nameLen = 0;
+	BaseType_t speedLen = 0;
+	const char *name = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &nameLen);
+	const char *speedArg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &speedLen);
+	uint16_t speed = MOTION_SPEED_ONE;
+
+	if (speedArg != NULL && !MotionPlayer_ParseSpeed(speedArg, (size_t)speedLen, &speed)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid speed\r\n");
+	} else if (name == NULL || !MotionFile_Request(name, (size_t)nameLen)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid file name (max %d chars, a-z 0-9 _ -)\r\n", MOTION_FILE_NAME_LEN - 1);
+	} else if (MotionQueue_PostSpeed(STATE_SD_FILE, MOTION_CLASS_USER, speed) != pdPASS) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, file dropped\r\n");
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: SD %.*s\r\n", (int)nameLen, name);
+	}
 	return pdFALSE;
 }
 
-// Pushup
-BaseType_t CLI_Pushup(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Export a built-in motion as a motion file, e.g. as a template for new ones
+BaseType_t CLI_SdSave(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_PUSHUP;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Push-up\r\n");
+	BaseType_t motionLen = 0;
+	BaseType_t fileLen = 0;
+	const char *motion = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &motionLen);
+	const char *file = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &fileLen);
+	char fileName[MOTION_FILE_NAME_LEN];
+
+	const MotionEntry *entry = MotionRegistry_FindN(motion, (size_t)motionLen);
+	if (entry == NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown motion\r\n");
+		return pdFALSE;
+	}
+	if (fileLen <= 0 || fileLen >= (BaseType_t)sizeof(fileName)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid file name\r\n");
+		return pdFALSE;
+	}
+	memcpy(fileName, file, fileLen);
+	fileName[fileLen] = '\0';
+
+	int32_t result = MotionFile_Save(fileName, entry->steps, (uint16_t)entry->count);
+	if (result == 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Saved %s as %s/%s%s\r\n", entry->label, MOTION_FILE_DIR, fileName, MOTION_FILE_EXT);
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Save failed (err %ld)\r\n", (long)result);
+	}
 	return pdFALSE;
 }
 
-// Sleep
-BaseType_t CLI_Sleep(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Report SD motion loader cache and streaming counters
+BaseType_t CLI_SdStats(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_SLEEP;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Sleep Mode\r\n");
+	MotionFileStats stats;
+
+	MotionFile_GetStats(&stats);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "Cache hit %lu miss %lu, streamed %lu, refills %lu max %lu us, underruns %lu, RAM %lu B\r\n",
+	         (unsigned long)stats.cacheHits, (unsigned long)stats.cacheMisses, (unsigned long)stats.streamed,
+	         (unsigned long)stats.refills, (unsigned long)stats.refillUsMax, (unsigned long)stats.underruns,
+	         (unsigned long)stats.ramBytes);
 	return pdFALSE;
 }
 
-// Dance1
-BaseType_t CLI_Dance1(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Run the loaded motion program, optionally loading it from the SD card first
+BaseType_t CLI_VmRun(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_DANCE1;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Dance 1\r\n");
+	BaseType_t fileLen = 0;
+	const char *file = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &fileLen);
+
+	if (file != NULL) {
+		char fileName[MOTION_FILE_NAME_LEN];
+		uint16_t len = 0;
+		int32_t result = ERROR_INVALID_ARG;
+
+		if (fileLen < (BaseType_t)sizeof(fileName)) {
+			memcpy(fileName, file, fileLen);
+			fileName[fileLen] = '\0';
+			result = MotionFile_LoadProgram(fileName, vmScratch, sizeof(vmScratch), &len);
+		}
+		if (result == 0) {
+			result = MotionVm_Load(vmScratch, len);
+		}
+		if (result != 0) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Program load failed (err %ld)\r\n", (long)result);
+			return pdFALSE;
+		}
+	}
+
+	if (MotionQueue_Post(STATE_VM_PROGRAM, MOTION_CLASS_USER) != pdPASS) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, program dropped\r\n");
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: program\r\n");
+	}
 	return pdFALSE;
 }
 
-// Dance2
-BaseType_t CLI_Dance2(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// Assemble the rest of the line as a motion program and run it
+BaseType_t CLI_VmAssemble(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_DANCE2;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Dance 2\r\n");
+	const char *source = (const char *)pcCommandString;
+	uint16_t errorLine = 0;
+
+	source += strcspn(source, " ");
+	source += strspn(source, " ");
+
+	int32_t result = MotionVm_LoadText(source, strlen(source), &errorLine);
+	if (result != 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Assembly failed in statement %u (err %ld)\r\n", errorLine, (long)result);
+	} else if (MotionQueue_Post(STATE_VM_PROGRAM, MOTION_CLASS_USER) != pdPASS) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, program dropped\r\n");
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: program\r\n");
+	}
 	return pdFALSE;
 }
 
-// Dance3
-BaseType_t CLI_Dance3(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+// List the loaded motion program, one instruction per call
+BaseType_t CLI_VmDisassemble(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
 {
-	current_state = STATE_DANCE3;
-	snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: Dance 3\r\n");
+	static uint16_t len = 0;
+	static uint16_t pc = 0;
+	static bool listing = false;
+
+	if (!listing) {
+		len = MotionVm_GetProgram(vmScratch, sizeof(vmScratch));
+		pc = 0;
+		listing = true;
+	}
+
+	uint16_t size = MotionVm_Disassemble(vmScratch, len, pc, (char *)pcWriteBuffer, xWriteBufferLen - 2);
+	if (size == 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%u bytes\r\n", len);
+		listing = false;
+		return pdFALSE;
+	}
+	strcat((char *)pcWriteBuffer, "\r\n");
+	pc += size;
+	return pdTRUE;
+}
+
+// Compile a built-in motion table into a program file on the SD card
+BaseType_t CLI_VmExport(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t motionLen = 0;
+	BaseType_t fileLen = 0;
+	const char *motion = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &motionLen);
+	const char *file = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &fileLen);
+	char fileName[MOTION_FILE_NAME_LEN];
+
+	const MotionEntry *entry = MotionRegistry_FindN(motion, (size_t)motionLen);
+	if (entry == NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Unknown motion\r\n");
+		return pdFALSE;
+	}
+	if (fileLen <= 0 || fileLen >= (BaseType_t)sizeof(fileName)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid file name\r\n");
+		return pdFALSE;
+	}
+	memcpy(fileName, file, fileLen);
+	fileName[fileLen] = '\0';
+
+	uint16_t len = MotionVm_CompileTable(entry->steps, (uint16_t)entry->count, vmScratch, sizeof(vmScratch));
+	int32_t result = (len == 0) ? ERROR_NO_MEMORY : MotionFile_SaveProgram(fileName, vmScratch, len);
+	if (result == 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%s: %u steps -> %u bytes in %s/%s%s\r\n",
+		         entry->label, (unsigned)entry->count, len, MOTION_FILE_DIR, fileName, MOTION_PROGRAM_EXT);
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Export failed (err %ld)\r\n", (long)result);
+	}
+	return pdFALSE;
+}
+
+// Benchmark the motion interpreter per opcode and report runtime faults
+BaseType_t CLI_VmBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static const uint8_t ops[] = { MOTION_OP_FRAME, MOTION_OP_MOVE, MOTION_OP_WAIT, MOTION_OP_LOOP, MOTION_OP_NEXT,
+	                               MOTION_OP_IF, MOTION_OP_CALL, MOTION_OP_RET, MOTION_OP_JUMP, MOTION_OP_PLAY };
+	static const char *const names[] = { "frm", "mov", "wait", "loop", "next", "if", "call", "ret", "jmp", "play" };
+	uint32_t cycles[MOTION_OP_COUNT];
+	MotionVmStats stats;
+	size_t w = 0;
+
+	MotionVm_Benchmark(1000, cycles);
+	MotionVm_GetStats(&stats);
+	for (size_t i = 0; i < sizeof(ops) && w < xWriteBufferLen; ++i) {
+		w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "%s%s %lu.%02lu", i ? " " : "", names[i],
+		                      (unsigned long)(cycles[ops[i]] / MOTION_VM_BENCH_SCALE),
+		                      (unsigned long)(cycles[ops[i]] % MOTION_VM_BENCH_SCALE));
+	}
+	if (w < xWriteBufferLen) {
+		snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "; faults %lu\r\n", (unsigned long)stats.faults);
+	}
 	return pdFALSE;
 }
 
+// Report servo frame lateness against the scheduler's deadlines
+BaseType_t CLI_Timing(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	MotionTimingSummary t;
+
+	if (param != NULL && paramLen == 5 && strncmp(param, "reset", 5) == 0) {
+		MotionTiming_Reset();
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Timing statistics cleared\r\n");
+		return pdFALSE;
+	}
+
+	MotionTiming_GetSummary(&t);
+	if (param != NULL && paramLen == 4 && strncmp(param, "hist", 4) == 0) {
+		// Bucket b counts frames late by [2^(b-1), 2^b) us
+		size_t w = (size_t)snprintf((char *)pcWriteBuffer, xWriteBufferLen, "us<");
+		for (int b = 0; b < MOTION_TIMING_BUCKETS && w < xWriteBufferLen; ++b) {
+			w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, " %lu", (unsigned long)t.bucket[b]);
+		}
+		if (w < xWriteBufferLen) {
+			snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "\r\n");
+		}
+		return pdFALSE;
+	}
+
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%lu frames late us min %lu mean %lu p99 %lu max %lu; %lu seqs, %lu over budget (max %lu us)\r\n",
+	         (unsigned long)t.samples, (unsigned long)t.minUs, (unsigned long)t.meanUs, (unsigned long)t.p99Us,
+	         (unsigned long)t.maxUs, (unsigned long)t.sequences, (unsigned long)t.overruns,
+	         (unsigned long)t.overrunUsMax);
+	return pdFALSE;
+}
+
+// Report how much servo bus traffic the delta frame writes save
+BaseType_t CLI_ServoBus(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	PCA9685BusStats bus;
+	MotionPlayerStats player;
+
+	pca9685_get_bus_stats(&bus);
+	MotionPlayer_GetStats(&player);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%lu frames, %lu bursts, %lu/%lu bytes sent; last seq %lu/%lu bytes\r\n",
+	         (unsigned long)bus.frames, (unsigned long)bus.bursts, (unsigned long)bus.bytesSent,
+	         (unsigned long)bus.bytesFull, (unsigned long)player.busBytesLast,
+	         (unsigned long)player.busBytesFullLast);
+	return pdFALSE;
+}
+
+// Parse a whole CLI parameter as a decimal number within [min, max]; false for anything else
+static bool CLI_ParseLong(const char *arg, long min, long max, long *value)
+{
+	char *end;
+	long parsed = strtol(arg, &end, 10);
+
+	if (end == arg || (*end != '\0' && *end != ' ') || parsed < min || parsed > max) {
+		return false;
+	}
+	*value = parsed;
+	return true;
+}
+
+// Show, trim or persist the per-channel servo calibration
+BaseType_t CLI_ServoCal(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	ServoCalChannel cal;
+
+	if (param != NULL && paramLen == 4 && strncmp(param, "save", 4) == 0) {
+		int32_t result = ServoCal_Save();
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, (result == ERROR_NONE) ? "Calibration saved\r\n"
+		         : (result == ERROR_BUSY) ? "Calibration not saved, motion playing\r\n" : "Calibration save failed\r\n");
+		return pdFALSE;
+	}
+	if (param != NULL && paramLen == 5 && strncmp(param, "reset", 5) == 0) {
+		ServoCal_Reset();
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Calibration reset to nominal (not saved)\r\n");
+		return pdFALSE;
+	}
+	if (param != NULL) {
+		// Channel, offset, min, max and invert, each checked before it is narrowed
+		static const long low[5] = { 0, -SERVO_CAL_OFFSET_MAX, 0, 0, 0 };
+		static const long high[5] = { PCA9685_SERVO_CHANNELS - 1, SERVO_CAL_OFFSET_MAX, SERVO_CAL_PULSE_LIMIT,
+		                              SERVO_CAL_PULSE_LIMIT, 1 };
+		long value[5] = { 0 };
+		bool valid = true;
+		for (int i = 0; i < 5; ++i) {
+			const char *arg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, i + 1, &paramLen);
+			if (arg == NULL) {
+				snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: servocal <ch> <offset> <min> <max> <inv>\r\n");
+				return pdFALSE;
+			}
+			valid = valid && CLI_ParseLong(arg, low[i], high[i], &value[i]);
+		}
+		if (valid) {
+			cal.offset = (int16_t)value[1];
+			cal.minPulse = (uint16_t)value[2];
+			cal.maxPulse = (uint16_t)value[3];
+			cal.invert = (uint8_t)value[4];
+			cal.reserved = 0;
+		}
+		if (!valid || ServoCal_Set((uint8_t)value[0], &cal) != ERROR_NONE) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid calibration (ch 0-%d, min < max <= %d, |offset| <= %d)\r\n",
+			         PCA9685_SERVO_CHANNELS - 1, SERVO_CAL_PULSE_LIMIT, SERVO_CAL_OFFSET_MAX);
+			return pdFALSE;
+		}
+	}
+
+	size_t w = 0;
+	for (uint8_t ch = 0; ch < PCA9685_SERVO_CHANNELS && w < xWriteBufferLen; ++ch) {
+		ServoCal_Get(ch, &cal);
+		w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "%u:%+d %u-%u%s ", ch, cal.offset,
+		                      cal.minPulse, cal.maxPulse, cal.invert ? "i" : "");
+	}
+	if (w < xWriteBufferLen) {
+		snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "\r\n");
+	}
+	return pdFALSE;
+}
+
+// Walk with the procedural gait generator
+BaseType_t CLI_Gait(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	MotionGaitParams params;
+	long value[5];
+	bool valid = true;
+
+	MotionGait_GetDefaults(&params);
+	if (param != NULL && paramLen == 5 && strncmp(param, "creep", 5) == 0) {
+		params.type = MOTION_GAIT_CREEP;
+	} else if (param == NULL || paramLen != 4 || strncmp(param, "trot", 4) != 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: gait <creep|trot> [speed stride turn height cycles]\r\n");
+		return pdFALSE;
+	}
+
+	value[0] = params.speed;
+	value[1] = params.stride;
+	value[2] = params.turnRadius;
+	value[3] = params.height;
+	value[4] = params.cycles;
+	for (int i = 0; i < 5; ++i) {
+		const char *arg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, i + 2, &paramLen);
+		if (arg == NULL) {
+			break;
+		}
+		if (!CLI_ParseLong(arg, (i == 2) ? INT16_MIN : 0, (i == 2) ? INT16_MAX : UINT16_MAX, &value[i])) {
+			valid = false;
+		}
+	}
+	if (!valid) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid gait parameters\r\n");
+		return pdFALSE;
+	}
+	params.speed = (uint16_t)value[0];
+	params.stride = (uint16_t)value[1];
+	params.turnRadius = (int16_t)value[2];
+	params.height = (uint16_t)value[3];
+	params.cycles = (uint16_t)value[4];
+
+	if (MotionGait_Set(&params) != ERROR_NONE) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid gait parameters (speed 1-%d, stride <= %d, height 1-%d)\r\n",
+		         MOTION_GAIT_SPEED_MAX, MOTION_GAIT_STRIDE_MAX, MOTION_GAIT_TIBIA / 10);
+	} else if (MotionQueue_Post(STATE_GAIT, MOTION_CLASS_USER) != pdPASS) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, gait dropped\r\n");
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: %s gait\r\n", (params.type == MOTION_GAIT_CREEP) ? "creep" : "trot");
+	}
+	return pdFALSE;
+}
+
+// Benchmark gait frame generation, including inverse kinematics for all legs
+BaseType_t CLI_GaitBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	MotionGaitStats stats;
+	uint32_t creep = MotionGait_Benchmark(MOTION_GAIT_CREEP, 1000);
+	uint32_t trot = MotionGait_Benchmark(MOTION_GAIT_TROT, 1000);
+
+	MotionGait_GetStats(&stats);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "Cycles/frame creep %lu (%lu us) trot %lu (%lu us) of a %d ms frame; live max %lu, last period %lu ms\r\n",
+	         (unsigned long)creep, (unsigned long)CycleCounterToUs(creep), (unsigned long)trot,
+	         (unsigned long)CycleCounterToUs(trot), MOTION_FRAME_MS, (unsigned long)stats.cyclesMax,
+	         (unsigned long)stats.periodMs);
+	return pdFALSE;
+}
+
+// Report how the live servo stream is arriving and being played
+BaseType_t CLI_Stream(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	MotionStreamStats s;
+
+	if (param != NULL && paramLen == 5 && strncmp(param, "reset", 5) == 0) {
+		MotionStream_ResetStats();
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Stream statistics cleared\r\n");
+		return pdFALSE;
+	}
+
+	MotionStream_GetStats(&s);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%s: rx %lu play %lu extra %lu hold %lu late %lu skip %lu wdog %lu; lat %lu/%lu ms buf %lu ms jit %lu us\r\n",
+	         MotionStream_Active() ? "active" : "idle", (unsigned long)s.received, (unsigned long)s.played,
+	         (unsigned long)s.extrapolated, (unsigned long)s.held, (unsigned long)s.late, (unsigned long)s.skipped,
+	         (unsigned long)s.timeouts, (unsigned long)s.latencyMeanMs, (unsigned long)s.latencyMaxMs,
+	         (unsigned long)s.bufferMeanMs, (unsigned long)s.jitterUs);
+	return pdFALSE;
+}
+
+// Move a single servo, e.g. to pose the robot while recording
+BaseType_t CLI_Jog(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *chArg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	const char *angleArg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &paramLen);
+	const char *msArg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 3, &paramLen);
+
+	if (chArg == NULL || angleArg == NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: jog <ch> <angle> [ms]\r\n");
+		return pdFALSE;
+	}
+	long ch = 0;
+	long angle = 0;
+	long ms = MOTION_JOG_MS_DEFAULT;
+	if (!CLI_ParseLong(chArg, 0, PCA9685_SERVO_CHANNELS - 1, &ch) || !CLI_ParseLong(angleArg, 0, 180, &angle)
+	    || (msArg != NULL && !CLI_ParseLong(msArg, 0, UINT16_MAX, &ms))) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid jog (ch 0-%d, angle 0-180, ms 0-%u)\r\n",
+		         PCA9685_SERVO_CHANNELS - 1, UINT16_MAX);
+		return pdFALSE;
+	}
+
+	if (MotionRecord_Jog((uint8_t)ch, pca9685_angle_to_pulse((int)angle), (uint16_t)ms) != ERROR_NONE) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, jog dropped\r\n");
+	} else {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Move: servo %ld to %ld deg\r\n", ch, angle);
+	}
+	return pdFALSE;
+}
+
+// Record commanded frames and save them as a motion file
+BaseType_t CLI_Record(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	BaseType_t argLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	const char *arg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &argLen);
+	char fileName[MOTION_FILE_NAME_LEN];
+	MotionRecordStats s;
+
+	if (param != NULL && paramLen == 5 && strncmp(param, "start", 5) == 0) {
+		long tol = (arg != NULL) ? strtol(arg, NULL, 10) : 0;
+		if (tol < 0 || tol > MOTION_RECORD_TOLERANCE_MAX || MotionRecord_Start((uint16_t)tol) != ERROR_NONE) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid tolerance (0-%d pulse counts)\r\n", MOTION_RECORD_TOLERANCE_MAX);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Recording; pose with jog or the stream, then record stop\r\n");
+		}
+		return pdFALSE;
+	}
+	if (param != NULL && paramLen == 4 && strncmp(param, "stop", 4) == 0) {
+		if (MotionRecord_Stop() != ERROR_NONE) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Nothing recorded\r\n");
+			return pdFALSE;
+		}
+		MotionQueue_Post(STATE_IDLE, MOTION_CLASS_IDLE);
+	} else if (param != NULL && paramLen == 4 && strncmp(param, "save", 4) == 0) {
+		if (arg == NULL || argLen >= (BaseType_t)sizeof(fileName)) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid file name\r\n");
+			return pdFALSE;
+		}
+		memcpy(fileName, arg, argLen);
+		fileName[argLen] = '\0';
+		int32_t result = MotionRecord_Save(fileName);
+		if (result == ERROR_NONE) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Saved %s/%s%s, play with sdplay %s\r\n", MOTION_FILE_DIR, fileName,
+			         MOTION_FILE_EXT, fileName);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Save failed (err %ld)\r\n", (long)result);
+		}
+		return pdFALSE;
+	} else if (param != NULL) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: record [start [tol]|stop|save <file>]\r\n");
+		return pdFALSE;
+	}
+
+	MotionRecord_GetStats(&s);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%s%s: %lu frames %lu ms -> %u keys (%lu B), tol %u err %lu; bus %lu -> %lu B\r\n",
+	         s.recording ? "recording" : "stopped", s.truncated ? " (full)" : "", (unsigned long)s.samples,
+	         (unsigned long)s.durationMs, s.keyframes, (unsigned long)s.fileBytes, s.tolerance,
+	         (unsigned long)s.errorMax, (unsigned long)s.busBytesRecorded, (unsigned long)s.busBytesPlayback);
+	return pdFALSE;
+}
+
+// Re-time every built-in motion at a speed and check each frame slot against a full bus write
+BaseType_t CLI_SpeedCheck(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	uint16_t speed = MOTION_SPEED_MAX;
+	MotionSpeedCheck check;
+
+	if (param != NULL && !MotionPlayer_ParseSpeed(param, (size_t)paramLen, &speed)) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Invalid speed\r\n");
+		return pdFALSE;
+	}
+
+	memset(&check, 0, sizeof(check));
+	check.stepMsMin = UINT32_MAX;
+	check.slotUsMin = UINT32_MAX;
+	for (int s = 0; s < STATE_COUNT; ++s) {
+		const MotionEntry *entry = MotionRegistry_Get((RobotState)s);
+		if (entry != NULL) {
+			MotionPlayer_CheckSpeed(entry->steps, entry->count, speed, &check);
+		}
+	}
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "x%u.%02u: %lu steps, shortest %lu ms, slot min %lu us vs write %lu us: %s (%lu short); %lu steps slower than at a lower speed\r\n",
+	         speed / MOTION_SPEED_ONE, (speed % MOTION_SPEED_ONE) * 100 / MOTION_SPEED_ONE, (unsigned long)check.steps,
+	         (unsigned long)check.stepMsMin, (unsigned long)check.slotUsMin, (unsigned long)check.writeUs,
+	         (check.overruns == 0) ? "fits" : "OVERRUN", (unsigned long)check.overruns, (unsigned long)check.slower);
+	return pdFALSE;
+}
+
+// Set servo speed limits and the cap on fast-moving servos; report the last sequence's peaks
+BaseType_t CLI_Slew(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	BaseType_t argLen = 0;
+	BaseType_t arg2Len = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	const char *arg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &argLen);
+	const char *arg2 = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 3, &arg2Len);
+	MotionPlayerStats player;
+	uint8_t cap;
+	uint16_t highDps;
+
+	if (param != NULL && paramLen == 3 && strncmp(param, "cap", 3) == 0) {
+		long servos = 0;
+		long dps = 0;
+		if (arg == NULL || arg2 == NULL || !CLI_ParseLong(arg, 1, PCA9685_SERVO_CHANNELS, &servos)
+		    || !CLI_ParseLong(arg2, 0, UINT16_MAX, &dps)) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: slew cap <1-%d> <deg/s, 0 = off>\r\n", PCA9685_SERVO_CHANNELS);
+			return pdFALSE;
+		}
+		MotionPlayer_SetSlewCap((uint8_t)servos, (uint16_t)dps);
+	} else if (param != NULL) {
+		bool all = paramLen == 3 && strncmp(param, "all", 3) == 0;
+		long ch = 0;
+		long dps = 0;
+		int32_t result = ERROR_INVALID_ARG;
+		if ((all || CLI_ParseLong(param, 0, PCA9685_SERVO_CHANNELS - 1, &ch)) && arg != NULL
+		    && CLI_ParseLong(arg, 0, UINT16_MAX, &dps)) {
+			for (long c = ch; c < (all ? PCA9685_SERVO_CHANNELS : ch + 1); ++c) {
+				result = MotionPlayer_SetSlewLimit((uint8_t)c, (uint16_t)dps);
+			}
+		}
+		if (result != ERROR_NONE) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: slew <0-%d|all> <deg/s, 0 = off>\r\n", PCA9685_SERVO_CHANNELS - 1);
+			return pdFALSE;
+		}
+	}
+
+	MotionPlayer_GetStats(&player);
+	MotionPlayer_GetSlewCap(&cap, &highDps);
+	size_t w = (size_t)snprintf((char *)pcWriteBuffer, xWriteBufferLen, "deg/s");
+	for (uint8_t ch = 0; ch < PCA9685_SERVO_CHANNELS && w < xWriteBufferLen; ++ch) {
+		w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, " %u", MotionPlayer_GetSlewLimit(ch));
+	}
+	if (w < xWriteBufferLen) {
+		snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w,
+		         "; cap %u over %u; last: peak %lu fast, %lu counts/frame, %lu deferred, +%lu frames\r\n",
+		         cap, highDps, (unsigned long)player.slewHighPeakLast, (unsigned long)player.slewSumPeakLast,
+		         (unsigned long)player.slewDeferredLast, (unsigned long)player.slewFramesLast);
+	}
+	return pdFALSE;
+}
+
+// Select aligned or staggered servo pulses and compare the modeled overlap of both over every built-in keyframe
+BaseType_t CLI_ServoPhase(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	uint32_t peak[2] = { 0, 0 };
+	uint32_t overlapSum[2] = { 0, 0 };
+	uint32_t excessMax[2] = { 0, 0 };
+	uint32_t frames = 0;
+	uint16_t counts[PCA9685_SERVO_CHANNELS];
+	PCA9685PhaseModel model;
+
+	if (param != NULL) {
+		if (paramLen == 7 && strncmp(param, "aligned", 7) == 0) {
+			pca9685_set_phase_mode(PCA9685_PHASE_ALIGNED);
+		} else if (paramLen == 7 && strncmp(param, "stagger", 7) == 0) {
+			pca9685_set_phase_mode(PCA9685_PHASE_STAGGER);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: servophase [aligned|stagger]\r\n");
+			return pdFALSE;
+		}
+	}
+
+	for (int s = 0; s < STATE_COUNT; ++s) {
+		const MotionEntry *entry = MotionRegistry_Get((RobotState)s);
+		for (uint16_t i = 0; entry != NULL && i < entry->count; ++i) {
+			ServoCal_Map(entry->steps[i].pulse, counts);
+			for (int m = 0; m < 2; ++m) {
+				pca9685_phase_model(counts, (m == 0) ? PCA9685_PHASE_ALIGNED : PCA9685_PHASE_STAGGER, &model);
+				peak[m] = (model.peak > peak[m]) ? model.peak : peak[m];
+				overlapSum[m] += model.overlapUs;
+				excessMax[m] = (model.excessUs > excessMax[m]) ? model.excessUs : excessMax[m];
+			}
+			frames++;
+		}
+	}
+	if (frames == 0) {
+		frames = 1;
+	}
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%s, step %u counts. %lu keyframes aligned -> staggered: peak %lu -> %lu servos, "
+	         "overlap %lu -> %lu us/period, worst excess %lu -> %lu servo-us\r\n",
+	         (pca9685_get_phase_mode() == PCA9685_PHASE_STAGGER) ? "stagger" : "aligned", PCA9685_PHASE_STEP,
+	         (unsigned long)frames, (unsigned long)peak[0], (unsigned long)peak[1],
+	         (unsigned long)(overlapSum[0] / frames), (unsigned long)(overlapSum[1] / frames),
+	         (unsigned long)excessMax[0], (unsigned long)excessMax[1]);
+	return pdFALSE;
+}
+
+// Turn the planned sequence entry transition on or off and report the last one
+BaseType_t CLI_Transition(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	MotionPlayerStats player;
+
+	if (param != NULL) {
+		if (paramLen == 2 && strncmp(param, "on", 2) == 0) {
+			MotionPlayer_SetTransition(true);
+		} else if (paramLen == 3 && strncmp(param, "off", 3) == 0) {
+			MotionPlayer_SetTransition(false);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: transition [on|off]\r\n");
+			return pdFALSE;
+		}
+	}
+
+	MotionPlayer_GetStats(&player);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "Transition %s: %lu planned, last %lu ms moving %lu joints, %ld ms saved in total\r\n",
+	         MotionPlayer_GetTransition() ? "on" : "off", (unsigned long)player.transitions,
+	         (unsigned long)player.transitionMsLast, (unsigned long)player.transitionJointsLast,
+	         (long)player.transitionSavedMs);
+	return pdFALSE;
+}
+
+// Report the PCA9685 brownout counters
+BaseType_t CLI_ServoHealth(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	PCA9685HealthStats h;
+
+	pca9685_get_health_stats(&h);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "MODE1 0x%02X; %lu checks, %lu read errors, %lu resets (%lu not restored), recovery last %lu us max %lu us\r\n",
+	         h.mode1Last, (unsigned long)h.checks, (unsigned long)h.readErrors, (unsigned long)h.resets,
+	         (unsigned long)h.restoreFailures, (unsigned long)h.recoverUsLast, (unsigned long)h.recoverUsMax);
+	return pdFALSE;
+}
+
+// Arm a trace of the next motion, or print the last trace one CSV row per call
+BaseType_t CLI_SimTrace(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static int32_t row = -1;    // -1: header next
+	BaseType_t nameLen = 0;
+	BaseType_t argLen = 0;
+	BaseType_t arg2Len = 0;
+	const char *name = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &nameLen);
+	const char *arg = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 2, &argLen);
+	const char *arg2 = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 3, &arg2Len);
+	MotionTraceSummary sum;
+	MotionTraceStep step;
+
+	if (name != NULL) {
+		const MotionEntry *entry = MotionRegistry_FindN(name, (size_t)nameLen);
+		uint16_t speed = MOTION_SPEED_ONE;
+		bool dry = false;
+		if (arg != NULL && argLen == 3 && strncmp(arg, "dry", 3) == 0) {
+			dry = true;
+		} else if (arg != NULL && !MotionPlayer_ParseSpeed(arg, (size_t)argLen, &speed)) {
+			entry = NULL;
+		}
+		if (arg2 != NULL) {
+			dry = arg2Len == 3 && strncmp(arg2, "dry", 3) == 0;
+			if (!dry) {
+				entry = NULL;
+			}
+		}
+		if (entry == NULL) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: simtrace <motion> [speed] [dry]\r\n");
+			return pdFALSE;
+		}
+		MotionTrace_Arm(dry);
+		if (MotionQueue_PostSpeed(entry->state, MOTION_CLASS_USER, speed) != pdPASS) {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Motion queue full, %s dropped\r\n", entry->label);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Tracing %s%s\r\n", entry->label, dry ? " (dry run)" : "");
+		}
+		return pdFALSE;
+	}
+
+	MotionTrace_GetSummary(&sum);
+	if (row < 0) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "step,planned_ms,actual_ms,error_ms,frames,transactions,bytes,a0,a1,a2,a3,a4,a5,a6,a7\r\n");
+		row = 0;
+		return pdTRUE;
+	}
+	if (MotionTrace_GetStep((uint16_t)row, &step)) {
+		long errorMs = ((long)step.actualUs - (long)step.plannedMs * 1000L) / 1000L;
+		size_t w = (size_t)snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%ld,%u,%lu,%ld,%u,%u,%u", (long)row,
+		                            step.plannedMs, (unsigned long)(step.actualUs / 1000UL), errorMs, step.frames,
+		                            step.transactions, step.bytes);
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS && w < xWriteBufferLen; ++ch) {
+			w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, ",%d", pca9685_pulse_to_angle(step.pulse[ch]));
+		}
+		if (w < xWriteBufferLen) {
+			snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "\r\n");
+		}
+		row++;
+		return pdTRUE;
+	}
+	row = -1;
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "# %u steps%s%s: planned %lu ms, actual %lu ms, %lu transactions, %lu bytes\r\n",
+	         sum.steps, sum.dryRun ? " dry" : "", sum.active ? " (running)" : (sum.armed ? " (armed)" : ""),
+	         (unsigned long)sum.plannedMs, (unsigned long)(sum.actualUs / 1000UL),
+	         (unsigned long)sum.transactions, (unsigned long)sum.bytes);
+	return pdFALSE;
+}
+
+// Report the I2C transaction queue counters, one bus per call
+BaseType_t CLI_I2cQueue(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static int bus = 0;
+	I2C_Queue_Stats q;
+
+	I2cGetQueueStats((eI2cBuses)bus, &q);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%s: %lu submitted, %lu done (%lu failed, %lu cancelled), %lu chained from the ISR, %lu repeated STARTs, depth max %u\r\n",
+	         I2cGetBusName((eI2cBuses)bus), (unsigned long)q.submitted, (unsigned long)q.completed, (unsigned long)q.failed,
+	         (unsigned long)q.cancelled, (unsigned long)q.chained, (unsigned long)q.repeatedStarts, q.depthMax);
+	if (++bus < I2C_BUS_COUNT) {
+		return pdTRUE;
+	}
+	bus = 0;
+	return pdFALSE;
+}
+
+// Print the DMA path counters against the interrupt path, one bus per call
+BaseType_t CLI_I2cDma(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static int bus = 0;
+	I2C_Dma_Stats d;
+
+	I2cGetDmaStats((eI2cBuses)bus, &d);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%s DMA: %lu transfers, %lu bytes, %lu failed; last %u bytes in %lu cycles vs %lu by IRQ, saved %ld us (total %ld us); "
+	         "IRQ: %lu transfers, %lu cycles/interrupt\r\n",
+	         I2cGetBusName((eI2cBuses)bus), (unsigned long)d.dmaTransfers, (unsigned long)d.dmaBytes, (unsigned long)d.dmaFailed, d.bytesLast,
+	         (unsigned long)d.dmaCyclesLast, (unsigned long)d.irqCyclesLast, (long)d.savedUsLast, (long)d.savedUsTotal,
+	         (unsigned long)d.irqTransfers,
+	         (unsigned long)((d.irqInterrupts != 0) ? d.irqCycles / d.irqInterrupts : 0));
+	if (++bus < I2C_BUS_COUNT) {
+		return pdTRUE;
+	}
+	bus = 0;
+	return pdFALSE;
+}
+
+// Switch the repeated START on or off and compare the register read latency of both, one bus per call
+BaseType_t CLI_I2cRepeatedStart(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static int bus = 0;
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	I2C_Read_Stats r;
+
+	if (param != NULL && bus == 0) {
+		if (paramLen == 2 && strncmp(param, "on", 2) == 0) {
+			I2cSetRepeatedStart(true);
+		} else if (paramLen == 3 && strncmp(param, "off", 3) == 0) {
+			I2cSetRepeatedStart(false);
+		} else {
+			snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: i2crs [on|off]\r\n");
+			return pdFALSE;
+		}
+	}
+
+	I2cGetReadStats((eI2cBuses)bus, &r);
+	snprintf((char *)pcWriteBuffer, xWriteBufferLen,
+	         "%s: repeated START %s; register reads: %lu with it, last %lu us avg %lu us; %lu with STOP, last %lu us avg %lu us\r\n",
+	         I2cGetBusName((eI2cBuses)bus), I2cGetRepeatedStart() ? "on" : "off",
+	         (unsigned long)r.rsReads, (unsigned long)r.rsUsLast,
+	         (unsigned long)((r.rsReads != 0) ? r.rsUsTotal / r.rsReads : 0),
+	         (unsigned long)r.stopReads, (unsigned long)r.stopUsLast,
+	         (unsigned long)((r.stopReads != 0) ? r.stopUsTotal / r.stopReads : 0));
+	if (++bus < I2C_BUS_COUNT) {
+		return pdTRUE;
+	}
+	bus = 0;
+	return pdFALSE;
+}
+
+// List the clock of each bus, then its device speed profiles, one line per call
+BaseType_t CLI_I2cSpeed(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static int bus = 0;
+	static int index = -1;
+	I2C_Speed_Stats s;
+	I2C_Speed_Profile p;
+
+	if (index < 0) {
+		I2cGetSpeedStats((eI2cBuses)bus, &s);
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%s: %u kHz now, %u kHz without a profile, %lu BAUD switches (%lu failed), %lu fallbacks\r\n",
+		         I2cGetBusName((eI2cBuses)bus), s.khz, s.khzBase, (unsigned long)s.switches, (unsigned long)s.failed, (unsigned long)s.fallbacks);
+		index = 0;
+		return pdTRUE;
+	}
+	if (I2cGetDeviceSpeed((eI2cBuses)bus, (uint8_t)index, &p) == ERROR_NONE) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "  0x%02X: %u kHz (rated %u), %u NACKs in a row, %lu fallbacks%s\r\n",
+		         p.address, p.khz, p.khzWanted, p.nacks, (unsigned long)p.fallbacks, p.pinned ? ", pinned" : "");
+		index++;
+		return pdTRUE;
+	}
+	pcWriteBuffer[0] = '\0';
+	index = -1;
+	if (++bus < I2C_BUS_COUNT) {
+		return CLI_I2cSpeed(pcWriteBuffer, xWriteBufferLen, pcCommandString);  // Header of the next bus
+	}
+	bus = 0;
+	return pdFALSE;
+}
+
+// Time full servo frame writes and full gesture FIFO reads at each bus clock, one clock per call
+BaseType_t CLI_I2cBench(int8_t *pcWriteBuffer, size_t xWriteBufferLen, const int8_t *pcCommandString)
+{
+	static const uint16_t khz[] = {I2C_STANDARD_KHZ, I2C_FAST_KHZ, I2C_FM_PLUS_KHZ};
+	static int step = 0;
+	BaseType_t paramLen = 0;
+	const char *param = FreeRTOS_CLIGetParameter((const char *)pcCommandString, 1, &paramLen);
+	long count = (param != NULL) ? strtol(param, NULL, 10) : 20;
+	I2C_Bench_Result frame;
+	I2C_Bench_Result fifo;
+	int32_t frameError;
+	int32_t fifoError;
+	size_t w;
+
+	if (count < 1 || count > 1000) {
+		snprintf((char *)pcWriteBuffer, xWriteBufferLen, "Usage: i2cbench [count 1-1000]\r\n");
+		return pdFALSE;
+	}
+
+	frameError = pca9685_bench_frame(khz[step], (uint16_t)count, &frame);
+	fifoError = APDS9960_BenchFifoRead(khz[step], (uint16_t)count, &fifo);
+	w = (size_t)snprintf((char *)pcWriteBuffer, xWriteBufferLen, "%4u kHz: ", khz[step]);
+	if (frameError == ERROR_NONE && w < xWriteBufferLen) {
+		w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "frame %u B avg %lu us (%lu-%lu), %u failed; ",
+		                      frame.bytes, (unsigned long)frame.usAvg, (unsigned long)frame.usMin, (unsigned long)frame.usMax, frame.errors);
+	} else if (frameError == ERROR_BUSY && w < xWriteBufferLen) {
+		w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "frame skipped, motion playing; ");
+	} else if (w < xWriteBufferLen) {
+		w += (size_t)snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "frame error %ld; ", (long)frameError);
+	}
+	if (fifoError == ERROR_NONE && w < xWriteBufferLen) {
+		snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "FIFO %u B avg %lu us (%lu-%lu), %u failed\r\n",
+		         fifo.bytes, (unsigned long)fifo.usAvg, (unsigned long)fifo.usMin, (unsigned long)fifo.usMax, fifo.errors);
+	} else if (w < xWriteBufferLen) {
+		snprintf((char *)pcWriteBuffer + w, xWriteBufferLen - w, "FIFO error %ld\r\n", (long)fifoError);
+	}
+	if (++step < (int)(sizeof(khz) / sizeof(khz[0]))) {
+		return pdTRUE;
+	}
+	step = 0;
+	return pdFALSE;
+}
@@ -12,200 +12,309 @@
 
 #include "ControlTask.h"
 #include "PCA9685.h"
+#include "MotionPlayer.h"
+#include "MotionQueue.h"
+#include "MotionRegistry.h"
+#include "MotionFile.h"
+#include "MotionVm.h"
+#include "MotionGait.h"
+#include "MotionStream.h"
+#include "MotionRecord.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include "SerialConsole.h"
 #include "AT42QT1010.h"
 #include "WifiHandlerThread/WifiHandler.h" 
 #include "EnvTask/EnvSensorTask.h" 
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
 
 // Standby
-const int Standby[][9] = {
-	{140, 90, 90, 40,  40, 90, 90, 140, 100}
+static const MotionStep Standby[] = {
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 100)
 };
 // Forward 
-const int Forward[][9] = {
-	{140,90,90,40,40,90,90,140,50},
-	{90,45,90,40,40,90,90,90,50},
-	{140,45,90,40,40,90,90,140,50},
-	{140,45,90,90,90,90,90,140,50},
-	{140,90,90,90,90,135,45,140,50},
-	{140,90,90,40,40,135,45,140,50},
-	{90,90,90,40,40,135,90,90,50},
-	{90,90,135,40,40,90,90,90,50},
-	{140,90,135,40,40,90,90,140,50},
-	{140,90,135,90,40,90,90,140,50},
-	{140,90,90,40,40,90,90,140,150}
+static const MotionStep Forward[] = {
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(90, 45, 90, 40, 40, 90, 90, 90, 50),
+	MOTION_STEP(140, 45, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(140, 45, 90, 90, 90, 90, 90, 140, 50),
+	MOTION_STEP(140, 90, 90, 90, 90, 135, 45, 140, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 135, 45, 140, 50),
+	MOTION_STEP(90, 90, 90, 40, 40, 135, 90, 90, 50),
+	MOTION_STEP(90, 90, 135, 40, 40, 90, 90, 90, 50),
+	MOTION_STEP(140, 90, 135, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(140, 90, 135, 90, 40, 90, 90, 140, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 150)
 };
 // Backward 
-const int Backward[][9] = {
-  {140, 90, 90, 40,  40, 90, 90, 140, 50},
-  { 90, 90, 90, 40, 40, 90, 45, 90, 50 },
-  { 140, 90, 90, 40, 40, 90, 45, 140, 50},
-  { 140, 90, 90, 90, 90, 90, 45, 140, 50 },
-  { 140, 45, 135, 90, 90, 90, 90, 140, 50 },
-  { 140, 45, 135, 40, 40, 90, 90, 140, 50 },
-  { 90, 90, 135, 40, 40, 90, 90, 90, 50 },
-  { 90, 90, 90, 40, 40, 135, 90, 90, 50 },
-  { 140, 90, 90, 40, 40, 135, 90, 140, 50 },
-  { 140, 90, 90, 40, 90, 135, 90, 140, 50 },
-  { 140, 90, 90, 40, 40, 90, 90, 140, 50 },
+static const MotionStep Backward[] = {
+  MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+  MOTION_STEP(90, 90, 90, 40, 40, 90, 45, 90, 50),
+  MOTION_STEP(140, 90, 90, 40, 40, 90, 45, 140, 50),
+  MOTION_STEP(140, 90, 90, 90, 90, 90, 45, 140, 50),
+  MOTION_STEP(140, 45, 135, 90, 90, 90, 90, 140, 50),
+  MOTION_STEP(140, 45, 135, 40, 40, 90, 90, 140, 50),
+  MOTION_STEP(90, 90, 135, 40, 40, 90, 90, 90, 50),
+  MOTION_STEP(90, 90, 90, 40, 40, 135, 90, 90, 50),
+  MOTION_STEP(140, 90, 90, 40, 40, 135, 90, 140, 50),
+  MOTION_STEP(140, 90, 90, 40, 90, 135, 90, 140, 50),
+  MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
 };
 // LeftShift 
-const int LeftShift[][9] = {
-	{140,90,90,40,40,90,90,140,50},
-	{90,90,90,40,40,90,90,90,50},
-	{90,135,90,40,40,90,135,90,50},
-	{140,135,90,40,40,90,135,140,50},
-	{140,135,90,90,90,90,135,140,50},
-	{140,135,135,90,90,135,135,140,50},
-	{140,135,135,40,40,135,135,140,50},
-	{140,90,90,40,40,90,90,140,50},
+static const MotionStep LeftShift[] = {
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(90, 90, 90, 40, 40, 90, 90, 90, 50),
+	MOTION_STEP(90, 135, 90, 40, 40, 90, 135, 90, 50),
+	MOTION_STEP(140, 135, 90, 40, 40, 90, 135, 140, 50),
+	MOTION_STEP(140, 135, 90, 90, 90, 90, 135, 140, 50),
+	MOTION_STEP(140, 135, 135, 90, 90, 135, 135, 140, 50),
+	MOTION_STEP(140, 135, 135, 40, 40, 135, 135, 140, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
 };
 
 // RightShift 
-const int RightShift[][9] = {
-	{140,90,90,40,40,90,90,140,50},
-	{90,90,90,40,40,90,90,90,50},
-	{90,45,90,40,40,90,45,90,50},
-	{140,45,90,40,40,90,45,140,50},
-	{140,45,90,90,90,90,45,140,50},
-	{140,45,45,90,90,45,45,140,50},
-	{140,45,45,40,40,45,45,140,50},
-	{140,90,90,40,40,90,90,140,50},
+static const MotionStep RightShift[] = {
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(90, 90, 90, 40, 40, 90, 90, 90, 50),
+	MOTION_STEP(90, 45, 90, 40, 40, 90, 45, 90, 50),
+	MOTION_STEP(140, 45, 90, 40, 40, 90, 45, 140, 50),
+	MOTION_STEP(140, 45, 90, 90, 90, 90, 45, 140, 50),
+	MOTION_STEP(140, 45, 45, 90, 90, 45, 45, 140, 50),
+	MOTION_STEP(140, 45, 45, 40, 40, 45, 45, 140, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
 };
 
 // Say Hi 
-const int SayHi[][9] = {
-	{140,90,90,90,90,90,90,90,100},
-	{30,90,90,90,90,90,90,90,100},
-	{30,130,90,90,90,90,90,90,100},
-	{30,50,90,90,90,90,90,90,100},
-	{30,130,90,90,90,90,90,90,100},
-	{30,90,90,90,90,90,90,90,100},
-	{140,90,90,90,90,90,90,90,100}
+static const MotionStep SayHi[] = {
+	MOTION_STEP(140, 90, 90, 90, 90, 90, 90, 90, 100),
+	MOTION_STEP(30, 90, 90, 90, 90, 90, 90, 90, 100),
+	MOTION_STEP(30, 130, 90, 90, 90, 90, 90, 90, 100),
+	MOTION_STEP(30, 50, 90, 90, 90, 90, 90, 90, 100),
+	MOTION_STEP(30, 130, 90, 90, 90, 90, 90, 90, 100),
+	MOTION_STEP(30, 90, 90, 90, 90, 90, 90, 90, 100),
+	MOTION_STEP(140, 90, 90, 90, 90, 90, 90, 90, 100)
 };
 
 // Lie 
-const int Lie[][9] = {
-	{70,90,90,110,110,90,90,70,500}
+static const MotionStep Lie[] = {
+	MOTION_STEP(70, 90, 90, 110, 110, 90, 90, 70, 500)
 };
 
 // Fighting 
-const int Fighting[][9] = {
-	{110,90,90,40,70,90,90,140,200},
-	{110,60,60,40,70,60,60,140,200},
-	{110,120,120,40,60,120,120,140,200},
-	{110,60,60,40,70,60,60,140,200},
-	{110,120,120,40,60,120,120,140,200},
-	{140,90,90,70,40,90,90,110,200},
-	{140,60,60,70,40,60,60,110,200},
-	{140,120,120,70,40,120,120,110,200},
-	{140,60,60,70,40,60,60,120,200},
-	{140,120,120,70,40,120,120,110,200},
-	{140,90,90,70,40,90,90,110,200}
+static const MotionStep Fighting[] = {
+	MOTION_STEP(110, 90, 90, 40, 70, 90, 90, 140, 200),
+	MOTION_STEP(110, 60, 60, 40, 70, 60, 60, 140, 200),
+	MOTION_STEP(110, 120, 120, 40, 60, 120, 120, 140, 200),
+	MOTION_STEP(110, 60, 60, 40, 70, 60, 60, 140, 200),
+	MOTION_STEP(110, 120, 120, 40, 60, 120, 120, 140, 200),
+	MOTION_STEP(140, 90, 90, 70, 40, 90, 90, 110, 200),
+	MOTION_STEP(140, 60, 60, 70, 40, 60, 60, 110, 200),
+	MOTION_STEP(140, 120, 120, 70, 40, 120, 120, 110, 200),
+	MOTION_STEP(140, 60, 60, 70, 40, 60, 60, 120, 200),
+	MOTION_STEP(140, 120, 120, 70, 40, 120, 120, 110, 200),
+	MOTION_STEP(140, 90, 90, 70, 40, 90, 90, 110, 200)
 };
 
 // PushUp
-const int PushUp[][9] = {
-	{140,90,90,40,40,90,90,140,300},
-	{110,90,160,40,70,90,20,140,300},
-	{140,90,160,40,40,90,20,140,300},
-	{110,90,160,40,70,90,20,140,300},
-	{140,90,160,40,40,90,20,140,300},
-	{110,90,160,40,70,90,20,140,300},
-	{140,90,160,40,40,90,20,140,500},
-	{45,90,160,135,135,90,20,45,800},
-	{140,90,160,135,120,90,20,45,200},
-	{140,90,160,135,40,90,20,45,200},
-	{140,90,160,40,40,90,20,140,200}
+static const MotionStep PushUp[] = {
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 300),
+	MOTION_STEP(110, 90, 160, 40, 70, 90, 20, 140, 300),
+	MOTION_STEP(140, 90, 160, 40, 40, 90, 20, 140, 300),
+	MOTION_STEP(110, 90, 160, 40, 70, 90, 20, 140, 300),
+	MOTION_STEP(140, 90, 160, 40, 40, 90, 20, 140, 300),
+	MOTION_STEP(110, 90, 160, 40, 70, 90, 20, 140, 300),
+	MOTION_STEP(140, 90, 160, 40, 40, 90, 20, 140, 500),
+	MOTION_STEP(45, 90, 160, 135, 135, 90, 20, 45, 800),
+	MOTION_STEP(140, 90, 160, 135, 120, 90, 20, 45, 200),
+	MOTION_STEP(140, 90, 160, 135, 40, 90, 20, 45, 200),
+	MOTION_STEP(140, 90, 160, 40, 40, 90, 20, 140, 200)
 };
 
 // Sleep 
-const int Sleep[][9] = {
-	{170,90,90,10,10,90,90,170,700},
-	{170,45,135,10,10,135,45,170,700}
+static const MotionStep Sleep[] = {
+	MOTION_STEP(170, 90, 90, 10, 10, 90, 90, 170, 700),
+	MOTION_STEP(170, 45, 135, 10, 10, 135, 45, 170, 700)
 };
 
 // Dance1
-const int Dance1[][9] = {
-	{170,90,90,10,60,90,90,110,50},
-	{155,90,90,25,50,90,90,125,50},
-	{140,90,90,40,40,90,90,140,50},
-	{125,90,90,55,30,90,90,155,50},
-	{110,90,90,50,20,90,90,170,50},
-	{125,90,90,55,30,90,90,155,50},
-	{140,90,90,40,40,90,90,140,50},
-	{155,90,90,25,50,90,90,125,50},
-	{170,90,90,10,60,90,90,110,50},
-	{155,90,90,25,50,90,90,125,50},
-	{140,90,90,40,40,90,90,140,50},
-	{170,90,90,10,60,90,90,110,50},
-	{155,90,90,25,50,90,90,125,50},
-	{140,90,90,40,40,90,90,140,50},
-	{125,90,90,55,30,90,90,155,50},
-	{110,90,90,50,20,90,90,170,50},
-	{125,90,90,55,30,90,90,155,50},
-	{140,90,90,40,40,90,90,140,50},
-	{155,90,90,25,50,90,90,125,50},
-	{170,90,90,10,60,90,90,110,50},
-	{155,90,90,25,50,90,90,125,50},
-	{140,90,90,40,40,90,90,140,50},	
+static const MotionStep Dance1[] = {
+	MOTION_STEP(170, 90, 90, 10, 60, 90, 90, 110, 50),
+	MOTION_STEP(155, 90, 90, 25, 50, 90, 90, 125, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(125, 90, 90, 55, 30, 90, 90, 155, 50),
+	MOTION_STEP(110, 90, 90, 50, 20, 90, 90, 170, 50),
+	MOTION_STEP(125, 90, 90, 55, 30, 90, 90, 155, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(155, 90, 90, 25, 50, 90, 90, 125, 50),
+	MOTION_STEP(170, 90, 90, 10, 60, 90, 90, 110, 50),
+	MOTION_STEP(155, 90, 90, 25, 50, 90, 90, 125, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(170, 90, 90, 10, 60, 90, 90, 110, 50),
+	MOTION_STEP(155, 90, 90, 25, 50, 90, 90, 125, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(125, 90, 90, 55, 30, 90, 90, 155, 50),
+	MOTION_STEP(110, 90, 90, 50, 20, 90, 90, 170, 50),
+	MOTION_STEP(125, 90, 90, 55, 30, 90, 90, 155, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),
+	MOTION_STEP(155, 90, 90, 25, 50, 90, 90, 125, 50),
+	MOTION_STEP(170, 90, 90, 10, 60, 90, 90, 110, 50),
+	MOTION_STEP(155, 90, 90, 25, 50, 90, 90, 125, 50),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50),	
 
 };
 
 // Dance2
-const int Dance2[][9] = {
-	{140,45,135,40,40,135,45,140,200},
-	{65,45,135,115,40,135,45,140,200},
-	{140,45,135,40,115,135,45,65,200},
-	{65,45,135,115,40,135,45,140,200},
-	{140,45,135,40,115,135,45,65,200},
-	{65,45,135,115,40,135,45,140,200},
-	{140,45,135,40,115,135,45,65,200},
-	{65,45,135,115,40,135,45,140,200},
-	{140,45,135,65,40,135,45,140,200}
+static const MotionStep Dance2[] = {
+	MOTION_STEP(140, 45, 135, 40, 40, 135, 45, 140, 200),
+	MOTION_STEP(65, 45, 135, 115, 40, 135, 45, 140, 200),
+	MOTION_STEP(140, 45, 135, 40, 115, 135, 45, 65, 200),
+	MOTION_STEP(65, 45, 135, 115, 40, 135, 45, 140, 200),
+	MOTION_STEP(140, 45, 135, 40, 115, 135, 45, 65, 200),
+	MOTION_STEP(65, 45, 135, 115, 40, 135, 45, 140, 200),
+	MOTION_STEP(140, 45, 135, 40, 115, 135, 45, 65, 200),
+	MOTION_STEP(65, 45, 135, 115, 40, 135, 45, 140, 200),
+	MOTION_STEP(140, 45, 135, 65, 40, 135, 45, 140, 200)
 };
 
 // Dance3
-const int Dance3[][9] = {
-	{140,45,135,40,40,135,45,140,200},
-	{70,45,135,110,120,135,45,140,200},
-	{140,45,135,40,40,135,45,140,200},
-	{70,45,135,40,120,135,45,60,200},
-	{140,45,135,40,40,135,45,140,200},
-	{70,45,135,110,120,135,45,140,200},
-	{140,45,135,40,40,135,45,140,200},
-	{70,45,135,40,120,135,45,60,200},
-	{140,45,135,40,40,135,45,140,200},
-	{140,90,90,40,40,90,90,140,200}
+static const MotionStep Dance3[] = {
+	MOTION_STEP(140, 45, 135, 40, 40, 135, 45, 140, 200),
+	MOTION_STEP(70, 45, 135, 110, 120, 135, 45, 140, 200),
+	MOTION_STEP(140, 45, 135, 40, 40, 135, 45, 140, 200),
+	MOTION_STEP(70, 45, 135, 40, 120, 135, 45, 60, 200),
+	MOTION_STEP(140, 45, 135, 40, 40, 135, 45, 140, 200),
+	MOTION_STEP(70, 45, 135, 110, 120, 135, 45, 140, 200),
+	MOTION_STEP(140, 45, 135, 40, 40, 135, 45, 140, 200),
+	MOTION_STEP(70, 45, 135, 40, 120, 135, 45, 60, 200),
+	MOTION_STEP(140, 45, 135, 40, 40, 135, 45, 140, 200),
+	MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 200)
 };
 
-// Global robot state variable
-RobotState current_state = STATE_IDLE;
+// Motion registry: one entry per RobotState
+const MotionEntry motionRegistry[STATE_COUNT] = {
+	MOTION_ENTRY(STATE_IDLE,        "idle",       "IDLE",       Standby),
+	MOTION_ENTRY(STATE_FORWARD,     "forward",    "Forward",    Forward),
+	MOTION_ENTRY(STATE_BACKWARD,    "backward",   "Backward",   Backward),
+	MOTION_ENTRY(STATE_LEFT_SHIFT,  "turn_left",  "Turn Left",  LeftShift),
+	MOTION_ENTRY(STATE_RIGHT_SHIFT, "turn_right", "Turn Right", RightShift),
+	MOTION_ENTRY(STATE_SAY_HI,      "say_hi",     "Say Hi",     SayHi),
+	MOTION_ENTRY(STATE_LIE,         "lie",        "Lie",        Lie),
+	MOTION_ENTRY(STATE_FIGHTING,    "fighting",   "Fighting",   Fighting),
+	MOTION_ENTRY(STATE_PUSHUP,      "push_up",    "Push Up",    PushUp),
+	MOTION_ENTRY(STATE_SLEEP,       "sleep",      "Sleep",      Sleep),
+	MOTION_ENTRY(STATE_DANCE1,      "wiggle",     "Wiggle",     Dance1),
+	MOTION_ENTRY(STATE_DANCE2,      "dance",      "Dance",      Dance2),
+	MOTION_ENTRY(STATE_DANCE3,      "warmup",     "Warm Up",    Dance3),
+};
+
+static volatile uint32_t obstacleRaisedAt;          // CycleCounter stamp of the pending alarm
+static volatile bool obstaclePending = false;       // Alarm raised but not yet reacted to
+static ControlReactionStats reactionStats;
+
+#define CONTROL_TOUCH_POLL_MS   50      // Touch GPIO poll period while waiting for commands
 
 
 /**
- * @fn      void PlayMotion(const int motion[][9], int steps)
+ * @fn      void PlayMotion(const MotionStep *motion, int steps)
  * @brief   Play a predefined motion sequence by setting servo angles.
- * @details Each row in the motion array represents one step.
- *          The first 8 values are servo angles, and the 9th is the delay in ms.
+ * @details Each step holds the 8 servo pulse counts (converted from angles
+ *          at compile time by MOTION_STEP) and the time in ms the servos take
+ *          to reach them. MotionPlayer interpolates between keyframes at the
+ *          50 Hz servo frame rate.
  * 
- * @param   motion - 2D array of motion steps [step][8 servo angles + 1 delay]
+ * @param   motion - Array of packed motion steps
  * @param   steps  - Number of steps in the motion
+ * @return  0 on success, ERROR_ABORTED if preempted, otherwise an I2C error
+ */
+int32_t PlayMotion(const MotionStep *motion, int steps) {
+	return MotionPlayer_Play(motion, steps);
+}
+
+/**
+ * @fn      uint32_t ControlTask_MotionStepCount(uint32_t *sequences)
+ * @brief   Counts the keyframes in the built-in motion tables.
+ * @details Used to report the flash footprint of the packed format.
+ * 
+ * @param   sequences - Receives the number of motion tables (may be NULL)
+ * @return  Total number of steps across all tables
+ */
+uint32_t ControlTask_MotionStepCount(uint32_t *sequences) {
+	uint32_t total = 0;
+
+	for (int i = 0; i < STATE_COUNT; ++i) {
+		total += motionRegistry[i].count;
+	}
+	if (sequences != NULL) {
+		*sequences = STATE_COUNT;
+	}
+	return total;
+}
+
+/**
+ * @fn      void ControlTask_RaiseObstacle(void)
+ * @brief   Signals an obstacle alarm to the control task.
+ * @details Posts a safety-class Backward, which preempts any running motion
+ *          at its current frame wait. Called from task context (EnvSensorTask);
+ *          the yield hands the CPU to the equal-priority control task right away.
+ * 
  * @return  None
  */
-void PlayMotion(const int motion[][9], int steps) {
-	for (int i = 0; i < steps; ++i) {
-		for (int ch = 0; ch < 8; ++ch) {
-			// Set each servo to its target angle for this step
-			if (set_servo_angle(ch, motion[i][ch]) != 0) {
-				// Optional: handle servo failure
-			}
-		}
-		// Wait for the specified time before next step
-		vTaskDelay(pdMS_TO_TICKS(motion[i][8]));
+void ControlTask_RaiseObstacle(void) {
+	if (!obstaclePending) {
+		obstacleRaisedAt = CycleCounterNow();
+		obstaclePending = true;
+	}
+	MotionQueue_Post(STATE_BACKWARD, MOTION_CLASS_SAFETY);
+	taskYIELD();
+}
+
+/**
+ * @fn      void ControlTask_GetReactionStats(ControlReactionStats *stats)
+ * @brief   Copies the obstacle reaction counters.
+ * 
+ * @param   stats - Destination structure
+ * @return  None
+ */
+void ControlTask_GetReactionStats(ControlReactionStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = reactionStats;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      static void ControlTask_AcknowledgeObstacle(void)
+ * @brief   Records the reaction latency of a pending obstacle alarm.
+ * @details Called right before the evasive motion starts, so the latency
+ *          covers detection, preemption of the old motion and rescheduling.
+ * 
+ * @return  None
+ */
+static void ControlTask_AcknowledgeObstacle(void) {
+	if (!obstaclePending) {
+		return;
 	}
+	obstaclePending = false;
+
+	uint32_t latencyUs = CycleCounterToUs(CycleCounterNow() - obstacleRaisedAt);
+	taskENTER_CRITICAL();
+	reactionStats.obstacles++;
+	reactionStats.latencyLastUs = latencyUs;
+	if (latencyUs > reactionStats.latencyMaxUs) {
+		reactionStats.latencyMaxUs = latencyUs;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      static void ControlTask_Pause(uint32_t ms)
+ * @brief   Waits between motions while still reacting to preempting commands.
+ * 
+ * @param   ms - Pause length in milliseconds
+ * @return  None
+ */
+static void ControlTask_Pause(uint32_t ms) {
+	MotionQueue_WaitPreempt(pdMS_TO_TICKS(ms));
 }
 
 /**
@@ -220,7 +329,7 @@ void PlayMotion(const int motion[][9], int steps) {
 void ControlTask(void *pvParameters) {
 	SerialConsoleWriteString("ControlTask started...\r\n");
 	// Initialize PWM controller (e.g., PCA9685) and set frequency
-	pca9685_init();
+	pca9685_init(PCA9685_PHASE_STAGGER);  // Spread the servo pulses over the period to flatten the supply peaks
 	PCA9685_SetPWMFreq(50);  // Set PWM frequency to 50Hz (standard for servos)
 
 	// Initialize capacitive touch sensor
@@ -230,96 +339,84 @@ void ControlTask(void *pvParameters) {
 	vTaskDelay(pdMS_TO_TICKS(500));
 
 	// Move all 8 servos to neutral (90 degrees)
-	for (int ch = 0; ch < 8; ++ch) {
-		set_servo_angle(ch, 90);
+	uint16_t neutral[PCA9685_SERVO_CHANNELS];
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		neutral[ch] = pca9685_angle_to_pulse(90);
 	}
+	pca9685_set_frame(neutral);
+	MotionPlayer_Init(neutral);
 
+	// Higher-priority commands preempt whatever motion is playing
+	MotionPlayer_SetAbortSource(MotionQueue_GetEventGroup(), MOTION_QUEUE_EVT_POSTED, MotionQueue_PreemptPending);
+	MotionQueue_Post(STATE_IDLE, MOTION_CLASS_IDLE);
+
+	bool touched = false;
 	while (1) {
+		MotionCommand cmd;
+
 		// If an obstacle is detected too close
 		if (!distance_safe) {
-			SerialConsoleWriteString("Obstacle too close, direct Backward.\r\n");
-			PlayMotion(Backward, sizeof(Backward)/sizeof(Backward[0]));
-
-			current_state = STATE_IDLE;
-			vTaskDelay(pdMS_TO_TICKS(500));
-			continue;
+			MotionQueue_Post(STATE_BACKWARD, MOTION_CLASS_SAFETY);
 		}
 
-		// If the touch sensor is triggered
-		if (AT42QT1010_IsTouched()) {
+		// If the touch sensor is triggered (rising edge, so holding does not queue repeats)
+		bool touchNow = AT42QT1010_IsTouched();
+		if (touchNow && !touched) {
 			SerialConsoleWriteString("Touch detected! Trigger Dance1.\r\n");
-			PlayMotion(Dance1, sizeof(Dance1)/sizeof(Dance1[0]));
-			vTaskDelay(pdMS_TO_TICKS(500));
+			MotionQueue_Post(STATE_DANCE1, MOTION_CLASS_USER);
+		}
+		touched = touchNow;
+
+		// Sleep until a command arrives; the timeout paces the touch GPIO poll and the servo driver check
+		if (MotionQueue_Receive(&cmd, pdMS_TO_TICKS(CONTROL_TOUCH_POLL_MS)) != pdPASS) {
+			pca9685_health_poll();
 			continue;
 		}
 
-		// State machine handling
-		switch (current_state) {
-			
-			case STATE_IDLE:
-			PlayMotion(Standby, sizeof(Standby)/sizeof(Standby[0]));
-			break;
-		
-			case STATE_FORWARD:
-			PlayMotion(Forward, sizeof(Forward)/sizeof(Forward[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_BACKWARD:
-			PlayMotion(Backward, sizeof(Backward)/sizeof(Backward[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_LEFT_SHIFT:
-			PlayMotion(LeftShift, sizeof(LeftShift)/sizeof(LeftShift[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_RIGHT_SHIFT:
-			PlayMotion(RightShift, sizeof(RightShift)/sizeof(RightShift[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_SAY_HI:
-			PlayMotion(SayHi, sizeof(SayHi)/sizeof(SayHi[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_LIE:
-			PlayMotion(Lie, sizeof(Lie)/sizeof(Lie[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_FIGHTING:
-			PlayMotion(Fighting, sizeof(Fighting)/sizeof(Fighting[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_PUSHUP:
-			PlayMotion(PushUp, sizeof(PushUp)/sizeof(PushUp[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_SLEEP:
-			PlayMotion(Sleep, sizeof(Sleep)/sizeof(Sleep[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_DANCE1:
-			PlayMotion(Dance1, sizeof(Dance1)/sizeof(Dance1[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_DANCE2:
-			PlayMotion(Dance2, sizeof(Dance2)/sizeof(Dance2[0]));
-			current_state = STATE_IDLE;
-			break;
-
-			case STATE_DANCE3:
-			PlayMotion(Dance3, sizeof(Dance3)/sizeof(Dance3[0]));
-			current_state = STATE_IDLE;
-			break;
+		if (cmd.cls == MOTION_CLASS_SAFETY) {
+			ControlTask_AcknowledgeObstacle();
+			SerialConsoleWriteString("Obstacle too close, direct Backward.\r\n");
 		}
 
+		int32_t result = 0;
+		MotionPlayer_SetSpeed(cmd.speed);
+		const MotionEntry *entry = MotionRegistry_Get(cmd.state);
+		if (entry != NULL) {
+			result = PlayMotion(entry->steps, entry->count);
+		} else if (cmd.state == STATE_SD_FILE) {
+			result = MotionFile_PlayRequested();
+			if (result != ERROR_NONE && result != ERROR_ABORTED) {
+				SerialConsoleWriteString("Motion file could not be played.\r\n");
+			}
+		} else if (cmd.state == STATE_VM_PROGRAM) {
+			result = MotionVm_Run();
+			if (result != ERROR_NONE && result != ERROR_ABORTED) {
+				SerialConsoleWriteString("Motion program stopped with a fault.\r\n");
+			}
+		} else if (cmd.state == STATE_GAIT) {
+			result = MotionGait_Run();
+		} else if (cmd.state == STATE_STREAM) {
+			result = MotionStream_Run();
+		} else if (cmd.state == STATE_JOG) {
+			result = MotionRecord_RunJog();
+		}
+		MotionQueue_Complete(result == ERROR_ABORTED);
+
+		MotionPlayerStats player;
+		MotionPlayer_GetStats(&player);
+		LogMessage(LOG_DEBUG_LVL, "Slew: peak %lu fast servos, %lu counts/frame, %lu deferred, +%lu frames\r\n",
+		           (unsigned long)player.slewHighPeakLast, (unsigned long)player.slewSumPeakLast,
+		           (unsigned long)player.slewDeferredLast, (unsigned long)player.slewFramesLast);
+
+		if (cmd.cls == MOTION_CLASS_SAFETY) {
+			obstaclePending = false;  // Alarms raised during the evasive motion are covered by it
+			ControlTask_Pause(500);
+		}
+
+		// Return to standby once after a motion, then block until the next command.
+		// Jogged poses are held, and so is every pose while a recording is taught.
+		if (cmd.state != STATE_IDLE && cmd.state != STATE_JOG && !MotionRecord_Active() && MotionQueue_Depth() == 0) {
+			MotionQueue_Post(STATE_IDLE, MOTION_CLASS_IDLE);
+		}
 	}
 }
@@ -2,7 +2,8 @@
  * @file    ControlTask.h
  * @brief   Declarations for robot motion control and state management.
  *
- * Defines the RobotState enum and exposes motion sequences and the ControlTask function.
+ * Defines the RobotState enum and exposes the ControlTask function. Motion tables are
+ * reached through MotionRegistry.h.
  * Used to coordinate servo-based motions like walking, dancing, and reacting to sensor input.
  */
 
@@ -11,6 +12,7 @@
 #define CONTROL_TASK_H
 
 #include <stdint.h>
+#include "MotionPlayer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -29,24 +31,25 @@ extern "C" {
 		STATE_SLEEP,
 		STATE_DANCE1,
 		STATE_DANCE2,
-		STATE_DANCE3
+		STATE_DANCE3,
+		STATE_COUNT,
+		STATE_SD_FILE = STATE_COUNT, // Motion file named by MotionFile_Request(), not in the registry
+		STATE_VM_PROGRAM,            // Bytecode program loaded into MotionVm
+		STATE_GAIT,                  // Procedural gait with the MotionGait_Set() parameters
+		STATE_STREAM,                // Live frames from MotionStream
+		STATE_JOG                    // Servo moves queued by MotionRecord_Jog(), held afterwards
 	} RobotState;
 
-	extern RobotState current_state;
-	extern const int Forward[][9];
-	extern const int Backward[][9];
-	extern const int LeftShift[][9];
-	extern const int RightShift[][9];
-	extern const int SayHi[][9];
-	extern const int Lie[][9];
-	extern const int Fighting[][9];
-	extern const int PushUp[][9];
-	extern const int Sleep[][9];
-	extern const int Dance1[][9];
-	extern const int Dance2[][9];
-	extern const int Dance3[][9];
-	extern const int Standby[][9];
+	typedef struct {
+		uint32_t obstacles;         // Obstacle alarms handled
+		uint32_t latencyLastUs;     // Alarm to start of evasive motion, last event
+		uint32_t latencyMaxUs;      // Worst-case alarm to evasive motion latency
+	} ControlReactionStats;
 
+	uint32_t ControlTask_MotionStepCount(uint32_t *sequences);
+	int32_t PlayMotion(const MotionStep *motion, int steps);
+	void ControlTask_RaiseObstacle(void);
+	void ControlTask_GetReactionStats(ControlReactionStats *stats);
 	void ControlTask(void *pvParameters);
 
 
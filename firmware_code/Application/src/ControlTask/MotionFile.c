@@ -0,0 +1,472 @@
+/**
+ * @file    MotionFile.c
+ * @brief   Motion sequences stored on the SD card.
+ *
+ * Files of up to MOTION_FILE_CACHE_STEPS keyframes are read once into an LRU
+ * cache slot and replayed from RAM afterwards. Longer files stream through two
+ * MOTION_FILE_HALF_STEPS buffers: both halves are loaded before the first
+ * frame, and a consumed half is reloaded from the player's prefetch hook,
+ * which runs in the slack between writing a frame and its next deadline. SD
+ * latency therefore only matters if a single half refill exceeds one frame;
+ * the refill time and any underruns are counted.
+ *
+ * All state is static and sized at compile time (checked against 1 KB below).
+ * Playback runs in ControlTask only; saving may happen from another task. FatFs
+ * locks the volume per call (FatFsSync.c), and a mutex here keeps the cache and
+ * stream state consistent between playback and saving.
+ */
+
+#include "MotionFile.h"
+#include "asf.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
+#include <string.h>
+#include <stdio.h>
+
+_Static_assert(sizeof(MotionStep) == 18, "motion files store unpadded 18-byte steps");
+_Static_assert(sizeof(MotionFileHeader) == 28, "motion file header layout changed");
+
+typedef struct {
+	char name[MOTION_FILE_NAME_LEN];
+	uint16_t count;                             // 0 marks an empty slot
+	uint32_t lastUse;                           // LRU stamp
+	MotionStep steps[MOTION_FILE_CACHE_STEPS];
+} MotionCacheSlot;
+
+typedef struct {
+	MotionSource base;                          // Must stay first
+	FIL file;
+	MotionStep half[2][MOTION_FILE_HALF_STEPS];
+	uint8_t halfCount[2];                       // Keyframes loaded per half, 0 once consumed
+	uint8_t fillHalf;                           // Next half the loader writes
+	uint8_t readHalf;                           // Half the player reads
+	uint8_t readPos;                            // Next keyframe within readHalf
+	bool failed;                                // A read error ended the stream
+	uint16_t remaining;                         // Keyframes still on the card
+} MotionStream;
+
+static struct {
+	MotionCacheSlot cache[MOTION_FILE_CACHE_SLOTS];
+	MotionStream stream;
+	char requested[MOTION_FILE_NAME_LEN];       // Set by MotionFile_Request()
+	uint32_t useClock;
+	MotionFileStats stats;
+} motionFile;
+
+_Static_assert(sizeof(motionFile) <= 1024, "motion file loader must stay within 1 KB of RAM");
+
+static SemaphoreHandle_t motionFileMutex = NULL;
+
+/**
+ * @fn      bool MotionFile_Init(void)
+ * @brief   Creates the mutex that serializes SD access between tasks.
+ * @return  true on success
+ */
+bool MotionFile_Init(void) {
+	if (motionFileMutex == NULL) {
+		motionFileMutex = xSemaphoreCreateMutex();
+	}
+	motionFile.stats.ramBytes = sizeof(motionFile);
+	return motionFileMutex != NULL;
+}
+
+static void MotionFile_Lock(void) {
+	if (motionFileMutex != NULL) {
+		xSemaphoreTake(motionFileMutex, portMAX_DELAY);
+	}
+}
+
+static void MotionFile_Unlock(void) {
+	if (motionFileMutex != NULL) {
+		xSemaphoreGive(motionFileMutex);
+	}
+}
+
+/**
+ * @fn      static bool MotionFile_ValidName(const char *name, size_t len)
+ * @brief   Accepts 1 to MOTION_FILE_NAME_LEN - 1 characters of [A-Za-z0-9_-].
+ */
+static bool MotionFile_ValidName(const char *name, size_t len) {
+	if (name == NULL || len == 0 || len >= MOTION_FILE_NAME_LEN) {
+		return false;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		char c = name[i];
+		bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn      static bool MotionFile_MakePath(char *path, size_t size, const char *name, const char *ext)
+ * @brief   Builds "0:/motions/<name><ext>" after validating the name.
+ */
+static bool MotionFile_MakePath(char *path, size_t size, const char *name, const char *ext) {
+	if (!MotionFile_ValidName(name, strlen(name))) {
+		return false;
+	}
+	int len = snprintf(path, size, "%s/%s%s", MOTION_FILE_DIR, name, ext);
+	return len > 0 && (size_t)len < size;
+}
+
+/**
+ * @fn      static bool MotionFile_ReadSteps(FIL *file, MotionStep *steps, uint16_t count)
+ * @brief   Reads count packed keyframes; records are stored in MotionStep layout.
+ */
+static bool MotionFile_ReadSteps(FIL *file, MotionStep *steps, uint16_t count) {
+	UINT want = (UINT)count * sizeof(MotionStep);
+	UINT got = 0;
+
+	return f_read(file, steps, want, &got) == FR_OK && got == want;
+}
+
+/**
+ * @fn      static void MotionFile_Refill(MotionStream *stream)
+ * @brief   Loads the next free buffer half, if any, and times the read.
+ */
+static void MotionFile_Refill(MotionStream *stream) {
+	uint8_t h = stream->fillHalf;
+
+	if (stream->halfCount[h] != 0 || stream->remaining == 0 || stream->failed) {
+		return;
+	}
+
+	uint16_t n = (stream->remaining < MOTION_FILE_HALF_STEPS) ? stream->remaining : MOTION_FILE_HALF_STEPS;
+	uint32_t start = CycleCounterNow();
+	if (!MotionFile_ReadSteps(&stream->file, stream->half[h], n)) {
+		stream->failed = true;
+		return;
+	}
+	uint32_t us = CycleCounterToUs(CycleCounterNow() - start);
+
+	stream->halfCount[h] = (uint8_t)n;
+	stream->remaining -= n;
+	stream->fillHalf ^= 1;
+
+	motionFile.stats.refills++;
+	if (us > motionFile.stats.refillUsMax) {
+		motionFile.stats.refillUsMax = us;
+	}
+}
+
+/**
+ * @fn      static void MotionFile_StreamPrefetch(MotionSource *source)
+ * @brief   MotionSource hook: refills a consumed half between frames.
+ */
+static void MotionFile_StreamPrefetch(MotionSource *source) {
+	MotionFile_Refill((MotionStream *)source);
+}
+
+/**
+ * @fn      static bool MotionFile_StreamNext(MotionSource *source, MotionStep *step)
+ * @brief   MotionSource hook: hands out the next buffered keyframe.
+ * @details If the player catches up with the loader the half is read
+ *          synchronously; that read is on the frame path and counted as an underrun.
+ */
+static bool MotionFile_StreamNext(MotionSource *source, MotionStep *step) {
+	MotionStream *stream = (MotionStream *)source;
+
+	if (stream->halfCount[stream->readHalf] == 0) {
+		if (stream->remaining == 0 || stream->failed) {
+			return false;
+		}
+		motionFile.stats.underruns++;
+		MotionFile_Refill(stream);
+		if (stream->halfCount[stream->readHalf] == 0) {
+			return false;
+		}
+	}
+
+	*step = stream->half[stream->readHalf][stream->readPos++];
+	if (stream->readPos >= stream->halfCount[stream->readHalf]) {
+		stream->halfCount[stream->readHalf] = 0;  // Free for the loader
+		stream->readPos = 0;
+		stream->readHalf ^= 1;
+	}
+	return true;
+}
+
+/**
+ * @fn      static MotionCacheSlot *MotionFile_CacheFind(const char *name)
+ * @brief   Returns the cache slot holding name, or NULL.
+ */
+static MotionCacheSlot *MotionFile_CacheFind(const char *name) {
+	for (int i = 0; i < MOTION_FILE_CACHE_SLOTS; ++i) {
+		MotionCacheSlot *slot = &motionFile.cache[i];
+		if (slot->count != 0 && strcmp(slot->name, name) == 0) {
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @fn      static MotionCacheSlot *MotionFile_CacheVictim(void)
+ * @brief   Returns an empty slot, or the least recently used one.
+ */
+static MotionCacheSlot *MotionFile_CacheVictim(void) {
+	MotionCacheSlot *victim = &motionFile.cache[0];
+
+	for (int i = 0; i < MOTION_FILE_CACHE_SLOTS; ++i) {
+		MotionCacheSlot *slot = &motionFile.cache[i];
+		if (slot->count == 0) {
+			return slot;
+		}
+		if (slot->lastUse < victim->lastUse) {
+			victim = slot;
+		}
+	}
+	return victim;
+}
+
+/**
+ * @fn      static int32_t MotionFile_OpenHeader(FIL *file, const char *name, const char *ext, uint32_t magic, uint16_t recordSize, MotionFileHeader *header)
+ * @brief   Opens a motion or program file and validates its header. Call with the mutex held.
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+static int32_t MotionFile_OpenHeader(FIL *file, const char *name, const char *ext, uint32_t magic,
+                                     uint16_t recordSize, MotionFileHeader *header) {
+	char path[32];
+	UINT got = 0;
+
+	if (!MotionFile_MakePath(path, sizeof(path), name, ext)) {
+		return ERROR_INVALID_ARG;
+	}
+	if (f_open(file, path, FA_OPEN_EXISTING | FA_READ) != FR_OK) {
+		return ERROR_NOT_FOUND;
+	}
+	if (f_read(file, header, sizeof(*header), &got) != FR_OK || got != sizeof(*header) ||
+	    header->magic != magic || header->version != MOTION_FILE_VERSION ||
+	    header->stepSize != recordSize || header->stepCount == 0) {
+		f_close(file);
+		return ERROR_BAD_FORMAT;
+	}
+	return 0;
+}
+
+/**
+ * @fn      int32_t MotionFile_Play(const char *name)
+ * @brief   Plays "0:/motions/<name>.bmo", from the cache when possible.
+ * @details ControlTask only. The mutex is held for the whole stream so another
+ *          task cannot move the FatFs window under the open file.
+ * @param   name - File name without directory or extension
+ * @return  0 on success, ERROR_ABORTED if preempted, otherwise an ERROR_ code
+ */
+int32_t MotionFile_Play(const char *name) {
+	MotionStream *stream = &motionFile.stream;
+	MotionFileHeader header;
+	int32_t result;
+
+	MotionCacheSlot *slot = MotionFile_CacheFind(name);
+	if (slot != NULL) {
+		motionFile.stats.cacheHits++;
+		slot->lastUse = ++motionFile.useClock;
+		return MotionPlayer_Play(slot->steps, slot->count);
+	}
+	motionFile.stats.cacheMisses++;
+
+	MotionFile_Lock();
+	result = MotionFile_OpenHeader(&stream->file, name, MOTION_FILE_EXT, MOTION_FILE_MAGIC, sizeof(MotionStep), &header);
+	if (result != 0) {
+		MotionFile_Unlock();
+		return result;
+	}
+
+	if (header.stepCount <= MOTION_FILE_CACHE_STEPS) {
+		slot = MotionFile_CacheVictim();
+		slot->count = 0;
+		bool ok = MotionFile_ReadSteps(&stream->file, slot->steps, header.stepCount);
+		f_close(&stream->file);
+		MotionFile_Unlock();
+		if (!ok) {
+			return ERROR_IO;
+		}
+		strcpy(slot->name, name);
+		slot->count = header.stepCount;
+		slot->lastUse = ++motionFile.useClock;
+		return MotionPlayer_Play(slot->steps, slot->count);
+	}
+
+	// Too long to cache: stream through the double buffer
+	motionFile.stats.streamed++;
+	stream->base.next = MotionFile_StreamNext;
+	stream->base.prefetch = MotionFile_StreamPrefetch;
+	stream->halfCount[0] = 0;
+	stream->halfCount[1] = 0;
+	stream->fillHalf = 0;
+	stream->readHalf = 0;
+	stream->readPos = 0;
+	stream->failed = false;
+	stream->remaining = header.stepCount;
+	MotionFile_Refill(stream);  // Both halves are ready before the first frame
+	MotionFile_Refill(stream);
+
+	result = MotionPlayer_PlaySource(&stream->base);
+	f_close(&stream->file);
+	MotionFile_Unlock();
+
+	if (result == 0 && stream->failed) {
+		result = ERROR_IO;
+	}
+	return result;
+}
+
+/**
+ * @fn      bool MotionFile_Request(const char *name, size_t len)
+ * @brief   Records the file the next STATE_SD_FILE command should play.
+ * @details The last request wins if several arrive before ControlTask runs.
+ * @param   name - File name without directory or extension (not necessarily terminated)
+ * @param   len  - Length of name
+ * @return  false if the name is not a valid motion file name
+ */
+bool MotionFile_Request(const char *name, size_t len) {
+	if (!MotionFile_ValidName(name, len)) {
+		return false;
+	}
+	taskENTER_CRITICAL();
+	memcpy(motionFile.requested, name, len);
+	motionFile.requested[len] = '\0';
+	taskEXIT_CRITICAL();
+	return true;
+}
+
+/**
+ * @fn      int32_t MotionFile_PlayRequested(void)
+ * @brief   Plays the file recorded by MotionFile_Request().
+ * @return  Same as MotionFile_Play()
+ */
+int32_t MotionFile_PlayRequested(void) {
+	char name[MOTION_FILE_NAME_LEN];
+
+	taskENTER_CRITICAL();
+	memcpy(name, motionFile.requested, sizeof(name));
+	taskEXIT_CRITICAL();
+
+	if (name[0] == '\0') {
+		return ERROR_NOT_FOUND;
+	}
+	return MotionFile_Play(name);
+}
+
+/**
+ * @fn      static int32_t MotionFile_Write(const char *name, const char *ext, uint32_t magic, uint16_t recordSize, const void *records, uint16_t count)
+ * @brief   Writes a header and count records to "0:/motions/<name><ext>".
+ * @details Creates the motions directory if needed and drops any cached copy.
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+static int32_t MotionFile_Write(const char *name, const char *ext, uint32_t magic, uint16_t recordSize,
+                                const void *records, uint16_t count) {
+	MotionFileHeader header;
+	char path[32];
+	FIL file;
+	UINT written = 0;
+	UINT bytes = (UINT)count * recordSize;
+	int32_t result = 0;
+
+	if (count == 0 || !MotionFile_MakePath(path, sizeof(path), name, ext)) {
+		return ERROR_INVALID_ARG;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = magic;
+	header.version = MOTION_FILE_VERSION;
+	header.stepCount = count;
+	header.stepSize = recordSize;
+	strncpy(header.name, name, sizeof(header.name) - 1);
+
+	MotionFile_Lock();
+	FRESULT res = f_mkdir(MOTION_FILE_DIR);
+	if (res != FR_OK && res != FR_EXIST) {
+		MotionFile_Unlock();
+		return ERROR_IO;
+	}
+	if (f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+		MotionFile_Unlock();
+		return ERROR_IO;
+	}
+	if (f_write(&file, &header, sizeof(header), &written) != FR_OK || written != sizeof(header) ||
+	    f_write(&file, records, bytes, &written) != FR_OK || written != bytes) {
+		result = ERROR_IO;
+	}
+	f_close(&file);
+
+	MotionCacheSlot *slot = MotionFile_CacheFind(name);
+	if (slot != NULL && magic == MOTION_FILE_MAGIC) {
+		slot->count = 0;
+	}
+	MotionFile_Unlock();
+	return result;
+}
+
+/**
+ * @fn      int32_t MotionFile_Save(const char *name, const MotionStep *steps, uint16_t count)
+ * @brief   Writes a keyframe table to "0:/motions/<name>.bmo".
+ * @param   name  - File name without directory or extension
+ * @param   steps - Keyframes to store
+ * @param   count - Number of keyframes
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+int32_t MotionFile_Save(const char *name, const MotionStep *steps, uint16_t count) {
+	return MotionFile_Write(name, MOTION_FILE_EXT, MOTION_FILE_MAGIC, sizeof(MotionStep), steps, count);
+}
+
+/**
+ * @fn      int32_t MotionFile_SaveProgram(const char *name, const uint8_t *code, uint16_t len)
+ * @brief   Writes a motion bytecode program to "0:/motions/<name>.bvm".
+ * @param   name - File name without directory or extension
+ * @param   code - Program bytes
+ * @param   len  - Program length
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+int32_t MotionFile_SaveProgram(const char *name, const uint8_t *code, uint16_t len) {
+	return MotionFile_Write(name, MOTION_PROGRAM_EXT, MOTION_PROGRAM_MAGIC, 1, code, len);
+}
+
+/**
+ * @fn      int32_t MotionFile_LoadProgram(const char *name, uint8_t *code, uint16_t size, uint16_t *len)
+ * @brief   Reads a motion bytecode program from "0:/motions/<name>.bvm".
+ * @details The caller verifies the program; this only checks the header.
+ * @param   name - File name without directory or extension
+ * @param   code - Output buffer
+ * @param   size - Size of code
+ * @param   len  - Receives the program length
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+int32_t MotionFile_LoadProgram(const char *name, uint8_t *code, uint16_t size, uint16_t *len) {
+	MotionFileHeader header;
+	FIL file;
+	UINT got = 0;
+
+	MotionFile_Lock();
+	int32_t result = MotionFile_OpenHeader(&file, name, MOTION_PROGRAM_EXT, MOTION_PROGRAM_MAGIC, 1, &header);
+	if (result == 0) {
+		if (header.stepCount > size) {
+			result = ERROR_NO_MEMORY;
+		} else if (f_read(&file, code, header.stepCount, &got) != FR_OK || got != header.stepCount) {
+			result = ERROR_IO;
+		} else {
+			*len = header.stepCount;
+		}
+		f_close(&file);
+	}
+	MotionFile_Unlock();
+	return result;
+}
+
+/**
+ * @fn      void MotionFile_GetStats(MotionFileStats *stats)
+ * @brief   Copies the loader counters.
+ * @param   stats - Destination structure
+ */
+void MotionFile_GetStats(MotionFileStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = motionFile.stats;
+	taskEXIT_CRITICAL();
+	stats->ramBytes = sizeof(motionFile);
+}
@@ -0,0 +1,68 @@
+/**
+ * @file    MotionFile.h
+ * @brief   Motion sequences stored on the SD card.
+ *
+ * A motion file is a MotionFileHeader followed by stepCount packed MotionStep
+ * records (little-endian, same layout as the built-in tables). Short files are
+ * kept in a small LRU cache after first use; longer ones stream through a
+ * double buffer during playback, so RAM use is bounded regardless of length.
+ * A program file (.bvm) uses the same header with one-byte records holding
+ * MotionVm bytecode.
+ */
+
+#ifndef MOTION_FILE_H
+#define MOTION_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "MotionPlayer.h"
+
+#define MOTION_FILE_MAGIC       0x314F4D42UL    // "BMO1" read as a little-endian uint32_t
+#define MOTION_FILE_VERSION     1
+#define MOTION_FILE_DIR         "0:/motions"
+#define MOTION_FILE_EXT         ".bmo"
+#define MOTION_PROGRAM_MAGIC    0x314D5642UL    // "BVM1", header of a MotionVm program file
+#define MOTION_PROGRAM_EXT      ".bvm"
+#define MOTION_FILE_NAME_LEN    12              // Including the terminator
+#define MOTION_FILE_HALF_STEPS  4               // Keyframes per stream buffer half
+#define MOTION_FILE_CACHE_SLOTS 3               // Sequences held in the LRU cache
+#define MOTION_FILE_CACHE_STEPS 12              // Longest sequence that is cached instead of streamed
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		uint32_t magic;         // MOTION_FILE_MAGIC
+		uint16_t version;       // MOTION_FILE_VERSION
+		uint16_t stepCount;     // Number of records that follow (program bytes for .bvm)
+		uint16_t stepSize;      // sizeof(MotionStep) when written, 1 for .bvm
+		uint16_t reserved;
+		char name[16];          // Informational, not required to match the file name
+	} MotionFileHeader;
+
+	typedef struct {
+		uint32_t cacheHits;     // Plays served from RAM
+		uint32_t cacheMisses;   // Plays that had to open the file
+		uint32_t streamed;      // Plays too long to cache, streamed from the card
+		uint32_t refills;       // Stream buffer halves loaded during playback
+		uint32_t refillUsMax;   // Slowest buffer refill, must stay below one frame
+		uint32_t underruns;     // Keyframes needed before their refill completed
+		uint32_t ramBytes;      // Static RAM used by the loader, cache and buffers
+	} MotionFileStats;
+
+	bool MotionFile_Init(void);
+	bool MotionFile_Request(const char *name, size_t len);
+	int32_t MotionFile_PlayRequested(void);
+	int32_t MotionFile_Play(const char *name);
+	int32_t MotionFile_Save(const char *name, const MotionStep *steps, uint16_t count);
+	int32_t MotionFile_SaveProgram(const char *name, const uint8_t *code, uint16_t len);
+	int32_t MotionFile_LoadProgram(const char *name, uint8_t *code, uint16_t size, uint16_t *len);
+	void MotionFile_GetStats(MotionFileStats *stats);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_FILE_H
@@ -0,0 +1,423 @@
+/**
+ * @file    MotionGait.c
+ * @brief   Procedural creep/trot gait with fixed-point leg inverse kinematics.
+ *
+ * The gait cycle is a 16-bit phase that advances once per 20 ms frame. Each
+ * leg reads it at its own offset: while the leg phase is inside the swing
+ * window the foot travels forward on a half-cosine and lifts on a half-sine,
+ * otherwise it moves back linearly on the ground. Turning scales the stride of
+ * the inner and outer legs (skid steering), since the hips only yaw.
+ *
+ * The solver has no floating point and only small divisions: asin() is a
+ * binary search over the same quarter-wave table that sin()/cos() interpolate.
+ * All state is static or a few words on the ControlTask stack.
+ */
+
+#include "MotionGait.h"
+#include "MotionQueue.h"
+#include "PCA9685.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define MOTION_GAIT_QUARTER     (MOTION_GAIT_TURN / 4)
+#define MOTION_GAIT_SIN_STEPS   256                 // Table entries per quarter turn, plus the endpoint
+#define MOTION_GAIT_SIN_ONE     32767               // sin(90 degrees) in Q15
+
+typedef struct {
+	uint8_t hip;                // PCA9685 channel of the hip yaw servo
+	uint8_t knee;               // PCA9685 channel of the knee servo
+	int8_t hipSign;             // +1 if a larger angle swings the foot forward
+	int8_t kneeSign;            // +1 if a larger angle lowers the foot
+	int8_t side;                // -1 left, +1 right
+} MotionGaitLeg;
+
+typedef enum {
+	MOTION_GAIT_STAGE_START,    // Move into the first gait pose
+	MOTION_GAIT_STAGE_WALK,
+	MOTION_GAIT_STAGE_SETTLE,   // Return to standing after the last cycle
+	MOTION_GAIT_STAGE_DONE
+} MotionGaitStage;
+
+typedef struct {
+	MotionSource base;                          // Must stay first
+	int32_t stride[MOTION_GAIT_LEGS];           // Per-leg foot travel after turning
+	int32_t height;
+	int32_t lift;
+	const uint16_t *offset;                     // Leg phase offsets, Q16 of a cycle
+	uint16_t phase;                             // Q16 of a cycle
+	uint16_t phaseStep;                         // Phase advance per frame
+	uint16_t swing;                             // Swing window, Q16 of a cycle
+	uint32_t swingRecip;                        // 2^27 / swing: leg phase -> half-turn angle
+	uint32_t stanceRecip;                       // 2^31 / stance: leg phase -> Q15 fraction
+	uint32_t framesLeft;                        // Walking frames to go, 0 walks until preempted
+	bool endless;
+	MotionGaitStage stage;
+} MotionGait;
+
+// Channel layout follows the Standby pose: knees stand at 140/40 and rise
+// towards 90, hips are 90 at neutral. Legs 0/3 and 1/2 are diagonal pairs.
+static const MotionGaitLeg gaitLegs[MOTION_GAIT_LEGS] = {
+	{ 1, 0, -1, +1, -1 },   // Front left
+	{ 2, 3, +1, -1, +1 },   // Front right
+	{ 5, 4, +1, -1, -1 },   // Rear left
+	{ 6, 7, -1, +1, +1 },   // Rear right
+};
+
+// Creep lifts front left, rear right, front right, rear left in turn
+static const uint16_t creepOffset[MOTION_GAIT_LEGS] = { 0, 32768, 49152, 16384 };
+static const uint16_t trotOffset[MOTION_GAIT_LEGS] = { 0, 32768, 32768, 0 };
+
+// sin(i * 90 / 256 degrees) in Q15
+static const int16_t sinTable[MOTION_GAIT_SIN_STEPS + 1] = {
+	0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+	2410, 2611, 2811, 3012, 3212, 3412, 3612, 3811, 4011, 4210, 4410, 4609,
+	4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6786, 6983,
+	7179, 7375, 7571, 7767, 7962, 8157, 8351, 8545, 8739, 8933, 9126, 9319,
+	9512, 9704, 9896, 10087, 10278, 10469, 10659, 10849, 11039, 11228, 11417, 11605,
+	11793, 11980, 12167, 12353, 12539, 12725, 12910, 13094, 13279, 13462, 13645, 13828,
+	14010, 14191, 14372, 14553, 14732, 14912, 15090, 15269, 15446, 15623, 15800, 15976,
+	16151, 16325, 16499, 16673, 16846, 17018, 17189, 17360, 17530, 17700, 17869, 18037,
+	18204, 18371, 18537, 18703, 18868, 19032, 19195, 19357, 19519, 19680, 19841, 20000,
+	20159, 20317, 20475, 20631, 20787, 20942, 21096, 21250, 21403, 21554, 21705, 21856,
+	22005, 22154, 22301, 22448, 22594, 22739, 22884, 23027, 23170, 23311, 23452, 23592,
+	23731, 23870, 24007, 24143, 24279, 24413, 24547, 24680, 24811, 24942, 25072, 25201,
+	25329, 25456, 25582, 25708, 25832, 25955, 26077, 26198, 26319, 26438, 26556, 26674,
+	26790, 26905, 27019, 27133, 27245, 27356, 27466, 27575, 27683, 27790, 27896, 28001,
+	28105, 28208, 28310, 28411, 28510, 28609, 28706, 28803, 28898, 28992, 29085, 29177,
+	29268, 29358, 29447, 29534, 29621, 29706, 29791, 29874, 29956, 30037, 30117, 30195,
+	30273, 30349, 30424, 30498, 30571, 30643, 30714, 30783, 30852, 30919, 30985, 31050,
+	31113, 31176, 31237, 31297, 31356, 31414, 31470, 31526, 31580, 31633, 31685, 31736,
+	31785, 31833, 31880, 31926, 31971, 32014, 32057, 32098, 32137, 32176, 32213, 32250,
+	32285, 32318, 32351, 32382, 32412, 32441, 32469, 32495, 32521, 32545, 32567, 32589,
+	32609, 32628, 32646, 32663, 32678, 32692, 32705, 32717, 32728, 32737, 32745, 32752,
+	32757, 32761, 32765, 32766, 32767
+};
+
+static MotionGaitParams gaitParams = { MOTION_GAIT_TROT, 60, 30, 0, 34, 0 };
+static MotionGait motionGait;
+static MotionGaitStats gaitStats;
+
+/**
+ * @fn      static int32_t MotionGait_Sin(int32_t a)
+ * @brief   Fixed-point sine.
+ * @param   a - Angle in 1/4096 turn, any value
+ * @return  sin(a) in Q15
+ */
+static int32_t MotionGait_Sin(int32_t a) {
+	a &= MOTION_GAIT_TURN - 1;
+	int32_t quadrant = a / MOTION_GAIT_QUARTER;
+	int32_t r = a & (MOTION_GAIT_QUARTER - 1);
+	if (quadrant & 1) {
+		r = MOTION_GAIT_QUARTER - r;
+	}
+
+	// Four angle units per table step
+	int32_t i = r >> 2;
+	int32_t v = sinTable[i];
+	if (r & 3) {
+		v += ((sinTable[i + 1] - v) * (r & 3)) >> 2;
+	}
+	return (quadrant & 2) ? -v : v;
+}
+
+/**
+ * @fn      static int32_t MotionGait_Asin(int32_t s)
+ * @brief   Fixed-point arcsine.
+ * @param   s - Sine in Q15, clamped to +/-1
+ * @return  Angle in 1/4096 turn, within +/-MOTION_GAIT_QUARTER
+ */
+static int32_t MotionGait_Asin(int32_t s) {
+	bool negative = (s < 0);
+	if (negative) s = -s;
+	if (s >= MOTION_GAIT_SIN_ONE) {
+		return negative ? -MOTION_GAIT_QUARTER : MOTION_GAIT_QUARTER;
+	}
+
+	// Largest entry not above s
+	int lo = 0, hi = MOTION_GAIT_SIN_STEPS;
+	while (hi - lo > 1) {
+		int mid = (lo + hi) >> 1;
+		if (sinTable[mid] <= s) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	int32_t a = lo << 2;
+	int32_t span = sinTable[hi] - sinTable[lo];
+	if (span > 0) {
+		a += ((s - sinTable[lo]) << 2) / span;
+	}
+	return negative ? -a : a;
+}
+
+/**
+ * @fn      static uint16_t MotionGait_Pulse(int32_t angle)
+ * @brief   Converts a servo angle into a nominal PCA9685 pulse.
+ * @param   angle - Servo angle in 1/4096 turn, 0 to half a turn
+ */
+static uint16_t MotionGait_Pulse(int32_t angle) {
+	if (angle < 0) angle = 0;
+	if (angle > 2 * MOTION_GAIT_QUARTER) angle = 2 * MOTION_GAIT_QUARTER;
+	return (uint16_t)(PCA9685_SERVO_MIN + ((angle * (PCA9685_SERVO_MAX - PCA9685_SERVO_MIN) + MOTION_GAIT_QUARTER) >> 11));
+}
+
+/**
+ * @fn      static void MotionGait_SolveLeg(const MotionGaitLeg *leg, int32_t x, int32_t z, uint16_t pulse[PCA9685_SERVO_CHANNELS])
+ * @brief   Two-link inverse kinematics for one leg.
+ * @details The knee angle below horizontal follows from the foot drop, which
+ *          fixes the horizontal reach (coxa + projected tibia); the hip yaw
+ *          then turns that reach until the foot sits x ahead of the hip.
+ * @param   leg   - Leg channels and mounting signs
+ * @param   x     - Foot forward of the hip, 0.1 mm
+ * @param   z     - Foot below the knee axis, 0.1 mm
+ * @param   pulse - Frame receiving the two servo pulses
+ */
+static void MotionGait_SolveLeg(const MotionGaitLeg *leg, int32_t x, int32_t z, uint16_t pulse[PCA9685_SERVO_CHANNELS]) {
+	if (z < 0) z = 0;
+	if (z > MOTION_GAIT_TIBIA) z = MOTION_GAIT_TIBIA;
+
+	int32_t knee = MotionGait_Asin((z << 15) / MOTION_GAIT_TIBIA);
+	int32_t reach = MOTION_GAIT_COXA + ((MOTION_GAIT_TIBIA * MotionGait_Sin(knee + MOTION_GAIT_QUARTER)) >> 15);
+	if (x > reach) x = reach;
+	if (x < -reach) x = -reach;
+	int32_t hip = MotionGait_Asin((x << 15) / reach);
+
+	pulse[leg->knee] = MotionGait_Pulse(MOTION_GAIT_QUARTER + leg->kneeSign * knee);
+	pulse[leg->hip] = MotionGait_Pulse(MOTION_GAIT_QUARTER + leg->hipSign * hip);
+}
+
+/**
+ * @fn      static void MotionGait_Frame(const MotionGait *gait, uint16_t phase, uint16_t pulse[PCA9685_SERVO_CHANNELS])
+ * @brief   Computes all eight servo pulses for one point of the gait cycle.
+ */
+static void MotionGait_Frame(const MotionGait *gait, uint16_t phase, uint16_t pulse[PCA9685_SERVO_CHANNELS]) {
+	for (int i = 0; i < MOTION_GAIT_LEGS; ++i) {
+		uint16_t p = (uint16_t)(phase + gait->offset[i]);
+		int32_t half = gait->stride[i] / 2;
+		int32_t x, z;
+
+		if (p < gait->swing) {
+			// Swing: half a turn of cos/sin across the window
+			int32_t a = (int32_t)((p * gait->swingRecip) >> 16);
+			x = -((half * MotionGait_Sin(a + MOTION_GAIT_QUARTER)) >> 15);
+			z = gait->height - ((gait->lift * MotionGait_Sin(a)) >> 15);
+		} else {
+			// Stance: foot slides back at constant speed
+			int32_t f = (int32_t)(((uint32_t)(p - gait->swing) * gait->stanceRecip) >> 16);
+			x = half - ((gait->stride[i] * f) >> 15);
+			z = gait->height;
+		}
+		MotionGait_SolveLeg(&gaitLegs[i], x, z, pulse);
+	}
+}
+
+/**
+ * @fn      static void MotionGait_Stand(const MotionGait *gait, uint16_t pulse[PCA9685_SERVO_CHANNELS])
+ * @brief   Computes the standing pose at the gait's body height.
+ */
+static void MotionGait_Stand(const MotionGait *gait, uint16_t pulse[PCA9685_SERVO_CHANNELS]) {
+	for (int i = 0; i < MOTION_GAIT_LEGS; ++i) {
+		MotionGait_SolveLeg(&gaitLegs[i], 0, gait->height, pulse);
+	}
+}
+
+/**
+ * @fn      static uint32_t MotionGait_Prepare(MotionGait *gait, const MotionGaitParams *params)
+ * @brief   Derives the per-frame constants of a gait from its parameters.
+ * @return  Gait cycle time in ms
+ */
+static uint32_t MotionGait_Prepare(MotionGait *gait, const MotionGaitParams *params) {
+	uint32_t stance = (params->type == MOTION_GAIT_CREEP) ? 49152UL : 32768UL;
+	int32_t stride = (int32_t)params->stride * 10;
+
+	gait->offset = (params->type == MOTION_GAIT_CREEP) ? creepOffset : trotOffset;
+	gait->swing = (uint16_t)(65536UL - stance);
+	gait->swingRecip = (1UL << 27) / gait->swing;
+	gait->stanceRecip = (1UL << 31) / stance;
+	gait->height = (int32_t)params->height * 10;
+	gait->lift = (gait->height < MOTION_GAIT_LIFT) ? gait->height : MOTION_GAIT_LIFT;
+	gait->phase = 0;
+
+	for (int i = 0; i < MOTION_GAIT_LEGS; ++i) {
+		int32_t legStride = stride;
+		if (params->turnRadius != 0) {
+			int32_t radius = (int32_t)params->turnRadius * 10;
+			legStride = stride * (radius + gaitLegs[i].side * (MOTION_GAIT_TRACK / 2)) / radius;
+		}
+		if (legStride > 2 * MOTION_GAIT_STRIDE_MAX * 10) legStride = 2 * MOTION_GAIT_STRIDE_MAX * 10;
+		if (legStride < -2 * MOTION_GAIT_STRIDE_MAX * 10) legStride = -2 * MOTION_GAIT_STRIDE_MAX * 10;
+		gait->stride[i] = legStride;
+	}
+
+	// The body moves one stride while a foot is on the ground
+	uint32_t periodMs = (uint32_t)(((uint64_t)params->stride * 1000U * 65536U) / (stance * params->speed));
+	if (periodMs < MOTION_GAIT_PERIOD_MIN_MS) periodMs = MOTION_GAIT_PERIOD_MIN_MS;
+	if (periodMs > MOTION_GAIT_PERIOD_MAX_MS) periodMs = MOTION_GAIT_PERIOD_MAX_MS;
+	gait->phaseStep = (uint16_t)((65536UL * MOTION_FRAME_MS) / periodMs);
+
+	uint32_t framesPerCycle = (65536UL + gait->phaseStep / 2) / gait->phaseStep;
+	gait->endless = (params->cycles == 0);
+	gait->framesLeft = framesPerCycle * params->cycles;
+	return periodMs;
+}
+
+/**
+ * @fn      static bool MotionGait_Next(MotionSource *source, MotionStep *step)
+ * @brief   MotionSource hook: one gait frame per call.
+ * @return  false once the gait has settled, or as soon as another command is queued
+ */
+static bool MotionGait_Next(MotionSource *source, MotionStep *step) {
+	MotionGait *gait = (MotionGait *)source;
+
+	// Any newer command takes over from the current pose without settling
+	if (MotionQueue_Depth() != 0) {
+		return false;
+	}
+
+	uint32_t start = CycleCounterNow();
+	switch (gait->stage) {
+	case MOTION_GAIT_STAGE_START:
+		MotionGait_Frame(gait, 0, step->pulse);
+		step->delay_ms = MOTION_GAIT_SETTLE_MS;
+		gait->stage = MOTION_GAIT_STAGE_WALK;
+		break;
+	case MOTION_GAIT_STAGE_WALK:
+		gait->phase = (uint16_t)(gait->phase + gait->phaseStep);
+		MotionGait_Frame(gait, gait->phase, step->pulse);
+		step->delay_ms = MOTION_FRAME_MS;
+		gaitStats.framesLast++;
+		if (!gait->endless && --gait->framesLeft == 0) {
+			gait->stage = MOTION_GAIT_STAGE_SETTLE;
+		}
+		break;
+	case MOTION_GAIT_STAGE_SETTLE:
+		MotionGait_Stand(gait, step->pulse);
+		step->delay_ms = MOTION_GAIT_SETTLE_MS;
+		gait->stage = MOTION_GAIT_STAGE_DONE;
+		break;
+	default:
+		return false;
+	}
+
+	gaitStats.cyclesLast = CycleCounterNow() - start;
+	if (gaitStats.cyclesLast > gaitStats.cyclesMax) {
+		gaitStats.cyclesMax = gaitStats.cyclesLast;
+	}
+	return true;
+}
+
+/**
+ * @fn      void MotionGait_GetDefaults(MotionGaitParams *params)
+ * @brief   Fills in a slow trot at standing height.
+ */
+void MotionGait_GetDefaults(MotionGaitParams *params) {
+	params->type = MOTION_GAIT_TROT;
+	params->speed = 60;
+	params->stride = 30;
+	params->turnRadius = 0;
+	params->height = 34;
+	params->cycles = 0;
+}
+
+/**
+ * @fn      int32_t MotionGait_Set(const MotionGaitParams *params)
+ * @brief   Sets the parameters used by the next MotionGait_Run().
+ * @return  ERROR_NONE, or ERROR_INVALID_ARG if a parameter is out of range
+ */
+int32_t MotionGait_Set(const MotionGaitParams *params) {
+	if (params->type >= MOTION_GAIT_TYPE_COUNT || params->speed == 0 || params->speed > MOTION_GAIT_SPEED_MAX
+		|| params->stride > MOTION_GAIT_STRIDE_MAX || params->height == 0
+		|| params->height * 10 > MOTION_GAIT_TIBIA) {
+		return ERROR_INVALID_ARG;
+	}
+
+	taskENTER_CRITICAL();
+	gaitParams = *params;
+	taskEXIT_CRITICAL();
+	return ERROR_NONE;
+}
+
+/**
+ * @fn      void MotionGait_Get(MotionGaitParams *params)
+ * @brief   Copies the parameters of the next gait.
+ */
+void MotionGait_Get(MotionGaitParams *params) {
+	taskENTER_CRITICAL();
+	*params = gaitParams;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      int32_t MotionGait_Run(void)
+ * @brief   Walks with the current parameters. ControlTask only.
+ * @return  0 on success, ERROR_ABORTED if preempted, otherwise the last I2C error
+ */
+int32_t MotionGait_Run(void) {
+	MotionGait *gait = &motionGait;
+	MotionGaitParams params;
+
+	MotionGait_Get(&params);
+	gait->base.next = MotionGait_Next;
+	gait->base.prefetch = NULL;
+	gait->stage = MOTION_GAIT_STAGE_START;
+	uint32_t periodMs = MotionGait_Prepare(gait, &params);
+
+	taskENTER_CRITICAL();
+	gaitStats.runs++;
+	gaitStats.periodMs = periodMs;
+	gaitStats.framesLast = 0;
+	taskEXIT_CRITICAL();
+
+	return MotionPlayer_PlaySource(&gait->base);
+}
+
+/**
+ * @fn      void MotionGait_GetStats(MotionGaitStats *stats)
+ * @brief   Copies the gait counters.
+ */
+void MotionGait_GetStats(MotionGaitStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = gaitStats;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      uint32_t MotionGait_Benchmark(MotionGaitType type, uint32_t iterations)
+ * @brief   Measures gait frame generation (timing + IK for 8 servos) on the target.
+ * @details Sweeps the whole cycle with a turning gait so both swing and
+ *          stance paths are exercised; nothing is written to the bus.
+ * @return  Average CPU cycles per frame
+ */
+uint32_t MotionGait_Benchmark(MotionGaitType type, uint32_t iterations) {
+	MotionGait gait;
+	MotionGaitParams params;
+	uint16_t pulse[PCA9685_SERVO_CHANNELS];
+	uint32_t sum = 0;
+	volatile uint32_t sink;
+
+	if (iterations == 0) return 0;
+
+	MotionGait_GetDefaults(&params);
+	params.type = type;
+	params.turnRadius = 300;
+	MotionGait_Prepare(&gait, &params);
+
+	uint32_t start = CycleCounterNow();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		MotionGait_Frame(&gait, (uint16_t)(i * 997U), pulse);
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			sum += pulse[ch];  // All four legs, or an inlined frame could solve the IK for one
+		}
+	}
+	uint32_t cycles = CycleCounterNow() - start;
+	sink = sum;
+	(void)sink;
+
+	return cycles / iterations;
+}
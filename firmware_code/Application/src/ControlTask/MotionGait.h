@@ -0,0 +1,70 @@
+/**
+ * @file    MotionGait.h
+ * @brief   Procedural creep/trot gait with fixed-point leg inverse kinematics.
+ *
+ * Each leg is a hip yaw servo carrying a horizontal coxa and a knee servo
+ * carrying the tibia. A foot target (forward offset, drop below the hip) is
+ * solved into both joint angles every frame with quarter-wave sine tables, so
+ * speed, stride, turning radius and body height can change between runs
+ * without new motion tables. Frames are fed to MotionPlayer as a MotionSource.
+ *
+ * Lengths below are in 0.1 mm; angles are in 1/4096 of a turn.
+ */
+
+#ifndef MOTION_GAIT_H
+#define MOTION_GAIT_H
+
+#include <stdint.h>
+#include "MotionPlayer.h"
+
+#define MOTION_GAIT_LEGS            4
+#define MOTION_GAIT_TURN            4096    // Angle units per full turn
+#define MOTION_GAIT_COXA            250     // Hip yaw axis to knee axis
+#define MOTION_GAIT_TIBIA           450     // Knee axis to foot
+#define MOTION_GAIT_TRACK           900     // Distance between left and right feet
+#define MOTION_GAIT_LIFT            150     // Foot clearance during swing
+#define MOTION_GAIT_STRIDE_MAX      60      // mm, keeps hips within +/-45 degrees at standing height
+#define MOTION_GAIT_SPEED_MAX       300     // mm/s
+#define MOTION_GAIT_PERIOD_MIN_MS   400     // Fastest gait cycle the servos can follow
+#define MOTION_GAIT_PERIOD_MAX_MS   8000
+#define MOTION_GAIT_SETTLE_MS       200     // Move into and out of the gait
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef enum {
+		MOTION_GAIT_CREEP,          // One leg in the air at a time, statically stable
+		MOTION_GAIT_TROT,           // Diagonal pairs swing together
+		MOTION_GAIT_TYPE_COUNT
+	} MotionGaitType;
+
+	typedef struct {
+		MotionGaitType type;
+		uint16_t speed;             // Body speed in mm/s
+		uint16_t stride;            // Foot travel per cycle in mm
+		int16_t turnRadius;         // mm, positive turns left, 0 walks straight
+		uint16_t height;            // Hip height above the ground in mm
+		uint16_t cycles;            // Gait cycles to walk, 0 until another command arrives
+	} MotionGaitParams;
+
+	typedef struct {
+		uint32_t runs;              // Gaits started
+		uint32_t periodMs;          // Cycle time of the last gait
+		uint32_t framesLast;        // Frames generated by the last gait
+		uint32_t cyclesLast;        // CPU cycles to generate the last frame
+		uint32_t cyclesMax;         // Worst frame since boot
+	} MotionGaitStats;
+
+	void MotionGait_GetDefaults(MotionGaitParams *params);
+	int32_t MotionGait_Set(const MotionGaitParams *params);
+	void MotionGait_Get(MotionGaitParams *params);
+	int32_t MotionGait_Run(void);
+	void MotionGait_GetStats(MotionGaitStats *stats);
+	uint32_t MotionGait_Benchmark(MotionGaitType type, uint32_t iterations);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_GAIT_H
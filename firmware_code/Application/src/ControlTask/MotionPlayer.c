@@ -0,0 +1,898 @@
+/**
+ * @file    MotionPlayer.c
+ * @brief   Fixed-rate keyframe interpolation engine for servo motion playback.
+ *
+ * Each table row is treated as a keyframe: the servos travel from the last
+ * commanded pose to the row's angles over the row's delay, with one PCA9685
+ * frame every MOTION_FRAME_MS. Easing curves run in Q15 integer arithmetic so
+ * the per-frame cost is a fixed handful of multiplies per servo and is
+ * recorded with CycleCounter for on-target profiling.
+ *
+ * Frame waits block on an event group instead of sleeping, so a preempting
+ * command posted mid-step stops playback at the next frame boundary at the latest.
+ */
+
+#include "MotionPlayer.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "MotionTiming.h"
+#include "MotionRecord.h"
+#include "MotionTrace.h"
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
+#include <string.h>
+
+static uint16_t currentPose[PCA9685_SERVO_CHANNELS];   // Last frame written to the servos
+static MotionEase playerEase = MOTION_EASE_IN_OUT;    // Easing applied between keyframes
+static uint16_t playerSpeed = MOTION_SPEED_ONE;        // Q8.8 playback speed of the running command
+static uint16_t slewDps[PCA9685_SERVO_CHANNELS];       // Per-servo speed limits, 0 = none
+static uint16_t slewCounts[PCA9685_SERVO_CHANNELS];    // The same limits in pulse counts per frame
+static uint16_t slewHighDps = MOTION_SLEW_HIGH_DPS;
+static uint16_t slewHighCounts;
+static uint8_t slewCap = MOTION_SLEW_CAP;
+static uint8_t slewRotor;                              // First servo offered a high-slew slot this frame
+static bool transitionPlan = true;                     // Re-time the first keyframe of each sequence
+static MotionPlayerStats playerStats;
+static uint16_t frameRecip[MOTION_RECIP_FRAMES + 1];   // MOTION_T_ONE / n, filled at init
+static EventGroupHandle_t abortGroup = NULL;           // Events that cut playback short
+static EventBits_t abortBits = 0;
+static MotionAbortCheck abortCheck = NULL;
+
+#if MOTION_FRAME_MS != 20
+#error "MOTION_FRAMES_FOR() assumes a 20 ms servo frame"
+#endif
+/** ceil(ms / 20) without a division, exact for any uint16_t step time */
+#define MOTION_FRAMES_FOR(ms) ((((uint32_t)(ms) + MOTION_FRAME_MS - 1) * 52429UL) >> 20)
+
+/** Degrees per second to pulse counts per frame, rounded */
+#define MOTION_SLEW_COUNTS(dps) \
+	((uint16_t)(((uint32_t)(dps) * (PCA9685_SERVO_MAX - PCA9685_SERVO_MIN) * MOTION_FRAME_MS + 90000UL) / 180000UL))
+
+typedef struct {
+	uint8_t highPeak;
+	uint16_t sumPeak;
+	uint32_t deferred;
+	uint32_t frames;
+} MotionSlewRecord;
+
+static int32_t MotionPlayer_Run(MotionSource *source, bool plan);
+
+_Static_assert((PCA9685_SERVO_CHANNELS & (PCA9685_SERVO_CHANNELS - 1)) == 0, "slew rotation masks the channel index");
+_Static_assert(MOTION_SETTLE_MS >= MOTION_FRAME_MS, "a scaled step must span at least one frame");
+_Static_assert(PCA9685_FRAME_US < MOTION_FRAME_MS * 1000UL, "a full servo frame must fit in one frame slot");
+
+/**
+ * @fn      void MotionPlayer_Init(const uint16_t pose[PCA9685_SERVO_CHANNELS])
+ * @brief   Sets the pose the first keyframe interpolates from.
+ * @details Also precomputes the per-frame progress increments so playback
+ *          does not divide per step, and applies the default speed limits.
+ * @param   pose - Pulse counts currently applied to channels 0-7
+ */
+void MotionPlayer_Init(const uint16_t pose[PCA9685_SERVO_CHANNELS]) {
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		currentPose[ch] = pose[ch];
+	}
+	for (int n = 1; n <= MOTION_RECIP_FRAMES; ++n) {
+		frameRecip[n] = MOTION_T_ONE / n;
+	}
+	for (uint8_t ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		MotionPlayer_SetSlewLimit(ch, MOTION_SLEW_DPS);
+	}
+	MotionPlayer_SetSlewCap(slewCap, slewHighDps);
+}
+
+/**
+ * @fn      void MotionPlayer_SetAbortSource(EventGroupHandle_t group, EventBits_t bits, MotionAbortCheck check)
+ * @brief   Selects what preempts a playing motion.
+ * @details Frame waits block on the event bits; when one is set the player
+ *          asks check() whether to stop. A NULL check aborts on any bit.
+ *          The bits are cleared by the wait, so consumers must not rely on
+ *          them staying set.
+ * @param   group - Event group to wait on, NULL to disable preemption
+ * @param   bits  - Bits that wake a frame wait
+ * @param   check - Decides whether a wake-up aborts playback, may be NULL
+ */
+void MotionPlayer_SetAbortSource(EventGroupHandle_t group, EventBits_t bits, MotionAbortCheck check) {
+	abortGroup = group;
+	abortBits = bits;
+	abortCheck = check;
+}
+
+/**
+ * @fn      static bool MotionPlayer_AbortRequested(void)
+ * @brief   Polls the abort source without blocking.
+ */
+static bool MotionPlayer_AbortRequested(void) {
+	if (abortGroup == NULL) {
+		return false;
+	}
+	if (abortCheck != NULL) {
+		return abortCheck();
+	}
+	return (xEventGroupGetBits(abortGroup) & abortBits) != 0;
+}
+
+/**
+ * @fn      static bool MotionPlayer_WaitFrame(TickType_t *lastWake, TickType_t period)
+ * @brief   Abortable equivalent of vTaskDelayUntil().
+ * @details Blocks until lastWake + period or until an abort is requested,
+ *          whichever comes first. lastWake advances by period either way,
+ *          so a late frame does not push back the ones after it.
+ * @param   lastWake - Reference time, updated to the new deadline
+ * @param   period   - Ticks from the reference time to the deadline
+ * @return  true if playback should stop
+ */
+static bool MotionPlayer_WaitFrame(TickType_t *lastWake, TickType_t period) {
+	TickType_t deadline = *lastWake + period;
+
+	*lastWake = deadline;
+	for (;;) {
+		TickType_t remaining = deadline - xTaskGetTickCount();
+		if ((int32_t)remaining < 0) {
+			remaining = 0;  // Behind schedule: only poll the abort source
+		}
+		if (abortGroup == NULL) {
+			if (remaining > 0) {
+				vTaskDelay(remaining);
+			}
+			return false;
+		}
+		if ((xEventGroupWaitBits(abortGroup, abortBits, pdTRUE, pdFALSE, remaining) & abortBits) == 0) {
+			return false;  // Deadline reached
+		}
+		if (abortCheck == NULL || abortCheck()) {
+			return true;
+		}
+		// Woken by an event that does not preempt this motion: keep waiting
+	}
+}
+
+/**
+ * @fn      void MotionPlayer_SetEase(MotionEase ease)
+ * @brief   Selects the easing curve used between keyframes.
+ * @param   ease - Easing curve
+ */
+void MotionPlayer_SetEase(MotionEase ease) {
+	if (ease < MOTION_EASE_COUNT) {
+		playerEase = ease;
+	}
+}
+
+/**
+ * @fn      MotionEase MotionPlayer_GetEase(void)
+ * @brief   Returns the easing curve used between keyframes.
+ */
+MotionEase MotionPlayer_GetEase(void) {
+	return playerEase;
+}
+
+/**
+ * @fn      void MotionPlayer_SetSpeed(uint16_t speed)
+ * @brief   Sets the playback speed for the following steps. ControlTask only.
+ * @param   speed - Q8.8 factor, clamped to MOTION_SPEED_MIN..MOTION_SPEED_MAX
+ */
+void MotionPlayer_SetSpeed(uint16_t speed) {
+	if (speed < MOTION_SPEED_MIN) speed = MOTION_SPEED_MIN;
+	if (speed > MOTION_SPEED_MAX) speed = MOTION_SPEED_MAX;
+	playerSpeed = speed;
+}
+
+/**
+ * @fn      uint16_t MotionPlayer_GetSpeed(void)
+ * @brief   Returns the Q8.8 playback speed in use.
+ */
+uint16_t MotionPlayer_GetSpeed(void) {
+	return playerSpeed;
+}
+
+/**
+ * @fn      bool MotionPlayer_ParseSpeed(const char *text, size_t len, uint16_t *speed)
+ * @brief   Parses a decimal speed factor such as "2", "1.5" or "0.75" into Q8.8.
+ * @param   text  - Digits with an optional fraction, not necessarily terminated
+ * @param   len   - Length of text
+ * @param   speed - Receives the factor, rounded to 1/256
+ * @return  false if the text is malformed or outside MOTION_SPEED_MIN..MOTION_SPEED_MAX
+ */
+bool MotionPlayer_ParseSpeed(const char *text, size_t len, uint16_t *speed) {
+	uint32_t whole = 0;
+	uint32_t frac = 0;
+	uint32_t scale = 1;
+	size_t i = 0;
+
+	for (; i < len && text[i] >= '0' && text[i] <= '9'; ++i) {
+		whole = whole * 10 + (uint32_t)(text[i] - '0');
+		if (whole > MOTION_SPEED_MAX / MOTION_SPEED_ONE) return false;
+	}
+	if (i == 0 && (i >= len || text[i] != '.')) return false;
+	if (i < len && text[i] == '.') {
+		for (++i; i < len && text[i] >= '0' && text[i] <= '9'; ++i) {
+			if (scale < 1000) {
+				frac = frac * 10 + (uint32_t)(text[i] - '0');
+				scale *= 10;
+			}
+		}
+	}
+	if (i != len) return false;
+
+	uint32_t q = whole * MOTION_SPEED_ONE + (frac * MOTION_SPEED_ONE + scale / 2) / scale;
+	if (q < MOTION_SPEED_MIN || q > MOTION_SPEED_MAX) return false;
+	*speed = (uint16_t)q;
+	return true;
+}
+
+/**
+ * @fn      static uint32_t MotionPlayer_ScaleStep(uint16_t delayMs, uint16_t speed, int32_t *carry)
+ * @brief   Re-times one step for a playback speed.
+ * @details Scaled steps are whole frames, so every frame slot is a full
+ *          MOTION_FRAME_MS; the rounding error is carried into the next step
+ *          so the sequence keeps its scaled length. Rounding never takes a
+ *          step past its table time the wrong way: faster playback never makes
+ *          it longer, slower playback never shorter. The settle clamp keeps a
+ *          step at MOTION_SETTLE_MS, or its table time if that is shorter,
+ *          floored to whole frames so it cannot exceed the step at 1.0; a step
+ *          under one frame keeps its short slot, as at 1.0. Time added by the
+ *          clamp is not taken back later.
+ * @param   carry - Scaled time not played yet, in 1/256 ms; 0 at the start of a sequence
+ * @return  Step time in ms
+ */
+static uint32_t MotionPlayer_ScaleStep(uint16_t delayMs, uint16_t speed, int32_t *carry) {
+	uint32_t settle = (delayMs < MOTION_SETTLE_MS) ? delayMs : MOTION_SETTLE_MS;
+	uint32_t minMs = (settle >= MOTION_FRAME_MS) ? MOTION_FRAMES_FOR(settle + 1 - MOTION_FRAME_MS) * MOTION_FRAME_MS : settle;  // settle floored to whole frames
+	uint32_t ms;
+
+	if (speed == MOTION_SPEED_ONE) {
+		return delayMs;
+	}
+	*carry += (int32_t)(((uint32_t)delayMs << 16) / speed);
+	int32_t frames = (*carry + (MOTION_FRAME_MS << 7)) / (MOTION_FRAME_MS << 8);
+	ms = (frames > 0) ? (uint32_t)frames * MOTION_FRAME_MS : 0;
+	if ((speed > MOTION_SPEED_ONE && ms > delayMs) || (speed < MOTION_SPEED_ONE && ms < delayMs)) {
+		ms = delayMs;
+	}
+	if (ms < minMs) {
+		ms = minMs;
+		*carry = 0;
+	} else {
+		*carry -= (int32_t)(ms << 8);
+	}
+	return ms;
+}
+
+/**
+ * @fn      void MotionPlayer_CheckSpeed(const MotionStep *motion, int steps, uint16_t speed, MotionSpeedCheck *check)
+ * @brief   Checks that every frame of a table, played at a speed, has time for its bus write.
+ * @details Re-times the table exactly like playback and compares each frame
+ *          slot (the last one of a step may be short) with a full PCA9685
+ *          frame on the bus plus the slowest interpolation tick seen so far.
+ *          Each step is also re-timed on its own at the next lower speed: a
+ *          step that plays longer at this speed than there, or than at 1.0
+ *          when speeding up, is counted in slower.
+ *          Results accumulate, so several tables can share one check; set
+ *          slotUsMin and stepMsMin to UINT32_MAX before the first call.
+ * @param   motion - Packed keyframes
+ * @param   steps  - Number of steps in the motion
+ * @param   speed  - Q8.8 playback speed
+ * @param   check  - Accumulated results
+ */
+void MotionPlayer_CheckSpeed(const MotionStep *motion, int steps, uint16_t speed, MotionSpeedCheck *check) {
+	int32_t carry = 0;
+
+	check->writeUs = PCA9685_FRAME_US + CycleCounterToUs(playerStats.kernelCyclesMax);
+	for (int i = 0; i < steps; ++i) {
+		uint32_t duration = MotionPlayer_ScaleStep(motion[i].delay_ms, speed, &carry);
+		uint32_t frames = MOTION_FRAMES_FOR(duration);
+		if (frames < 1) frames = 1;
+		int32_t alone = 0;
+		int32_t lower = 0;
+		uint32_t here = MotionPlayer_ScaleStep(motion[i].delay_ms, speed, &alone);
+		uint32_t below = (speed > MOTION_SPEED_MIN) ? MotionPlayer_ScaleStep(motion[i].delay_ms, (uint16_t)(speed - 1), &lower) : here;
+		if (here > below || (speed > MOTION_SPEED_ONE && here > motion[i].delay_ms)) check->slower++;
+		uint32_t lastSlot = (duration > MOTION_FRAME_MS * (frames - 1)) ? duration - MOTION_FRAME_MS * (frames - 1) : 0;
+		uint32_t slotUs = ((lastSlot < MOTION_FRAME_MS) ? lastSlot : MOTION_FRAME_MS) * 1000UL;
+
+		check->steps++;
+		if (duration < check->stepMsMin) check->stepMsMin = duration;
+		if (slotUs < check->slotUsMin) check->slotUsMin = slotUs;
+		if (slotUs < check->writeUs) check->overruns++;
+	}
+}
+
+/**
+ * @fn      int32_t MotionPlayer_SetSlewLimit(uint8_t channel, uint16_t degPerSec)
+ * @brief   Sets the fastest a servo may be driven; steps that would be faster are stretched.
+ * @param   channel   - Servo channel 0-7
+ * @param   degPerSec - Speed limit, 0 for none
+ * @return  ERROR_NONE, or ERROR_INVALID_ARG for a bad channel or a limit under one count per frame
+ */
+int32_t MotionPlayer_SetSlewLimit(uint8_t channel, uint16_t degPerSec) {
+	if (channel >= PCA9685_SERVO_CHANNELS || (degPerSec != 0 && MOTION_SLEW_COUNTS(degPerSec) == 0)) {
+		return ERROR_INVALID_ARG;
+	}
+	slewDps[channel] = degPerSec;
+	slewCounts[channel] = MOTION_SLEW_COUNTS(degPerSec);
+	return ERROR_NONE;
+}
+
+/**
+ * @fn      uint16_t MotionPlayer_GetSlewLimit(uint8_t channel)
+ * @brief   Returns a servo's speed limit in degrees/s, 0 if it has none.
+ */
+uint16_t MotionPlayer_GetSlewLimit(uint8_t channel) {
+	return (channel < PCA9685_SERVO_CHANNELS) ? slewDps[channel] : 0;
+}
+
+/**
+ * @fn      void MotionPlayer_SetSlewCap(uint8_t servos, uint16_t highDegPerSec)
+ * @brief   Limits how many servos may move faster than highDegPerSec in the same frame.
+ * @details Servos over the cap are held to highDegPerSec for that frame and
+ *          catch up afterwards; the slots rotate so no servo waits for long.
+ * @param   servos        - Servos allowed to slew fast at once, PCA9685_SERVO_CHANNELS for no cap
+ * @param   highDegPerSec - Speed that counts as fast, 0 disables the cap
+ */
+void MotionPlayer_SetSlewCap(uint8_t servos, uint16_t highDegPerSec) {
+	slewCap = (servos > PCA9685_SERVO_CHANNELS) ? PCA9685_SERVO_CHANNELS : servos;
+	slewHighDps = highDegPerSec;
+	slewHighCounts = MOTION_SLEW_COUNTS(highDegPerSec);
+	if (highDegPerSec != 0 && slewHighCounts == 0) {
+		slewHighCounts = 1;
+	}
+}
+
+/**
+ * @fn      void MotionPlayer_GetSlewCap(uint8_t *servos, uint16_t *highDegPerSec)
+ * @brief   Returns the high-slew cap set by MotionPlayer_SetSlewCap().
+ */
+void MotionPlayer_GetSlewCap(uint8_t *servos, uint16_t *highDegPerSec) {
+	*servos = slewCap;
+	*highDegPerSec = slewHighDps;
+}
+
+/**
+ * @fn      static int MotionPlayer_SlewFrames(const uint16_t from[PCA9685_SERVO_CHANNELS], const uint16_t to[PCA9685_SERVO_CHANNELS], int frames)
+ * @brief   Stretches a step so no servo has to beat its speed limit.
+ * @details The easing curves peak at 1.5x (in-out) and 3x (cubic) the
+ *          average speed of a step, which is taken into account.
+ * @return  Frames the step needs, at least frames
+ */
+static int MotionPlayer_SlewFrames(const uint16_t from[PCA9685_SERVO_CHANNELS], const uint16_t to[PCA9685_SERVO_CHANNELS], int frames) {
+	static const uint16_t easePeak[MOTION_EASE_COUNT] = { 256, 384, 768 };   // Peak / average speed, Q8
+	uint32_t peak = easePeak[playerEase];
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		if (slewCounts[ch] == 0) {
+			continue;
+		}
+		uint32_t dist = (uint32_t)((to[ch] > from[ch]) ? to[ch] - from[ch] : from[ch] - to[ch]);
+		uint32_t per = (uint32_t)slewCounts[ch] << 8;
+		int need = (int)((dist * peak + per - 1) / per);
+		if (need > frames) {
+			frames = need;
+		}
+	}
+	return frames;
+}
+
+/**
+ * @fn      static int MotionPlayer_TransitionFrames(uint16_t target[PCA9685_SERVO_CHANNELS], uint8_t *joints)
+ * @brief   Plans the shortest move from the current pose into a sequence's first keyframe.
+ * @details Joints already within MOTION_TRANSITION_DEADBAND of the target are
+ *          left where they are (target is rewritten to the current pulse) so
+ *          they cost no bus traffic. The moving joints get the fewest frames
+ *          that keep each under its speed limit at the easing peak, and never
+ *          faster than MOTION_SLEW_DPS, so a servo without a limit does not
+ *          snap into the pose. When more of them move than the high-slew cap
+ *          allows, the rest stay under the high-slew speed so no catch-up
+ *          frames follow.
+ * @param   target - First keyframe pulses, updated in place
+ * @param   joints - Receives the number of joints that move
+ * @return  Frames the transition needs, 0 if the pose already matches
+ */
+static int MotionPlayer_TransitionFrames(uint16_t target[PCA9685_SERVO_CHANNELS], uint8_t *joints) {
+	static const uint16_t easePeak[MOTION_EASE_COUNT] = { 256, 384, 768 };   // Peak / average speed, Q8
+	uint32_t dist[PCA9685_SERVO_CHANNELS];
+	int moving = 0;
+	int frames = 1;
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		uint32_t d = (uint32_t)((target[ch] > currentPose[ch]) ? target[ch] - currentPose[ch] : currentPose[ch] - target[ch]);
+		if (d <= MOTION_TRANSITION_DEADBAND) {
+			target[ch] = currentPose[ch];
+			continue;
+		}
+		uint16_t limit = MOTION_SLEW_COUNTS(MOTION_SLEW_DPS);
+		if (slewCounts[ch] != 0 && slewCounts[ch] < limit) {
+			limit = slewCounts[ch];
+		}
+		uint32_t per = (uint32_t)limit << 8;
+		int need = (int)((d * easePeak[playerEase] + per - 1) / per);
+		if (need > frames) {
+			frames = need;
+		}
+		// Keep the moving distances sorted, largest first
+		int i = moving++;
+		while (i > 0 && dist[i - 1] < d) {
+			dist[i] = dist[i - 1];
+			i--;
+		}
+		dist[i] = d;
+	}
+	*joints = (uint8_t)moving;
+	if (moving == 0) {
+		return 0;
+	}
+
+	if (slewHighCounts != 0 && moving > slewCap) {
+		uint32_t per = (uint32_t)slewHighCounts << 8;
+		int need = (int)((dist[slewCap] * easePeak[playerEase] + per - 1) / per);
+		if (need > frames) {
+			frames = need;
+		}
+	}
+	return frames;
+}
+
+/**
+ * @fn      void MotionPlayer_SetTransition(bool enabled)
+ * @brief   Turns the planned entry transition of each sequence on or off.
+ * @details When off, the servos move into the first keyframe over its table
+ *          time, stretched only by the speed limits, as into every other keyframe.
+ */
+void MotionPlayer_SetTransition(bool enabled) {
+	transitionPlan = enabled;
+}
+
+/**
+ * @fn      bool MotionPlayer_GetTransition(void)
+ * @brief   Returns whether entry transitions are planned.
+ */
+bool MotionPlayer_GetTransition(void) {
+	return transitionPlan;
+}
+
+/**
+ * @fn      static void MotionPlayer_Slew(const uint16_t goal[PCA9685_SERVO_CHANNELS], MotionSlewRecord *rec)
+ * @brief   Moves currentPose toward goal within the speed limits and the high-slew cap.
+ */
+static void MotionPlayer_Slew(const uint16_t goal[PCA9685_SERVO_CHANNELS], MotionSlewRecord *rec) {
+	uint8_t high = 0;
+	uint32_t sum = 0;
+
+	for (int i = 0; i < PCA9685_SERVO_CHANNELS; ++i) {
+		int ch = (slewRotor + i) & (PCA9685_SERVO_CHANNELS - 1);
+		int32_t delta = (int32_t)goal[ch] - currentPose[ch];
+		int32_t limit = slewCounts[ch];
+		if (limit != 0 && delta > limit) delta = limit;
+		if (limit != 0 && delta < -limit) delta = -limit;
+
+		int32_t mag = (delta < 0) ? -delta : delta;
+		if (slewHighCounts != 0 && mag > slewHighCounts) {
+			if (high < slewCap) {
+				high++;
+			} else {
+				delta = (delta < 0) ? -(int32_t)slewHighCounts : (int32_t)slewHighCounts;
+				mag = slewHighCounts;
+				rec->deferred++;
+			}
+		}
+		currentPose[ch] = (uint16_t)(currentPose[ch] + delta);
+		sum += (uint32_t)mag;
+	}
+	slewRotor = (uint8_t)((slewRotor + 1) & (PCA9685_SERVO_CHANNELS - 1));
+
+	if (high > rec->highPeak) rec->highPeak = high;
+	if (sum > rec->sumPeak) rec->sumPeak = (uint16_t)sum;
+}
+
+/**
+ * @fn      uint16_t MotionPlayer_Ease(MotionEase ease, uint16_t t)
+ * @brief   Evaluates an easing curve in Q15 fixed point.
+ * @param   ease - Easing curve
+ * @param   t    - Progress in [0, MOTION_T_ONE]
+ * @return  Eased progress in [0, MOTION_T_ONE]
+ */
+uint16_t MotionPlayer_Ease(MotionEase ease, uint16_t t) {
+	uint32_t t2, t3, u;
+
+	switch (ease) {
+		case MOTION_EASE_IN_OUT:
+		// t^2 * (3 - 2t)
+		t2 = ((uint32_t)t * t) >> 15;
+		return (uint16_t)((t2 * (3UL * MOTION_T_ONE - 2UL * t)) >> 15);
+
+		case MOTION_EASE_CUBIC:
+		// 4t^3 for the first half, mirrored for the second half
+		u = (t < MOTION_T_ONE / 2) ? t : (MOTION_T_ONE - t);
+		t3 = ((((uint32_t)u * u) >> 15) * u) >> 15;
+		return (uint16_t)((t < MOTION_T_ONE / 2) ? (4 * t3) : (MOTION_T_ONE - 4 * t3));
+
+		case MOTION_EASE_LINEAR:
+		default:
+		return t;
+	}
+}
+
+/**
+ * @fn      void MotionPlayer_Interpolate(const uint16_t from[], const uint16_t to[], uint16_t t, MotionEase ease, uint16_t out[])
+ * @brief   Interpolation kernel: computes one intermediate servo frame.
+ * @details One easing evaluation plus one multiply and shift per channel.
+ * @param   from - Pulse counts at the start of the step
+ * @param   to   - Pulse counts at the keyframe
+ * @param   t    - Progress in [0, MOTION_T_ONE]
+ * @param   ease - Easing curve
+ * @param   out  - Resulting pulse counts
+ */
+void MotionPlayer_Interpolate(const uint16_t from[PCA9685_SERVO_CHANNELS], const uint16_t to[PCA9685_SERVO_CHANNELS],
+                              uint16_t t, MotionEase ease, uint16_t out[PCA9685_SERVO_CHANNELS]) {
+	int32_t e = MotionPlayer_Ease(ease, t);
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		int32_t delta = (int32_t)to[ch] - (int32_t)from[ch];
+		out[ch] = (uint16_t)(from[ch] + ((delta * e) >> 15));
+	}
+}
+
+typedef struct {
+	MotionSource base;
+	const MotionStep *steps;
+	int count;
+	int index;
+} MotionTableSource;
+
+/**
+ * @fn      static bool MotionPlayer_TableNext(MotionSource *source, MotionStep *step)
+ * @brief   MotionSource callback walking a keyframe table in memory.
+ */
+static bool MotionPlayer_TableNext(MotionSource *source, MotionStep *step) {
+	MotionTableSource *table = (MotionTableSource *)source;
+
+	if (table->index >= table->count) {
+		return false;
+	}
+	*step = table->steps[table->index++];
+	return true;
+}
+
+/**
+ * @fn      int32_t MotionPlayer_Play(const MotionStep *motion, int steps)
+ * @brief   Plays a motion table with interpolation at the servo frame rate.
+ * @param   motion - Packed keyframes
+ * @param   steps  - Number of steps in the motion
+ * @return  0 on success, ERROR_ABORTED if preempted, otherwise the last I2C error
+ */
+int32_t MotionPlayer_Play(const MotionStep *motion, int steps) {
+	MotionTableSource table = { { MotionPlayer_TableNext, NULL }, motion, steps, 0 };
+
+	return MotionPlayer_PlaySource(&table.base);
+}
+
+/**
+ * @fn      int32_t MotionPlayer_PlayTimed(const MotionStep *motion, int steps)
+ * @brief   Plays a motion table without an entry transition.
+ * @details For moves whose timing was chosen by the user (jog), where the
+ *          servos must reach the keyframe in the step's own time.
+ * @return  Same as MotionPlayer_Play()
+ */
+int32_t MotionPlayer_PlayTimed(const MotionStep *motion, int steps) {
+	MotionTableSource table = { { MotionPlayer_TableNext, NULL }, motion, steps, 0 };
+
+	return MotionPlayer_Run(&table.base, false);
+}
+
+/**
+ * @fn      static void MotionPlayer_RecordBus(const PCA9685BusStats *before)
+ * @brief   Stores the servo bus bytes used since the sequence started.
+ * @param   before - Bus counters taken at the start of the sequence
+ */
+static void MotionPlayer_RecordBus(const PCA9685BusStats *before) {
+	PCA9685BusStats after;
+
+	pca9685_get_bus_stats(&after);
+	playerStats.busBytesLast = after.bytesSent - before->bytesSent;
+	playerStats.busBytesFullLast = after.bytesFull - before->bytesFull;
+}
+
+/**
+ * @fn      static void MotionPlayer_RecordSlew(const MotionSlewRecord *rec)
+ * @brief   Stores the slew peaks of the sequence that just ended.
+ */
+static void MotionPlayer_RecordSlew(const MotionSlewRecord *rec) {
+	playerStats.slewHighPeakLast = rec->highPeak;
+	playerStats.slewSumPeakLast = rec->sumPeak;
+	playerStats.slewDeferredLast = rec->deferred;
+	playerStats.slewFramesLast = rec->frames;
+}
+
+/**
+ * @fn      static void MotionPlayer_EndTrace(bool dryRun, const uint16_t heldPose[PCA9685_SERVO_CHANNELS])
+ * @brief   Ends a sequence trace; after a dry run the pose goes back to what the servos hold.
+ */
+static void MotionPlayer_EndTrace(bool dryRun, const uint16_t heldPose[PCA9685_SERVO_CHANNELS]) {
+	MotionTrace_End();
+	if (dryRun) {
+		memcpy(currentPose, heldPose, sizeof(currentPose));
+	}
+}
+
+/**
+ * @fn      static int MotionPlayer_PlanEntry(const MotionStep *first, MotionStep *entry)
+ * @brief   Plans the transition segment played before a sequence's first keyframe.
+ * @details The entry keyframe holds the first pose (minus the joints already
+ *          in place) and the planned transition time; the first keyframe
+ *          then plays with its own table time, so its dwell is kept.
+ *          transitionSavedMs compares when the first pose is reached with
+ *          the time moving into it over the first step would take.
+ * @param   first - First keyframe of the sequence
+ * @param   entry - Receives the transition segment
+ * @return  Frames of the transition, 0 if the servos already hold the first pose
+ */
+static int MotionPlayer_PlanEntry(const MotionStep *first, MotionStep *entry) {
+	uint8_t joints;
+	int arrival = MotionPlayer_SlewFrames(currentPose, first->pulse, (int)MOTION_FRAMES_FOR(first->delay_ms)) * MOTION_FRAME_MS;
+
+	*entry = *first;
+	int frames = MotionPlayer_TransitionFrames(entry->pulse, &joints);
+	entry->delay_ms = (uint16_t)(frames * MOTION_FRAME_MS);
+	playerStats.transitions++;
+	playerStats.transitionMsLast = entry->delay_ms;
+	playerStats.transitionJointsLast = joints;
+	playerStats.transitionSavedMs += arrival - (int)entry->delay_ms;
+	return frames;
+}
+
+/**
+ * @fn      int32_t MotionPlayer_PlaySource(MotionSource *source)
+ * @brief   Plays keyframes pulled from a source, entering through a planned transition.
+ * @details See MotionPlayer_Run(); the transition is planned unless turned off
+ *          with MotionPlayer_SetTransition().
+ * @param   source - Keyframe source
+ * @return  0 on success, ERROR_ABORTED if preempted, otherwise the last I2C error
+ */
+int32_t MotionPlayer_PlaySource(MotionSource *source) {
+	return MotionPlayer_Run(source, transitionPlan);
+}
+
+/**
+ * @fn      static int32_t MotionPlayer_Run(MotionSource *source, bool plan)
+ * @brief   Plays keyframes pulled from a source with interpolation at the servo frame rate.
+ * @details Each keyframe moves from the current pose to its pulse counts over
+ *          its delay. Frames are paced against absolute deadlines so bus time
+ *          does not accumulate as drift; the final frame of a step absorbs any
+ *          remainder that is not a whole frame. Keyframes are already pulse
+ *          counts, so nothing is divided on the way to the bus. At a speed
+ *          other than MOTION_SPEED_ONE each step is re-timed to whole frames
+ *          as it is pulled (see MotionPlayer_ScaleStep()); tables stay as they are.
+ *          How late each frame starts, and whether a completed sequence fits
+ *          the sum of its step times, is recorded in MotionTiming.
+ *          The source's prefetch hook runs right after each frame is written,
+ *          inside the slack before the next deadline, so slow sources (SD card)
+ *          do not shift frame timing as long as they fit in that slack.
+ *          If an abort is requested the motion stops after the frame being
+ *          waited on, leaving the servos at the last interpolated pose.
+ *          With plan set, a transition segment from the pose the servos are
+ *          actually in is played before the first keyframe (see
+ *          MotionPlayer_PlanEntry()); tables are written for a robot standing
+ *          in their first pose, which it often is not. The transition is not
+ *          speed scaled and is left out when the pose already matches.
+ * @param   source - Keyframe source
+ * @param   plan   - Plan the entry transition
+ * @return  0 on success, ERROR_ABORTED if preempted, otherwise the last I2C error
+ */
+static int32_t MotionPlayer_Run(MotionSource *source, bool plan) {
+	uint16_t from[PCA9685_SERVO_CHANNELS];
+	uint16_t goal[PCA9685_SERVO_CHANNELS];
+	MotionStep step;
+	MotionStep entry;                 // Transition segment played before the first keyframe
+	bool entering = false;
+	bool pulled = false;              // step holds a keyframe not played yet
+	TickType_t lastWake = xTaskGetTickCount();
+	uint32_t sequenceStart = CycleCounterAtTick(lastWake);
+	uint32_t budgetMs = 0;
+	int32_t error = 0;
+	int32_t carry = 0;
+	PCA9685BusStats bus;
+	MotionSlewRecord slew = { 0 };
+	uint16_t heldPose[PCA9685_SERVO_CHANNELS];
+
+	if (MotionPlayer_AbortRequested()) {
+		playerStats.aborts++;
+		return ERROR_ABORTED;
+	}
+
+	pca9685_get_bus_stats(&bus);
+	bool dryRun = MotionTrace_Begin();
+	memcpy(heldPose, currentPose, sizeof(heldPose));
+	MotionRecord_Sample(currentPose, lastWake - pdMS_TO_TICKS(MOTION_FRAME_MS));  // Pose held until now
+	if (plan && source->next(source, &step)) {
+		pulled = true;
+		entering = MotionPlayer_PlanEntry(&step, &entry) > 0;
+	}
+	while (entering || pulled || source->next(source, &step)) {
+		const MotionStep *seg = entering ? &entry : &step;
+		int duration;
+		if (entering) {
+			duration = entry.delay_ms;  // Planned in whole frames at the speed limits
+			entering = false;
+		} else {
+			duration = (int)MotionPlayer_ScaleStep(step.delay_ms, playerSpeed, &carry);
+			pulled = false;
+		}
+		int frames = (int)MOTION_FRAMES_FOR(duration);
+		if (frames < 1) frames = 1;
+
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			from[ch] = currentPose[ch];
+		}
+
+		// Too fast for a servo's limit: spread the step over more (whole) frames
+		int needed = MotionPlayer_SlewFrames(from, seg->pulse, frames);
+		if (needed > frames) {
+			slew.frames += (uint32_t)(needed - frames);
+			frames = needed;
+			duration = frames * MOTION_FRAME_MS;
+		}
+		budgetMs += duration;
+
+		uint16_t tStep = (frames <= MOTION_RECIP_FRAMES) ? frameRecip[frames] : (uint16_t)(MOTION_T_ONE / frames);
+		uint16_t t = 0;
+		int k;
+		for (k = 1; ; ++k) {
+			// Past the last frame only servos held back by the high-slew cap are still moving
+			bool catchUp = k > frames;
+			if (!catchUp) {
+				t = (k == frames) ? MOTION_T_ONE : (uint16_t)(t + tStep);
+			}
+
+			// lastWake is this frame's deadline; a late wake-up shows up here, not as drift
+			uint32_t start = CycleCounterNow();
+			MotionTiming_RecordFrame(CycleCounterToUs(start - CycleCounterAtTick(lastWake)));
+
+			MotionPlayer_Interpolate(from, seg->pulse, t, playerEase, goal);
+			MotionPlayer_Slew(goal, &slew);
+			playerStats.kernelCyclesLast = CycleCounterNow() - start;
+			if (playerStats.kernelCyclesLast > playerStats.kernelCyclesMax) {
+				playerStats.kernelCyclesMax = playerStats.kernelCyclesLast;
+			}
+
+			int32_t result = pca9685_set_frame(currentPose);
+			MotionRecord_Sample(currentPose, lastWake);
+			playerStats.frames++;
+			if (result != 0) {
+				playerStats.frameErrors++;
+				error = result;
+			}
+
+			if (source->prefetch != NULL) {
+				source->prefetch(source);
+			}
+			pca9685_health_poll();  // Brownout readback, also in the slack before the next deadline
+
+			int wait = (k != frames) ? MOTION_FRAME_MS : duration - MOTION_FRAME_MS * (frames - 1);
+			if (wait < 0) wait = 0;
+			if (catchUp) {
+				slew.frames++;
+				budgetMs += MOTION_FRAME_MS;
+			}
+			if (MotionPlayer_WaitFrame(&lastWake, pdMS_TO_TICKS(wait))) {
+				playerStats.aborts++;
+				MotionPlayer_RecordBus(&bus);
+				MotionPlayer_RecordSlew(&slew);
+				MotionPlayer_EndTrace(dryRun, heldPose);
+				return ERROR_ABORTED;
+			}
+			if (k >= frames && memcmp(currentPose, seg->pulse, sizeof(currentPose)) == 0) {
+				break;
+			}
+		}
+		MotionTrace_Step((uint32_t)duration, k);
+	}
+
+	MotionTiming_RecordSequence(budgetMs * 1000UL, CycleCounterToUs(CycleCounterNow() - sequenceStart));
+	MotionPlayer_RecordBus(&bus);
+	MotionPlayer_RecordSlew(&slew);
+	MotionPlayer_EndTrace(dryRun, heldPose);
+	return error;
+}
+
+/**
+ * @fn      void MotionPlayer_GetPose(uint16_t pose[PCA9685_SERVO_CHANNELS])
+ * @brief   Copies the last frame written to the servos. Call from the playing task.
+ * @param   pose - Receives pulse counts for channels 0-7
+ */
+void MotionPlayer_GetPose(uint16_t pose[PCA9685_SERVO_CHANNELS]) {
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		pose[ch] = currentPose[ch];
+	}
+}
+
+/**
+ * @fn      void MotionPlayer_GetStats(MotionPlayerStats *stats)
+ * @brief   Copies the playback counters.
+ * @param   stats - Destination structure
+ */
+void MotionPlayer_GetStats(MotionPlayerStats *stats) {
+	*stats = playerStats;
+}
+
+/**
+ * @fn      uint32_t MotionPlayer_Benchmark(MotionEase ease, uint32_t iterations)
+ * @brief   Measures the interpolation kernel on the target.
+ * @details Runs the kernel across a full 0..180 degree sweep on every channel
+ *          without touching the bus.
+ * @param   ease       - Easing curve to benchmark
+ * @param   iterations - Number of kernel invocations
+ * @return  Average CPU cycles per kernel invocation
+ */
+uint32_t MotionPlayer_Benchmark(MotionEase ease, uint32_t iterations) {
+	uint16_t from[PCA9685_SERVO_CHANNELS];
+	uint16_t to[PCA9685_SERVO_CHANNELS];
+	uint16_t out[PCA9685_SERVO_CHANNELS];
+	volatile uint16_t lo = PCA9685_SERVO_MIN;  // Read at run time like a pose, not folded into the kernel
+	volatile uint16_t hi = PCA9685_SERVO_MAX;
+	uint32_t sum = 0;
+	volatile uint32_t sink;
+
+	if (iterations == 0) return 0;
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		from[ch] = lo;
+		to[ch] = hi;
+	}
+
+	uint32_t start = CycleCounterNow();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		MotionPlayer_Interpolate(from, to, (uint16_t)(i & (MOTION_T_ONE - 1)), ease, out);
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			sum += out[ch];  // Use every channel, or an inlined kernel is cut down to the one kept
+		}
+	}
+	uint32_t cycles = CycleCounterNow() - start;
+	sink = sum;
+	(void)sink;
+
+	return cycles / iterations;
+}
+
+/**
+ * @fn      void MotionPlayer_BenchmarkDecode(uint32_t iterations, uint32_t *mapCycles, uint32_t *packedCycles)
+ * @brief   Compares keyframe decode cost of angle tables against packed steps.
+ * @details The angle path runs pca9685_angle_to_pulse() (runtime map() division)
+ *          on 8 servos; the packed path copies 8 precomputed pulse counts.
+ * @param   iterations   - Number of keyframes to decode per path
+ * @param   mapCycles    - Average cycles per keyframe through map()
+ * @param   packedCycles - Average cycles per keyframe from a MotionStep
+ */
+void MotionPlayer_BenchmarkDecode(uint32_t iterations, uint32_t *mapCycles, uint32_t *packedCycles) {
+	static const int angleStep[9] = {140, 90, 90, 40, 40, 90, 90, 140, 50};
+	static const MotionStep packedStep = MOTION_STEP(140, 90, 90, 40, 40, 90, 90, 140, 50);
+	volatile const int *angles = angleStep;
+	volatile const MotionStep *packed = &packedStep;
+	uint16_t out[PCA9685_SERVO_CHANNELS];
+	uint32_t sum = 0;
+	volatile uint32_t sink;
+
+	if (iterations == 0) return;
+
+	uint32_t start = CycleCounterNow();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			out[ch] = pca9685_angle_to_pulse(angles[ch]);
+		}
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			sum += out[ch];  // Every channel, so neither path is cut down to the one kept
+		}
+	}
+	*mapCycles = (CycleCounterNow() - start) / iterations;
+
+	start = CycleCounterNow();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			out[ch] = packed->pulse[ch];
+		}
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			sum += out[ch];
+		}
+	}
+	*packedCycles = (CycleCounterNow() - start) / iterations;
+	sink = sum;
+	(void)sink;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file    MotionPlayer.h
+ * @brief   Fixed-rate keyframe interpolation engine for servo motion playback.
+ *
+ * Plays motion tables as keyframes and generates intermediate PCA9685 frames
+ * at the servo refresh rate using integer easing curves (no FPU on the M0+).
+ */
+
+#ifndef MOTION_PLAYER_H
+#define MOTION_PLAYER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "PCA9685.h"
+#include "FreeRTOS.h"
+#include "event_groups.h"
+
+#define MOTION_FRAME_MS     (1000 / PCA9685_FREQ)   // One servo frame per PWM period (20 ms)
+#define MOTION_T_ONE        32768                   // 1.0 in the Q15 interpolation parameter
+#define MOTION_RECIP_FRAMES 64                      // Steps up to this many frames avoid a division
+#define MOTION_SPEED_ONE    256                     // 1.0 in the Q8.8 playback speed
+#define MOTION_SPEED_MIN    64                      // 0.25x
+#define MOTION_SPEED_MAX    1024                    // 4x
+#define MOTION_SETTLE_MS    60                      // Shortest step a faster playback may produce (whole frames, never past the table time)
+#define MOTION_SLEW_DPS     600                     // Default per-servo speed limit in degrees/s (0 = none)
+#define MOTION_SLEW_HIGH_DPS 300                    // Default speed above which a servo counts as high-slew
+#define MOTION_SLEW_CAP     4                       // Default number of servos allowed to slew fast at once
+#define MOTION_TRANSITION_DEADBAND 2                // Joints this close to a sequence's first pose are not moved into it
+
+/**
+ * Converts an angle literal to a PCA9685 OFF count at compile time.
+ * Same mapping as pca9685_angle_to_pulse(), clamped to [PCA9685_SERVO_MIN, PCA9685_SERVO_MAX].
+ */
+#define MOTION_PULSE(angle) \
+	((uint16_t)(PCA9685_SERVO_MIN + (((angle) < 0 ? 0 : (angle) > 180 ? 180 : (angle)) * (PCA9685_SERVO_MAX - PCA9685_SERVO_MIN)) / 180))
+
+/** Packs one keyframe (8 servo angles + step time in ms) into a MotionStep initializer. */
+#define MOTION_STEP(a0, a1, a2, a3, a4, a5, a6, a7, ms) \
+	{ { MOTION_PULSE(a0), MOTION_PULSE(a1), MOTION_PULSE(a2), MOTION_PULSE(a3), \
+	    MOTION_PULSE(a4), MOTION_PULSE(a5), MOTION_PULSE(a6), MOTION_PULSE(a7) }, (ms) }
+
+/** Number of steps in a MotionStep table visible in the current translation unit. */
+#define MOTION_STEP_COUNT(table) (sizeof(table) / sizeof((table)[0]))
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef enum {
+		MOTION_EASE_LINEAR,     // Constant velocity
+		MOTION_EASE_IN_OUT,     // Smoothstep 3t^2 - 2t^3
+		MOTION_EASE_CUBIC,      // Cubic ease-in-out
+		MOTION_EASE_COUNT
+	} MotionEase;
+
+	/** Returns true if the motion being played should stop. */
+	typedef bool (*MotionAbortCheck)(void);
+
+	/** One packed keyframe: pulse counts for channels 0-7 and the step time. */
+	typedef struct {
+		uint16_t pulse[PCA9685_SERVO_CHANNELS];  // PCA9685 OFF counts, already clamped
+		uint16_t delay_ms;                       // Time to reach the keyframe
+	} MotionStep;
+
+	/**
+	 * Pull-based keyframe source for MotionPlayer_PlaySource().
+	 * Embed as the first member of a larger struct to carry source state.
+	 */
+	typedef struct MotionSource MotionSource;
+	struct MotionSource {
+		bool (*next)(MotionSource *source, MotionStep *step);  // Copies the next keyframe, false at the end
+		void (*prefetch)(MotionSource *source);                // Work done between frames, may be NULL
+	};
+
+	typedef struct {
+		uint32_t frames;            // Frames written to the PCA9685
+		uint32_t frameErrors;       // Frame writes that failed on the bus
+		uint32_t kernelCyclesLast;  // Cycles of the last interpolation tick
+		uint32_t kernelCyclesMax;   // Worst-case cycles of one interpolation tick
+		uint32_t aborts;            // Motions cut short by an abort request
+		uint32_t busBytesLast;      // Servo bus bytes sent by the last sequence
+		uint32_t busBytesFullLast;  // Bytes the same sequence would have sent as full frames
+		uint32_t slewHighPeakLast;  // Most servos slewing fast in one frame of the last sequence
+		uint32_t slewSumPeakLast;   // Largest summed movement of one frame, in pulse counts
+		uint32_t slewDeferredLast;  // Servo frames the cap slowed down in the last sequence
+		uint32_t slewFramesLast;    // Frames added to the last sequence by the speed limits
+		uint32_t transitions;       // Sequences entered through a planned transition
+		uint32_t transitionMsLast;  // Planned entry time of the last one, 0 if it was already in pose
+		uint32_t transitionJointsLast;  // Joints that entry moved
+		int32_t transitionSavedMs;  // First pose reached earlier than over the (stretched) first step, all sequences
+	} MotionPlayerStats;
+
+	typedef struct {
+		uint32_t steps;             // Steps checked
+		uint32_t overruns;          // Frame slots shorter than a frame write
+		uint32_t stepMsMin;         // Shortest step after scaling
+		uint32_t slotUsMin;         // Shortest frame slot after scaling
+		uint32_t writeUs;           // Worst frame write: full bus frame plus the slowest kernel tick
+		uint32_t slower;            // Steps longer than at the next lower speed (or at 1.0 when speeding up)
+	} MotionSpeedCheck;
+
+	void MotionPlayer_Init(const uint16_t pose[PCA9685_SERVO_CHANNELS]);
+	void MotionPlayer_SetAbortSource(EventGroupHandle_t group, EventBits_t bits, MotionAbortCheck check);
+	void MotionPlayer_SetEase(MotionEase ease);
+	MotionEase MotionPlayer_GetEase(void);
+	void MotionPlayer_SetSpeed(uint16_t speed);
+	uint16_t MotionPlayer_GetSpeed(void);
+	bool MotionPlayer_ParseSpeed(const char *text, size_t len, uint16_t *speed);
+	void MotionPlayer_CheckSpeed(const MotionStep *motion, int steps, uint16_t speed, MotionSpeedCheck *check);
+	int32_t MotionPlayer_SetSlewLimit(uint8_t channel, uint16_t degPerSec);
+	uint16_t MotionPlayer_GetSlewLimit(uint8_t channel);
+	void MotionPlayer_SetSlewCap(uint8_t servos, uint16_t highDegPerSec);
+	void MotionPlayer_GetSlewCap(uint8_t *servos, uint16_t *highDegPerSec);
+	void MotionPlayer_SetTransition(bool enabled);
+	bool MotionPlayer_GetTransition(void);
+	int32_t MotionPlayer_Play(const MotionStep *motion, int steps);
+	int32_t MotionPlayer_PlayTimed(const MotionStep *motion, int steps);
+	int32_t MotionPlayer_PlaySource(MotionSource *source);
+	uint16_t MotionPlayer_Ease(MotionEase ease, uint16_t t);
+	void MotionPlayer_Interpolate(const uint16_t from[PCA9685_SERVO_CHANNELS], const uint16_t to[PCA9685_SERVO_CHANNELS],
+	                              uint16_t t, MotionEase ease, uint16_t out[PCA9685_SERVO_CHANNELS]);
+	void MotionPlayer_GetPose(uint16_t pose[PCA9685_SERVO_CHANNELS]);
+	void MotionPlayer_GetStats(MotionPlayerStats *stats);
+	uint32_t MotionPlayer_Benchmark(MotionEase ease, uint32_t iterations);
+	void MotionPlayer_BenchmarkDecode(uint32_t iterations, uint32_t *mapCycles, uint32_t *packedCycles);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_PLAYER_H
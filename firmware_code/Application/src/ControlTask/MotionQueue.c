@@ -0,0 +1,280 @@
+/**
+ * @file    MotionQueue.c
+ * @brief   Prioritized motion command queue feeding ControlTask.
+ *
+ * Each priority class has a small ring of pending RobotState commands guarded
+ * by a critical section; an event group wakes ControlTask when something is
+ * posted. A repeat of the last command in a class (or of the running command)
+ * is coalesced instead of queued, and a full class rejects the new command and
+ * counts the drop. Posting into a class above the running one makes
+ * MotionQueue_PreemptPending() true, which the motion player polls at every
+ * frame wait.
+ */
+
+#include "MotionQueue.h"
+#include "MotionPlayer.h"
+#include "task.h"
+
+typedef struct {
+	RobotState state[MOTION_QUEUE_DEPTH];
+	uint16_t speed[MOTION_QUEUE_DEPTH];
+	uint8_t head;
+	uint8_t count;
+} MotionRing;
+
+static MotionRing rings[MOTION_CLASS_COUNT];
+static EventGroupHandle_t queueEvents = NULL;
+static MotionClass activeClass = MOTION_CLASS_COUNT;    // MOTION_CLASS_COUNT while nothing is running
+static volatile RobotState activeState = STATE_IDLE;
+static uint16_t activeSpeed = MOTION_SPEED_ONE;
+static MotionQueueStats queueStats;
+
+/**
+ * @fn      bool MotionQueue_Init(void)
+ * @brief   Creates the event group used to wake the consumer.
+ * @details Commands posted before this call are kept and picked up by the
+ *          first MotionQueue_Receive().
+ * @return  true on success
+ */
+bool MotionQueue_Init(void) {
+	if (queueEvents == NULL) {
+		queueEvents = xEventGroupCreate();
+	}
+	return queueEvents != NULL;
+}
+
+/**
+ * @fn      static uint32_t MotionQueue_TotalDepth(void)
+ * @brief   Sums pending commands over all classes. Call inside a critical section.
+ */
+static uint32_t MotionQueue_TotalDepth(void) {
+	uint32_t depth = 0;
+	for (int c = 0; c < MOTION_CLASS_COUNT; ++c) {
+		depth += rings[c].count;
+	}
+	return depth;
+}
+
+/**
+ * @fn      BaseType_t MotionQueue_Post(RobotState state, MotionClass cls)
+ * @brief   Queues a motion command at normal speed. Task context only.
+ * @param   state - Motion to play
+ * @param   cls   - Priority class of the producer
+ * @return  pdPASS if queued or coalesced, errQUEUE_FULL if the class is full
+ */
+BaseType_t MotionQueue_Post(RobotState state, MotionClass cls) {
+	return MotionQueue_PostSpeed(state, cls, MOTION_SPEED_ONE);
+}
+
+/**
+ * @fn      BaseType_t MotionQueue_PostSpeed(RobotState state, MotionClass cls, uint16_t speed)
+ * @brief   Queues a motion command played at a speed factor. Task context only.
+ * @details A queued repeat takes the new speed; a repeat of the running
+ *          motion is only coalesced if the speed is the same.
+ * @param   state - Motion to play
+ * @param   cls   - Priority class of the producer
+ * @param   speed - Q8.8 playback speed (MOTION_SPEED_ONE for table timing)
+ * @return  pdPASS if queued or coalesced, errQUEUE_FULL if the class is full
+ */
+BaseType_t MotionQueue_PostSpeed(RobotState state, MotionClass cls, uint16_t speed) {
+	BaseType_t result = pdPASS;
+
+	if (cls >= MOTION_CLASS_COUNT) {
+		return pdFAIL;
+	}
+
+	taskENTER_CRITICAL();
+	MotionRing *ring = &rings[cls];
+	uint8_t tail = (uint8_t)((ring->head + ring->count - 1) % MOTION_QUEUE_DEPTH);
+	bool repeatsTail = ring->count > 0 && ring->state[tail] == state;
+	// States past STATE_COUNT take their payload from elsewhere (file name, program), so a
+	// repeat of the running one is new work; queued repeats still share the latest payload
+	bool repeatsActive = ring->count == 0 && activeClass == cls && activeState == state && state < STATE_COUNT
+	                     && activeSpeed == speed;
+
+	if (repeatsTail) {
+		ring->speed[tail] = speed;
+		queueStats.coalesced++;
+	} else if (repeatsActive) {
+		queueStats.coalesced++;
+	} else if (ring->count >= MOTION_QUEUE_DEPTH) {
+		queueStats.dropped[cls]++;
+		result = errQUEUE_FULL;
+	} else {
+		ring->state[(ring->head + ring->count) % MOTION_QUEUE_DEPTH] = state;
+		ring->speed[(ring->head + ring->count) % MOTION_QUEUE_DEPTH] = speed;
+		ring->count++;
+		queueStats.posted++;
+
+		uint32_t depth = MotionQueue_TotalDepth();
+		if (depth > queueStats.depthMax) {
+			queueStats.depthMax = (uint8_t)depth;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	if (result == pdPASS && queueEvents != NULL) {
+		xEventGroupSetBits(queueEvents, MOTION_QUEUE_EVT_POSTED);
+	}
+	return result;
+}
+
+/**
+ * @fn      BaseType_t MotionQueue_Receive(MotionCommand *cmd, TickType_t timeout)
+ * @brief   Takes the highest-priority pending command and marks it running.
+ * @details Within a class commands come out in the order they were posted.
+ * @param   cmd     - Receives the command
+ * @param   timeout - Ticks to block while the queue is empty
+ * @return  pdPASS if a command was taken, errQUEUE_EMPTY on timeout
+ */
+BaseType_t MotionQueue_Receive(MotionCommand *cmd, TickType_t timeout) {
+	TickType_t start = xTaskGetTickCount();
+
+	for (;;) {
+		bool found = false;
+
+		taskENTER_CRITICAL();
+		for (int c = 0; c < MOTION_CLASS_COUNT; ++c) {
+			MotionRing *ring = &rings[c];
+			if (ring->count > 0) {
+				cmd->state = ring->state[ring->head];
+				cmd->cls = (MotionClass)c;
+				cmd->speed = ring->speed[ring->head];
+				ring->head = (ring->head + 1) % MOTION_QUEUE_DEPTH;
+				ring->count--;
+				activeClass = cmd->cls;
+				activeState = cmd->state;
+				activeSpeed = cmd->speed;
+				found = true;
+				break;
+			}
+		}
+		taskEXIT_CRITICAL();
+
+		if (found) {
+			return pdPASS;
+		}
+
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (queueEvents == NULL || elapsed >= timeout) {
+			return errQUEUE_EMPTY;
+		}
+		xEventGroupWaitBits(queueEvents, MOTION_QUEUE_EVT_POSTED, pdTRUE, pdFALSE,
+		                    (timeout == portMAX_DELAY) ? portMAX_DELAY : timeout - elapsed);
+	}
+}
+
+/**
+ * @fn      void MotionQueue_Complete(bool preempted)
+ * @brief   Marks the running command as finished.
+ * @param   preempted - true if the motion was cut short by a higher class
+ */
+void MotionQueue_Complete(bool preempted) {
+	taskENTER_CRITICAL();
+	if (preempted) {
+		queueStats.preemptions++;
+	}
+	activeClass = MOTION_CLASS_COUNT;
+	activeState = STATE_IDLE;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      bool MotionQueue_PreemptPending(void)
+ * @brief   Checks whether a command above the running command's class is waiting.
+ * @return  true if the running motion should stop
+ */
+bool MotionQueue_PreemptPending(void) {
+	bool pending = false;
+
+	taskENTER_CRITICAL();
+	for (int c = 0; c < (int)activeClass && c < MOTION_CLASS_COUNT; ++c) {
+		if (rings[c].count > 0) {
+			pending = true;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+	return pending;
+}
+
+/**
+ * @fn      bool MotionQueue_WaitPreempt(TickType_t timeout)
+ * @brief   Sleeps until the timeout or until a preempting command arrives.
+ * @param   timeout - Ticks to wait
+ * @return  true if woken by a preempting command
+ */
+bool MotionQueue_WaitPreempt(TickType_t timeout) {
+	TickType_t start = xTaskGetTickCount();
+
+	for (;;) {
+		if (MotionQueue_PreemptPending()) {
+			return true;
+		}
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (queueEvents == NULL || elapsed >= timeout) {
+			return false;
+		}
+		xEventGroupWaitBits(queueEvents, MOTION_QUEUE_EVT_POSTED, pdTRUE, pdFALSE, timeout - elapsed);
+	}
+}
+
+/**
+ * @fn      bool MotionQueue_Idle(void)
+ * @brief   Checks that no command is running or waiting.
+ * @details Unlike MotionQueue_GetActiveState(), which also reads STATE_IDLE
+ *          while the standby motion plays.
+ * @return  true if ControlTask has nothing to play
+ */
+bool MotionQueue_Idle(void) {
+	bool idle;
+
+	taskENTER_CRITICAL();
+	idle = activeClass == MOTION_CLASS_COUNT;
+	for (int c = 0; c < MOTION_CLASS_COUNT && idle; ++c) {
+		idle = rings[c].count == 0;
+	}
+	taskEXIT_CRITICAL();
+	return idle;
+}
+
+/**
+ * @fn      RobotState MotionQueue_GetActiveState(void)
+ * @brief   Returns the motion being played, STATE_IDLE when at rest.
+ */
+RobotState MotionQueue_GetActiveState(void) {
+	return activeState;
+}
+
+/**
+ * @fn      EventGroupHandle_t MotionQueue_GetEventGroup(void)
+ * @brief   Returns the event group that carries MOTION_QUEUE_EVT_POSTED.
+ */
+EventGroupHandle_t MotionQueue_GetEventGroup(void) {
+	return queueEvents;
+}
+
+/**
+ * @fn      uint32_t MotionQueue_Depth(void)
+ * @brief   Returns the number of pending commands over all classes.
+ */
+uint32_t MotionQueue_Depth(void) {
+	taskENTER_CRITICAL();
+	uint32_t depth = MotionQueue_TotalDepth();
+	taskEXIT_CRITICAL();
+	return depth;
+}
+
+/**
+ * @fn      void MotionQueue_GetStats(MotionQueueStats *stats)
+ * @brief   Copies the queue counters and current per-class depth.
+ * @param   stats - Destination structure
+ */
+void MotionQueue_GetStats(MotionQueueStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = queueStats;
+	for (int c = 0; c < MOTION_CLASS_COUNT; ++c) {
+		stats->depth[c] = rings[c].count;
+	}
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,68 @@
+/**
+ * @file    MotionQueue.h
+ * @brief   Prioritized motion command queue feeding ControlTask.
+ *
+ * Producers (CLI, MQTT, gestures, safety logic) post RobotState commands in a
+ * priority class instead of writing a shared state variable. ControlTask
+ * blocks on the queue, runs the highest-priority pending command, and is
+ * preempted when a command of a higher class arrives.
+ */
+
+#ifndef MOTION_QUEUE_H
+#define MOTION_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FreeRTOS.h"
+#include "event_groups.h"
+#include "ControlTask.h"
+
+#define MOTION_QUEUE_DEPTH          4           // Commands held per priority class
+#define MOTION_QUEUE_EVT_POSTED     (1 << 0)    // Set whenever a command is queued
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	/** Priority classes, highest first. A higher class preempts a running lower one. */
+	typedef enum {
+		MOTION_CLASS_SAFETY,    // Obstacle avoidance
+		MOTION_CLASS_USER,      // CLI, MQTT and touch commands
+		MOTION_CLASS_GESTURE,   // APDS9960 gestures
+		MOTION_CLASS_IDLE,      // Return to standby
+		MOTION_CLASS_COUNT
+	} MotionClass;
+
+	typedef struct {
+		RobotState state;
+		MotionClass cls;
+		uint16_t speed;         // Q8.8 playback speed, MOTION_SPEED_ONE unless posted with one
+	} MotionCommand;
+
+	typedef struct {
+		uint32_t posted;                        // Commands accepted
+		uint32_t coalesced;                     // Repeats merged into the queued command
+		uint32_t dropped[MOTION_CLASS_COUNT];   // Commands rejected because the class was full
+		uint32_t preemptions;                   // Running motions cut short by a higher class
+		uint8_t depth[MOTION_CLASS_COUNT];      // Commands currently pending per class
+		uint8_t depthMax;                       // Largest total depth seen
+	} MotionQueueStats;
+
+	bool MotionQueue_Init(void);
+	BaseType_t MotionQueue_Post(RobotState state, MotionClass cls);
+	BaseType_t MotionQueue_PostSpeed(RobotState state, MotionClass cls, uint16_t speed);
+	BaseType_t MotionQueue_Receive(MotionCommand *cmd, TickType_t timeout);
+	void MotionQueue_Complete(bool preempted);
+	bool MotionQueue_PreemptPending(void);
+	bool MotionQueue_WaitPreempt(TickType_t timeout);
+	bool MotionQueue_Idle(void);
+	RobotState MotionQueue_GetActiveState(void);
+	EventGroupHandle_t MotionQueue_GetEventGroup(void);
+	uint32_t MotionQueue_Depth(void);
+	void MotionQueue_GetStats(MotionQueueStats *stats);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_QUEUE_H
@@ -0,0 +1,454 @@
+/**
+ * @file    MotionRecord.c
+ * @brief   Teach mode: records commanded servo frames into new motion files.
+ *
+ * MotionPlayer hands every frame it writes to MotionRecord_Sample(), plus the
+ * pose a sequence starts from (one frame before its first frame), so a pose
+ * held between two commands is recorded as a hold rather than a slow drift.
+ *
+ * Samples collect in a MOTION_RECORD_RAW buffer. When it fills, the buffer is
+ * reduced with Ramer-Douglas-Peucker and the surviving keyframes are appended
+ * to the keyframe store; the last one stays behind as the start of the next
+ * chunk. The error of a dropped sample is measured the way playback would
+ * miss it: the keyframes on either side are interpolated with the player's
+ * easing at the sample's time, and the largest per-servo difference must stay
+ * within the tolerance. Reduction runs on ControlTask right after a frame is
+ * written, in the slack before the next one.
+ *
+ * Two things keep playback traffic on the servo bus low. Keyframe changes
+ * within MOTION_RECORD_DEADBAND are removed when recording stops, so servos
+ * that only jittered are not rewritten every frame (PCA9685 frames only send
+ * changed channels). And a held pose needs one keyframe whatever its length.
+ */
+
+#include "MotionRecord.h"
+#include "MotionFile.h"
+#include "MotionQueue.h"
+#include "ControlTask.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
+#include <string.h>
+
+#define MOTION_RECORD_SEGMENT_MAX_MS    60000   // Longest keyframe step, delay_ms is 16 bits
+#define MOTION_RECORD_CHANNEL_BYTES     4       // Bus bytes per changed channel in a frame (PCA9685 burst)
+
+_Static_assert(MOTION_RECORD_KEYFRAMES >= MOTION_RECORD_RAW, "the reduction scratch is sized for the keyframe store");
+_Static_assert(MOTION_RECORD_KEYFRAMES <= 255, "reduction indices are 8 bits");
+
+typedef struct {
+	MotionStep raw[MOTION_RECORD_RAW];          // Samples not reduced yet, delay_ms unused
+	uint32_t rawMs[MOTION_RECORD_RAW];          // Sample times since the recording started
+	MotionStep key[MOTION_RECORD_KEYFRAMES];
+	uint32_t keyMs[MOTION_RECORD_KEYFRAMES];
+	uint16_t rawCount;
+	uint16_t keyCount;
+	volatile bool recording;
+	bool started;                               // First sample taken
+	TickType_t lastTick;
+	uint32_t timeMs;
+	uint16_t lastPose[PCA9685_SERVO_CHANNELS];  // Previous sample, for the recorded bus traffic
+} MotionRecorder;
+
+typedef struct {
+	uint16_t target[PCA9685_SERVO_CHANNELS];
+	uint8_t mask;                               // Channels with a pending target
+	uint16_t ms;
+} MotionJog;
+
+static MotionRecorder recorder;
+static MotionRecordStats recordStats;
+static MotionJog jog;
+static SemaphoreHandle_t recordMutex = NULL;
+static uint8_t reduceKeep[MOTION_RECORD_KEYFRAMES];
+static uint8_t reduceStack[MOTION_RECORD_KEYFRAMES][2];
+
+static void MotionRecord_Finish(MotionRecorder *r);
+
+/**
+ * @fn      bool MotionRecord_Init(void)
+ * @brief   Creates the lock shared by ControlTask and the CLI.
+ * @return  true on success
+ */
+bool MotionRecord_Init(void) {
+	if (recordMutex == NULL) {
+		recordMutex = xSemaphoreCreateMutex();
+	}
+	recordStats.tolerance = MOTION_RECORD_TOLERANCE;
+	return recordMutex != NULL;
+}
+
+static void MotionRecord_Lock(void) {
+	if (recordMutex != NULL) {
+		xSemaphoreTake(recordMutex, portMAX_DELAY);
+	}
+}
+
+static void MotionRecord_Unlock(void) {
+	if (recordMutex != NULL) {
+		xSemaphoreGive(recordMutex);
+	}
+}
+
+/**
+ * @fn      static uint16_t MotionRecord_Deviation(const MotionStep *pts, const uint32_t *ms, int a, int b, int i)
+ * @brief   Largest per-servo distance between sample i and where playback of a -> b is at its time.
+ */
+static uint16_t MotionRecord_Deviation(const MotionStep *pts, const uint32_t *ms, int a, int b, int i) {
+	uint16_t out[PCA9685_SERVO_CHANNELS];
+	uint32_t span = ms[b] - ms[a];
+	uint32_t off = ms[i] - ms[a];
+	uint16_t dev = 0;
+
+	while (span > 0xFFFF) {
+		span >>= 1;
+		off >>= 1;
+	}
+	uint16_t t = (span != 0) ? (uint16_t)((off << 15) / span) : MOTION_T_ONE;
+	MotionPlayer_Interpolate(pts[a].pulse, pts[b].pulse, t, MotionPlayer_GetEase(), out);
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		int32_t d = (int32_t)out[ch] - pts[i].pulse[ch];
+		if (d < 0) d = -d;
+		if (d > dev) dev = (uint16_t)d;
+	}
+	return dev;
+}
+
+/**
+ * @fn      static uint16_t MotionRecord_Reduce(MotionStep *pts, uint32_t *ms, uint16_t count, uint16_t tolerance)
+ * @brief   Ramer-Douglas-Peucker over a run of samples, compacted in place.
+ * @details Iterative with an explicit stack so ControlTask's stack use stays
+ *          fixed. The first and last samples are always kept. A step that
+ *          would not fit delay_ms is split even if it is within tolerance.
+ * @return  Number of samples kept
+ */
+static uint16_t MotionRecord_Reduce(MotionStep *pts, uint32_t *ms, uint16_t count, uint16_t tolerance) {
+	int depth = 0;
+	uint16_t kept = 0;
+
+	if (count <= 2) {
+		return count;
+	}
+	memset(reduceKeep, 0, count);
+	reduceKeep[0] = 1;
+	reduceKeep[count - 1] = 1;
+	reduceStack[depth][0] = 0;
+	reduceStack[depth][1] = (uint8_t)(count - 1);
+	depth++;
+
+	while (depth > 0) {
+		depth--;
+		int a = reduceStack[depth][0];
+		int b = reduceStack[depth][1];
+		if (b - a < 2) {
+			continue;
+		}
+
+		int worst = a + 1;
+		uint16_t worstDev = 0;
+		for (int i = a + 1; i < b; ++i) {
+			uint16_t dev = MotionRecord_Deviation(pts, ms, a, b, i);
+			if (dev > worstDev) {
+				worstDev = dev;
+				worst = i;
+			}
+		}
+
+		if (worstDev <= tolerance) {
+			if (ms[b] - ms[a] <= MOTION_RECORD_SEGMENT_MAX_MS) {
+				if (worstDev > recordStats.errorMax) {
+					recordStats.errorMax = worstDev;
+				}
+				continue;
+			}
+			worst = (a + b) / 2;
+		}
+		reduceKeep[worst] = 1;
+		// Each pop pushes at most two intervals that do not overlap, so count entries suffice
+		reduceStack[depth][0] = (uint8_t)a;
+		reduceStack[depth][1] = (uint8_t)worst;
+		depth++;
+		reduceStack[depth][0] = (uint8_t)worst;
+		reduceStack[depth][1] = (uint8_t)b;
+		depth++;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (reduceKeep[i]) {
+			pts[kept] = pts[i];
+			ms[kept] = ms[i];
+			kept++;
+		}
+	}
+	return kept;
+}
+
+/**
+ * @fn      static void MotionRecord_Flush(MotionRecorder *r)
+ * @brief   Reduces the raw samples and moves the survivors to the keyframe store.
+ * @details If they do not fit, the tolerance doubles and both the store and
+ *          the chunk are reduced again. Past MOTION_RECORD_TOLERANCE_MAX the
+ *          chunk is dropped and recording stops. Caller holds the lock.
+ */
+static void MotionRecord_Flush(MotionRecorder *r) {
+	uint32_t start = CycleCounterNow();
+	uint16_t skip = (r->keyCount > 0) ? 1 : 0;   // raw[0] is the store's last keyframe
+	uint16_t n = MotionRecord_Reduce(r->raw, r->rawMs, r->rawCount, recordStats.tolerance);
+
+	while (r->keyCount + n - skip > MOTION_RECORD_KEYFRAMES) {
+		if (recordStats.tolerance >= MOTION_RECORD_TOLERANCE_MAX) {
+			recordStats.truncated = true;
+			r->recording = false;
+			r->rawCount = 0;
+			MotionRecord_Finish(r);
+			return;
+		}
+		recordStats.tolerance = (uint16_t)(recordStats.tolerance * 2);
+		if (recordStats.tolerance > MOTION_RECORD_TOLERANCE_MAX) {
+			recordStats.tolerance = MOTION_RECORD_TOLERANCE_MAX;
+		}
+		r->keyCount = MotionRecord_Reduce(r->key, r->keyMs, r->keyCount, recordStats.tolerance);
+		n = MotionRecord_Reduce(r->raw, r->rawMs, n, recordStats.tolerance);
+	}
+
+	for (uint16_t i = skip; i < n; ++i) {
+		r->key[r->keyCount] = r->raw[i];
+		r->keyMs[r->keyCount] = r->rawMs[i];
+		r->keyCount++;
+	}
+	r->raw[0] = r->raw[n - 1];
+	r->rawMs[0] = r->rawMs[n - 1];
+	r->rawCount = 1;
+
+	uint32_t cycles = CycleCounterNow() - start;
+	if (cycles > recordStats.reduceCyclesMax) {
+		recordStats.reduceCyclesMax = cycles;
+	}
+}
+
+/**
+ * @fn      void MotionRecord_Sample(const uint16_t pose[PCA9685_SERVO_CHANNELS], TickType_t tick)
+ * @brief   Records a commanded frame. Called by MotionPlayer on ControlTask.
+ * @param   pose - Nominal pulses written (or about to be) to the servos
+ * @param   tick - Time of the frame; samples not after the previous one are ignored
+ */
+void MotionRecord_Sample(const uint16_t pose[PCA9685_SERVO_CHANNELS], TickType_t tick) {
+	MotionRecorder *r = &recorder;
+
+	if (!r->recording) {
+		return;
+	}
+	MotionRecord_Lock();
+	if (!r->recording) {
+		MotionRecord_Unlock();
+		return;
+	}
+
+	if (r->started) {
+		int32_t gap = (int32_t)(tick - r->lastTick) * (int32_t)portTICK_PERIOD_MS;
+		if (gap <= 0) {
+			MotionRecord_Unlock();
+			return;
+		}
+		if (gap > MOTION_RECORD_PAUSE_MAX_MS) {
+			gap = MOTION_RECORD_PAUSE_MAX_MS;
+		}
+		r->timeMs += (uint32_t)gap;
+
+		uint32_t changed = 0;
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			changed += (pose[ch] != r->lastPose[ch]);
+		}
+		recordStats.busBytesRecorded += changed * MOTION_RECORD_CHANNEL_BYTES;
+	}
+	r->started = true;
+	r->lastTick = tick;
+	memcpy(r->lastPose, pose, sizeof(r->lastPose));
+
+	memcpy(r->raw[r->rawCount].pulse, pose, sizeof(r->raw[0].pulse));
+	r->rawMs[r->rawCount] = r->timeMs;
+	r->rawCount++;
+	recordStats.samples++;
+	recordStats.durationMs = r->timeMs;
+
+	if (r->rawCount == MOTION_RECORD_RAW) {
+		MotionRecord_Flush(r);
+	}
+	MotionRecord_Unlock();
+}
+
+/**
+ * @fn      static void MotionRecord_Finish(MotionRecorder *r)
+ * @brief   Turns the keyframe store into MotionSteps ready to save. Caller holds the lock.
+ * @details Applies the deadband, fills in delay_ms and estimates the bus
+ *          traffic of playing the result (the first step assumes every servo moves).
+ */
+static void MotionRecord_Finish(MotionRecorder *r) {
+	recordStats.busBytesPlayback = 0;
+	for (uint16_t i = 0; i < r->keyCount; ++i) {
+		MotionStep *step = &r->key[i];
+		uint32_t changed = PCA9685_SERVO_CHANNELS;
+
+		if (i == 0) {
+			step->delay_ms = MOTION_RECORD_LEAD_MS;
+		} else {
+			const MotionStep *prev = &r->key[i - 1];
+			step->delay_ms = (uint16_t)(r->keyMs[i] - r->keyMs[i - 1]);
+			changed = 0;
+			for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+				int32_t d = (int32_t)step->pulse[ch] - prev->pulse[ch];
+				if (d >= -MOTION_RECORD_DEADBAND && d <= MOTION_RECORD_DEADBAND) {
+					step->pulse[ch] = prev->pulse[ch];
+				} else {
+					changed++;
+				}
+			}
+		}
+		uint32_t frames = (step->delay_ms + MOTION_FRAME_MS - 1) / MOTION_FRAME_MS;
+		recordStats.busBytesPlayback += frames * changed * MOTION_RECORD_CHANNEL_BYTES;
+	}
+	recordStats.keyframes = r->keyCount;
+	recordStats.fileBytes = (r->keyCount != 0) ? sizeof(MotionFileHeader) + r->keyCount * sizeof(MotionStep) : 0;
+}
+
+/**
+ * @fn      int32_t MotionRecord_Start(uint16_t tolerance)
+ * @brief   Discards any previous recording and starts sampling.
+ * @param   tolerance - Allowed deviation in pulse counts, 0 for MOTION_RECORD_TOLERANCE
+ * @return  ERROR_NONE, or ERROR_INVALID_ARG if the tolerance is above MOTION_RECORD_TOLERANCE_MAX
+ */
+int32_t MotionRecord_Start(uint16_t tolerance) {
+	MotionRecorder *r = &recorder;
+
+	if (tolerance > MOTION_RECORD_TOLERANCE_MAX) {
+		return ERROR_INVALID_ARG;
+	}
+	MotionRecord_Lock();
+	r->rawCount = 0;
+	r->keyCount = 0;
+	r->started = false;
+	r->timeMs = 0;
+	memset(&recordStats, 0, sizeof(recordStats));
+	recordStats.tolerance = (tolerance != 0) ? tolerance : MOTION_RECORD_TOLERANCE;
+	recordStats.recording = true;
+	r->recording = true;
+	MotionRecord_Unlock();
+	return ERROR_NONE;
+}
+
+/**
+ * @fn      int32_t MotionRecord_Stop(void)
+ * @brief   Stops sampling and reduces what is left.
+ * @return  ERROR_NONE, or ERROR_NOT_FOUND if nothing was recorded
+ */
+int32_t MotionRecord_Stop(void) {
+	MotionRecorder *r = &recorder;
+
+	MotionRecord_Lock();
+	if (r->recording) {
+		r->recording = false;
+		if (r->rawCount >= 2 || (r->rawCount == 1 && r->keyCount == 0)) {
+			MotionRecord_Flush(r);
+		}
+		MotionRecord_Finish(r);
+	}
+	recordStats.recording = false;
+	int32_t result = (r->keyCount != 0) ? ERROR_NONE : ERROR_NOT_FOUND;
+	MotionRecord_Unlock();
+	return result;
+}
+
+/**
+ * @fn      int32_t MotionRecord_Save(const char *name)
+ * @brief   Writes the last recording to "0:/motions/<name>.bmo".
+ * @details Saving replaces any cached copy, so sdplay plays the new file at once.
+ * @return  0 on success, ERROR_BUSY while recording, ERROR_NOT_FOUND if
+ *          nothing was recorded, otherwise the MotionFile_Save() error
+ */
+int32_t MotionRecord_Save(const char *name) {
+	MotionRecorder *r = &recorder;
+	int32_t result;
+
+	MotionRecord_Lock();
+	if (r->recording) {
+		result = ERROR_BUSY;
+	} else if (r->keyCount == 0) {
+		result = ERROR_NOT_FOUND;
+	} else {
+		result = MotionFile_Save(name, r->key, r->keyCount);
+	}
+	MotionRecord_Unlock();
+	return result;
+}
+
+/**
+ * @fn      bool MotionRecord_Active(void)
+ * @brief   Returns true while recording; ControlTask then stays in the taught pose.
+ */
+bool MotionRecord_Active(void) {
+	return recorder.recording;
+}
+
+/**
+ * @fn      void MotionRecord_GetStats(MotionRecordStats *stats)
+ * @brief   Copies the recorder state and counters.
+ */
+void MotionRecord_GetStats(MotionRecordStats *stats) {
+	MotionRecord_Lock();
+	*stats = recordStats;
+	stats->recording = recorder.recording;
+	if (recorder.recording) {
+		stats->keyframes = recorder.keyCount;
+	}
+	MotionRecord_Unlock();
+}
+
+/**
+ * @fn      int32_t MotionRecord_Jog(uint8_t channel, uint16_t pulse, uint16_t ms)
+ * @brief   Queues a move of one servo, keeping the others where they are.
+ * @details Jogs posted before ControlTask runs are merged into one move.
+ * @param   channel - Servo channel 0-7
+ * @param   pulse   - Nominal pulse, clamped to PCA9685_SERVO_MIN..MAX
+ * @param   ms      - Move time
+ * @return  ERROR_NONE, ERROR_INVALID_ARG, or ERROR_BUSY if the motion queue is full
+ */
+int32_t MotionRecord_Jog(uint8_t channel, uint16_t pulse, uint16_t ms) {
+	if (channel >= PCA9685_SERVO_CHANNELS) {
+		return ERROR_INVALID_ARG;
+	}
+	if (pulse < PCA9685_SERVO_MIN) pulse = PCA9685_SERVO_MIN;
+	if (pulse > PCA9685_SERVO_MAX) pulse = PCA9685_SERVO_MAX;
+
+	taskENTER_CRITICAL();
+	jog.target[channel] = pulse;
+	jog.mask |= (uint8_t)(1U << channel);
+	jog.ms = ms;
+	taskEXIT_CRITICAL();
+
+	return (MotionQueue_Post(STATE_JOG, MOTION_CLASS_USER) == pdPASS) ? ERROR_NONE : ERROR_BUSY;
+}
+
+/**
+ * @fn      int32_t MotionRecord_RunJog(void)
+ * @brief   Plays the pending jog moves. ControlTask only.
+ * @return  Same as MotionPlayer_PlayTimed()
+ */
+int32_t MotionRecord_RunJog(void) {
+	MotionStep step;
+
+	MotionPlayer_GetPose(step.pulse);
+	taskENTER_CRITICAL();
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		if (jog.mask & (1U << ch)) {
+			step.pulse[ch] = jog.target[ch];
+		}
+	}
+	step.delay_ms = jog.ms;
+	jog.mask = 0;
+	taskEXIT_CRITICAL();
+
+	return MotionPlayer_PlayTimed(&step, 1);  // The jog time is the user's
+}
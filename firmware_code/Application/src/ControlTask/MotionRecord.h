@@ -0,0 +1,64 @@
+/**
+ * @file    MotionRecord.h
+ * @brief   Teach mode: records commanded servo frames into new motion files.
+ *
+ * While recording, every frame MotionPlayer writes (jog commands, streamed
+ * frames, or any other motion) is sampled with its frame time. Samples are
+ * reduced to keyframes with Ramer-Douglas-Peucker in joint space and saved to
+ * the SD card as an ordinary .bmo motion file, which plays with sdplay like
+ * any other file.
+ *
+ * The keyframe store is bounded: when it fills, the tolerance doubles and the
+ * kept keyframes are reduced again, so file size and playback length never
+ * exceed MOTION_RECORD_KEYFRAMES steps.
+ */
+
+#ifndef MOTION_RECORD_H
+#define MOTION_RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "MotionPlayer.h"
+
+#define MOTION_RECORD_RAW           40      // Samples reduced at a time (0.8 s of frames)
+#define MOTION_RECORD_KEYFRAMES     64      // Largest recorded sequence
+#define MOTION_RECORD_TOLERANCE     3       // Default allowed deviation in pulse counts (about 1.2 degrees)
+#define MOTION_RECORD_TOLERANCE_MAX 48
+#define MOTION_RECORD_DEADBAND      2       // Keyframe changes this small are dropped so idle servos stay off the bus
+#define MOTION_RECORD_PAUSE_MAX_MS  2000    // Longer pauses between commands are shortened to this
+#define MOTION_RECORD_LEAD_MS       500     // Time to reach the first keyframe on playback
+#define MOTION_JOG_MS_DEFAULT       300
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		bool recording;
+		bool truncated;             // Stopped because the store was full at the largest tolerance
+		uint16_t tolerance;         // Deviation allowed now, in pulse counts
+		uint16_t keyframes;
+		uint32_t samples;           // Frames sampled
+		uint32_t durationMs;        // Recorded time after shortening pauses
+		uint32_t errorMax;          // Largest deviation of a dropped frame from the played-back path
+		uint32_t fileBytes;         // Size of the motion file Save() would write
+		uint32_t busBytesRecorded;  // Servo bus bytes of the frames as sampled
+		uint32_t busBytesPlayback;  // Estimated servo bus bytes to play the keyframes back
+		uint32_t reduceCyclesMax;   // Slowest reduction pass, runs in the frame slack
+	} MotionRecordStats;
+
+	bool MotionRecord_Init(void);
+	int32_t MotionRecord_Start(uint16_t tolerance);
+	int32_t MotionRecord_Stop(void);
+	int32_t MotionRecord_Save(const char *name);
+	bool MotionRecord_Active(void);
+	void MotionRecord_Sample(const uint16_t pose[PCA9685_SERVO_CHANNELS], TickType_t tick);
+	void MotionRecord_GetStats(MotionRecordStats *stats);
+	int32_t MotionRecord_Jog(uint8_t channel, uint16_t pulse, uint16_t ms);
+	int32_t MotionRecord_RunJog(void);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_RECORD_H
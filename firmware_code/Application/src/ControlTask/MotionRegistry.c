@@ -0,0 +1,122 @@
+/**
+ * @file    MotionRegistry.c
+ * @brief   Constant-time lookup of motions by state or command string.
+ *
+ * Command strings hash with FNV-1a (custom offset basis) folded to 5 bits.
+ * The offset basis was searched offline so every accepted name lands in its
+ * own slot; lookup is one hash, one slot read and one string compare. When
+ * adding a name, pick a new seed that keeps all slots collision-free and
+ * place every name at its new slot; the registry section of the host check
+ * (make check in host/) resolves every alias through the hash.
+ */
+
+#include "MotionRegistry.h"
+#include <string.h>
+
+#define MOTION_HASH_SEED    0x811CEBA6UL    // FNV-1a offset basis giving a perfect hash over the names below
+#define MOTION_HASH_PRIME   16777619UL
+#define MOTION_HASH_SLOTS   MOTION_REGISTRY_SLOTS
+
+typedef struct {
+	const char *name;
+	RobotState state;
+} MotionAlias;
+
+// Names accepted from MQTT ("turn_left") and the CLI ("left"), placed at their hash slot
+static const MotionAlias aliasSlots[MOTION_HASH_SLOTS] = {
+	[1]  = { "hi",         STATE_SAY_HI },
+	[3]  = { "say_hi",     STATE_SAY_HI },
+	[4]  = { "lie",        STATE_LIE },
+	[5]  = { "dance",      STATE_DANCE2 },
+	[6]  = { "turn_left",  STATE_LEFT_SHIFT },
+	[7]  = { "pushup",     STATE_PUSHUP },
+	[9]  = { "standby",    STATE_IDLE },
+	[10] = { "right",      STATE_RIGHT_SHIFT },
+	[11] = { "idle",       STATE_IDLE },
+	[12] = { "fight",      STATE_FIGHTING },
+	[14] = { "sleep",      STATE_SLEEP },
+	[16] = { "dance3",     STATE_DANCE3 },
+	[18] = { "forward",    STATE_FORWARD },
+	[19] = { "left",       STATE_LEFT_SHIFT },
+	[20] = { "push_up",    STATE_PUSHUP },
+	[22] = { "dance1",     STATE_DANCE1 },
+	[23] = { "warmup",     STATE_DANCE3 },
+	[24] = { "turn_right", STATE_RIGHT_SHIFT },
+	[25] = { "backward",   STATE_BACKWARD },
+	[26] = { "wiggle",     STATE_DANCE1 },
+	[28] = { "fighting",   STATE_FIGHTING },
+	[31] = { "dance2",     STATE_DANCE2 },
+};
+
+/**
+ * @fn      static uint32_t MotionRegistry_Hash(const char *name, size_t len)
+ * @brief   Maps a command string to its alias slot.
+ */
+static uint32_t MotionRegistry_Hash(const char *name, size_t len) {
+	uint32_t h = MOTION_HASH_SEED;
+
+	for (size_t i = 0; i < len; ++i) {
+		h ^= (uint8_t)name[i];
+		h *= MOTION_HASH_PRIME;
+	}
+	return (h ^ (h >> 16)) & (MOTION_HASH_SLOTS - 1);
+}
+
+/**
+ * @fn      const MotionEntry *MotionRegistry_Get(RobotState state)
+ * @brief   Returns the registry entry for a state.
+ * @param   state - Motion state
+ * @return  Entry, or NULL if the state is out of range
+ */
+const MotionEntry *MotionRegistry_Get(RobotState state) {
+	if ((unsigned)state >= STATE_COUNT) {
+		return NULL;
+	}
+	return &motionRegistry[state];
+}
+
+/**
+ * @fn      const MotionEntry *MotionRegistry_FindN(const char *name, size_t len)
+ * @brief   Looks up a motion by command string (not necessarily terminated).
+ * @param   name - Command string
+ * @param   len  - Length of name
+ * @return  Entry, or NULL if the name is unknown
+ */
+const MotionEntry *MotionRegistry_FindN(const char *name, size_t len) {
+	if (name == NULL) {
+		return NULL;
+	}
+
+	const MotionAlias *slot = &aliasSlots[MotionRegistry_Hash(name, len)];
+	if (slot->name == NULL || strlen(slot->name) != len || strncmp(slot->name, name, len) != 0) {
+		return NULL;
+	}
+	return &motionRegistry[slot->state];
+}
+
+/**
+ * @fn      const MotionEntry *MotionRegistry_Find(const char *name)
+ * @brief   Looks up a motion by null-terminated command string.
+ * @param   name - Command string
+ * @return  Entry, or NULL if the name is unknown
+ */
+const MotionEntry *MotionRegistry_Find(const char *name) {
+	return MotionRegistry_FindN(name, (name != NULL) ? strlen(name) : 0);
+}
+
+/**
+ * @fn      const char *MotionRegistry_Alias(uint8_t slot, RobotState *state)
+ * @brief   Reads one alias slot, to list or check the accepted command strings.
+ * @param   slot  - Slot index, below MOTION_REGISTRY_SLOTS
+ * @param   state - Receives the state the alias plays, may be NULL
+ * @return  Alias, or NULL for an empty slot or one out of range
+ */
+const char *MotionRegistry_Alias(uint8_t slot, RobotState *state) {
+	if (slot >= MOTION_HASH_SLOTS || aliasSlots[slot].name == NULL) {
+		return NULL;
+	}
+	if (state != NULL) {
+		*state = aliasSlots[slot].state;
+	}
+	return aliasSlots[slot].name;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file    MotionRegistry.h
+ * @brief   Single table mapping motions to names, labels and keyframe tables.
+ *
+ * The registry is indexed by RobotState, so state lookup is a direct array
+ * access. Command strings from MQTT and the CLI (including aliases such as
+ * "turn_left"/"left") resolve through a perfect hash to the same entries.
+ */
+
+#ifndef MOTION_REGISTRY_H
+#define MOTION_REGISTRY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ControlTask.h"
+#include "MotionPlayer.h"
+
+#define MOTION_REGISTRY_SLOTS   32      // Alias hash slots, a power of two
+
+/** Registry initializer; the step count is taken from the table itself so it cannot drift. */
+#define MOTION_ENTRY(st, nm, lbl, table) \
+	[st] = { (st), (nm), (lbl), (table), MOTION_STEP_COUNT(table) }
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		RobotState state;
+		const char *name;           // Canonical command name (MQTT payload)
+		const char *label;          // Text shown on the LCD
+		const MotionStep *steps;    // Keyframe table
+		uint16_t count;             // Number of keyframes in steps
+	} MotionEntry;
+
+	extern const MotionEntry motionRegistry[STATE_COUNT];
+
+	const MotionEntry *MotionRegistry_Get(RobotState state);
+	const MotionEntry *MotionRegistry_Find(const char *name);
+	const MotionEntry *MotionRegistry_FindN(const char *name, size_t len);
+	const char *MotionRegistry_Alias(uint8_t slot, RobotState *state);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_REGISTRY_H
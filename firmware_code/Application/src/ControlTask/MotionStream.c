@@ -0,0 +1,294 @@
+/**
+ * @file    MotionStream.c
+ * @brief   Live servo frames streamed from the dashboard through a jitter buffer.
+ *
+ * The MQTT callback (WiFi task) files frames into MOTION_STREAM_SLOTS slots by
+ * sequence number; ControlTask plays one slot per servo frame. The first frame
+ * of a stream queues STATE_STREAM, so streaming preempts and is preempted like
+ * any other user command. Playout starts once MOTION_STREAM_DEPTH frames are
+ * buffered and drops the oldest frames when the sender's clock runs ahead, so
+ * latency stays near the buffer depth instead of growing.
+ *
+ * Latency is measured against the sender's clock without synchronizing it:
+ * the smallest arrival-minus-send difference seen in a stream is taken as the
+ * fixed path delay, and every frame reports how far above that it was written
+ * to the servos.
+ */
+
+#include "MotionStream.h"
+#include "MotionQueue.h"
+#include "ControlTask.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct {
+	uint16_t seq;
+	bool valid;
+	TickType_t arrival;
+	uint32_t sent;                              // Sender time in ms
+	uint16_t pulse[PCA9685_SERVO_CHANNELS];
+} MotionStreamSlot;
+
+typedef struct {
+	MotionSource base;                          // Must stay first
+	MotionStreamSlot slot[MOTION_STREAM_SLOTS];
+	volatile bool active;                       // Stream queued or playing
+	bool playing;                               // Prebuffering done
+	bool ended;                                 // Sender closed the stream
+	uint16_t playSeq;                           // Next sequence to play
+	uint16_t newestSeq;
+	TickType_t startTick;
+	TickType_t lastArrival;
+	uint32_t lastSent;
+	int32_t transitMin;                         // Fastest arrival - send seen in this stream
+	uint8_t conceal;                            // Consecutive missing frames
+	uint16_t last[PCA9685_SERVO_CHANNELS];      // Last two poses played, for extrapolation
+	uint16_t prev[PCA9685_SERVO_CHANNELS];
+} MotionStream;
+
+_Static_assert((MOTION_STREAM_SLOTS & (MOTION_STREAM_SLOTS - 1)) == 0, "slot count must be a power of two");
+
+static MotionStream motionStream;
+static MotionStreamStats streamStats;
+static uint32_t jitter16;                       // Interarrival jitter in ms, scaled by 16
+static uint32_t latencySum;
+static uint32_t bufferSum;
+
+/**
+ * @fn      static void MotionStream_Start(MotionStream *s, uint16_t seq, TickType_t now)
+ * @brief   Clears the buffer for a new stream. Caller holds the critical section.
+ */
+static void MotionStream_Start(MotionStream *s, uint16_t seq, TickType_t now) {
+	for (int i = 0; i < MOTION_STREAM_SLOTS; ++i) {
+		s->slot[i].valid = false;
+	}
+	s->active = true;
+	s->playing = false;
+	s->ended = false;
+	s->playSeq = seq;
+	s->newestSeq = seq;
+	s->startTick = now;
+	s->lastArrival = now;
+	s->conceal = 0;
+	streamStats.streams++;
+}
+
+/**
+ * @fn      bool MotionStream_Push(const uint8_t *frame, size_t len)
+ * @brief   Accepts one stream frame. Called from the MQTT callback.
+ * @param   frame - Frame as received, see MotionStream.h
+ * @param   len   - Payload length
+ * @return  true if the payload is a stream frame (even if it was dropped)
+ */
+bool MotionStream_Push(const uint8_t *frame, size_t len) {
+	MotionStream *s = &motionStream;
+
+	if (len != MOTION_STREAM_FRAME_LEN || frame[0] != MOTION_STREAM_MAGIC) {
+		return false;
+	}
+
+	uint16_t seq = (uint16_t)(frame[2] | (frame[3] << 8));
+	uint32_t sent = (uint32_t)frame[4] | ((uint32_t)frame[5] << 8) | ((uint32_t)frame[6] << 16) | ((uint32_t)frame[7] << 24);
+	TickType_t now = xTaskGetTickCount();
+	bool start = false;
+
+	taskENTER_CRITICAL();
+	if (frame[1] & MOTION_STREAM_FLAG_END) {
+		s->ended = true;
+		taskEXIT_CRITICAL();
+		return true;
+	}
+	if (!s->active) {
+		MotionStream_Start(s, seq, now);
+		start = true;
+	}
+
+	int16_t ahead = (int16_t)(seq - s->playSeq);
+	MotionStreamSlot *slot = &s->slot[seq & (MOTION_STREAM_SLOTS - 1)];
+	if (ahead < 0) {
+		streamStats.late++;
+	} else if (slot->valid && slot->seq == seq) {
+		streamStats.duplicates++;
+	} else {
+		if (ahead >= MOTION_STREAM_SLOTS) {
+			// Sender far ahead (e.g. after a stall): restart playout just behind this frame
+			for (int i = 0; i < MOTION_STREAM_SLOTS; ++i) {
+				s->slot[i].valid = false;
+			}
+			s->playSeq = (uint16_t)(seq - (MOTION_STREAM_DEPTH - 1));
+			streamStats.skipped += (uint32_t)ahead - (MOTION_STREAM_DEPTH - 1);
+		}
+		slot->seq = seq;
+		slot->valid = true;
+		slot->arrival = now;
+		slot->sent = sent;
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			slot->pulse[ch] = (uint16_t)(frame[8 + 2 * ch] | (frame[9 + 2 * ch] << 8));
+		}
+		streamStats.received++;
+
+		int32_t transit = (int32_t)(now - sent);
+		if (start || transit < s->transitMin) {
+			s->transitMin = transit;
+		}
+		if (!start && (int16_t)(seq - s->newestSeq) > 0) {
+			// RFC 3550: J += (|D| - J) / 16, kept scaled by 16
+			int32_t d = (int32_t)(now - s->lastArrival) - (int32_t)(sent - s->lastSent);
+			jitter16 += (uint32_t)abs(d) - ((jitter16 + 8) >> 4);
+		}
+		if (start || (int16_t)(seq - s->newestSeq) > 0) {
+			s->newestSeq = seq;
+			s->lastSent = sent;
+		}
+	}
+	s->lastArrival = now;
+	taskEXIT_CRITICAL();
+
+	if (start && MotionQueue_Post(STATE_STREAM, MOTION_CLASS_USER) != pdPASS) {
+		s->active = false;
+	}
+	return true;
+}
+
+/**
+ * @fn      static void MotionStream_Conceal(MotionStream *s)
+ * @brief   Fills in a missing frame: extrapolate the last motion, then hold.
+ */
+static void MotionStream_Conceal(MotionStream *s) {
+	if (++s->conceal <= MOTION_STREAM_EXTRAPOLATE) {
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			int32_t v = 2 * (int32_t)s->last[ch] - s->prev[ch];
+			if (v < PCA9685_SERVO_MIN) v = PCA9685_SERVO_MIN;
+			if (v > PCA9685_SERVO_MAX) v = PCA9685_SERVO_MAX;
+			s->prev[ch] = s->last[ch];
+			s->last[ch] = (uint16_t)v;
+		}
+		streamStats.extrapolated++;
+	} else {
+		memcpy(s->prev, s->last, sizeof(s->prev));
+		streamStats.held++;
+	}
+}
+
+/**
+ * @fn      static bool MotionStream_Next(MotionSource *source, MotionStep *step)
+ * @brief   MotionSource hook: the next frame from the jitter buffer.
+ * @return  false when the stream closes, times out or another command is queued
+ */
+static bool MotionStream_Next(MotionSource *source, MotionStep *step) {
+	MotionStream *s = (MotionStream *)source;
+	TickType_t now = xTaskGetTickCount();
+
+	if (MotionQueue_Depth() != 0) {
+		return false;
+	}
+
+	taskENTER_CRITICAL();
+	if (s->ended) {
+		taskEXIT_CRITICAL();
+		return false;
+	}
+	if (now - s->lastArrival > pdMS_TO_TICKS(MOTION_STREAM_TIMEOUT_MS)) {
+		streamStats.timeouts++;
+		taskEXIT_CRITICAL();
+		return false;  // ControlTask falls back to Standby
+	}
+
+	int16_t buffered = (int16_t)(s->newestSeq - s->playSeq) + 1;
+	if (!s->playing && (buffered >= MOTION_STREAM_DEPTH
+		|| now - s->startTick >= pdMS_TO_TICKS(2 * MOTION_STREAM_DEPTH * MOTION_FRAME_MS))) {
+		s->playing = true;
+	}
+
+	if (s->playing) {
+		// Keep playout MOTION_STREAM_DEPTH behind the newest frame when the sender runs fast
+		while (buffered > MOTION_STREAM_DEPTH + 1) {
+			s->slot[s->playSeq & (MOTION_STREAM_SLOTS - 1)].valid = false;
+			s->playSeq++;
+			buffered--;
+			streamStats.skipped++;
+		}
+
+		MotionStreamSlot *slot = &s->slot[s->playSeq & (MOTION_STREAM_SLOTS - 1)];
+		if (slot->valid && slot->seq == s->playSeq) {
+			memcpy(s->prev, s->last, sizeof(s->prev));
+			memcpy(s->last, slot->pulse, sizeof(s->last));
+			slot->valid = false;
+			s->conceal = 0;
+
+			uint32_t latency = (uint32_t)((int32_t)(now - slot->sent) - s->transitMin);
+			streamStats.played++;
+			latencySum += latency;
+			bufferSum += now - slot->arrival;
+			if (latency > streamStats.latencyMaxMs) {
+				streamStats.latencyMaxMs = latency;
+			}
+		} else {
+			MotionStream_Conceal(s);
+		}
+		s->playSeq++;
+	}
+	memcpy(step->pulse, s->last, sizeof(step->pulse));
+	taskEXIT_CRITICAL();
+
+	step->delay_ms = MOTION_FRAME_MS;
+	return true;
+}
+
+/**
+ * @fn      bool MotionStream_Active(void)
+ * @brief   Returns true while a stream is queued or playing.
+ */
+bool MotionStream_Active(void) {
+	return motionStream.active;
+}
+
+/**
+ * @fn      int32_t MotionStream_Run(void)
+ * @brief   Plays the stream until it ends. ControlTask only.
+ * @return  0 when the stream ended, ERROR_ABORTED if preempted, otherwise the last I2C error
+ */
+int32_t MotionStream_Run(void) {
+	MotionStream *s = &motionStream;
+	uint16_t pose[PCA9685_SERVO_CHANNELS];
+
+	MotionPlayer_GetPose(pose);
+	taskENTER_CRITICAL();
+	s->base.next = MotionStream_Next;
+	s->base.prefetch = NULL;
+	memcpy(s->last, pose, sizeof(s->last));
+	memcpy(s->prev, pose, sizeof(s->prev));
+	taskEXIT_CRITICAL();
+
+	int32_t result = MotionPlayer_PlaySource(&s->base);
+	s->active = false;
+	return result;
+}
+
+/**
+ * @fn      void MotionStream_GetStats(MotionStreamStats *stats)
+ * @brief   Copies the stream counters and computes the averages.
+ */
+void MotionStream_GetStats(MotionStreamStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = streamStats;
+	stats->latencyMeanMs = (streamStats.played != 0) ? latencySum / streamStats.played : 0;
+	stats->bufferMeanMs = (streamStats.played != 0) ? bufferSum / streamStats.played : 0;
+	stats->jitterUs = (jitter16 * 1000U) >> 4;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      void MotionStream_ResetStats(void)
+ * @brief   Clears the stream counters.
+ */
+void MotionStream_ResetStats(void) {
+	taskENTER_CRITICAL();
+	memset(&streamStats, 0, sizeof(streamStats));
+	jitter16 = 0;
+	latencySum = 0;
+	bufferSum = 0;
+	taskEXIT_CRITICAL();
+}
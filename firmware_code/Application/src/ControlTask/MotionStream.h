@@ -0,0 +1,67 @@
+/**
+ * @file    MotionStream.h
+ * @brief   Live servo frames streamed from the dashboard through a jitter buffer.
+ *
+ * A stream frame is MOTION_STREAM_FRAME_LEN bytes, little-endian:
+ *
+ *  offset  size  field
+ *   0       1    MOTION_STREAM_MAGIC (never a printable mode name)
+ *   1       1    flags, MOTION_STREAM_FLAG_END closes the stream
+ *   2       2    sequence number, +1 per frame
+ *   4       4    sender time in ms, any epoch
+ *   8      16    8 nominal pulses (PCA9685_SERVO_MIN..MAX), channels 0-7
+ *
+ * Frames are sent on the motion topic at up to 50 Hz. ControlTask plays them
+ * one per servo frame, MOTION_STREAM_DEPTH frames behind the newest arrival,
+ * and conceals missing ones. Without a frame for MOTION_STREAM_TIMEOUT_MS the
+ * stream ends and the robot returns to Standby.
+ */
+
+#ifndef MOTION_STREAM_H
+#define MOTION_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "MotionPlayer.h"
+
+#define MOTION_STREAM_MAGIC         0xA5
+#define MOTION_STREAM_FLAG_END      0x01
+#define MOTION_STREAM_FRAME_LEN     (8 + 2 * PCA9685_SERVO_CHANNELS)
+#define MOTION_STREAM_SLOTS         8       // Jitter buffer size in frames, power of two
+#define MOTION_STREAM_DEPTH         2       // Frames held back before playout starts
+#define MOTION_STREAM_EXTRAPOLATE   2       // Missing frames extrapolated before holding the pose
+#define MOTION_STREAM_TIMEOUT_MS    500     // Watchdog: silence that ends the stream
+#define MOTION_STREAM_POLL_MS       5       // Network poll period while a stream is active
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		uint32_t streams;           // Streams started
+		uint32_t received;          // Valid frames accepted into the buffer
+		uint32_t played;            // Frames played as sent
+		uint32_t extrapolated;      // Missing frames replaced by extrapolation
+		uint32_t held;              // Missing frames replaced by holding the pose
+		uint32_t late;              // Frames that arrived after their playout slot
+		uint32_t duplicates;
+		uint32_t skipped;           // Frames dropped to keep playout at the buffer depth
+		uint32_t timeouts;          // Streams ended by the watchdog
+		uint32_t latencyMeanMs;     // Send to servo write, above the fastest frame seen
+		uint32_t latencyMaxMs;
+		uint32_t bufferMeanMs;      // Arrival to servo write
+		uint32_t jitterUs;          // Interarrival jitter (RFC 3550 estimator)
+	} MotionStreamStats;
+
+	bool MotionStream_Push(const uint8_t *frame, size_t len);
+	bool MotionStream_Active(void);
+	int32_t MotionStream_Run(void);
+	void MotionStream_GetStats(MotionStreamStats *stats);
+	void MotionStream_ResetStats(void);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_STREAM_H
@@ -0,0 +1,120 @@
+/**
+ * @file    MotionTiming.c
+ * @brief   Servo frame lateness histogram and per-sequence timing budget.
+ *
+ * Lateness goes into power-of-two microsecond buckets, so 16 counters cover
+ * everything from scheduler jitter to multi-tick stalls without dividing on
+ * the frame path. Min, max and mean are exact; p99 is resolved to a bucket.
+ */
+
+#include "MotionTiming.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>
+
+static struct {
+	uint32_t samples;
+	uint32_t minUs;
+	uint32_t maxUs;
+	uint64_t sumUs;
+	uint32_t sequences;
+	uint32_t overruns;
+	uint32_t overrunUsMax;
+	uint32_t bucket[MOTION_TIMING_BUCKETS];
+} timing = { .minUs = UINT32_MAX };
+
+/**
+ * @fn      static int MotionTiming_Bucket(uint32_t us)
+ * @brief   Returns the histogram bucket for a lateness value.
+ */
+static int MotionTiming_Bucket(uint32_t us) {
+	int b = 0;
+	while (us != 0 && b < MOTION_TIMING_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/**
+ * @fn      void MotionTiming_RecordFrame(uint32_t latenessUs)
+ * @brief   Records how late a frame started relative to its deadline.
+ * @param   latenessUs - Start time minus deadline in microseconds
+ */
+void MotionTiming_RecordFrame(uint32_t latenessUs) {
+	int b = MotionTiming_Bucket(latenessUs);
+
+	taskENTER_CRITICAL();
+	timing.samples++;
+	timing.sumUs += latenessUs;
+	timing.bucket[b]++;
+	if (latenessUs < timing.minUs) timing.minUs = latenessUs;
+	if (latenessUs > timing.maxUs) timing.maxUs = latenessUs;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      void MotionTiming_RecordSequence(uint32_t budgetUs, uint32_t elapsedUs)
+ * @brief   Checks a completed sequence against the sum of its step times.
+ * @param   budgetUs  - Nominal sequence duration
+ * @param   elapsedUs - Measured duration from first frame deadline to the end
+ */
+void MotionTiming_RecordSequence(uint32_t budgetUs, uint32_t elapsedUs) {
+	uint32_t overrun = (elapsedUs > budgetUs) ? elapsedUs - budgetUs : 0;
+
+	taskENTER_CRITICAL();
+	timing.sequences++;
+	if (overrun > MOTION_TIMING_SLACK_US) {
+		timing.overruns++;
+	}
+	if (overrun > timing.overrunUsMax) {
+		timing.overrunUsMax = overrun;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      void MotionTiming_GetSummary(MotionTimingSummary *summary)
+ * @brief   Computes min/mean/p99/max and copies the histogram.
+ * @param   summary - Destination structure
+ */
+void MotionTiming_GetSummary(MotionTimingSummary *summary) {
+	uint64_t sum;
+
+	taskENTER_CRITICAL();
+	summary->samples = timing.samples;
+	summary->minUs = (timing.samples != 0) ? timing.minUs : 0;
+	summary->maxUs = timing.maxUs;
+	summary->sequences = timing.sequences;
+	summary->overruns = timing.overruns;
+	summary->overrunUsMax = timing.overrunUsMax;
+	memcpy(summary->bucket, timing.bucket, sizeof(summary->bucket));
+	sum = timing.sumUs;
+	taskEXIT_CRITICAL();
+
+	summary->meanUs = (summary->samples != 0) ? (uint32_t)(sum / summary->samples) : 0;
+
+	// Smallest bucket edge at or above 99 % of the samples
+	uint32_t target = summary->samples - summary->samples / 100;
+	uint32_t seen = 0;
+	summary->p99Us = 0;
+	for (int b = 0; b < MOTION_TIMING_BUCKETS && summary->samples != 0; ++b) {
+		seen += summary->bucket[b];
+		if (seen >= target) {
+			uint32_t edge = (b == 0) ? 0 : (1UL << b) - 1;
+			summary->p99Us = (edge < summary->maxUs && b < MOTION_TIMING_BUCKETS - 1) ? edge : summary->maxUs;
+			break;
+		}
+	}
+}
+
+/**
+ * @fn      void MotionTiming_Reset(void)
+ * @brief   Clears all timing statistics.
+ */
+void MotionTiming_Reset(void) {
+	taskENTER_CRITICAL();
+	memset(&timing, 0, sizeof(timing));
+	timing.minUs = UINT32_MAX;
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,44 @@
+/**
+ * @file    MotionTiming.h
+ * @brief   Servo frame lateness histogram and per-sequence timing budget.
+ *
+ * The motion player schedules every frame against an absolute deadline. This
+ * module records how late each frame actually started and whether each
+ * sequence finished within the sum of its step times, so gait timing can be
+ * checked under WiFi/MQTT load.
+ */
+
+#ifndef MOTION_TIMING_H
+#define MOTION_TIMING_H
+
+#include <stdint.h>
+
+#define MOTION_TIMING_BUCKETS       16      // Bucket 0 is < 1 us, bucket b >= 1 is [2^(b-1), 2^b) us, the last is open
+#define MOTION_TIMING_SLACK_US      1000    // Sequence overrun tolerated before it counts against the budget
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		uint32_t samples;           // Frames recorded
+		uint32_t minUs;             // Earliest frame start past its deadline
+		uint32_t meanUs;
+		uint32_t p99Us;             // Upper edge of the bucket holding the 99th percentile
+		uint32_t maxUs;
+		uint32_t sequences;         // Sequences played to the end
+		uint32_t overruns;          // Sequences that ran over budget by more than MOTION_TIMING_SLACK_US
+		uint32_t overrunUsMax;      // Worst overrun of a sequence
+		uint32_t bucket[MOTION_TIMING_BUCKETS];
+	} MotionTimingSummary;
+
+	void MotionTiming_RecordFrame(uint32_t latenessUs);
+	void MotionTiming_RecordSequence(uint32_t budgetUs, uint32_t elapsedUs);
+	void MotionTiming_GetSummary(MotionTimingSummary *summary);
+	void MotionTiming_Reset(void);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_TIMING_H
@@ -0,0 +1,198 @@
+/**
+ * @file    MotionTrace.c
+ * @brief   Per-step trace of one motion sequence, optionally with the servo bus mocked.
+ *
+ * The trace installs a PCA9685 write hook for the length of one sequence.
+ * The hook keeps an image of the LEDn_ON/OFF registers of channels 0-7,
+ * seeded from the pose the player holds, and applies each auto-increment
+ * burst to it, so pulses come from the bytes that went (or would have gone)
+ * to the chip rather than from what the player meant to send.
+ */
+
+#include "MotionTrace.h"
+#include "ServoCal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "CycleCounter/CycleCounter.h"
+#include <string.h>
+
+static MotionTraceStep traceSteps[MOTION_TRACE_STEPS];
+static MotionTraceSummary trace;
+static uint8_t ledRegs[PCA9685_SERVO_CHANNELS][4];     // LEDn_ON_L, ON_H, OFF_L, OFF_H as last written
+static uint32_t stepStart;                             // CycleCounter stamp of the running step's start
+static uint16_t stepTransactions;
+static uint16_t stepBytes;
+
+/**
+ * @fn      static bool MotionTrace_Write(const uint8_t *data, uint16_t len)
+ * @brief   PCA9685 write hook: applies one burst to the register image.
+ * @param   data - Start register followed by register values
+ * @param   len  - Number of bytes in data
+ * @return  true in a dry run, so the write is kept off the bus
+ */
+static bool MotionTrace_Write(const uint8_t *data, uint16_t len) {
+	for (uint16_t i = 1; i < len; ++i) {
+		int reg = data[0] + (i - 1) - PCA9685_LED0_ON_L;  // Auto-increment, set up by PCA9685_SetPWMFreq()
+		if (reg >= 0 && reg < 4 * PCA9685_SERVO_CHANNELS) {
+			ledRegs[reg / 4][reg % 4] = data[i];
+		}
+	}
+	stepTransactions++;
+	stepBytes += 1 + len;
+	return trace.dryRun;
+}
+
+/**
+ * @fn      static uint16_t MotionTrace_Pulse(int channel)
+ * @brief   Pulse width of a channel in the register image, 0 when fully off.
+ */
+static uint16_t MotionTrace_Pulse(int channel) {
+	const uint8_t *led = ledRegs[channel];
+	uint16_t on = (uint16_t)(led[0] | ((led[1] & 0x0F) << 8));
+	uint16_t off = (uint16_t)(led[2] | ((led[3] & 0x0F) << 8));
+
+	if (led[3] & 0x10) {
+		return 0;  // Full-off bit
+	}
+	return (uint16_t)((off - on) & (PCA9685_PWM_COUNTS - 1));
+}
+
+/**
+ * @fn      void MotionTrace_Arm(bool dryRun)
+ * @brief   Traces the next sequence the player starts.
+ * @param   dryRun - Keep its servo writes off the bus
+ */
+void MotionTrace_Arm(bool dryRun) {
+	taskENTER_CRITICAL();
+	if (!trace.active) {
+		trace.armed = true;
+		trace.dryRun = dryRun;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      bool MotionTrace_Begin(void)
+ * @brief   Starts an armed trace at the start of a sequence. ControlTask only.
+ * @details Seeds the register image with the frame the chip holds: the
+ *          player's pose through the calibration, at the channel phase offsets.
+ * @return  true if the sequence is a dry run and the player must restore its pose afterwards
+ */
+bool MotionTrace_Begin(void) {
+	uint16_t pose[PCA9685_SERVO_CHANNELS];
+	uint16_t counts[PCA9685_SERVO_CHANNELS];
+
+	if (!trace.armed) {
+		return false;
+	}
+	MotionPlayer_GetPose(pose);
+	ServoCal_Map(pose, counts);
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		uint16_t on = (pca9685_get_phase_mode() == PCA9685_PHASE_STAGGER) ? (uint16_t)(ch * PCA9685_PHASE_STEP) : 0;
+		uint16_t off = (uint16_t)((on + counts[ch]) & (PCA9685_PWM_COUNTS - 1));
+		ledRegs[ch][0] = (uint8_t)(on & 0xFF);
+		ledRegs[ch][1] = (uint8_t)(on >> 8);
+		ledRegs[ch][2] = (uint8_t)(off & 0xFF);
+		ledRegs[ch][3] = (uint8_t)(off >> 8);
+	}
+
+	taskENTER_CRITICAL();
+	trace.armed = false;
+	trace.active = true;
+	trace.steps = 0;
+	trace.kept = 0;
+	trace.plannedMs = 0;
+	trace.actualUs = 0;
+	trace.transactions = 0;
+	trace.bytes = 0;
+	taskEXIT_CRITICAL();
+
+	stepTransactions = 0;
+	stepBytes = 0;
+	stepStart = CycleCounterNow();
+	pca9685_set_write_hook(MotionTrace_Write);
+	return trace.dryRun;
+}
+
+/**
+ * @fn      void MotionTrace_Step(uint32_t plannedMs, int frames)
+ * @brief   Closes the running step. Call after its last frame wait.
+ * @param   plannedMs - Time the player gave the step
+ * @param   frames    - Frames it wrote, catch-up frames included
+ */
+void MotionTrace_Step(uint32_t plannedMs, int frames) {
+	if (!trace.active) {
+		return;
+	}
+	uint32_t now = CycleCounterNow();
+	uint32_t us = CycleCounterToUs(now - stepStart);
+	stepStart = now;
+
+	taskENTER_CRITICAL();
+	if (trace.kept < MOTION_TRACE_STEPS) {
+		MotionTraceStep *row = &traceSteps[trace.kept++];
+		row->plannedMs = (uint16_t)plannedMs;
+		row->actualUs = us;
+		row->frames = (uint8_t)((frames > UINT8_MAX) ? UINT8_MAX : frames);
+		row->transactions = (uint8_t)((stepTransactions > UINT8_MAX) ? UINT8_MAX : stepTransactions);
+		row->bytes = stepBytes;
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			row->pulse[ch] = MotionTrace_Pulse(ch);
+		}
+	}
+	trace.steps++;
+	trace.plannedMs += plannedMs;
+	trace.actualUs += us;
+	trace.transactions += stepTransactions;
+	trace.bytes += stepBytes;
+	taskEXIT_CRITICAL();
+
+	stepTransactions = 0;
+	stepBytes = 0;
+}
+
+/**
+ * @fn      void MotionTrace_End(void)
+ * @brief   Stops the trace at the end of the sequence, played out or aborted.
+ * @details After a dry run the chip still holds the frame from before it, so
+ *          the next frame is written in full.
+ */
+void MotionTrace_End(void) {
+	if (!trace.active) {
+		return;
+	}
+	pca9685_set_write_hook(NULL);
+	if (trace.dryRun) {
+		pca9685_invalidate_shadow();
+	}
+	taskENTER_CRITICAL();
+	trace.active = false;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      void MotionTrace_GetSummary(MotionTraceSummary *summary)
+ * @brief   Copies the totals of the last (or running) trace.
+ */
+void MotionTrace_GetSummary(MotionTraceSummary *summary) {
+	taskENTER_CRITICAL();
+	*summary = trace;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      bool MotionTrace_GetStep(uint16_t index, MotionTraceStep *step)
+ * @brief   Copies one step of the last trace.
+ * @return  false if index is past the kept steps
+ */
+bool MotionTrace_GetStep(uint16_t index, MotionTraceStep *step) {
+	bool ok;
+
+	taskENTER_CRITICAL();
+	ok = index < trace.kept;
+	if (ok) {
+		*step = traceSteps[index];
+	}
+	taskEXIT_CRITICAL();
+	return ok;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file    MotionTrace.h
+ * @brief   Per-step trace of one motion sequence, optionally with the servo bus mocked.
+ *
+ * An armed trace follows the next sequence MotionPlayer plays. Every frame
+ * write to the PCA9685 is decoded register by register into per-channel
+ * pulses, and each step records its planned and measured time, the I2C
+ * transactions and bytes it took, and the pose it ended in. In a dry run
+ * the writes are not sent, so motion-path changes can be compared on a
+ * board without servo power; afterwards the player returns to the pose the
+ * servos really hold.
+ *
+ * The trace is read back as CSV with the simtrace command, one row per step:
+ *   step,planned_ms,actual_ms,error_ms,frames,transactions,bytes,a0..a7
+ */
+
+#ifndef MOTION_TRACE_H
+#define MOTION_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "MotionPlayer.h"
+
+#ifndef MOTION_TRACE_STEPS
+#define MOTION_TRACE_STEPS  32      // Longest sequence traced, later steps are counted but not kept
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		uint16_t plannedMs;         // Step time after speed scaling and speed limits
+		uint32_t actualUs;          // Step start to the next step's start
+		uint8_t frames;
+		uint8_t transactions;       // Servo bus writes
+		uint16_t bytes;             // Servo bus bytes including the address byte
+		uint16_t pulse[PCA9685_SERVO_CHANNELS];  // Pulse widths decoded from the registers at step end
+	} MotionTraceStep;
+
+	typedef struct {
+		bool armed;
+		bool active;
+		bool dryRun;
+		uint16_t steps;             // Steps played, including any not kept
+		uint16_t kept;              // Rows available from MotionTrace_GetStep()
+		uint32_t plannedMs;
+		uint32_t actualUs;
+		uint32_t transactions;
+		uint32_t bytes;
+	} MotionTraceSummary;
+
+	void MotionTrace_Arm(bool dryRun);
+	bool MotionTrace_Begin(void);
+	void MotionTrace_Step(uint32_t plannedMs, int frames);
+	void MotionTrace_End(void);
+	void MotionTrace_GetSummary(MotionTraceSummary *summary);
+	bool MotionTrace_GetStep(uint16_t index, MotionTraceStep *step);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_TRACE_H
@@ -0,0 +1,950 @@
+/**
+ * @file    MotionVm.c
+ * @brief   Bytecode interpreter for sensor-reactive motion programs.
+ *
+ * The interpreter is a MotionSource: the motion player pulls keyframes from
+ * it, and it runs instructions until one produces a keyframe (frame, move,
+ * wait, or a step of a played built-in table). Control flow and sensor tests
+ * therefore run between keyframes on ControlTask, and preemption, frame pacing
+ * and easing come from the player unchanged. Since a program may loop until a
+ * sensor changes, it also ends at a keyframe boundary as soon as any other
+ * command is queued.
+ *
+ * Programs are verified before they are accepted: every instruction must be
+ * complete, every operand in range and every target on an instruction
+ * boundary. Stack overflow, unbalanced next/ret, running off the end and
+ * spinning for MOTION_VM_OPS_PER_STEP instructions without a keyframe are
+ * caught at run time and stop the program with a fault.
+ *
+ * The assembler, disassembler and table compiler below only depend on the
+ * registry and the PCA9685 angle map, so they can be built into a host tool
+ * as well as run from the CLI.
+ */
+
+#include "MotionVm.h"
+#include "MotionRegistry.h"
+#include "MotionQueue.h"
+#include "AT42QT1010.h"
+#include "PCA9685.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "EnvTask/EnvSensorTask.h"
+#include "CycleCounter/CycleCounter.h"
+#include "I2cDriver/I2cDriver.h"
+#include <string.h>
+#include <stdio.h>
+
+#define MOTION_VM_MAX_TOKENS    12      // Mnemonic plus the 9 operands of move, with room for a label
+#define MOTION_VM_NO_ECHO       32767   // Distance reported when the ultrasonic sensor sees nothing
+
+typedef struct {
+	uint16_t pc;            // Loop body start, or return address
+	uint16_t count;         // Loop iterations left, 0 marks a call frame
+} MotionVmFrame;
+
+typedef struct {
+	MotionSource base;                      // Must stay first
+	const uint8_t *code;
+	uint16_t len;
+	uint16_t pc;
+	uint8_t sp;
+	MotionVmFrame stack[MOTION_VM_STACK_DEPTH];
+	const MotionStep *table;                // Built-in table being played by "play"
+	uint16_t tableLeft;
+	uint16_t hold[PCA9685_SERVO_CHANNELS];  // Last keyframe target, held by "wait"
+	int32_t fault;
+	uint16_t faultPc;
+	bool yieldToQueue;                      // End at the next keyframe once another command is queued
+} MotionVm;
+
+typedef struct {
+	char name[MOTION_VM_LABEL_LEN];
+	uint16_t pc;
+} MotionVmLabel;
+
+typedef struct {
+	const char *s;
+	uint8_t len;
+} MotionVmToken;
+
+static const uint8_t motionVmOpSize[MOTION_OP_COUNT] = { 1, 9, 11, 3, 2, 1, 7, 3, 1, 3, 2 };
+static const uint8_t motionVmOpArgs[MOTION_OP_COUNT] = { 0, 8, 9, 1, 1, 0, 4, 1, 0, 1, 1 };
+static const char *const motionVmMnemonics[MOTION_OP_COUNT] = {
+	"end", "frame", "move", "wait", "loop", "next", "if", "call", "ret", "jump", "play"
+};
+static const char *const motionVmSensors[MOTION_SENSOR_COUNT] = { "dist", "touch", "safe" };
+static const char *const motionVmCmps[MOTION_CMP_COUNT] = { "<", ">=", "==", "!=" };
+
+static MotionVm motionVm;                               // Program run by ControlTask
+static uint8_t activeCode[MOTION_VM_PROGRAM_MAX];       // Copy being executed
+static uint8_t pendingCode[MOTION_VM_PROGRAM_MAX];      // Last program loaded
+static uint16_t pendingLen = 0;
+static SemaphoreHandle_t vmMutex = NULL;
+static MotionVmStats vmStats;
+
+static uint16_t MotionVm_Read16(const uint8_t *p) {
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void MotionVm_Write16(uint8_t *p, uint16_t value) {
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+/**
+ * @fn      bool MotionVm_Init(void)
+ * @brief   Creates the mutex that guards the loaded program.
+ * @return  true on success
+ */
+bool MotionVm_Init(void) {
+	if (vmMutex == NULL) {
+		vmMutex = xSemaphoreCreateMutex();
+	}
+	return vmMutex != NULL;
+}
+
+static void MotionVm_Lock(void) {
+	if (vmMutex != NULL) {
+		xSemaphoreTake(vmMutex, portMAX_DELAY);
+	}
+}
+
+static void MotionVm_Unlock(void) {
+	if (vmMutex != NULL) {
+		xSemaphoreGive(vmMutex);
+	}
+}
+
+/**
+ * @fn      static int32_t MotionVm_ReadSensor(uint8_t sensor)
+ * @brief   Returns the current value of a MotionSensor.
+ */
+static int32_t MotionVm_ReadSensor(uint8_t sensor) {
+	switch (sensor) {
+		case MOTION_SENSOR_DISTANCE: {
+			int reading = distance_reading;
+			return (reading > 0) ? reading / 100 : MOTION_VM_NO_ECHO;
+		}
+		case MOTION_SENSOR_TOUCH:
+			return AT42QT1010_IsTouched() ? 1 : 0;
+		default:
+			return distance_safe ? 1 : 0;
+	}
+}
+
+/**
+ * @fn      static bool MotionVm_Test(const uint8_t *ins)
+ * @brief   Evaluates the sensor test of an "if" instruction.
+ */
+static bool MotionVm_Test(const uint8_t *ins) {
+	int32_t reading = MotionVm_ReadSensor(ins[1]);
+	int32_t value = (int16_t)MotionVm_Read16(&ins[3]);
+
+	switch (ins[2]) {
+		case MOTION_CMP_LT: return reading < value;
+		case MOTION_CMP_GE: return reading >= value;
+		case MOTION_CMP_EQ: return reading == value;
+		default:            return reading != value;
+	}
+}
+
+static bool MotionVm_Fault(MotionVm *vm, int32_t error) {
+	vm->fault = error;
+	vm->faultPc = vm->pc;
+	return false;
+}
+
+/**
+ * @fn      static void MotionVm_Yield(MotionVm *vm, const uint8_t *angles, uint16_t ms, MotionStep *step)
+ * @brief   Builds a keyframe from 8 angles and remembers it for "wait".
+ */
+static void MotionVm_Yield(MotionVm *vm, const uint8_t *angles, uint16_t ms, MotionStep *step) {
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		step->pulse[ch] = pca9685_angle_to_pulse(angles[ch]);
+		vm->hold[ch] = step->pulse[ch];
+	}
+	step->delay_ms = ms;
+}
+
+/**
+ * @fn      static bool MotionVm_Next(MotionSource *source, MotionStep *step)
+ * @brief   MotionSource hook: runs instructions until the next keyframe.
+ * @return  false at "end" or on a fault
+ */
+static bool MotionVm_Next(MotionSource *source, MotionStep *step) {
+	MotionVm *vm = (MotionVm *)source;
+
+	// Programs may loop forever; any newer command, even of the same class, ends them
+	if (vm->yieldToQueue && MotionQueue_Depth() != 0) {
+		return false;
+	}
+
+	if (vm->tableLeft > 0) {
+		*step = *vm->table++;
+		vm->tableLeft--;
+		memcpy(vm->hold, step->pulse, sizeof(vm->hold));
+		return true;
+	}
+
+	for (int ops = 0; ops < MOTION_VM_OPS_PER_STEP; ++ops) {
+		if (vm->pc >= vm->len) {
+			return MotionVm_Fault(vm, ERROR_BAD_ADDRESS);
+		}
+
+		const uint8_t *ins = &vm->code[vm->pc];
+		MotionVmFrame *top = (vm->sp > 0) ? &vm->stack[vm->sp - 1] : NULL;
+
+		switch (ins[0]) {
+			case MOTION_OP_END:
+				return false;
+
+			case MOTION_OP_FRAME:
+				MotionVm_Yield(vm, &ins[1], 0, step);
+				vm->pc += 9;
+				return true;
+
+			case MOTION_OP_MOVE:
+				MotionVm_Yield(vm, &ins[1], MotionVm_Read16(&ins[9]), step);
+				vm->pc += 11;
+				return true;
+
+			case MOTION_OP_WAIT:
+				memcpy(step->pulse, vm->hold, sizeof(vm->hold));
+				step->delay_ms = MotionVm_Read16(&ins[1]);
+				vm->pc += 3;
+				return true;
+
+			case MOTION_OP_LOOP:
+				if (vm->sp >= MOTION_VM_STACK_DEPTH) {
+					return MotionVm_Fault(vm, ERROR_OVERFLOW);
+				}
+				vm->stack[vm->sp].pc = vm->pc + 2;
+				vm->stack[vm->sp].count = ins[1];
+				vm->sp++;
+				vm->pc += 2;
+				break;
+
+			case MOTION_OP_NEXT:
+				if (top == NULL || top->count == 0) {
+					return MotionVm_Fault(vm, ERROR_BAD_DATA);
+				}
+				if (--top->count > 0) {
+					vm->pc = top->pc;
+				} else {
+					vm->sp--;
+					vm->pc += 1;
+				}
+				break;
+
+			case MOTION_OP_IF:
+				vm->pc = MotionVm_Test(ins) ? MotionVm_Read16(&ins[5]) : vm->pc + 7;
+				break;
+
+			case MOTION_OP_CALL:
+				if (vm->sp >= MOTION_VM_STACK_DEPTH) {
+					return MotionVm_Fault(vm, ERROR_OVERFLOW);
+				}
+				vm->stack[vm->sp].pc = vm->pc + 3;
+				vm->stack[vm->sp].count = 0;
+				vm->sp++;
+				vm->pc = MotionVm_Read16(&ins[1]);
+				break;
+
+			case MOTION_OP_RET:
+				if (top == NULL || top->count != 0) {
+					return MotionVm_Fault(vm, ERROR_BAD_DATA);
+				}
+				vm->pc = top->pc;
+				vm->sp--;
+				break;
+
+			case MOTION_OP_JUMP:
+				vm->pc = MotionVm_Read16(&ins[1]);
+				break;
+
+			case MOTION_OP_PLAY: {
+				const MotionEntry *entry = MotionRegistry_Get((RobotState)ins[1]);
+				vm->pc += 2;
+				if (entry != NULL && entry->count > 0) {
+					vm->table = entry->steps;
+					vm->tableLeft = (uint16_t)entry->count;
+					return MotionVm_Next(source, step);
+				}
+				break;
+			}
+
+			default:
+				return MotionVm_Fault(vm, ERROR_UNSUPPORTED_OP);
+		}
+	}
+
+	// Control flow only, never reaching a keyframe
+	return MotionVm_Fault(vm, ERROR_TIMEOUT);
+}
+
+/**
+ * @fn      int32_t MotionVm_Verify(const uint8_t *code, uint16_t len)
+ * @brief   Checks that a program is well formed before it is accepted.
+ * @param   code - Program bytes
+ * @param   len  - Program length
+ * @return  0 if valid, otherwise an ERROR_ code
+ */
+int32_t MotionVm_Verify(const uint8_t *code, uint16_t len) {
+	uint8_t starts[MOTION_VM_PROGRAM_MAX / 8];
+	uint16_t pc;
+
+	if (code == NULL || len == 0 || len > MOTION_VM_PROGRAM_MAX) {
+		return ERROR_INVALID_ARG;
+	}
+	memset(starts, 0, sizeof(starts));
+
+	// Decode linearly, checking operands and marking instruction boundaries
+	for (pc = 0; pc < len; pc += motionVmOpSize[code[pc]]) {
+		const uint8_t *ins = &code[pc];
+		if (ins[0] >= MOTION_OP_COUNT || pc + motionVmOpSize[ins[0]] > len) {
+			return ERROR_BAD_FORMAT;
+		}
+		switch (ins[0]) {
+			case MOTION_OP_FRAME:
+			case MOTION_OP_MOVE:
+				for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+					if (ins[1 + ch] > 180) {
+						return ERROR_BAD_FORMAT;
+					}
+				}
+				break;
+			case MOTION_OP_LOOP:
+				if (ins[1] == 0) {
+					return ERROR_BAD_FORMAT;
+				}
+				break;
+			case MOTION_OP_IF:
+				if (ins[1] >= MOTION_SENSOR_COUNT || ins[2] >= MOTION_CMP_COUNT) {
+					return ERROR_BAD_FORMAT;
+				}
+				break;
+			case MOTION_OP_PLAY:
+				if (MotionRegistry_Get((RobotState)ins[1]) == NULL) {
+					return ERROR_BAD_FORMAT;
+				}
+				break;
+			default:
+				break;
+		}
+		starts[pc >> 3] |= (uint8_t)(1 << (pc & 7));
+	}
+
+	// Every branch must land on an instruction
+	for (pc = 0; pc < len; pc += motionVmOpSize[code[pc]]) {
+		uint16_t target;
+		switch (code[pc]) {
+			case MOTION_OP_IF:   target = MotionVm_Read16(&code[pc + 5]); break;
+			case MOTION_OP_CALL:
+			case MOTION_OP_JUMP: target = MotionVm_Read16(&code[pc + 1]); break;
+			default:             continue;
+		}
+		if (target >= len || !(starts[target >> 3] & (1 << (target & 7)))) {
+			return ERROR_BAD_ADDRESS;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @fn      int32_t MotionVm_Load(const uint8_t *code, uint16_t len)
+ * @brief   Verifies a binary program and makes it the one STATE_VM_PROGRAM runs.
+ * @param   code - Program bytes
+ * @param   len  - Program length
+ * @return  0 on success, otherwise an ERROR_ code (the loaded program is kept)
+ */
+int32_t MotionVm_Load(const uint8_t *code, uint16_t len) {
+	int32_t result = MotionVm_Verify(code, len);
+	if (result != 0) {
+		return result;
+	}
+
+	MotionVm_Lock();
+	memcpy(pendingCode, code, len);
+	pendingLen = len;
+	MotionVm_Unlock();
+	return 0;
+}
+
+/**
+ * @fn      int32_t MotionVm_LoadText(const char *text, size_t len, uint16_t *errorLine)
+ * @brief   Assembles a program directly into the load buffer.
+ * @details On failure no program is left loaded.
+ * @param   text      - Assembly source, not necessarily terminated
+ * @param   len       - Length of text
+ * @param   errorLine - Receives the failing statement number, 0 on success
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+int32_t MotionVm_LoadText(const char *text, size_t len, uint16_t *errorLine) {
+	uint16_t codeLen = 0;
+
+	MotionVm_Lock();
+	int32_t result = MotionVm_Assemble(text, len, pendingCode, sizeof(pendingCode), &codeLen, errorLine);
+	pendingLen = (result == 0) ? codeLen : 0;
+	MotionVm_Unlock();
+	return result;
+}
+
+/**
+ * @fn      uint16_t MotionVm_GetProgram(uint8_t *code, uint16_t size)
+ * @brief   Copies the loaded program, e.g. for listing or saving.
+ * @return  Program length, 0 if none is loaded or it does not fit
+ */
+uint16_t MotionVm_GetProgram(uint8_t *code, uint16_t size) {
+	MotionVm_Lock();
+	uint16_t len = (pendingLen <= size) ? pendingLen : 0;
+	memcpy(code, pendingCode, len);
+	MotionVm_Unlock();
+	return len;
+}
+
+/**
+ * @fn      int32_t MotionVm_Run(void)
+ * @brief   Plays the loaded program. ControlTask only.
+ * @details The program is copied first, so a new one can be loaded while this
+ *          one runs.
+ * @return  0 on success, ERROR_ABORTED if preempted, ERROR_NOT_FOUND if nothing
+ *          is loaded, otherwise the fault or I2C error
+ */
+int32_t MotionVm_Run(void) {
+	MotionVm *vm = &motionVm;
+
+	MotionVm_Lock();
+	uint16_t len = pendingLen;
+	memcpy(activeCode, pendingCode, len);
+	MotionVm_Unlock();
+
+	if (len == 0) {
+		return ERROR_NOT_FOUND;
+	}
+
+	vm->base.next = MotionVm_Next;
+	vm->base.prefetch = NULL;
+	vm->code = activeCode;
+	vm->len = len;
+	vm->pc = 0;
+	vm->sp = 0;
+	vm->tableLeft = 0;
+	vm->fault = 0;
+	vm->yieldToQueue = true;
+	MotionPlayer_GetPose(vm->hold);
+	vmStats.runs++;
+
+	int32_t result = MotionPlayer_PlaySource(&vm->base);
+	if (result == 0 && vm->fault != 0) {
+		result = vm->fault;
+		taskENTER_CRITICAL();
+		vmStats.faults++;
+		vmStats.lastFault = vm->fault;
+		vmStats.lastFaultPc = vm->faultPc;
+		taskEXIT_CRITICAL();
+	}
+	return result;
+}
+
+/**
+ * @fn      static int MotionVm_Tokenize(const char *s, size_t len, MotionVmToken *tok)
+ * @brief   Splits one statement at blanks and commas; '#' starts a comment.
+ * @return  Number of tokens, -1 if there are too many
+ */
+static int MotionVm_Tokenize(const char *s, size_t len, MotionVmToken *tok) {
+	int n = 0;
+	size_t i = 0;
+
+	for (;;) {
+		while (i < len && (s[i] == ' ' || s[i] == '\t' || s[i] == ',' || s[i] == '\r')) i++;
+		if (i >= len || s[i] == '#') {
+			return n;
+		}
+		size_t start = i;
+		while (i < len && s[i] != ' ' && s[i] != '\t' && s[i] != ',' && s[i] != '\r' && s[i] != '#') i++;
+		if (n == MOTION_VM_MAX_TOKENS || i - start > 255) {
+			return -1;
+		}
+		tok[n].s = &s[start];
+		tok[n].len = (uint8_t)(i - start);
+		n++;
+	}
+}
+
+static int MotionVm_Lookup(const MotionVmToken *tok, const char *const *words, int count) {
+	for (int i = 0; i < count; ++i) {
+		if (strlen(words[i]) == tok->len && strncmp(tok->s, words[i], tok->len) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @fn      static bool MotionVm_ParseInt(const char *s, size_t len, int32_t min, int32_t max, int32_t *value)
+ * @brief   Parses a decimal integer and range-checks it.
+ */
+static bool MotionVm_ParseInt(const char *s, size_t len, int32_t min, int32_t max, int32_t *value) {
+	bool negative = (len > 0 && s[0] == '-');
+	size_t i = negative ? 1 : 0;
+	int32_t v = 0;
+
+	if (i >= len || len - i > 6) {
+		return false;
+	}
+	for (; i < len; ++i) {
+		if (s[i] < '0' || s[i] > '9') {
+			return false;
+		}
+		v = v * 10 + (s[i] - '0');
+	}
+	v = negative ? -v : v;
+	if (v < min || v > max) {
+		return false;
+	}
+	*value = v;
+	return true;
+}
+
+/**
+ * @fn      static bool MotionVm_ParseTarget(const MotionVmToken *tok, const MotionVmLabel *labels, int labelCount, bool resolve, uint16_t *pc)
+ * @brief   Resolves "@offset" or a label name. Unknown labels are only an error once resolving.
+ */
+static bool MotionVm_ParseTarget(const MotionVmToken *tok, const MotionVmLabel *labels, int labelCount,
+                                 bool resolve, uint16_t *pc) {
+	int32_t value;
+
+	if (tok->len > 1 && tok->s[0] == '@') {
+		if (!MotionVm_ParseInt(tok->s + 1, tok->len - 1, 0, MOTION_VM_PROGRAM_MAX - 1, &value)) {
+			return false;
+		}
+		*pc = (uint16_t)value;
+		return true;
+	}
+	for (int i = 0; i < labelCount; ++i) {
+		if (strlen(labels[i].name) == tok->len && strncmp(tok->s, labels[i].name, tok->len) == 0) {
+			*pc = labels[i].pc;
+			return true;
+		}
+	}
+	*pc = 0;
+	return !resolve;
+}
+
+/**
+ * @fn      static int32_t MotionVm_Encode(const MotionVmToken *tok, int n, const MotionVmLabel *labels, int labelCount, bool resolve, uint8_t *ins)
+ * @brief   Encodes one instruction.
+ * @return  Instruction size, or a negative ERROR_ code
+ */
+static int32_t MotionVm_Encode(const MotionVmToken *tok, int n, const MotionVmLabel *labels, int labelCount,
+                               bool resolve, uint8_t *ins) {
+	int op = MotionVm_Lookup(&tok[0], motionVmMnemonics, MOTION_OP_COUNT);
+	int32_t value;
+	uint16_t target;
+
+	if (op < 0) {
+		return ERROR_UNSUPPORTED_OP;
+	}
+	if (n - 1 != motionVmOpArgs[op]) {
+		return ERROR_WRONG_LENGTH;
+	}
+	ins[0] = (uint8_t)op;
+
+	switch (op) {
+		case MOTION_OP_FRAME:
+		case MOTION_OP_MOVE:
+			for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+				if (!MotionVm_ParseInt(tok[1 + ch].s, tok[1 + ch].len, 0, 180, &value)) {
+					return ERROR_BAD_FORMAT;
+				}
+				ins[1 + ch] = (uint8_t)value;
+			}
+			if (op == MOTION_OP_MOVE) {
+				if (!MotionVm_ParseInt(tok[9].s, tok[9].len, 0, 65535, &value)) {
+					return ERROR_BAD_FORMAT;
+				}
+				MotionVm_Write16(&ins[9], (uint16_t)value);
+			}
+			break;
+
+		case MOTION_OP_WAIT:
+			if (!MotionVm_ParseInt(tok[1].s, tok[1].len, 0, 65535, &value)) {
+				return ERROR_BAD_FORMAT;
+			}
+			MotionVm_Write16(&ins[1], (uint16_t)value);
+			break;
+
+		case MOTION_OP_LOOP:
+			if (!MotionVm_ParseInt(tok[1].s, tok[1].len, 1, 255, &value)) {
+				return ERROR_BAD_FORMAT;
+			}
+			ins[1] = (uint8_t)value;
+			break;
+
+		case MOTION_OP_IF: {
+			int sensor = MotionVm_Lookup(&tok[1], motionVmSensors, MOTION_SENSOR_COUNT);
+			int cmp = MotionVm_Lookup(&tok[2], motionVmCmps, MOTION_CMP_COUNT);
+			if (sensor < 0 || cmp < 0 || !MotionVm_ParseInt(tok[3].s, tok[3].len, -32768, 32767, &value) ||
+			    !MotionVm_ParseTarget(&tok[4], labels, labelCount, resolve, &target)) {
+				return ERROR_BAD_FORMAT;
+			}
+			ins[1] = (uint8_t)sensor;
+			ins[2] = (uint8_t)cmp;
+			MotionVm_Write16(&ins[3], (uint16_t)value);
+			MotionVm_Write16(&ins[5], target);
+			break;
+		}
+
+		case MOTION_OP_CALL:
+		case MOTION_OP_JUMP:
+			if (!MotionVm_ParseTarget(&tok[1], labels, labelCount, resolve, &target)) {
+				return ERROR_BAD_FORMAT;
+			}
+			MotionVm_Write16(&ins[1], target);
+			break;
+
+		case MOTION_OP_PLAY: {
+			const MotionEntry *entry = MotionRegistry_FindN(tok[1].s, tok[1].len);
+			if (entry == NULL) {
+				return ERROR_NOT_FOUND;
+			}
+			ins[1] = (uint8_t)entry->state;
+			break;
+		}
+
+		default:
+			break;
+	}
+	return motionVmOpSize[op];
+}
+
+/**
+ * @fn      int32_t MotionVm_Assemble(const char *text, size_t len, uint8_t *code, uint16_t size, uint16_t *codeLen, uint16_t *errorLine)
+ * @brief   Two-pass assembler for the mnemonics listed in MotionVm.h.
+ * @details Statements are separated by ';' or newlines. "name:" defines a
+ *          label, targets are label names or "@offset", and "play" takes any
+ *          registry name. An "end" is appended if the program does not finish
+ *          with one. The result is verified before returning.
+ * @param   text      - Assembly source, not necessarily terminated
+ * @param   len       - Length of text
+ * @param   code      - Output buffer
+ * @param   size      - Size of code
+ * @param   codeLen   - Receives the program length
+ * @param   errorLine - Receives the failing statement number, 0 on success
+ * @return  0 on success, otherwise an ERROR_ code
+ */
+int32_t MotionVm_Assemble(const char *text, size_t len, uint8_t *code, uint16_t size,
+                          uint16_t *codeLen, uint16_t *errorLine) {
+	MotionVmLabel labels[MOTION_VM_LABELS];
+	MotionVmToken tok[MOTION_VM_MAX_TOKENS];
+	int labelCount = 0;
+	uint16_t pc = 0;
+
+	if (size > MOTION_VM_PROGRAM_MAX) {
+		size = MOTION_VM_PROGRAM_MAX;
+	}
+
+	for (int pass = 0; pass < 2; ++pass) {
+		uint8_t lastOp = MOTION_OP_COUNT;
+		uint16_t line = 0;
+		size_t pos = 0;
+		pc = 0;
+
+		while (pos < len) {
+			size_t end = pos;
+			while (end < len && text[end] != ';' && text[end] != '\n') end++;
+			int n = MotionVm_Tokenize(&text[pos], end - pos, tok);
+			pos = end + 1;
+			*errorLine = ++line;
+
+			if (n < 0) {
+				return ERROR_BAD_FORMAT;
+			}
+			int first = 0;
+			if (n > 0 && tok[0].s[tok[0].len - 1] == ':') {
+				if (pass == 0) {
+					size_t nameLen = tok[0].len - 1;
+					if (nameLen == 0 || nameLen >= MOTION_VM_LABEL_LEN) {
+						return ERROR_BAD_FORMAT;
+					}
+					if (labelCount == MOTION_VM_LABELS) {
+						return ERROR_NO_MEMORY;
+					}
+					memcpy(labels[labelCount].name, tok[0].s, nameLen);
+					labels[labelCount].name[nameLen] = '\0';
+					labels[labelCount].pc = pc;
+					labelCount++;
+				}
+				first = 1;
+			}
+			if (first >= n) {
+				continue;
+			}
+
+			uint8_t ins[11];
+			int32_t insLen = MotionVm_Encode(&tok[first], n - first, labels, labelCount, pass == 1, ins);
+			if (insLen < 0) {
+				return insLen;
+			}
+			if (pc + insLen > size) {
+				return ERROR_NO_MEMORY;
+			}
+			if (pass == 1) {
+				memcpy(&code[pc], ins, insLen);
+			}
+			pc += (uint16_t)insLen;
+			lastOp = ins[0];
+		}
+
+		if (lastOp != MOTION_OP_END) {
+			if (pc + 1 > size) {
+				return ERROR_NO_MEMORY;
+			}
+			if (pass == 1) {
+				code[pc] = MOTION_OP_END;
+			}
+			pc++;
+		}
+	}
+
+	*codeLen = pc;
+	*errorLine = 0;
+	return MotionVm_Verify(code, pc);
+}
+
+/**
+ * @fn      uint16_t MotionVm_Disassemble(const uint8_t *code, uint16_t len, uint16_t pc, char *out, size_t size)
+ * @brief   Formats one instruction as "offset: mnemonic operands".
+ * @details The output assembles back to the same bytes.
+ * @param   code - Program bytes
+ * @param   len  - Program length
+ * @param   pc   - Offset of the instruction
+ * @param   out  - Text buffer
+ * @param   size - Size of out
+ * @return  Instruction size, 0 past the end or on an invalid instruction
+ */
+uint16_t MotionVm_Disassemble(const uint8_t *code, uint16_t len, uint16_t pc, char *out, size_t size) {
+	if (pc >= len || code[pc] >= MOTION_OP_COUNT || pc + motionVmOpSize[code[pc]] > len || size == 0) {
+		return 0;
+	}
+
+	const uint8_t *ins = &code[pc];
+	size_t w = (size_t)snprintf(out, size, "%3u: %s", pc, motionVmMnemonics[ins[0]]);
+
+	switch (ins[0]) {
+		case MOTION_OP_FRAME:
+		case MOTION_OP_MOVE:
+			for (int ch = 0; ch < PCA9685_SERVO_CHANNELS && w < size; ++ch) {
+				w += (size_t)snprintf(out + w, size - w, " %u", ins[1 + ch]);
+			}
+			if (ins[0] == MOTION_OP_MOVE && w < size) {
+				snprintf(out + w, size - w, " %u", MotionVm_Read16(&ins[9]));
+			}
+			break;
+		case MOTION_OP_WAIT:
+			snprintf(out + w, size - w, " %u", MotionVm_Read16(&ins[1]));
+			break;
+		case MOTION_OP_LOOP:
+			snprintf(out + w, size - w, " %u", ins[1]);
+			break;
+		case MOTION_OP_IF:
+			snprintf(out + w, size - w, " %s %s %d @%u",
+			         (ins[1] < MOTION_SENSOR_COUNT) ? motionVmSensors[ins[1]] : "?",
+			         (ins[2] < MOTION_CMP_COUNT) ? motionVmCmps[ins[2]] : "?",
+			         (int16_t)MotionVm_Read16(&ins[3]), MotionVm_Read16(&ins[5]));
+			break;
+		case MOTION_OP_CALL:
+		case MOTION_OP_JUMP:
+			snprintf(out + w, size - w, " @%u", MotionVm_Read16(&ins[1]));
+			break;
+		case MOTION_OP_PLAY: {
+			const MotionEntry *entry = MotionRegistry_Get((RobotState)ins[1]);
+			snprintf(out + w, size - w, " %s", (entry != NULL) ? entry->name : "?");
+			break;
+		}
+		default:
+			break;
+	}
+	return motionVmOpSize[ins[0]];
+}
+
+/**
+ * @fn      uint16_t MotionVm_CompileTable(const MotionStep *steps, uint16_t count, uint8_t *code, uint16_t size)
+ * @brief   Compiles a packed keyframe table into a straight-line program.
+ * @details Each step becomes a "move"; pulse counts go back to whole degrees,
+ *          which is exact for the built-in tables since they were written in degrees.
+ * @param   steps - Keyframes
+ * @param   count - Number of keyframes
+ * @param   code  - Output buffer
+ * @param   size  - Size of code
+ * @return  Program length, 0 if it does not fit
+ */
+uint16_t MotionVm_CompileTable(const MotionStep *steps, uint16_t count, uint8_t *code, uint16_t size) {
+	uint16_t pc = 0;
+
+	for (uint16_t i = 0; i < count; ++i) {
+		if (pc + 11 + 1 > size) {
+			return 0;
+		}
+		code[pc] = MOTION_OP_MOVE;
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			code[pc + 1 + ch] = (uint8_t)pca9685_pulse_to_angle(steps[i].pulse[ch]);
+		}
+		MotionVm_Write16(&code[pc + 9], steps[i].delay_ms);
+		pc += 11;
+	}
+	code[pc++] = MOTION_OP_END;
+	return pc;
+}
+
+/**
+ * @fn      void MotionVm_GetStats(MotionVmStats *stats)
+ * @brief   Copies the interpreter counters.
+ * @param   stats - Destination structure
+ */
+void MotionVm_GetStats(MotionVmStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = vmStats;
+	stats->loadedLen = pendingLen;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      static uint32_t MotionVm_TimeNext(MotionVm *vm, const uint8_t *code, uint16_t len, const MotionVmFrame *frames, uint8_t depth, uint32_t iterations)
+ * @brief   Total cycles of iterations keyframe fetches starting at offset 0.
+ * @details Each fetch starts with the given frames on the stack, the last one on top.
+ */
+static uint32_t MotionVm_TimeNext(MotionVm *vm, const uint8_t *code, uint16_t len, const MotionVmFrame *frames,
+                                  uint8_t depth, uint32_t iterations) {
+	MotionStep step;
+	uint32_t sum = 0;
+	volatile uint32_t sink;
+
+	vm->code = code;
+	vm->len = len;
+
+	uint32_t start = CycleCounterNow();
+	for (uint32_t i = 0; i < iterations; ++i) {
+		vm->pc = 0;
+		vm->tableLeft = 0;
+		for (vm->sp = 0; vm->sp < depth; ++vm->sp) {
+			vm->stack[vm->sp] = frames[vm->sp];
+		}
+		MotionVm_Next(&vm->base, &step);
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			sum += step.pulse[ch];  // The whole step, so an inlined fetch cannot skip decoding most of it
+		}
+		sum += step.delay_ms;
+	}
+	uint32_t cycles = CycleCounterNow() - start;
+	sink = sum;
+	(void)sink;
+
+	return cycles;
+}
+
+/**
+ * @fn      static uint32_t MotionVm_TimeChain(MotionVm *vm, uint8_t *code, const uint8_t *op, uint8_t opLen, uint8_t chain, const MotionVmFrame *frames, uint8_t depth, uint32_t iterations)
+ * @brief   Total cycles of iterations runs of chain copies of one instruction and a closing "wait".
+ * @details Branch targets of jump, call and if are patched to the copy that
+ *          follows, so every copy runs once.
+ */
+static uint32_t MotionVm_TimeChain(MotionVm *vm, uint8_t *code, const uint8_t *op, uint8_t opLen, uint8_t chain,
+                                   const MotionVmFrame *frames, uint8_t depth, uint32_t iterations) {
+	uint16_t pc = 0;
+
+	for (uint8_t i = 0; i < chain; ++i, pc += opLen) {
+		memcpy(&code[pc], op, opLen);
+		if (op[0] == MOTION_OP_JUMP || op[0] == MOTION_OP_CALL) {
+			MotionVm_Write16(&code[pc + 1], (uint16_t)(pc + opLen));
+		} else if (op[0] == MOTION_OP_IF) {
+			MotionVm_Write16(&code[pc + 5], (uint16_t)(pc + opLen));
+		}
+	}
+	code[pc] = MOTION_OP_WAIT;
+	MotionVm_Write16(&code[pc + 1], 300);
+	return MotionVm_TimeNext(vm, code, (uint16_t)(pc + 3), frames, depth, iterations);
+}
+
+/**
+ * @fn      void MotionVm_Benchmark(uint32_t iterations, uint32_t cycles[MOTION_OP_COUNT])
+ * @brief   Measures the interpreter cost of each opcode on the target.
+ * @details Keyframe opcodes (frame, move, wait, play) are timed as one fetch
+ *          including dispatch. A control-flow opcode costs less than one tick
+ *          of the host clock, so it is timed as a chain of identical copies
+ *          ahead of one "wait"; the cost of a lone "wait" is subtracted and
+ *          the rest divided by the chain length. Chains are as long as the
+ *          step budget and a program allow, or the stack for loop, call
+ *          and ret. Sensor
+ *          tests read the cached ultrasonic distance; nothing touches the bus.
+ * @param   iterations - Fetches per opcode
+ * @param   cycles     - Receives average CPU cycles per opcode, times MOTION_VM_BENCH_SCALE
+ */
+void MotionVm_Benchmark(uint32_t iterations, uint32_t cycles[MOTION_OP_COUNT]) {
+	static const uint8_t endCode[]   = { MOTION_OP_END };
+	static const uint8_t frameCode[] = { MOTION_OP_FRAME, 90, 90, 90, 90, 90, 90, 90, 90 };
+	static const uint8_t moveCode[]  = { MOTION_OP_MOVE, 140, 90, 90, 40, 40, 90, 90, 140, 44, 1 };
+	static const uint8_t waitCode[]  = { MOTION_OP_WAIT, 44, 1 };
+	static const uint8_t playCode[]  = { MOTION_OP_PLAY, STATE_IDLE };
+	static const uint8_t loopOp[]    = { MOTION_OP_LOOP, 2 };
+	static const uint8_t nextOp[]    = { MOTION_OP_NEXT };
+	static const uint8_t ifOp[]      = { MOTION_OP_IF, MOTION_SENSOR_DISTANCE, MOTION_CMP_LT, 0, 0, 0, 0 };
+	static const uint8_t callOp[]    = { MOTION_OP_CALL, 0, 0 };
+	static const uint8_t retOp[]     = { MOTION_OP_RET };
+	static const uint8_t jumpOp[]    = { MOTION_OP_JUMP, 0, 0 };
+	const uint8_t longChain = MOTION_VM_OPS_PER_STEP - 1;  // Leaves one op for the closing wait
+	const uint8_t ifChain = (MOTION_VM_PROGRAM_MAX - 3) / sizeof(ifOp);
+	static uint8_t chain[MOTION_VM_PROGRAM_MAX];  // Not on the stack of the CLI task
+	MotionVmFrame frames[MOTION_VM_STACK_DEPTH];
+	uint32_t flow[MOTION_OP_COUNT] = { 0 };
+	uint8_t length[MOTION_OP_COUNT] = { 0 };
+	MotionVm vm;
+
+	memset(&vm, 0, sizeof(vm));
+	memset(cycles, 0, sizeof(uint32_t) * MOTION_OP_COUNT);
+	if (iterations == 0) return;
+
+	vm.base.next = MotionVm_Next;
+	MotionPlayer_GetPose(vm.hold);
+
+	uint32_t wait = MotionVm_TimeNext(&vm, waitCode, sizeof(waitCode), NULL, 0, iterations);
+	cycles[MOTION_OP_WAIT]  = wait;
+	cycles[MOTION_OP_END]   = MotionVm_TimeNext(&vm, endCode, sizeof(endCode), NULL, 0, iterations);
+	cycles[MOTION_OP_FRAME] = MotionVm_TimeNext(&vm, frameCode, sizeof(frameCode), NULL, 0, iterations);
+	cycles[MOTION_OP_MOVE]  = MotionVm_TimeNext(&vm, moveCode, sizeof(moveCode), NULL, 0, iterations);
+	cycles[MOTION_OP_PLAY]  = MotionVm_TimeNext(&vm, playCode, sizeof(playCode), NULL, 0, iterations);
+
+	length[MOTION_OP_LOOP] = MOTION_VM_STACK_DEPTH;
+	flow[MOTION_OP_LOOP] = MotionVm_TimeChain(&vm, chain, loopOp, sizeof(loopOp), MOTION_VM_STACK_DEPTH, NULL, 0,
+	                                          iterations);
+	// One frame that sends each "next" back to itself until the last falls through
+	frames[0].pc = 0;
+	frames[0].count = longChain;
+	length[MOTION_OP_NEXT] = longChain;
+	flow[MOTION_OP_NEXT] = MotionVm_TimeChain(&vm, chain, nextOp, sizeof(nextOp), 1, frames, 1, iterations);
+	length[MOTION_OP_IF] = ifChain;
+	flow[MOTION_OP_IF] = MotionVm_TimeChain(&vm, chain, ifOp, sizeof(ifOp), ifChain, NULL, 0, iterations);
+	length[MOTION_OP_CALL] = MOTION_VM_STACK_DEPTH;
+	flow[MOTION_OP_CALL] = MotionVm_TimeChain(&vm, chain, callOp, sizeof(callOp), MOTION_VM_STACK_DEPTH, NULL, 0,
+	                                          iterations);
+	// Return addresses stacked so that each "ret" lands on the one after it
+	for (uint8_t i = 0; i < MOTION_VM_STACK_DEPTH; ++i) {
+		frames[i].pc = (uint16_t)(MOTION_VM_STACK_DEPTH - i);
+		frames[i].count = 0;
+	}
+	length[MOTION_OP_RET] = MOTION_VM_STACK_DEPTH;
+	flow[MOTION_OP_RET] = MotionVm_TimeChain(&vm, chain, retOp, sizeof(retOp), MOTION_VM_STACK_DEPTH, frames,
+	                                         MOTION_VM_STACK_DEPTH, iterations);
+	length[MOTION_OP_JUMP] = longChain;
+	flow[MOTION_OP_JUMP] = MotionVm_TimeChain(&vm, chain, jumpOp, sizeof(jumpOp), longChain, NULL, 0, iterations);
+
+	for (int op = 0; op < MOTION_OP_COUNT; ++op) {
+		if (length[op] != 0) {
+			uint64_t net = (flow[op] > wait) ? flow[op] - wait : 0;
+			cycles[op] = (uint32_t)(net * MOTION_VM_BENCH_SCALE / ((uint64_t)iterations * length[op]));
+		} else {
+			cycles[op] = (uint32_t)((uint64_t)cycles[op] * MOTION_VM_BENCH_SCALE / iterations);
+		}
+	}
+}
@@ -0,0 +1,98 @@
+/**
+ * @file    MotionVm.h
+ * @brief   Bytecode interpreter for sensor-reactive motion programs.
+ *
+ * A program is a byte string of instructions (opcode byte, little-endian
+ * operands). Keyframes are stored as whole degrees, so a MOVE is 11 bytes.
+ * Jump targets are absolute byte offsets. Loops and calls share one bounded
+ * stack, so a program cannot use more RAM than MOTION_VM_STACK_DEPTH frames.
+ *
+ *  op  mnemonic                         bytes
+ *  00  end                                1
+ *  01  frame a0..a7                       9   snap to the pose
+ *  02  move  a0..a7 ms                   11   interpolate to the pose
+ *  03  wait  ms                           3   hold the pose
+ *  04  loop  n                            2   repeat up to the matching next n times
+ *  05  next                               1
+ *  06  if    sensor cmp value target      7   branch when the sensor test holds
+ *  07  call  target                       3
+ *  08  ret                                1
+ *  09  jump  target                       3
+ *  0A  play  motion                       2   play a built-in table as a subsequence
+ */
+
+#ifndef MOTION_VM_H
+#define MOTION_VM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "MotionPlayer.h"
+
+#define MOTION_VM_PROGRAM_MAX   256     // Largest program in bytes
+#define MOTION_VM_STACK_DEPTH   8       // Nested loops plus calls
+#define MOTION_VM_OPS_PER_STEP  64      // Instructions allowed between two keyframes
+#define MOTION_VM_LABELS        8       // Labels per assembled program
+#define MOTION_VM_LABEL_LEN     8       // Including the terminator
+#define MOTION_VM_BENCH_SCALE   100     // MotionVm_Benchmark() reports 1/100 cycle
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef enum {
+		MOTION_OP_END,
+		MOTION_OP_FRAME,
+		MOTION_OP_MOVE,
+		MOTION_OP_WAIT,
+		MOTION_OP_LOOP,
+		MOTION_OP_NEXT,
+		MOTION_OP_IF,
+		MOTION_OP_CALL,
+		MOTION_OP_RET,
+		MOTION_OP_JUMP,
+		MOTION_OP_PLAY,
+		MOTION_OP_COUNT
+	} MotionOpcode;
+
+	typedef enum {
+		MOTION_SENSOR_DISTANCE,     // Ultrasonic distance in cm, no echo reads as 32767
+		MOTION_SENSOR_TOUCH,        // 1 while the touch pad is pressed
+		MOTION_SENSOR_SAFE,         // 1 while no obstacle is in range
+		MOTION_SENSOR_COUNT
+	} MotionSensor;
+
+	typedef enum {
+		MOTION_CMP_LT,
+		MOTION_CMP_GE,
+		MOTION_CMP_EQ,
+		MOTION_CMP_NE,
+		MOTION_CMP_COUNT
+	} MotionCmp;
+
+	typedef struct {
+		uint32_t runs;              // Programs started
+		uint32_t faults;            // Programs stopped by a runtime fault
+		int32_t lastFault;          // ERROR_ code of the last fault
+		uint16_t lastFaultPc;       // Offset of the faulting instruction
+		uint16_t loadedLen;         // Size of the program waiting to run
+	} MotionVmStats;
+
+	bool MotionVm_Init(void);
+	int32_t MotionVm_Verify(const uint8_t *code, uint16_t len);
+	int32_t MotionVm_Load(const uint8_t *code, uint16_t len);
+	int32_t MotionVm_LoadText(const char *text, size_t len, uint16_t *errorLine);
+	uint16_t MotionVm_GetProgram(uint8_t *code, uint16_t size);
+	int32_t MotionVm_Run(void);
+	int32_t MotionVm_Assemble(const char *text, size_t len, uint8_t *code, uint16_t size,
+	                          uint16_t *codeLen, uint16_t *errorLine);
+	uint16_t MotionVm_Disassemble(const uint8_t *code, uint16_t len, uint16_t pc, char *out, size_t size);
+	uint16_t MotionVm_CompileTable(const MotionStep *steps, uint16_t count, uint8_t *code, uint16_t size);
+	void MotionVm_GetStats(MotionVmStats *stats);
+	void MotionVm_Benchmark(uint32_t iterations, uint32_t cycles[MOTION_OP_COUNT]);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // MOTION_VM_H
@@ -12,9 +12,72 @@
 #include "SerialConsole.h"
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
+#include "ServoCal.h"
+#include "CycleCounter/CycleCounter.h"
+#include "MotionQueue.h"
 #include <string.h> 
+#include <stdbool.h>
 
-I2C_Data PCA9685Data; // Global I2C communication data structure for PCA9685
+static uint16_t shadowOff[PCA9685_SERVO_CHANNELS];  // LEDn_OFF of channels 0-7 as last written to the chip
+static bool shadowValid = false;                    // Cleared whenever the chip may not match the shadow
+static PCA9685BusStats busStats;
+static PCA9685PhaseMode phaseMode = PCA9685_PHASE_ALIGNED;
+static uint8_t prescaleSet = PCA9685_PRESCALE_POR;      // PRE_SCALE last programmed by PCA9685_SetPWMFreq()
+static bool shadowLoaded = false;                       // shadowOff holds a frame that reached the chip once
+static TickType_t healthLastCheck;
+static PCA9685HealthStats healthStats;
+static PCA9685WriteHook writeHook = NULL;              // Sees every frame burst, may keep it off the bus
+static SemaphoreHandle_t servoMutex = NULL;            // Held across every sequence of servo writes and readbacks
+
+#define PCA9685_RUNS_MAX    ((PCA9685_SERVO_CHANNELS + 1) / 2)   // Most delta bursts one frame can need
+static uint8_t runData[PCA9685_RUNS_MAX][PCA9685_FRAME_LEN];  // Delta bursts of the frame in flight
+static I2C_Request runReq[PCA9685_RUNS_MAX];
+
+static void pca9685_lock(void) {
+	if (servoMutex != NULL) {
+		xSemaphoreTake(servoMutex, portMAX_DELAY);
+	}
+}
+
+static void pca9685_unlock(void) {
+	if (servoMutex != NULL) {
+		xSemaphoreGive(servoMutex);
+	}
+}
+
+/**
+ * @fn      static uint16_t pca9685_phase_on(PCA9685PhaseMode mode, int channel)
+ * @brief   LEDn_ON count where a channel's pulse starts in the given phase mode.
+ */
+static uint16_t pca9685_phase_on(PCA9685PhaseMode mode, int channel) {
+	return (mode == PCA9685_PHASE_STAGGER) ? (uint16_t)(channel * PCA9685_PHASE_STEP) : 0;
+}
+
+/**
+ * @fn      static void pca9685_put_led(uint8_t *led, int channel, uint16_t count, bool withOn)
+ * @brief   Fills the LEDn_ON/OFF register bytes for one channel.
+ * @details The pulse starts at the channel's phase offset and keeps its width;
+ *          an OFF past the end of the period wraps, which the chip supports.
+ * @param   led     - Destination, LEDn_ON_L onwards (or LEDn_OFF_L without ON)
+ * @param   channel - Servo channel 0-7
+ * @param   count   - Calibrated pulse width in counts
+ * @param   withOn  - Write the ON bytes too
+ * @return  Bytes written
+ */
+static int pca9685_put_led(uint8_t *led, int channel, uint16_t count, bool withOn) {
+	uint16_t on = pca9685_phase_on(phaseMode, channel);
+	uint16_t off = (uint16_t)((on + count) & (PCA9685_PWM_COUNTS - 1));
+	uint8_t *p = led;
+
+	if (withOn) {
+		*p++ = (uint8_t)(on & 0xFF);    // LEDn_ON_L
+		*p++ = (uint8_t)(on >> 8);      // LEDn_ON_H
+	}
+	*p++ = (uint8_t)(off & 0xFF);       // LEDn_OFF_L
+	*p++ = (uint8_t)(off >> 8);         // LEDn_OFF_H
+	return (int)(p - led);
+}
 
 /**
  * @fn      static long map(long x, long in_min, long in_max, long out_min, long out_max)
@@ -38,51 +101,135 @@ static long map(long x, long in_min, long in_max, long out_min, long out_max) {
  */
 static int32_t PCA9685_WriteCommand(uint8_t reg, uint8_t value) {
 	uint8_t cmd[2] = { reg, value };
+	I2C_Data write;
 
-	memset(&PCA9685Data, 0, sizeof(PCA9685Data));
-	PCA9685Data.address = PCA9685_I2C_ADDRESS;
-	PCA9685Data.msgOut = cmd;
-	PCA9685Data.lenOut = sizeof(cmd);
-	PCA9685Data.lenIn = 0;
+	memset(&write, 0, sizeof(write));
+	write.address = PCA9685_I2C_ADDRESS;
+	write.bus = PCA9685_I2C_BUS;
+	write.msgOut = cmd;
+	write.lenOut = sizeof(cmd);
+	write.lenIn = 0;
 
-	return I2cWriteDataWait(&PCA9685Data, 0xFF); 
+	return I2cWriteDataWait(&write, 0xFF);
 }
 /**
- * @fn      void PCA9685_SetPWMFreq(uint8_t freq_hz)
- * @brief   Sets the PWM frequency of the PCA9685.
- * @details Configures the internal prescaler to generate a desired frequency.
- * @param   freq_hz - Desired PWM frequency in Hz (typically 50Hz for servos)
+ * @fn      static int32_t PCA9685_ReadRegister(uint8_t reg, uint8_t *value)
+ * @brief   Reads a single register from the PCA9685 via I2C.
+ * @param   reg   - Register address
+ * @param   value - Receives the register value
+ * @return  I2C communication result (0 on success)
  */
-void PCA9685_SetPWMFreq(uint8_t freq_hz) {
-	float prescaleval = 25000000.0 / (4096.0 * freq_hz) - 1.0;
-	uint8_t prescale = (uint8_t)(prescaleval + 0.5f);
+static int32_t PCA9685_ReadRegister(uint8_t reg, uint8_t *value) {
+	I2C_Data read;
+
+	memset(&read, 0, sizeof(read));
+	read.address = PCA9685_I2C_ADDRESS;
+	read.bus = PCA9685_I2C_BUS;
+	read.msgOut = &reg;
+	read.lenOut = 1;
+	read.msgIn = value;
+	read.lenIn = 1;
+
+	return I2cReadDataWait(&read, 0, 0xFF);
+}
+
+/**
+ * @fn      static int32_t PCA9685_Configure(uint8_t prescale)
+ * @brief   Programs the prescaler and restarts the outputs with auto-increment.
+ * @param   prescale - PRE_SCALE value
+ * @return  I2C communication result (0 on success, else the last error)
+ */
+static int32_t PCA9685_Configure(uint8_t prescale) {
+	int32_t error = 0;
+	int32_t result;
 
 	// Enter sleep mode before setting prescaler
-	PCA9685_WriteCommand(0x00, 0x10);
+	result = PCA9685_WriteCommand(PCA9685_MODE1, PCA9685_MODE1_SLEEP);
+	if (result != 0) error = result;
 	vTaskDelay(pdMS_TO_TICKS(1));
 
 	// Set the prescaler
-	PCA9685_WriteCommand(0xFE, prescale);
+	result = PCA9685_WriteCommand(PCA9685_PRE_SCALE, prescale);
+	if (result != 0) error = result;
 
 	// Wake up
-	PCA9685_WriteCommand(0x00, 0x00);
+	result = PCA9685_WriteCommand(PCA9685_MODE1, 0x00);
+	if (result != 0) error = result;
 	vTaskDelay(pdMS_TO_TICKS(1));
 
 	// Restart with auto-increment enabled
-	PCA9685_WriteCommand(0x00, 0xA1);
+	result = PCA9685_WriteCommand(PCA9685_MODE1, PCA9685_MODE1_RUN);
+	if (result != 0) error = result;
+	return error;
 }
 
 /**
- * @fn      void pca9685_init(void)
+ * @fn      void PCA9685_SetPWMFreq(uint8_t freq_hz)
+ * @brief   Sets the PWM frequency of the PCA9685.
+ * @details Configures the internal prescaler to generate a desired frequency.
+ *          The prescaler is remembered so a brownout restore can reprogram it.
+ * @param   freq_hz - Desired PWM frequency in Hz (typically 50Hz for servos)
+ */
+void PCA9685_SetPWMFreq(uint8_t freq_hz) {
+	float prescaleval = 25000000.0 / (4096.0 * freq_hz) - 1.0;
+	uint8_t prescale = (uint8_t)(prescaleval + 0.5f);
+
+	prescaleSet = prescale;
+	PCA9685_Configure(prescale);
+}
+
+/**
+ * @fn      void pca9685_init(PCA9685PhaseMode phase)
  * @brief   Initializes the PCA9685 by resetting MODE1 register.
+ * @param   phase - Where each channel's pulse starts in the PWM period
  * @return  None.
  */
-void pca9685_init(void) {
+void pca9685_init(PCA9685PhaseMode phase) {
+	if (servoMutex == NULL) {
+		servoMutex = xSemaphoreCreateMutex();
+	}
+	phaseMode = phase;
+	shadowLoaded = false;
+	healthLastCheck = xTaskGetTickCount();
+	pca9685_invalidate_shadow();
 	PCA9685_WriteCommand(0x00, 0x00);  // Reset mode
 	vTaskDelay(pdMS_TO_TICKS(5));
+#if I2C_SERVO_BUS_ENABLED
+	I2cSetDeviceSpeed(PCA9685_I2C_BUS, PCA9685_I2C_ADDRESS, PCA9685_I2C_FMPLUS_KHZ);  // Alone on its bus; falls back by itself if the wiring cannot take it
+#endif
 	SerialConsoleWriteString("PCA9685 Initialized\r\n");
 }
 
+/**
+ * @fn      uint16_t pca9685_angle_to_pulse(int angle)
+ * @brief   Converts a servo angle to a PCA9685 OFF count.
+ * @details Clamps angle to [0,180] and maps it onto [PCA9685_SERVO_MIN, PCA9685_SERVO_MAX].
+ * @param   angle   - Desired servo angle in degrees
+ * @return  12-bit pulse count for the LEDn_OFF register
+ */
+uint16_t pca9685_angle_to_pulse(int angle) {
+	// Clamp angle to [0, 180]
+	if (angle < 0) angle = 0;
+	if (angle > 180) angle = 180;
+
+	return (uint16_t)map(angle, 0, 180, PCA9685_SERVO_MIN, PCA9685_SERVO_MAX);
+}
+
+/**
+ * @fn      int pca9685_pulse_to_angle(uint16_t pulse)
+ * @brief   Converts a PCA9685 OFF count back to the nearest servo angle.
+ * @details Inverse of pca9685_angle_to_pulse(); rounds so angle -> pulse -> angle is lossless.
+ * @param   pulse   - 12-bit pulse count
+ * @return  Servo angle in degrees (0-180)
+ */
+int pca9685_pulse_to_angle(uint16_t pulse) {
+	if (pulse <= PCA9685_SERVO_MIN) return 0;
+	if (pulse >= PCA9685_SERVO_MAX) return 180;
+
+	return ((pulse - PCA9685_SERVO_MIN) * 180 + (PCA9685_SERVO_MAX - PCA9685_SERVO_MIN) / 2)
+		/ (PCA9685_SERVO_MAX - PCA9685_SERVO_MIN);
+}
+
 /**
  * @fn      int32_t set_servo_angle(uint8_t channel, int angle)
  * @brief   Sets a servo motor to a specific angle on the given channel.
@@ -92,25 +239,439 @@ void pca9685_init(void) {
  * @return  I2C communication result (0 on success)
  */
 int32_t set_servo_angle(uint8_t channel, int angle) {
-	// Clamp angle to [0, 180]
-	if (angle < 0) angle = 0;
-	if (angle > 180) angle = 180;
-
 	// Map angle to pulse width (typically 500C2500us scaled to 12-bit value)
-	int pulse = map(angle, 0, 180, PCA9685_SERVO_MIN, PCA9685_SERVO_MAX);
-
-	uint8_t data[5] = {
-		(uint8_t)(0x06 + 4 * channel),  // Start register address for LEDn_ON_L
-		0x00, 0x00,                     // LEDn_ON = 0 (start of cycle)
-		(uint8_t)(pulse & 0xFF),        // LEDn_OFF_L
-		(uint8_t)(pulse >> 8)           // LEDn_OFF_H
-	};
-
-	memset(&PCA9685Data, 0, sizeof(PCA9685Data));
-	PCA9685Data.address = PCA9685_I2C_ADDRESS;
-	PCA9685Data.msgOut = data;
-	PCA9685Data.lenOut = sizeof(data);
-	PCA9685Data.lenIn = 0;
-
-	return I2cWriteDataWait(&PCA9685Data, 0xFF);
+	int pulse = ServoCal_MapChannel(channel, pca9685_angle_to_pulse(angle));
+
+	uint8_t data[5] = { (uint8_t)(PCA9685_LED0_ON_L + 4 * channel) };  // Start register address for LEDn_ON_L
+
+	pca9685_put_led(&data[1], channel < PCA9685_SERVO_CHANNELS ? channel : 0, (uint16_t)pulse, true);
+
+	I2C_Data write;
+	memset(&write, 0, sizeof(write));
+	write.address = PCA9685_I2C_ADDRESS;
+	write.bus = PCA9685_I2C_BUS;
+	write.msgOut = data;
+	write.lenOut = sizeof(data);
+	write.lenIn = 0;
+
+	pca9685_lock();
+	int32_t result = I2cWriteDataWait(&write, 0xFF);
+	if (channel < PCA9685_SERVO_CHANNELS) {
+		shadowOff[channel] = (uint16_t)pulse;
+		if (result != 0) {
+			shadowValid = false;
+		}
+	}
+	pca9685_unlock();
+	return result;
+}
+
+/**
+ * @fn      static int32_t pca9685_submit(I2C_Request *req, const uint8_t *data, uint16_t len)
+ * @brief   Queues one auto-increment burst to the PCA9685 and counts its bus bytes.
+ * @details The burst is in flight when this returns; wait for it with I2cWait().
+ *          data must stay valid until then.
+ * @param   req  - Request to fill and submit
+ * @param   data - Start register followed by register values
+ * @param   len  - Number of bytes in data
+ * @return  0 if queued (or taken by the write hook), else the I2C error
+ */
+static int32_t pca9685_submit(I2C_Request *req, const uint8_t *data, uint16_t len) {
+	memset(req, 0, sizeof(*req));
+	req->data.address = PCA9685_I2C_ADDRESS;
+	req->data.bus = PCA9685_I2C_BUS;
+	req->data.msgOut = data;
+	req->data.lenOut = len;
+	req->notify = xTaskGetCurrentTaskHandle();
+
+	busStats.bursts++;
+	busStats.bytesSent += 1 + len;  // Address byte + register + data
+	if (writeHook != NULL && writeHook(data, len)) {
+		req->done = true;  // Kept off the bus, I2cWait() returns at once
+		return 0;
+	}
+	int32_t error = I2cSubmit(req);
+	if (error != 0) {
+		req->result = error;
+		req->done = true;
+	}
+	return error;
+}
+
+/**
+ * @fn      static int32_t pca9685_write(uint8_t *data, uint16_t len)
+ * @brief   Sends one auto-increment burst to the PCA9685 and waits for it.
+ * @param   data - Start register followed by register values
+ * @param   len  - Number of bytes in data
+ * @return  I2C communication result (0 on success)
+ */
+static int32_t pca9685_write(uint8_t *data, uint16_t len) {
+	I2C_Request req;
+
+	pca9685_submit(&req, data, len);
+	return I2cWait(&req, 0xFF);
+}
+
+/**
+ * @fn      static uint16_t pca9685_fill_run(uint8_t *data, const uint16_t counts[PCA9685_SERVO_CHANNELS], int first, int last)
+ * @brief   Builds the burst writing LEDn_OFF of channels first..last.
+ * @details The burst starts at LEDfirst_OFF_L; the ON registers of the channels
+ *          in between are rewritten with their phase offset, which they already hold.
+ * @param   data - Receives the burst, PCA9685_FRAME_LEN bytes at most
+ * @return  Length of the burst
+ */
+static uint16_t pca9685_fill_run(uint8_t *data, const uint16_t counts[PCA9685_SERVO_CHANNELS], int first, int last) {
+	uint8_t *p = data;
+
+	*p++ = (uint8_t)(PCA9685_LED0_OFF_L + 4 * first);
+	for (int ch = first; ch <= last; ++ch) {
+		p += pca9685_put_led(p, ch, counts[ch], ch != first);
+	}
+	return (uint16_t)(p - data);
+}
+
+/**
+ * @fn      static int32_t pca9685_write_full(const uint16_t counts[PCA9685_SERVO_CHANNELS])
+ * @brief   Writes ON/OFF of all servo channels from LED0_ON_L in one transaction.
+ * @details On success the shadow is known to match the chip again.
+ * @param   counts - Calibrated pulse widths of channels 0-7
+ * @return  I2C communication result (0 on success)
+ */
+static int32_t pca9685_write_full(const uint16_t counts[PCA9685_SERVO_CHANNELS]) {
+	uint8_t data[PCA9685_FRAME_LEN];
+	uint16_t copy[PCA9685_SERVO_CHANNELS];
+
+	memcpy(copy, counts, sizeof(copy));  // counts may be the shadow itself
+	data[0] = PCA9685_LED0_ON_L;
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		pca9685_put_led(&data[1 + 4 * ch], ch, copy[ch], true);
+	}
+	int32_t error = pca9685_write(data, sizeof(data));
+	if (error == 0) {
+		memcpy(shadowOff, copy, sizeof(shadowOff));
+		shadowValid = true;
+		shadowLoaded = true;
+	}
+	return error;
+}
+
+/**
+ * @fn      int32_t pca9685_set_frame(const uint16_t pulses[PCA9685_SERVO_CHANNELS])
+ * @brief   Writes the pulse widths of servo channels 0-7, sending only what changed.
+ * @details A shadow copy of the LEDn_OFF registers is compared with the new
+ *          frame; each run of adjacent changed channels goes out as one
+ *          auto-increment burst (MODE1 AI, enabled by PCA9685_SetPWMFreq()),
+ *          and an unchanged frame costs no bus traffic. All bursts of a frame
+ *          are queued at once (I2cSubmit()) and chained from the completion
+ *          interrupt, with no task switch between them. Holds the servo lock
+ *          for the whole frame, so waits out a running pca9685_bench_frame(). Until the shadow is
+ *          known to match the chip (after init or a failed write) the whole
+ *          frame is written from LED0_ON_L in a single transaction.
+ *          Pulses pass through the channel calibration (ServoCal) first, and
+ *          the shadow holds the calibrated counts. In PCA9685_PHASE_STAGGER
+ *          mode the ON/OFF pair is shifted by the channel's phase offset; the
+ *          width, and so the shadow comparison, is unchanged.
+ * @param   pulses  - Nominal pulses for channels 0-7 (see pca9685_angle_to_pulse())
+ * @return  I2C communication result (0 on success, else the last error)
+ */
+int32_t pca9685_set_frame(const uint16_t pulses[PCA9685_SERVO_CHANNELS]) {
+	uint16_t counts[PCA9685_SERVO_CHANNELS];
+	int32_t error = 0;
+
+	ServoCal_Map(pulses, counts);
+	pca9685_lock();
+	busStats.frames++;
+	busStats.bytesFull += 1 + PCA9685_FRAME_LEN;
+
+	if (!shadowValid) {
+		error = pca9685_write_full(counts);
+		pca9685_unlock();
+		return error;
+	}
+
+	int runFirst[PCA9685_RUNS_MAX];
+	int runLast[PCA9685_RUNS_MAX];
+	int runs = 0;
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		if (counts[ch] == shadowOff[ch]) {
+			continue;
+		}
+		int first = ch;
+		while (ch + 1 < PCA9685_SERVO_CHANNELS && counts[ch + 1] != shadowOff[ch + 1]) {
+			ch++;
+		}
+
+		uint16_t len = pca9685_fill_run(runData[runs], counts, first, ch);
+		runFirst[runs] = first;
+		runLast[runs] = ch;
+		pca9685_submit(&runReq[runs], runData[runs], len);
+		runs++;
+	}
+
+	// Every burst is queued before the first wait, so they follow each other on the bus
+	for (int i = 0; i < runs; ++i) {
+		int32_t result = I2cWait(&runReq[i], 0xFF);
+		if (result != 0) {
+			error = result;
+			shadowValid = false;  // Resend everything next frame
+		} else {
+			memcpy(&shadowOff[runFirst[i]], &counts[runFirst[i]], sizeof(uint16_t) * (runLast[i] - runFirst[i] + 1));
+		}
+	}
+	pca9685_unlock();
+	return error;
+}
+
+/**
+ * @fn      void pca9685_invalidate_shadow(void)
+ * @brief   Forces the next pca9685_set_frame() to write all channels.
+ * @details Call when the chip may have lost its registers (reset, power loss).
+ */
+void pca9685_invalidate_shadow(void) {
+	shadowValid = false;
+}
+
+/**
+ * @fn      void pca9685_get_bus_stats(PCA9685BusStats *stats)
+ * @brief   Copies the frame write counters.
+ * @param   stats - Destination structure
+ */
+void pca9685_get_bus_stats(PCA9685BusStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = busStats;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      void pca9685_set_phase_mode(PCA9685PhaseMode mode)
+ * @brief   Changes where the servo pulses start in the PWM period.
+ * @details All channels are rewritten on the next frame so the ON registers
+ *          follow; the servos see one period with a shifted edge.
+ * @param   mode - PCA9685_PHASE_ALIGNED or PCA9685_PHASE_STAGGER
+ */
+void pca9685_set_phase_mode(PCA9685PhaseMode mode) {
+	pca9685_lock();
+	phaseMode = mode;
+	pca9685_invalidate_shadow();
+	pca9685_unlock();
+}
+
+/**
+ * @fn      PCA9685PhaseMode pca9685_get_phase_mode(void)
+ * @brief   Returns the phase mode used for servo writes.
+ */
+PCA9685PhaseMode pca9685_get_phase_mode(void) {
+	return phaseMode;
+}
+
+/**
+ * @fn      void pca9685_phase_model(const uint16_t counts[PCA9685_SERVO_CHANNELS], PCA9685PhaseMode mode, PCA9685PhaseModel *model)
+ * @brief   Models how the servo pulses of one frame overlap in the PWM period.
+ * @details Servo current is drawn mostly while a pulse is high, so the number
+ *          of pulses high at once approximates the summed supply load. The
+ *          period is split at every rising and falling edge and each segment
+ *          is counted once; no more than 16 edges, so this is cheap enough to
+ *          run over whole motions.
+ * @param   counts - Calibrated pulse widths of channels 0-7 (0 = output off)
+ * @param   mode   - Phase mode to model
+ * @param   model  - Result
+ */
+void pca9685_phase_model(const uint16_t counts[PCA9685_SERVO_CHANNELS], PCA9685PhaseMode mode, PCA9685PhaseModel *model) {
+	uint16_t edges[2 * PCA9685_SERVO_CHANNELS + 1];
+	int n = 0;
+
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		if (counts[ch] == 0) {
+			continue;
+		}
+		uint16_t on = pca9685_phase_on(mode, ch);
+		edges[n++] = on;
+		edges[n++] = (uint16_t)((on + counts[ch]) & (PCA9685_PWM_COUNTS - 1));
+	}
+	edges[n++] = 0;  // Also split at the period wrap
+
+	// Insertion sort, at most 17 entries
+	for (int i = 1; i < n; ++i) {
+		uint16_t e = edges[i];
+		int j = i - 1;
+		while (j >= 0 && edges[j] > e) {
+			edges[j + 1] = edges[j];
+			j--;
+		}
+		edges[j + 1] = e;
+	}
+
+	uint32_t overlap = 0;
+	uint32_t load = 0;
+	model->peak = 0;
+	for (int i = 0; i < n; ++i) {
+		uint16_t start = edges[i];
+		uint16_t end = (i + 1 < n) ? edges[i + 1] : PCA9685_PWM_COUNTS;
+		if (end == start) {
+			continue;
+		}
+		uint8_t high = 0;
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			uint16_t since = (uint16_t)((start - pca9685_phase_on(mode, ch)) & (PCA9685_PWM_COUNTS - 1));
+			if (counts[ch] != 0 && since < counts[ch]) {
+				high++;
+			}
+		}
+		if (high > model->peak) {
+			model->peak = high;
+		}
+		if (high > 1) {
+			overlap += end - start;
+			load += (uint32_t)(high - 1) * (end - start);
+		}
+	}
+	model->overlapUs = (uint16_t)(overlap * (1000000UL / PCA9685_FREQ) / PCA9685_PWM_COUNTS);
+	model->excessUs = load * (1000000UL / PCA9685_FREQ) / PCA9685_PWM_COUNTS;
+}
+
+/**
+ * @fn      static int32_t pca9685_restore(void)
+ * @brief   Brings a chip that reset back to the running configuration and pose.
+ * @details Reprograms PRE_SCALE and MODE1, then rewrites the last frame from
+ *          the shadow in one burst. A few ms, well inside one motion step.
+ * @return  I2C communication result (0 on success, else the last error)
+ */
+static int32_t pca9685_restore(void) {
+	int32_t error = PCA9685_Configure(prescaleSet);
+
+	shadowValid = false;
+	if (error == 0 && shadowLoaded) {
+		error = pca9685_write_full(shadowOff);
+	}
+	return error;
+}
+
+/**
+ * @fn      int32_t pca9685_health_check(void)
+ * @brief   Reads MODE1 and PRE_SCALE back and restores the chip if it has reset.
+ * @details A servo rail brownout can reset the PCA9685 to its power-on state
+ *          (sleeping, prescale 0x1E, no auto-increment), after which every
+ *          write is accepted but nothing moves. Two one-byte reads tell the
+ *          states apart. Call from the task that writes the servo frames.
+ * @return  ERROR_NONE if the chip was healthy or has been restored, otherwise the I2C error
+ */
+int32_t pca9685_health_check(void) {
+	// Preset to the healthy values: a failed read must not look like a reset
+	uint8_t mode1 = PCA9685_MODE1_RUN & (uint8_t)~PCA9685_MODE1_RESTART;
+	uint8_t prescale = prescaleSet;
+	int32_t error;
+
+	pca9685_lock();  // Readback and restore must not interleave with a frame
+	healthLastCheck = xTaskGetTickCount();
+	error = PCA9685_ReadRegister(PCA9685_MODE1, &mode1);
+	if (error == 0) {
+		error = PCA9685_ReadRegister(PCA9685_PRE_SCALE, &prescale);
+	}
+
+	taskENTER_CRITICAL();
+	healthStats.checks++;
+	if (error != 0) {
+		healthStats.readErrors++;
+	}
+	healthStats.mode1Last = mode1;
+	taskEXIT_CRITICAL();
+	if (error != 0) {
+		pca9685_unlock();
+		return error;
+	}
+	if ((mode1 & (PCA9685_MODE1_SLEEP | PCA9685_MODE1_AI)) == PCA9685_MODE1_AI && prescale == prescaleSet) {
+		pca9685_unlock();
+		return ERROR_NONE;
+	}
+
+	uint32_t start = CycleCounterNow();
+	error = pca9685_restore();
+	uint32_t us = CycleCounterToUs(CycleCounterNow() - start);
+	pca9685_unlock();
+
+	taskENTER_CRITICAL();
+	healthStats.resets++;
+	if (error != 0) {
+		healthStats.restoreFailures++;
+	}
+	healthStats.recoverUsLast = us;
+	if (us > healthStats.recoverUsMax) {
+		healthStats.recoverUsMax = us;
+	}
+	taskEXIT_CRITICAL();
+	SerialConsoleWriteString("PCA9685 reset detected, state restored\r\n");
+	return error;
+}
+
+/**
+ * @fn      void pca9685_health_poll(void)
+ * @brief   Runs pca9685_health_check() once every PCA9685_HEALTH_PERIOD_MS.
+ * @details Cheap enough to call after every frame write; the readback only
+ *          happens when the period has elapsed.
+ */
+void pca9685_health_poll(void) {
+	if (xTaskGetTickCount() - healthLastCheck >= pdMS_TO_TICKS(PCA9685_HEALTH_PERIOD_MS)) {
+		pca9685_health_check();
+	}
+}
+
+/**
+ * @fn      void pca9685_get_health_stats(PCA9685HealthStats *stats)
+ * @brief   Copies the brownout detection counters.
+ * @param   stats - Destination structure
+ */
+void pca9685_get_health_stats(PCA9685HealthStats *stats) {
+	taskENTER_CRITICAL();
+	*stats = healthStats;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @fn      void pca9685_set_write_hook(PCA9685WriteHook hook)
+ * @brief   Installs a function that sees every servo frame burst (MotionTrace).
+ * @details Set and cleared from the task that writes the frames.
+ * @param   hook - Called before each burst, NULL to remove
+ */
+void pca9685_set_write_hook(PCA9685WriteHook hook) {
+	writeHook = hook;
+}
+
+/**
+ * @fn      int32_t pca9685_bench_frame(uint16_t khz, uint16_t count, I2C_Bench_Result *result)
+ * @brief   Times full frame writes at one bus clock.
+ * @details Writes the frame the chip already holds, so the servos do not move. Refused
+ *          unless the motion queue is idle; the servo lock is held throughout, so a
+ *          motion posted meanwhile starts once the benchmark is done.
+ * @param   khz    - Bus clock to run at
+ * @param   count  - Frames to write
+ * @param   result - Receives the timing
+ * @return  0 if the frames ran, ERROR_NOT_READY before the first frame, ERROR_BUSY while a
+ *          motion plays or waits, else the I2C error
+ */
+int32_t pca9685_bench_frame(uint16_t khz, uint16_t count, I2C_Bench_Result *result) {
+	uint8_t data[PCA9685_FRAME_LEN];
+	I2C_Data frame;
+
+	if (!shadowLoaded) {
+		return ERROR_NOT_READY;
+	}
+	pca9685_lock();
+	if (!MotionQueue_Idle()) {  // A motion received after this waits in pca9685_set_frame()
+		pca9685_unlock();
+		return ERROR_BUSY;
+	}
+	data[0] = PCA9685_LED0_ON_L;
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		pca9685_put_led(&data[1 + 4 * ch], ch, shadowOff[ch], true);
+	}
+	memset(&frame, 0, sizeof(frame));
+	frame.address = PCA9685_I2C_ADDRESS;
+	frame.bus = PCA9685_I2C_BUS;
+	frame.msgOut = data;
+	frame.lenOut = sizeof(data);
+
+	int32_t error = I2cBenchmark(&frame, khz, count, result);
+	pca9685_invalidate_shadow();
+	pca9685_unlock();
+	return error;
 }
@@ -10,19 +10,90 @@
 #define PCA9685_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "I2cDriver/I2cDriver.h"   // PCA9685_I2C_BUS, PCA9685_I2C_KHZ
 
 #define PCA9685_I2C_ADDRESS 0x40
+#define PCA9685_I2C_BUS     I2C_BUS_SERVO   // eI2cBuses (I2cDriver.h) the chip is wired to
 #define PCA9685_FREQ        50
 #define PCA9685_SERVO_MIN   150
 #define PCA9685_SERVO_MAX   600
 
+#define PCA9685_MODE1           0x00   // MODE1 register
+#define PCA9685_LED0_ON_L       0x06   // First LEDn register, each channel spans 4 bytes
+#define PCA9685_LED0_OFF_L      0x08   // LED0_OFF_L, where a delta burst for channel 0 starts
+#define PCA9685_PRE_SCALE       0xFE   // Prescaler register
+#define PCA9685_PRESCALE_POR    0x1E   // PRE_SCALE after power-on reset (200 Hz)
+#define PCA9685_MODE1_RESTART   0x80
+#define PCA9685_MODE1_AI        0x20   // Register auto-increment
+#define PCA9685_MODE1_SLEEP     0x10   // Oscillator off, set after power-on reset
+#define PCA9685_MODE1_ALLCALL   0x01
+#define PCA9685_MODE1_RUN       (PCA9685_MODE1_RESTART | PCA9685_MODE1_AI | PCA9685_MODE1_ALLCALL)
+#define PCA9685_HEALTH_PERIOD_MS 500   // MODE1/PRE_SCALE readback period
+#define PCA9685_SERVO_CHANNELS  8      // Servos wired to channels 0-7
+#define PCA9685_FRAME_LEN       (1 + 4 * PCA9685_SERVO_CHANNELS)   // Register byte + ON/OFF pairs
+#define PCA9685_I2C_KHZ         I2C_SERVO_BUS_KHZ  // Clock of PCA9685_I2C_BUS (I2cDriver.h), the floor of a NACK fallback
+#define PCA9685_I2C_FMPLUS_KHZ  I2C_FM_PLUS_KHZ    // Clock the chip is rated for, its speed profile on a servo bus of its own
+/** Worst-case bus time of a full frame write: address, frame and start/stop, 9 clocks per byte */
+#define PCA9685_FRAME_US        ((2 + PCA9685_FRAME_LEN) * 9 * 1000UL / PCA9685_I2C_KHZ)
+#define PCA9685_PWM_COUNTS      4096   // Counts per PWM period (12-bit ON/OFF registers)
+/** Staggered start spacing, sized so that channel 7 still ends inside the period. The step
+ *  (499 counts) is shorter than PCA9685_SERVO_MAX, so a pulse above 499 counts still
+ *  overlaps the start of the next channel by the excess: up to 101 counts (~490 us),
+ *  seen in push_up, sleep and wiggle. Pulses never wrap past the end of the period. */
+#define PCA9685_PHASE_STEP      ((PCA9685_PWM_COUNTS - PCA9685_SERVO_MAX) / (PCA9685_SERVO_CHANNELS - 1))
+
 #ifdef __cplusplus
 extern "C" {
 	#endif
+
+	typedef struct {
+		uint32_t frames;            // pca9685_set_frame() calls
+		uint32_t bursts;            // I2C write transactions issued for them
+		uint32_t bytesSent;         // Bytes on the bus including the address byte
+		uint32_t bytesFull;         // Bytes full 8-channel writes would have taken
+	} PCA9685BusStats;
+
+	typedef struct {
+		uint32_t checks;            // MODE1/PRE_SCALE readbacks
+		uint32_t readErrors;        // Readbacks that failed on the bus
+		uint32_t resets;            // Chip found in its power-on state
+		uint32_t restoreFailures;   // Restores that failed on the bus
+		uint32_t recoverUsLast;     // Detection to last frame rewritten
+		uint32_t recoverUsMax;
+		uint8_t mode1Last;          // MODE1 as last read
+	} PCA9685HealthStats;
+
+	/** Sees one frame burst (start register + values); returns true to keep it off the bus. */
+	typedef bool (*PCA9685WriteHook)(const uint8_t *data, uint16_t len);
+
+	typedef enum {
+		PCA9685_PHASE_ALIGNED,      // Every pulse starts at count 0 (LEDn_ON = 0)
+		PCA9685_PHASE_STAGGER       // Channel n starts at n * PCA9685_PHASE_STEP
+	} PCA9685PhaseMode;
+
+	typedef struct {
+		uint8_t peak;               // Most pulses high at the same time
+		uint16_t overlapUs;         // Time per period with two or more pulses high
+		uint32_t excessUs;          // Sum over that time of the pulses beyond the first
+	} PCA9685PhaseModel;
 	
-	void pca9685_init(void);
+	void pca9685_init(PCA9685PhaseMode phase);
 	int32_t set_servo_angle(uint8_t channel, int angle);
+	uint16_t pca9685_angle_to_pulse(int angle);
+	int pca9685_pulse_to_angle(uint16_t pulse);
+	int32_t pca9685_set_frame(const uint16_t pulses[PCA9685_SERVO_CHANNELS]);
+	void pca9685_invalidate_shadow(void);
+	void pca9685_get_bus_stats(PCA9685BusStats *stats);
+	int32_t pca9685_health_check(void);
+	void pca9685_health_poll(void);
+	void pca9685_get_health_stats(PCA9685HealthStats *stats);
+	void pca9685_set_write_hook(PCA9685WriteHook hook);
+	void pca9685_set_phase_mode(PCA9685PhaseMode mode);
+	PCA9685PhaseMode pca9685_get_phase_mode(void);
+	void pca9685_phase_model(const uint16_t counts[PCA9685_SERVO_CHANNELS], PCA9685PhaseMode mode, PCA9685PhaseModel *model);
 	void PCA9685_SetPWMFreq(uint8_t freq_hz);
+	int32_t pca9685_bench_frame(uint16_t khz, uint16_t count, I2C_Bench_Result *result);
 
 	#ifdef __cplusplus
 }
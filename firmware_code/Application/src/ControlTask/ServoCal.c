@@ -0,0 +1,240 @@
+/**
+ * @file    ServoCal.c
+ * @brief   Per-channel servo calibration stored in NVM.
+ *
+ * The SAMD21G18A has no separate RWW EEPROM array, so the record lives in the
+ * last row of the main flash array. That row is inside the EEPROM emulation
+ * section whenever the EEPROM fuse is set, and the bootloader only erases the
+ * rows an application image occupies, so a firmware update keeps it.
+ *
+ * The lookup table has one entry per 2^SERVO_CAL_LUT_SHIFT nominal counts
+ * (about 0.8 degree), which keeps it at 3.6 KB for eight channels. Pulses in
+ * between are interpolated, so the default calibration maps every nominal
+ * pulse to itself. Entries are rebuilt in place when a channel changes; a
+ * frame written meanwhile may mix old and new entries of that one channel,
+ * which only lasts a single frame.
+ */
+
+#include "ServoCal.h"
+#include "MotionQueue.h"
+#include "asf.h"
+#include "I2cDriver/I2cDriver.h"
+#include <string.h>
+#include <stddef.h>
+
+#define SERVO_CAL_NVM_ADDRESS   (FLASH_SIZE - NVMCTRL_ROW_SIZE)
+#define SERVO_CAL_NOMINAL_RANGE (PCA9685_SERVO_MAX - PCA9685_SERVO_MIN)
+
+typedef struct {
+	uint32_t magic;                                     // SERVO_CAL_MAGIC
+	uint16_t version;                                   // SERVO_CAL_VERSION
+	uint16_t count;                                     // PCA9685_SERVO_CHANNELS when written
+	ServoCalChannel channel[PCA9685_SERVO_CHANNELS];
+	uint32_t crc;                                       // CRC-32 of everything above
+} ServoCalRecord;
+
+_Static_assert(sizeof(ServoCalChannel) == 8, "calibration record layout changed");
+_Static_assert(sizeof(ServoCalRecord) <= NVMCTRL_ROW_SIZE, "calibration record must fit one flash row");
+_Static_assert(SERVO_CAL_LUT_SHIFT >= 1, "ServoCal_MapChannel() rounds by half an entry");
+
+static ServoCalChannel calChannel[PCA9685_SERVO_CHANNELS];
+static uint16_t calLut[PCA9685_SERVO_CHANNELS][SERVO_CAL_LUT_SIZE];
+
+/**
+ * @fn      static void ServoCal_Default(ServoCalChannel *cal)
+ * @brief   Fills in the calibration that reproduces the nominal pulses.
+ */
+static void ServoCal_Default(ServoCalChannel *cal) {
+	memset(cal, 0, sizeof(*cal));
+	cal->minPulse = PCA9685_SERVO_MIN;
+	cal->maxPulse = PCA9685_SERVO_MAX;
+}
+
+/**
+ * @fn      static void ServoCal_BuildChannel(uint8_t channel)
+ * @brief   Folds a channel's calibration into its row of the lookup table.
+ */
+static void ServoCal_BuildChannel(uint8_t channel) {
+	const ServoCalChannel *cal = &calChannel[channel];
+	int32_t span = (int32_t)cal->maxPulse - cal->minPulse;
+
+	for (int i = 0; i < SERVO_CAL_LUT_SIZE; ++i) {
+		int32_t t = i << SERVO_CAL_LUT_SHIFT;
+		if (t > SERVO_CAL_NOMINAL_RANGE) t = SERVO_CAL_NOMINAL_RANGE;
+		if (cal->invert) t = SERVO_CAL_NOMINAL_RANGE - t;
+
+		int32_t pulse = cal->minPulse + (t * span + SERVO_CAL_NOMINAL_RANGE / 2) / SERVO_CAL_NOMINAL_RANGE + cal->offset;
+		if (pulse < 0) pulse = 0;
+		if (pulse > SERVO_CAL_PULSE_LIMIT) pulse = SERVO_CAL_PULSE_LIMIT;
+		calLut[channel][i] = (uint16_t)pulse;
+	}
+}
+
+/**
+ * @fn      static bool ServoCal_Valid(const ServoCalChannel *cal)
+ * @brief   Checks a channel calibration before it is used or stored.
+ */
+static bool ServoCal_Valid(const ServoCalChannel *cal) {
+	return cal->minPulse < cal->maxPulse && cal->maxPulse <= SERVO_CAL_PULSE_LIMIT
+		&& cal->offset >= -SERVO_CAL_OFFSET_MAX && cal->offset <= SERVO_CAL_OFFSET_MAX
+		&& cal->invert <= 1;
+}
+
+/**
+ * @fn      bool ServoCal_Init(void)
+ * @brief   Loads the stored calibration and builds the lookup table.
+ * @details Falls back to the nominal mapping if no valid record is stored.
+ *          Also switches the NVM controller to automatic page writes, which
+ *          ServoCal_Save() relies on.
+ * @return  true if a stored calibration was loaded
+ */
+bool ServoCal_Init(void) {
+	struct nvm_config config;
+	ServoCalRecord record;
+	crc32_t crc = 0;
+	bool loaded = false;
+
+	nvm_get_config_defaults(&config);
+	config.manual_page_write = false;
+	nvm_set_config(&config);
+
+	memcpy(&record, (const void *)SERVO_CAL_NVM_ADDRESS, sizeof(record));
+	crc32_calculate(&record, offsetof(ServoCalRecord, crc), &crc);
+	if (record.magic == SERVO_CAL_MAGIC && record.version == SERVO_CAL_VERSION
+		&& record.count == PCA9685_SERVO_CHANNELS && record.crc == crc) {
+		loaded = true;
+		for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+			if (!ServoCal_Valid(&record.channel[ch])) {
+				loaded = false;
+			}
+		}
+	}
+
+	for (uint8_t ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		if (loaded) {
+			calChannel[ch] = record.channel[ch];
+		} else {
+			ServoCal_Default(&calChannel[ch]);
+		}
+		ServoCal_BuildChannel(ch);
+	}
+	return loaded;
+}
+
+/**
+ * @fn      void ServoCal_Map(const uint16_t nominal[PCA9685_SERVO_CHANNELS], uint16_t out[PCA9685_SERVO_CHANNELS])
+ * @brief   Converts a frame of nominal pulses into calibrated PCA9685 counts.
+ * @param   nominal - Pulses as stored in motion tables
+ * @param   out     - Counts to write to LEDn_OFF, may alias nominal
+ */
+void ServoCal_Map(const uint16_t nominal[PCA9685_SERVO_CHANNELS], uint16_t out[PCA9685_SERVO_CHANNELS]) {
+	for (int ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		out[ch] = ServoCal_MapChannel((uint8_t)ch, nominal[ch]);
+	}
+}
+
+/**
+ * @fn      uint16_t ServoCal_MapChannel(uint8_t channel, uint16_t nominal)
+ * @brief   Converts one nominal pulse into the calibrated count of a channel.
+ * @details Interpolates between the two table entries around the pulse.
+ *          Channels above the servo range are returned unchanged.
+ */
+uint16_t ServoCal_MapChannel(uint8_t channel, uint16_t nominal) {
+	if (channel >= PCA9685_SERVO_CHANNELS) {
+		return nominal;
+	}
+	if (nominal < PCA9685_SERVO_MIN) nominal = PCA9685_SERVO_MIN;
+	if (nominal > PCA9685_SERVO_MAX) nominal = PCA9685_SERVO_MAX;
+
+	uint16_t t = nominal - PCA9685_SERVO_MIN;
+	const uint16_t *entry = &calLut[channel][t >> SERVO_CAL_LUT_SHIFT];
+	int32_t frac = t & ((1 << SERVO_CAL_LUT_SHIFT) - 1);
+	int32_t delta = (int32_t)entry[1] - entry[0];
+	return (uint16_t)(entry[0] + ((delta * frac + (1 << (SERVO_CAL_LUT_SHIFT - 1))) >> SERVO_CAL_LUT_SHIFT));
+}
+
+/**
+ * @fn      void ServoCal_Get(uint8_t channel, ServoCalChannel *cal)
+ * @brief   Copies the calibration in use for a channel.
+ */
+void ServoCal_Get(uint8_t channel, ServoCalChannel *cal) {
+	if (channel < PCA9685_SERVO_CHANNELS) {
+		*cal = calChannel[channel];
+	}
+}
+
+/**
+ * @fn      int32_t ServoCal_Set(uint8_t channel, const ServoCalChannel *cal)
+ * @brief   Changes a channel's calibration in RAM; takes effect with the next frame.
+ * @return  ERROR_NONE, or ERROR_INVALID_ARG for a bad channel or values
+ */
+int32_t ServoCal_Set(uint8_t channel, const ServoCalChannel *cal) {
+	if (channel >= PCA9685_SERVO_CHANNELS || !ServoCal_Valid(cal)) {
+		return ERROR_INVALID_ARG;
+	}
+	calChannel[channel] = *cal;
+	calChannel[channel].reserved = 0;
+	ServoCal_BuildChannel(channel);
+	return ERROR_NONE;
+}
+
+/**
+ * @fn      void ServoCal_Reset(void)
+ * @brief   Returns every channel to the nominal mapping (not saved).
+ */
+void ServoCal_Reset(void) {
+	for (uint8_t ch = 0; ch < PCA9685_SERVO_CHANNELS; ++ch) {
+		ServoCal_Default(&calChannel[ch]);
+		ServoCal_BuildChannel(ch);
+	}
+}
+
+/**
+ * @fn      int32_t ServoCal_Save(void)
+ * @brief   Writes the calibration in use to NVM.
+ * @details The CPU stalls on flash reads while the row is erased and written
+ *          (a few ms), which would stall servo frames, so it refuses while a
+ *          motion is playing or queued.
+ * @return  ERROR_NONE, ERROR_BUSY unless the motion queue is idle, or ERROR_IO
+ *          if the flash could not be programmed
+ */
+int32_t ServoCal_Save(void) {
+	uint8_t page[NVMCTRL_PAGE_SIZE];
+	ServoCalRecord record;
+	crc32_t crc = 0;
+	enum status_code status;
+
+	if (!MotionQueue_Idle()) {
+		return ERROR_BUSY;
+	}
+
+	record.magic = SERVO_CAL_MAGIC;
+	record.version = SERVO_CAL_VERSION;
+	record.count = PCA9685_SERVO_CHANNELS;
+	memcpy(record.channel, calChannel, sizeof(record.channel));
+	crc32_calculate(&record, offsetof(ServoCalRecord, crc), &crc);
+	record.crc = crc;
+
+	do {
+		status = nvm_erase_row(SERVO_CAL_NVM_ADDRESS);
+	} while (status == STATUS_BUSY);
+	if (status != STATUS_OK) {
+		return ERROR_IO;
+	}
+
+	for (uint32_t done = 0; done < sizeof(record); done += NVMCTRL_PAGE_SIZE) {
+		uint32_t len = sizeof(record) - done;
+		if (len > NVMCTRL_PAGE_SIZE) len = NVMCTRL_PAGE_SIZE;
+
+		memset(page, 0xFF, sizeof(page));
+		memcpy(page, (const uint8_t *)&record + done, len);
+		do {
+			status = nvm_write_buffer(SERVO_CAL_NVM_ADDRESS + done, page, NVMCTRL_PAGE_SIZE);
+		} while (status == STATUS_BUSY);
+		if (status != STATUS_OK) {
+			return ERROR_IO;
+		}
+	}
+
+	return (memcmp((const void *)SERVO_CAL_NVM_ADDRESS, &record, sizeof(record)) == 0) ? ERROR_NONE : ERROR_IO;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file    ServoCal.h
+ * @brief   Per-channel servo calibration stored in NVM.
+ *
+ * Motion tables hold nominal pulses (PCA9685_SERVO_MIN..MAX for 0..180
+ * degrees) that are the same on every robot. Each channel's mechanical trim
+ * (offset, pulse range, mounting direction) is kept in the last flash row and
+ * folded into a lookup table at boot, so turning a nominal pulse into the
+ * count written to the PCA9685 is two table reads and a shift per servo.
+ */
+
+#ifndef SERVO_CAL_H
+#define SERVO_CAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "PCA9685.h"
+
+#define SERVO_CAL_MAGIC         0x314C4353UL    // "SCL1" read as a little-endian uint32_t
+#define SERVO_CAL_VERSION       1
+#define SERVO_CAL_LUT_SHIFT     1               // Nominal pulse counts per table entry, as a power of two
+#define SERVO_CAL_LUT_SIZE      (((PCA9685_SERVO_MAX - PCA9685_SERVO_MIN) >> SERVO_CAL_LUT_SHIFT) + 2)  // Last entry repeated for interpolation
+#define SERVO_CAL_OFFSET_MAX    200             // Largest trim in pulse counts either way
+#define SERVO_CAL_PULSE_LIMIT   4095            // LEDn_OFF is 12 bits
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	typedef struct {
+		int16_t offset;         // Trim added to every pulse of the channel
+		uint16_t minPulse;      // Pulse for 0 degrees before inversion
+		uint16_t maxPulse;      // Pulse for 180 degrees before inversion
+		uint8_t invert;         // 1 when the servo is mounted mirrored
+		uint8_t reserved;
+	} ServoCalChannel;
+
+	bool ServoCal_Init(void);
+	void ServoCal_Map(const uint16_t nominal[PCA9685_SERVO_CHANNELS], uint16_t out[PCA9685_SERVO_CHANNELS]);
+	uint16_t ServoCal_MapChannel(uint8_t channel, uint16_t nominal);
+	void ServoCal_Get(uint8_t channel, ServoCalChannel *cal);
+	int32_t ServoCal_Set(uint8_t channel, const ServoCalChannel *cal);
+	void ServoCal_Reset(void);
+	int32_t ServoCal_Save(void);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVO_CAL_H
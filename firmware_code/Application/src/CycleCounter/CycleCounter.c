@@ -0,0 +1,55 @@
+/**
+ * @file    CycleCounter.c
+ * @brief   CPU cycle timestamps built from the FreeRTOS tick and SysTick.
+ *
+ * Differences between two CycleCounterNow() values give elapsed CPU cycles,
+ * valid for intervals shorter than 2^32 cycles (~89 s at 48 MHz).
+ * Must be called from task context with interrupts enabled.
+ */
+
+#include "CycleCounter.h"
+#include <asf.h>
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**
+ * @fn      uint32_t CycleCounterNow(void)
+ * @brief   Returns a free-running CPU cycle timestamp.
+ * @details Combines the tick count with the SysTick counter value and re-reads
+ *          when a tick boundary is crossed between the two reads. Interrupts
+ *          must be enabled so the tick count follows SysTick wrap-arounds.
+ * @return  Timestamp in CPU cycles (wraps modulo 2^32)
+ */
+uint32_t CycleCounterNow(void) {
+	uint32_t reload = SysTick->LOAD + 1;
+	TickType_t tick;
+	uint32_t val;
+
+	do {
+		tick = xTaskGetTickCount();
+		val = SysTick->VAL;
+	} while (tick != xTaskGetTickCount());
+
+	return (uint32_t)tick * reload + (reload - 1 - val);
+}
+
+/**
+ * @fn      uint32_t CycleCounterToUs(uint32_t cycles)
+ * @brief   Converts a cycle count to microseconds.
+ * @param   cycles - Elapsed CPU cycles
+ * @return  Elapsed time in microseconds
+ */
+uint32_t CycleCounterToUs(uint32_t cycles) {
+	return cycles / (configCPU_CLOCK_HZ / 1000000UL);
+}
+
+/**
+ * @fn      uint32_t CycleCounterAtTick(uint32_t tick)
+ * @brief   Returns the timestamp at which a tick began, on the CycleCounterNow() scale.
+ * @details Lets tick-based deadlines be compared against cycle timestamps.
+ * @param   tick - FreeRTOS tick count
+ * @return  Timestamp in CPU cycles (wraps modulo 2^32)
+ */
+uint32_t CycleCounterAtTick(uint32_t tick) {
+	return tick * (SysTick->LOAD + 1);
+}
@@ -0,0 +1,27 @@
+/**
+ * @file    CycleCounter.h
+ * @brief   CPU cycle timestamps for profiling on the Cortex-M0+.
+ *
+ * The M0+ has no DWT cycle counter, so timestamps are built from the FreeRTOS
+ * tick count and the SysTick down-counter. Used to measure hot paths
+ * (servo frame generation, I2C transfers) directly on the target.
+ */
+
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+	#endif
+
+	uint32_t CycleCounterNow(void);
+	uint32_t CycleCounterToUs(uint32_t cycles);
+	uint32_t CycleCounterAtTick(uint32_t tick);
+
+	#ifdef __cplusplus
+}
+#endif
+
+#endif // CYCLE_COUNTER_H
@@ -16,6 +16,7 @@
 #include "WifiHandlerThread/WifiHandler.h"
 #include "EnvTask/EnvSensorTask.h"
 #include "ControlTask/ControlTask.h"
+#include "ControlTask/MotionQueue.h"
 
 /**
  * @fn      void vDisplayTask(void *pvParameters)
@@ -76,7 +77,7 @@ void vDisplayTask(void *pvParameters) {
 			drawString(70, 80, buffer, WHITE, BLACK);
 
 			// --- Mode Display ---
-			if (current_state == STATE_IDLE) {
+			if (MotionQueue_GetActiveState() == STATE_IDLE) {
 				drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
 				drawString(70, 100, "IDLE", WHITE, BLACK);
 			}
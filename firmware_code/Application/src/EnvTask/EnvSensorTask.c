@@ -23,6 +23,7 @@
 #include "DisplayTask/ST7735.h"
 #include "ControlTask/AT42QT1010.h"
 #include "WifiHandlerThread/WifiHandler.h"
+#include "ControlTask/ControlTask.h"
 
 // Environmental threshold values
 float TEMP_THRESHOLD = 50.0f;
@@ -31,6 +32,7 @@ float VOC_THRESHOLD  = 290.0f;
 int   DIST_THRESHOLD = 400;
 
 volatile bool distance_safe = true;  // Shared flag for distance status
+volatile int distance_reading = -1;  // Last ultrasonic reading in 0.01 cm, <= 0 without an echo
 
 /**
  * @fn      void vEnvSensorTask(void *pvParameters)
@@ -100,6 +102,7 @@ void vEnvSensorTask(void *pvParameters)
         int rh_int   = (int)(rh * 100);
         int voc_int  = (int)(voc_index * 100);
         int dist_int = dist_cm;
+        distance_reading = dist_int;
         bool touched = AT42QT1010_IsTouched();
         int touch_int = touched ? 1 : 0;
 
@@ -139,6 +142,13 @@ void vEnvSensorTask(void *pvParameters)
         bool voc_alarm  = (voc_index > VOC_THRESHOLD);
         bool dis_alarm  = (dist_int > 0 && dist_int < DIST_THRESHOLD);
 
+        // Publish the distance result first so motion stops before the slow LCD/buzzer work
+        bool was_safe = distance_safe;
+        distance_safe = !dis_alarm;  // Shared flag for other tasks
+        if (was_safe && dis_alarm) {
+            ControlTask_RaiseObstacle();  // Preempt the motion in progress
+        }
+
         // --- Actuation ---
         if (temp_alarm || rh_alarm || voc_alarm || dis_alarm) {
             BuzzerPWM_Start();
@@ -148,8 +158,6 @@ void vEnvSensorTask(void *pvParameters)
             BuzzerPWM_Stop();
         }
 
-        distance_safe = !dis_alarm;  // Shared flag for other tasks
-
         vTaskDelay(pdMS_TO_TICKS(1000));  // Loop interval
     }
 }
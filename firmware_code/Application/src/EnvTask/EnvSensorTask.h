@@ -16,6 +16,7 @@
 #define SGP40_READ_BUF_SIZE 3
 
 extern volatile bool distance_safe;
+extern volatile int distance_reading;
 extern volatile bool sensor_ready;
 
 void vEnvSensorTask(void *pvParameters);
@@ -42,6 +42,7 @@ int SGP40_Init(void) {
         SerialConsoleWriteString("SGP Get Serial Fail!\r\n");
         return error;
     }
+    I2cSetDeviceSpeed(I2C_BUS_SENSOR, SGP40_ADDR, I2C_FAST_KHZ);  // Rated for Fast-mode; the serial ID was read at the bus clock
 
     // Format serial bytes as hexadecimal string
     char *bufPtr = (char *)buffer1;
@@ -34,6 +34,9 @@ int SHTC3_Init(void) {
 
     // Send wakeup command and wait
     int32_t error = I2cWriteDataWait(&SHTC3Data, WAIT_TIME);
+    if (ERROR_NONE == error) {
+        I2cSetDeviceSpeed(I2C_BUS_SENSOR, SHTC3_ADDR, I2C_FAST_KHZ);  // Rated for Fast-mode, woken at the bus clock
+    }
 
     return error;
 }
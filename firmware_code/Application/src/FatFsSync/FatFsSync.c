@@ -0,0 +1,49 @@
+/**
+ * @file    FatFsSync.c
+ * @brief   FreeRTOS sync objects for the reentrant FatFs build (_FS_REENTRANT).
+ *
+ * FatFs takes the volume's mutex around every API call, so ControlTask can
+ * read a motion file between frames while the WiFi task downloads an image
+ * and the CLI copies one. A file object itself still belongs to one task.
+ */
+
+#include <asf.h>
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+/**
+ * @fn      int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+ * @brief   Creates the mutex of a volume; called by f_mount().
+ * @return  Non-zero on success
+ */
+int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj) {
+	*sobj = xSemaphoreCreateMutex();
+	return *sobj != NULL;
+}
+
+/**
+ * @fn      int ff_req_grant(_SYNC_t sobj)
+ * @brief   Takes the volume mutex, waiting at most _FS_TIMEOUT ticks.
+ * @return  Non-zero if taken; FatFs fails the call with FR_TIMEOUT otherwise
+ */
+int ff_req_grant(_SYNC_t sobj) {
+	return xSemaphoreTake(sobj, _FS_TIMEOUT) == pdTRUE;
+}
+
+/**
+ * @fn      void ff_rel_grant(_SYNC_t sobj)
+ * @brief   Gives the volume mutex back.
+ */
+void ff_rel_grant(_SYNC_t sobj) {
+	xSemaphoreGive(sobj);
+}
+
+/**
+ * @fn      int ff_del_syncobj(_SYNC_t sobj)
+ * @brief   Deletes the mutex of a volume being unmounted.
+ * @return  Non-zero on success
+ */
+int ff_del_syncobj(_SYNC_t sobj) {
+	vSemaphoreDelete(sobj);
+	return 1;
+}
@@ -94,6 +94,9 @@ bool APDS9960_Init(void) {
     if (!read_apds9960(APDS9960_ID, &chip_id)) return false;
     if (!(chip_id == APDS9960_ID_1 || chip_id == APDS9960_ID_2)) return false;
 
+    // Found at the bus clock; the rest runs at the Fast-mode clock the part is rated for
+    I2cSetDeviceSpeed(I2C_BUS_SENSOR, APDS9960_I2C_ADDR, I2C_FAST_KHZ);
+
     // Disable features before config
     if (!write_apds9960(APDS9960_ENABLE, 0x00)) return false;
 
@@ -286,3 +289,28 @@ static bool classifyGesture(void) {
     }
     return true;
 }
+
+/**
+ * @fn      int32_t APDS9960_BenchFifoRead(uint16_t khz, uint16_t count, struct I2C_Bench_Result *result)
+ * @brief   Times full gesture FIFO reads (32 datasets) at one bus clock.
+ * @details Reads from GFIFO_U as APDS9960_ReadGesture() does. Run it with nothing in front
+ *          of the sensor: the datasets of a gesture in progress would be drained.
+ * @param   khz    - Bus clock to run at
+ * @param   count  - FIFO reads to make
+ * @param   result - Receives the timing
+ * @return  0 if the reads ran, else the I2C error
+ */
+int32_t APDS9960_BenchFifoRead(uint16_t khz, uint16_t count, struct I2C_Bench_Result *result) {
+    static uint8_t fifo[128];      // Off the CLI stack; U, D, L, R per dataset
+    uint8_t reg = APDS9960_GFIFO_U;
+    I2C_Data read;
+
+    memset(&read, 0, sizeof(read));
+    read.address = APDS9960_I2C_ADDR;
+    read.bus = I2C_BUS_SENSOR;
+    read.msgOut = &reg;
+    read.lenOut = 1;
+    read.msgIn = fifo;
+    read.lenIn = sizeof(fifo);
+    return I2cBenchmark(&read, khz, count, result);
+}
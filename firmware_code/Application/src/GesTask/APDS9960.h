@@ -71,8 +71,10 @@ typedef struct {
 } gesture_data_t;
 
 /* Function Prototypes */
+struct I2C_Bench_Result;  // I2cDriver.h
 bool APDS9960_Init(void);
 bool APDS9960_IsGestureAvailable(void);
 bool APDS9960_ReadGesture(int *gesture);
+int32_t APDS9960_BenchFifoRead(uint16_t khz, uint16_t count, struct I2C_Bench_Result *result);
 
 #endif // APDS9960_H_
@@ -12,6 +12,7 @@
 #include "APDS9960.h"
 #include "GesTask.h"
 #include "ControlTask/ControlTask.h"   
+#include "ControlTask/MotionQueue.h"
 
 volatile bool gestureEnabled = false;  // External flag to enable/disable gesture detection
 
@@ -19,7 +20,7 @@ volatile bool gestureEnabled = false;  // External flag to enable/disable gestur
  * @fn      void GesTask(void *pvParameters)
  * @brief   FreeRTOS task for detecting gestures using the APDS9960 sensor.
  * @details Initializes APDS9960, then periodically checks for available gesture data.
- *          On detection, it classifies the gesture and updates current_state accordingly.
+ *          On detection, it classifies the gesture and posts the matching motion command.
  */
 void GesTask(void *pvParameters)
 {
@@ -43,12 +44,12 @@ void GesTask(void *pvParameters)
                 if (APDS9960_ReadGesture(&gesture)) {
                     switch (gesture) {
                         case DIR_LEFT:
-                            current_state = STATE_LEFT_SHIFT;
+                            MotionQueue_Post(STATE_LEFT_SHIFT, MOTION_CLASS_GESTURE);
                             SerialConsoleWriteString("Left Gesture\r\n");
                             break;
 
                         case DIR_RIGHT:
-                            current_state = STATE_RIGHT_SHIFT;
+                            MotionQueue_Post(STATE_RIGHT_SHIFT, MOTION_CLASS_GESTURE);
                             SerialConsoleWriteString("Right Gesture\r\n");
                             break;
 
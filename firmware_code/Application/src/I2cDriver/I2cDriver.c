@@ -10,27 +10,125 @@
  * Includes
  ******************************************************************************/
 #include "I2cDriver.h"
+#include "CycleCounter/CycleCounter.h"
+#include <string.h>
 
 /******************************************************************************
  * Defines
  ******************************************************************************/
 
+/// Hardware of one I2C bus
+typedef struct I2C_Bus_Config {
+    const char *name;
+    Sercom *sercom;
+    uint32_t pinmuxPad0;
+    uint32_t pinmuxPad1;
+    uint16_t khz;
+    uint8_t dmaTriggerTx;
+    uint8_t dmaTriggerRx;
+} I2C_Bus_Config;
+
+/// Driver state of one I2C bus
+typedef struct I2C_Bus {
+    struct i2c_master_module module;    ///< ASF module; first, so the ASF callbacks can cast it back to its bus
+    struct i2c_master_packet packet;    ///< Packet of the job on the bus
+    SemaphoreHandle_t semaphoreHandle;  ///< Binary semaphore to notify task that we have received an I2C interrupt on the bus
+    I2C_Bus_State state;
+    uint8_t transmitError;              ///< Flag used to indicate that there was an I2C transmission error on the bus.
+    bool initialized;
+
+    I2C_Request *volatile queueHead;    ///< Request on the bus, followed by the queued ones
+    I2C_Request *queueTail;             ///< Last queued request
+    volatile uint16_t queueDepth;       ///< Requests queued or on the bus
+    volatile bool readPhase;            ///< The request on the bus has written and is reading
+    I2C_Queue_Stats queueStats;         ///< Queue counters
+
+    struct dma_resource dmaTx;              ///< DMA channel feeding DATA on writes
+    struct dma_resource dmaRx;              ///< DMA channel draining DATA on reads
+    DmacDescriptor dmaTxDescriptor;         ///< Rebuilt for every write, copied into the DMAC by the driver
+    DmacDescriptor dmaRxDescriptor;         ///< Rebuilt for every read
+    bool dmaReady;                          ///< Both channels allocated
+    struct dma_resource *volatile dmaActive;  ///< Channel of the transfer on the bus, NULL in interrupt mode
+    uint32_t dmaCycles;                     ///< CPU cycles the transfer on the bus has taken so far
+    uint16_t dmaLen;                        ///< Length of the transfer on the bus
+    I2C_Dma_Stats dmaStats;                 ///< DMA path counters
+
+    I2C_Read_Stats readStats;           ///< Register read latency
+
+    I2C_Speed_Profile speedProfiles[I2C_SPEED_PROFILES];  ///< Devices with a clock of their own
+    uint32_t gclkHz;                    ///< SERCOM core clock the BAUD is derived from
+    uint16_t khzBase;                   ///< Clock of devices without a profile
+    uint16_t khzNow;                    ///< Clock the BAUD is set for
+    volatile bool speedPending;         ///< The queue head waits for a clock change, nothing on the bus
+    volatile bool speedSwitching;       ///< A task is making that change
+    uint32_t speedSwitches;             ///< BAUD reprogrammings
+    uint32_t speedFailed;               ///< Requests failed because the bus did not go idle for a change
+    uint32_t speedFallbacks;            ///< Profile steps down
+} I2C_Bus;
+
 /******************************************************************************
  * Variables
  ******************************************************************************/
-SemaphoreHandle_t sensorI2cMutexHandle;                       ///< Mutex to handle the sensor I2C bus thread access.
-SemaphoreHandle_t sensorI2cSemaphoreHandle;                   ///< Binary semaphore to notify task that we have received an I2C interrupt on the Sensor bus
-static volatile TaskHandle_t xTaskToNotifySensorDone = NULL;  ///< Stores the handle of the task that will be notified when the SENSOR transmission is complete. */
-static uint8_t sensorTransmitError = false;                   ///< Flag used to indicate that there was an I2C transmission error on the SENSOR bus.
+static const I2C_Bus_Config i2cBusConfig[I2C_BUS_COUNT] = {
+    {"sensor", SERCOM0, PINMUX_PA08C_SERCOM0_PAD0, PINMUX_PA09C_SERCOM0_PAD1, I2C_SENSOR_BUS_KHZ, SERCOM0_DMAC_ID_TX, SERCOM0_DMAC_ID_RX},
+#if I2C_SERVO_BUS_ENABLED
+    {"servo", I2C_SERVO_SERCOM, I2C_SERVO_PINMUX_PAD0, I2C_SERVO_PINMUX_PAD1, I2C_SERVO_BUS_KHZ, I2C_SERVO_DMAC_ID_TX, I2C_SERVO_DMAC_ID_RX},
+#endif
+};
 
-struct i2c_master_module i2cSensorBusInstance;
-static I2C_Bus_State I2cSensorBusState;  ///< Structure that defines the I2C Bus used for the sensors.
+static I2C_Bus i2cBuses[I2C_BUS_COUNT];
+static I2C_Bus *i2cBusOfSercom[SERCOM_INST_NUM];  ///< Bus behind each SERCOM instance, for the interrupt handler
 
-struct i2c_master_packet sensorPacketWrite;
+static volatile bool i2cRepeatedStart = true;  ///< Join the write and read of a request with a repeated START
 /******************************************************************************
  * Forward Declarations
  ******************************************************************************/
-static int32_t I2cDriverConfigureSensorBus(void)
+static void I2cQueueComplete(I2C_Bus *bus, int32_t status);
+static void I2cDmaBusInterrupt(I2C_Bus *bus, uint32_t start);
+static void I2cDmaRelease(I2C_Bus *bus, bool abort);
+
+/**
+ * @fn			static I2C_Bus *I2cGetBus(uint8_t bus)
+ * @brief       Returns the state of an initialized bus, NULL for an unknown or unused one.
+ */
+static I2C_Bus *I2cGetBus(uint8_t bus)
+{
+    if (bus >= I2C_BUS_COUNT || !i2cBuses[bus].initialized) {
+        return NULL;
+    }
+    return &i2cBuses[bus];
+}
+
+/**
+ * @fn			static void I2cReleaseBus(I2C_Bus *bus)
+ * @brief       Sends STOP if the bus is still owned. Interrupts masked or ISR only.
+ * @details     ASF leaves the bus owned when a write without STOP fails or is cancelled,
+ *              since it cannot know the caller wanted the read that was to follow.
+ */
+static void I2cReleaseBus(I2C_Bus *bus)
+{
+    SercomI2cm *const hw = &bus->module.hw->I2CM;
+
+    if ((hw->STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk) == SERCOM_I2CM_STATUS_BUSSTATE(2)) {
+        _i2c_master_wait_for_sync(&bus->module);
+        hw->CTRLB.reg |= SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(3);
+    }
+}
+
+/**
+ * @fn			static uint32_t I2cIsrCycles(uint32_t start)
+ * @brief       Cycles since a SysTick->VAL reading taken in the same interrupt.
+ * @details     The tick count does not move while an interrupt runs, so the SysTick counter is read directly.
+ */
+static uint32_t I2cIsrCycles(uint32_t start)
+{
+    uint32_t reload = SysTick->LOAD + 1;
+    uint32_t now = SysTick->VAL;
+
+    return (start >= now) ? start - now : start + reload - now;
+}
+
+static int32_t I2cDriverConfigureBus(I2C_Bus *bus, const I2C_Bus_Config *busConfig)
 {
     int32_t error = STATUS_OK;
     status_code_genare_t errCodeAsf = STATUS_OK;
@@ -38,25 +136,29 @@ static int32_t I2cDriverConfigureSensorBus(void)
     struct i2c_master_config config_i2c_master;
     i2c_master_get_config_defaults(&config_i2c_master);
 
-    config_i2c_master.pinmux_pad0 = PINMUX_PA08C_SERCOM0_PAD0;
-    config_i2c_master.pinmux_pad1 = PINMUX_PA09C_SERCOM0_PAD1;
+    config_i2c_master.pinmux_pad0 = busConfig->pinmuxPad0;
+    config_i2c_master.pinmux_pad1 = busConfig->pinmuxPad1;
+    config_i2c_master.baud_rate = (enum i2c_master_baud_rate)busConfig->khz;  // ASF baud rates are in kHz
     /* Change buffer timeout to something longer */
     config_i2c_master.buffer_timeout = 1000;
     /* Initialize and enable device with config. Try three times to initialize */
 
     for (uint8_t i = I2C_INIT_ATTEMPTS; i != 0; i--) {
-        errCodeAsf = i2c_master_init(&i2cSensorBusInstance, SERCOM0, &config_i2c_master);
+        errCodeAsf = i2c_master_init(&bus->module, busConfig->sercom, &config_i2c_master);
         if (STATUS_OK == errCodeAsf) {
             error = errCodeAsf;
             break;
         } else {
-            i2c_master_reset(&i2cSensorBusInstance);
+            i2c_master_reset(&bus->module);
         }
     }
 
     if (STATUS_OK != error) goto exit;
 
-    i2c_master_enable(&i2cSensorBusInstance);
+    bus->gclkHz = system_gclk_chan_get_hz(SERCOM0_GCLK_ID_CORE + _sercom_get_sercom_inst_index(busConfig->sercom));
+    bus->khzBase = busConfig->khz;
+    bus->khzNow = busConfig->khz;
+    i2c_master_enable(&bus->module);
 
 exit:
     return error;
@@ -65,110 +167,263 @@ exit:
  * Callback Functions
  ******************************************************************************/
 /*
-  * @fn			void I2cSensorsTxComplete(struct i2c_m_async_desc *const i2c)
-  * @brief       Callback function for when the SENSORS I2C bus ends transmissions
+  * @fn			void I2cTxComplete(struct i2c_master_module *const module)
+  * @brief       Callback function for when an I2C bus ends transmissions
   * @details     This callback sets a flag that tells us that the bus is not busy, and the last transmission is done. With USE_FREERTOS flag, this
                                  callback notifies the registered thread that the I2C transfer has finished. The registered thread is the thread that initiated the I2C transaction,
                                  and is currently waiting for a notification that it has finished.
-  * @param[in]   i2c Pointer to I2C structure used inside the Atmel ASFv3  framework
+  * @param[in]   module Pointer to I2C structure used inside the Atmel ASFv3  framework, the first member of its bus
   * @return      This function is a callback, and it is registered as such when we send an I2C transmission on this I2C bus.
   * @note
   */
-void I2cSensorsTxComplete(struct i2c_master_module *const module)
+void I2cTxComplete(struct i2c_master_module *const module)
 {
-    I2cSensorBusState.i2cState = I2C_BUS_READY;
-    I2cSensorBusState.rxDoneFlag = true;
+    I2C_Bus *bus = (I2C_Bus *)module;
+
+    if (bus->queueHead != NULL) {
+        I2cQueueComplete(bus, ERROR_NONE);
+        return;
+    }
+    bus->state.i2cState = I2C_BUS_READY;
+    bus->state.rxDoneFlag = true;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    xSemaphoreGiveFromISR(sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken);
-    sensorTransmitError = false;
+    xSemaphoreGiveFromISR(bus->semaphoreHandle, &xHigherPriorityTaskWoken);
+    bus->transmitError = false;
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 /**
-  * @fn				void I2cSensorRxComplete(struct i2c_m_async_desc *const i2c)
-  * @brief			Callback function for when the SENSOR I2C bus ends data reception
+  * @fn				void I2cRxComplete(struct i2c_master_module *const module)
+  * @brief			Callback function for when an I2C bus ends data reception
   * @details			This callback sets a flag that tells us that the bus is not busy, and the last reception is done. With USE_FREERTOS flag, this
                                          callback notifies the registered thread that the I2C transfer has finished. The registered thread is the thread that initiated the I2C transaction,
                                          and is currently waiting for a notification that it has finished.
-  * @param[in]		i2c Pointer to I2C structure used inside the Atmel ASFv3  framework
+  * @param[in]		module Pointer to I2C structure used inside the Atmel ASFv3  framework, the first member of its bus
   * @return			This function is a callback, and it is registered as such when we send an I2C reception on this I2C bus.
   * @note
   */
-void I2cSensorsRxComplete(struct i2c_master_module *const module)
+void I2cRxComplete(struct i2c_master_module *const module)
 {
-    I2cSensorBusState.i2cState = I2C_BUS_READY;
-    I2cSensorBusState.rxDoneFlag = true;
+    I2C_Bus *bus = (I2C_Bus *)module;
+
+    if (bus->queueHead != NULL) {
+        I2cQueueComplete(bus, ERROR_NONE);
+        return;
+    }
+    bus->state.i2cState = I2C_BUS_READY;
+    bus->state.rxDoneFlag = true;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    xSemaphoreGiveFromISR(sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken);
-    sensorTransmitError = false;
+    xSemaphoreGiveFromISR(bus->semaphoreHandle, &xHigherPriorityTaskWoken);
+    bus->transmitError = false;
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 /**
-  * @fn				void I2cSensorError(struct i2c_m_async_desc *const i2c)
-  * @brief			Callback function for when the LED I2C bus encounters an error while transmitting/receiving
+  * @fn				void I2cError(struct i2c_master_module *const module)
+  * @brief			Callback function for when an I2C bus encounters an error while transmitting/receiving
   * @details			This callback sets a flag that tells us that the bus is not busy, and the last reception is done. With USE_FREERTOS flag, this
                                          callback notifies the registered thread that the I2C transfer has finished. The registered thread is the thread that initiated the I2C transaction,
                                          and is currently waiting for a notification that it has finished.
-  * @param[in]		i2c Pointer to I2C structure used inside the Atmel ASFv3  framework
+  * @param[in]		module Pointer to I2C structure used inside the Atmel ASFv3  framework, the first member of its bus
   * @return			This function is a callback, and it is registered as such when we send an I2C reception on this I2C bus.
   * @note
   */
-void I2cSensorsError(struct i2c_master_module *const module)
+void I2cError(struct i2c_master_module *const module)
 {
-    I2cSensorBusState.i2cState = I2C_BUS_READY;
-    I2cSensorBusState.txDoneFlag = true;
+    I2C_Bus *bus = (I2C_Bus *)module;
+
+    if (bus->queueHead != NULL) {
+        I2cReleaseBus(bus);
+        I2cQueueComplete(bus, ERROR_ABORTED);  // Same code the blocking calls have always returned for a bus error
+        return;
+    }
+    bus->state.i2cState = I2C_BUS_READY;
+    bus->state.txDoneFlag = true;
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 
-    xSemaphoreGiveFromISR(sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken);
-    sensorTransmitError = true;
+    xSemaphoreGiveFromISR(bus->semaphoreHandle, &xHigherPriorityTaskWoken);
+    bus->transmitError = true;
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
-void I2cDriverRegisterSensorBusCallbacks(void)
+static void I2cDriverRegisterBusCallbacks(I2C_Bus *bus)
 {
     /* Register callback function. */
-    i2c_master_register_callback(&i2cSensorBusInstance, I2cSensorsTxComplete, I2C_MASTER_CALLBACK_WRITE_COMPLETE);
-    i2c_master_enable_callback(&i2cSensorBusInstance, I2C_MASTER_CALLBACK_WRITE_COMPLETE);
+    i2c_master_register_callback(&bus->module, I2cTxComplete, I2C_MASTER_CALLBACK_WRITE_COMPLETE);
+    i2c_master_enable_callback(&bus->module, I2C_MASTER_CALLBACK_WRITE_COMPLETE);
 
-    i2c_master_register_callback(&i2cSensorBusInstance, I2cSensorsRxComplete, I2C_MASTER_CALLBACK_READ_COMPLETE);
-    i2c_master_enable_callback(&i2cSensorBusInstance, I2C_MASTER_CALLBACK_READ_COMPLETE);
+    i2c_master_register_callback(&bus->module, I2cRxComplete, I2C_MASTER_CALLBACK_READ_COMPLETE);
+    i2c_master_enable_callback(&bus->module, I2C_MASTER_CALLBACK_READ_COMPLETE);
 
-    i2c_master_register_callback(&i2cSensorBusInstance, I2cSensorsError, I2C_MASTER_CALLBACK_ERROR);
-    i2c_master_enable_callback(&i2cSensorBusInstance, I2C_MASTER_CALLBACK_ERROR);
+    i2c_master_register_callback(&bus->module, I2cError, I2C_MASTER_CALLBACK_ERROR);
+    i2c_master_enable_callback(&bus->module, I2C_MASTER_CALLBACK_ERROR);
+}
+
+/**
+ * @fn			static void I2cBusHandler(uint8_t instance)
+ * @brief       SERCOM interrupt handler of the I2C buses, in place of the ASF one.
+ * @details     Hands the interrupt to the DMA path while a DMA transfer is on the bus and to the ASF
+ *              driver otherwise, timing the latter to know what a byte costs in interrupt mode.
+ */
+static void I2cBusHandler(uint8_t instance)
+{
+    uint32_t start = SysTick->VAL;
+    I2C_Bus *bus = i2cBusOfSercom[instance];
+
+    if (bus->dmaActive != NULL) {
+        I2cDmaBusInterrupt(bus, start);
+        return;
+    }
+    _i2c_master_interrupt_handler(instance);
+
+    bus->dmaStats.irqCycles += I2cIsrCycles(start);
+    if (++bus->dmaStats.irqInterrupts >= 1024) {
+        bus->dmaStats.irqCycles /= 2;  // Keep a running average, not a sum that wraps
+        bus->dmaStats.irqInterrupts /= 2;
+    }
+}
+
+/**
+ * @fn			static I2C_Bus *I2cDmaGetBus(const struct dma_resource *resource)
+ * @brief       Returns the bus a DMA channel moves the transfer of, NULL if none is on it.
+ */
+static I2C_Bus *I2cDmaGetBus(const struct dma_resource *resource)
+{
+    for (int i = 0; i < I2C_BUS_COUNT; ++i) {
+        if (i2cBuses[i].dmaActive == resource) {
+            return &i2cBuses[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @fn			static void I2cDmaTransferDone(struct dma_resource *const resource)
+ * @brief       DMA completion callback.
+ * @details     A read is over once the last byte is in memory; the SERCOM has already answered it
+ *              with NACK and STOP. A write is over when the last byte has left the shift register
+ *              and been acknowledged, which the SERCOM signals with MB.
+ */
+static void I2cDmaTransferDone(struct dma_resource *const resource)
+{
+    uint32_t start = SysTick->VAL;
+    I2C_Bus *bus = I2cDmaGetBus(resource);
+
+    if (bus == NULL) {
+        return;
+    }
+    if (resource == &bus->dmaTx) {
+        bus->module.hw->I2CM.INTENSET.reg = SERCOM_I2CM_INTENSET_MB;
+        bus->dmaCycles += I2cIsrCycles(start);
+        return;
+    }
+    I2cDmaBusInterrupt(bus, start);
+}
+
+/**
+ * @fn			static void I2cDmaTransferError(struct dma_resource *const resource)
+ * @brief       DMA error callback, ends the transfer on the bus with ERROR_IO.
+ */
+static void I2cDmaTransferError(struct dma_resource *const resource)
+{
+    I2C_Bus *bus = I2cDmaGetBus(resource);
+
+    if (bus == NULL) {
+        return;
+    }
+    I2cDmaRelease(bus, true);
+    bus->dmaStats.dmaFailed++;
+    I2cQueueComplete(bus, ERROR_IO);
+}
+
+/**
+ * @fn			static void I2cDriverConfigureBusDma(I2C_Bus *bus, const I2C_Bus_Config *busConfig)
+ * @brief       Allocates the DMA channels of a bus and takes over its interrupt.
+ * @details     Without free channels every transfer on the bus stays in interrupt mode.
+ */
+static void I2cDriverConfigureBusDma(I2C_Bus *bus, const I2C_Bus_Config *busConfig)
+{
+    struct dma_resource_config config;
+    struct dma_descriptor_config descriptor;
+    uint8_t instance = _sercom_get_sercom_inst_index(busConfig->sercom);
+
+    i2cBusOfSercom[instance] = bus;
+    _sercom_set_handler(instance, I2cBusHandler);
+
+    dma_get_config_defaults(&config);
+    config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+    config.peripheral_trigger = busConfig->dmaTriggerTx;
+    if (dma_allocate(&bus->dmaTx, &config) != STATUS_OK) {
+        return;
+    }
+    config.peripheral_trigger = busConfig->dmaTriggerRx;
+    if (dma_allocate(&bus->dmaRx, &config) != STATUS_OK) {
+        dma_free(&bus->dmaTx);
+        return;
+    }
+
+    dma_descriptor_get_config_defaults(&descriptor);
+    dma_descriptor_create(&bus->dmaTxDescriptor, &descriptor);
+    dma_descriptor_create(&bus->dmaRxDescriptor, &descriptor);
+    dma_add_descriptor(&bus->dmaTx, &bus->dmaTxDescriptor);
+    dma_add_descriptor(&bus->dmaRx, &bus->dmaRxDescriptor);
+
+    dma_register_callback(&bus->dmaTx, I2cDmaTransferDone, DMA_CALLBACK_TRANSFER_DONE);
+    dma_register_callback(&bus->dmaTx, I2cDmaTransferError, DMA_CALLBACK_TRANSFER_ERROR);
+    dma_enable_callback(&bus->dmaTx, DMA_CALLBACK_TRANSFER_DONE);
+    dma_enable_callback(&bus->dmaTx, DMA_CALLBACK_TRANSFER_ERROR);
+    dma_register_callback(&bus->dmaRx, I2cDmaTransferDone, DMA_CALLBACK_TRANSFER_DONE);
+    dma_register_callback(&bus->dmaRx, I2cDmaTransferError, DMA_CALLBACK_TRANSFER_ERROR);
+    dma_enable_callback(&bus->dmaRx, DMA_CALLBACK_TRANSFER_DONE);
+    dma_enable_callback(&bus->dmaRx, DMA_CALLBACK_TRANSFER_ERROR);
+
+    bus->dmaReady = true;
 }
 
 /**
  * @fn			int32_t I2cInitializeDriver(void)
  * @brief       Function call to initialize the I2C driver\
- * @details     This function must be called from an RTOS thread if using RTOS, and must be called before any I2C call
+ * @details     Brings up every bus of i2cBusConfig. This function must be called from an RTOS thread if using RTOS,
+ *              and must be called before any I2C call
  * @note
  */
 int32_t I2cInitializeDriver(void)
 {
     int32_t error = STATUS_OK;
 
-    error = I2cDriverConfigureSensorBus();
-    if (STATUS_OK != error) goto exit;
+    for (int i = 0; i < I2C_BUS_COUNT; ++i) {
+        I2C_Bus *bus = &i2cBuses[i];
 
-    I2cDriverRegisterSensorBusCallbacks();
+        error = I2cDriverConfigureBus(bus, &i2cBusConfig[i]);
+        if (STATUS_OK != error) goto exit;
 
-    sensorI2cMutexHandle = xSemaphoreCreateMutex();
+        I2cDriverRegisterBusCallbacks(bus);
+        I2cDriverConfigureBusDma(bus, &i2cBusConfig[i]);
 
-    sensorI2cSemaphoreHandle = xSemaphoreCreateBinary();
-    // xSemaphoreGive(sensorI2cSemaphoreHandle);
+        bus->semaphoreHandle = xSemaphoreCreateBinary();
 
-    if (NULL == sensorI2cMutexHandle || NULL == sensorI2cSemaphoreHandle) {
-        error = STATUS_SUSPEND;  // Could not initialize mutex!
-        goto exit;
+        if (NULL == bus->semaphoreHandle) {
+            error = STATUS_SUSPEND;  // Could not initialize semaphore!
+            goto exit;
+        }
+        bus->initialized = true;
     }
 
 exit:
     return error;
 }
 
+/**
+ * @fn			const char *I2cGetBusName(eI2cBuses bus)
+ * @brief       Short name of a bus for reports, NULL for an unknown one.
+ */
+const char *I2cGetBusName(eI2cBuses bus)
+{
+    return (bus < I2C_BUS_COUNT) ? i2cBusConfig[bus].name : NULL;
+}
+
 /**
  * @fn    int32_t I2cWriteData(I2C_Data *data)
  * @brief       Function call to write an specified number of bytes on the given I2C bus
@@ -182,21 +437,22 @@ int32_t I2cWriteData(I2C_Data *data)
 {
     int32_t error = ERROR_NONE;
     enum status_code hwError;
+    I2C_Bus *bus;
 
     // Check parameters
-    if (data == NULL || data->msgOut == NULL) {
+    if (data == NULL || data->msgOut == NULL || (bus = I2cGetBus(data->bus)) == NULL) {
         error = ERR_INVALID_ARG;
         goto exit;
     }
 
     // Prepare to write
-    sensorPacketWrite.address = data->address;
-    sensorPacketWrite.data = (uint8_t *)data->msgOut;
-    sensorPacketWrite.data_length = data->lenOut;
+    bus->packet.address = data->address;
+    bus->packet.data = (uint8_t *)data->msgOut;
+    bus->packet.data_length = data->lenOut;
 
     // Write
 
-    hwError = i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+    hwError = i2c_master_write_packet_job(&bus->module, &bus->packet);
 
     if (STATUS_OK != hwError) {
         error = ERROR_IO;
@@ -219,21 +475,22 @@ int32_t I2cReadData(I2C_Data *data)
 {
     int32_t error = ERROR_NONE;
     enum status_code hwError;
+    I2C_Bus *bus;
 
     // Check parameters
-    if (data == NULL || data->msgOut == NULL) {
+    if (data == NULL || data->msgOut == NULL || (bus = I2cGetBus(data->bus)) == NULL) {
         error = ERR_INVALID_ARG;
         goto exit;
     }
 
     // Prepare to read
-    sensorPacketWrite.address = data->address;
-    sensorPacketWrite.data = data->msgIn;
-    sensorPacketWrite.data_length = data->lenIn;
+    bus->packet.address = data->address;
+    bus->packet.data = data->msgIn;
+    bus->packet.data_length = data->lenIn;
 
     // Read
 
-    hwError = i2c_master_read_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+    hwError = i2c_master_read_packet_job(&bus->module, &bus->packet);
 
     if (STATUS_OK != hwError) {
         error = ERROR_IO;
@@ -244,214 +501,875 @@ exit:
     return error;
 }
 
+/******************************************************************************
+ * Transaction queue
+ ******************************************************************************/
 /**
- * @fn			int32_t I2cFreeMutex(eI2cBuses bus)
- * @brief       Frees the mutex of the given I2C bus
- * @details
- * @param[in]   bus Enum that represents the bus in which we are interested to free the mutex of.
- * @return      Returns (0) if the bus is ready, (1) if it is busy.
- * @note
+ * @fn			static int32_t I2cDmaStartPhase(I2C_Bus *bus, I2C_Request *req, bool read)
+ * @brief       Starts the write or the read of a request as a DMA transfer. Interrupts masked or ISR only.
+ * @details     With ADDR.LENEN the SERCOM counts the bytes itself, NACKs the last byte of a read and
+ *              ends the transfer with STOP, so the CPU only sees the interrupt at the end. During the
+ *              transfer the SERCOM interrupt is left to errors (and, on a read, to an address NACK).
+ * @return      ERROR_NONE if the transfer was started, ERROR_BUSY if the channel was not free
  */
-int32_t I2cFreeMutex(void)
+static int32_t I2cDmaStartPhase(I2C_Bus *bus, I2C_Request *req, bool read)
 {
-    int32_t error = ERROR_NONE;
+    uint32_t start = SysTick->VAL;
+    SercomI2cm *const hw = &bus->module.hw->I2CM;
+    struct dma_resource *resource = read ? &bus->dmaRx : &bus->dmaTx;
+    uint16_t len = read ? req->data.lenIn : req->data.lenOut;
+    struct dma_descriptor_config config;
+
+    dma_descriptor_get_config_defaults(&config);
+    config.block_transfer_count = len;
+    if (read) {
+        config.src_increment_enable = false;
+        config.source_address = (uint32_t)&hw->DATA.reg;
+        config.destination_address = (uint32_t)req->data.msgIn + len;  // The DMAC takes the end of an incremented buffer
+    } else {
+        config.dst_increment_enable = false;
+        config.source_address = (uint32_t)req->data.msgOut + len;
+        config.destination_address = (uint32_t)&hw->DATA.reg;
+    }
+    dma_descriptor_create(read ? &bus->dmaRxDescriptor : &bus->dmaTxDescriptor, &config);
+    if (dma_start_transfer_job(resource) != STATUS_OK) {
+        return ERROR_BUSY;
+    }
+
+    bus->readPhase = read;
+    bus->dmaActive = resource;
+    bus->dmaLen = len;
+    hw->STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_LENERR;
+    hw->INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB | SERCOM_I2CM_INTFLAG_ERROR;
+    hw->INTENSET.reg = SERCOM_I2CM_INTENSET_ERROR | (read ? SERCOM_I2CM_INTENSET_MB : 0);
+    _i2c_master_wait_for_sync(&bus->module);
+    hw->CTRLB.reg &= ~SERCOM_I2CM_CTRLB_ACKACT;  // Smart mode ACKs each byte read, LENEN NACKs the last
+    _i2c_master_wait_for_sync(&bus->module);
+    i2c_master_dma_set_transfer(&bus->module, req->data.address, (uint8_t)len, read ? I2C_TRANSFER_READ : I2C_TRANSFER_WRITE);
+
+    bus->dmaCycles = I2cIsrCycles(start);
+    return ERROR_NONE;
+}
 
-    if (xSemaphoreGive(sensorI2cMutexHandle) != pdTRUE) {
-        error = ERROR_NOT_INITIALIZED;  // We could not return the mutex! We must not have it!
+/**
+ * @fn			static void I2cDmaRelease(I2C_Bus *bus, bool abort)
+ * @brief       Hands the bus back to interrupt mode at the end of a DMA transfer. Interrupts masked or ISR only.
+ * @details     Waits for the STOP the SERCOM sends at the end of the transfer so the next job does
+ *              not find the bus still owned, and sends it if it does not come.
+ * @param[in]   abort Stop the DMA channel, the transfer ended early
+ */
+static void I2cDmaRelease(I2C_Bus *bus, bool abort)
+{
+    SercomI2cm *const hw = &bus->module.hw->I2CM;
+    uint16_t spin = I2C_DMA_STOP_SPIN;
+
+    hw->INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB | SERCOM_I2CM_INTENCLR_ERROR;
+    if (abort) {
+        dma_abort_job(bus->dmaActive);
     }
-    return error;
+    while ((hw->STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk) == SERCOM_I2CM_STATUS_BUSSTATE(2) && --spin != 0) {
+    }
+    if (spin == 0) {
+        _i2c_master_wait_for_sync(&bus->module);
+        hw->CTRLB.reg |= SERCOM_I2CM_CTRLB_ACKACT | SERCOM_I2CM_CTRLB_CMD(3);
+    }
+    hw->INTFLAG.reg = SERCOM_I2CM_INTFLAG_MB | SERCOM_I2CM_INTFLAG_SB | SERCOM_I2CM_INTFLAG_ERROR;
+    bus->dmaActive = NULL;
 }
 
 /**
- * @fn			int32_t I2cGetMutex(TickType_t waitTime)
- * @brief       Frees the mutex of the given I2C bus
- * @details
- * @param[in]   waitTime Time to wait for the mutex to be freed.
- * @return      Returns (0) if the bus is ready, (1) if it is busy.
- * @note
+ * @fn			static void I2cDmaBusInterrupt(I2C_Bus *bus, uint32_t start)
+ * @brief       Ends the DMA transfer on the bus, from the SERCOM or the DMA interrupt.
+ * @details     Compares the CPU time the transfer took with what its bytes would have cost one
+ *              interrupt each (one more for the address), at the measured interrupt mode cost.
+ * @param[in]   start SysTick->VAL at the interrupt entry
  */
-int32_t I2cGetMutex(TickType_t waitTime)
+static void I2cDmaBusInterrupt(I2C_Bus *bus, uint32_t start)
 {
-    int32_t error = ERROR_NONE;
-    if (xSemaphoreTake(sensorI2cMutexHandle, waitTime) != pdTRUE) {
-        error = ERROR_NOT_READY;
+    SercomI2cm *const hw = &bus->module.hw->I2CM;
+    I2C_Dma_Stats *stats = &bus->dmaStats;
+    int32_t result = ERROR_NONE;
+
+    if ((hw->INTFLAG.reg & SERCOM_I2CM_INTFLAG_ERROR) ||
+        (hw->STATUS.reg & (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_LENERR | SERCOM_I2CM_STATUS_RXNACK))) {
+        result = ERROR_ABORTED;  // Same code as a bus error in interrupt mode
     }
-    return error;
+    I2cDmaRelease(bus, result != ERROR_NONE);
+    hw->STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_LENERR;
+    bus->dmaCycles += I2cIsrCycles(start);
+
+    if (result == ERROR_NONE) {
+        uint32_t perInterrupt = (stats->irqInterrupts != 0) ? stats->irqCycles / stats->irqInterrupts : I2C_IRQ_CYCLES_DEFAULT;
+        int32_t cyclesPerUs = (int32_t)(configCPU_CLOCK_HZ / 1000000UL);
+
+        stats->dmaTransfers++;
+        stats->dmaBytes += bus->dmaLen;
+        stats->bytesLast = bus->dmaLen;
+        stats->dmaCyclesLast = bus->dmaCycles;
+        stats->irqCyclesLast = (bus->dmaLen + 1) * perInterrupt;
+        stats->savedUsLast = ((int32_t)stats->irqCyclesLast - (int32_t)bus->dmaCycles) / cyclesPerUs;
+        stats->savedUsTotal += stats->savedUsLast;
+    } else {
+        stats->dmaFailed++;
+    }
+    I2cQueueComplete(bus, result);
 }
 
-static int32_t I2cGetSemaphoreHandle(SemaphoreHandle_t *handle)
+/**
+ * @fn			static int32_t I2cQueueStartPhase(I2C_Bus *bus, I2C_Request *req, bool read)
+ * @brief       Starts the write or the read of a request on the bus. Interrupts masked or ISR only.
+ * @return      ERROR_NONE if the job was started, ERROR_IO otherwise
+ */
+static int32_t I2cQueueStartPhase(I2C_Bus *bus, I2C_Request *req, bool read)
 {
-    int32_t error = ERROR_NONE;
-    *handle = sensorI2cSemaphoreHandle;
-    return error;
+    enum status_code hwError;
+    uint16_t len = read ? req->data.lenIn : req->data.lenOut;
+    bool noStop = !read && req->data.lenIn > 0 && i2cRepeatedStart;  // A DMA write always ends with STOP
+
+    if (bus->dmaReady && !noStop && len >= I2C_DMA_THRESHOLD && len <= I2C_DMA_MAX_LEN && I2cDmaStartPhase(bus, req, read) == ERROR_NONE) {
+        return ERROR_NONE;
+    }
+    bus->dmaStats.irqTransfers++;
+    bus->readPhase = read;
+    bus->packet.address = req->data.address;
+    if (read) {
+        bus->packet.data = req->data.msgIn;
+        bus->packet.data_length = req->data.lenIn;
+        hwError = i2c_master_read_packet_job(&bus->module, &bus->packet);
+    } else {
+        bus->packet.data = (uint8_t *)req->data.msgOut;
+        bus->packet.data_length = req->data.lenOut;
+        if (noStop) {
+            hwError = i2c_master_write_packet_job_no_stop(&bus->module, &bus->packet);
+        } else {
+            hwError = i2c_master_write_packet_job(&bus->module, &bus->packet);
+        }
+    }
+    return (STATUS_OK == hwError) ? ERROR_NONE : ERROR_IO;
 }
 
 /**
- * @fn			static uint8_t I2cGetTaskErrorStatus(I2C_Data *data)
- * @brief       Sets the error state of the latest I2C bus transaction for a given I2C data, which holds which physical I2C
- *bus we are using.
- * @details     This error flag is set to indicate when a I2C transaction has failed on a given I2C bus (encapsulated in
- *the I2C data structure).
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note
+ * @fn			static I2C_Speed_Profile *I2cSpeedFind(I2C_Bus *bus, uint8_t address)
+ * @brief       Returns the speed profile of a device, NULL if it runs at the bus clock.
  */
-static uint8_t I2cGetTaskErrorStatus(void)
+static I2C_Speed_Profile *I2cSpeedFind(I2C_Bus *bus, uint8_t address)
 {
-    return sensorTransmitError;
+    for (int i = 0; i < I2C_SPEED_PROFILES; ++i) {
+        if (bus->speedProfiles[i].khzWanted != 0 && bus->speedProfiles[i].address == address) {
+            return &bus->speedProfiles[i];
+        }
+    }
+    return NULL;
 }
 
 /**
- * @fn			static uint8_t I2cSetTaskErrorStatus(I2C_Data *data, uint8_t value)
- * @brief       Sets the error state of the latest I2C bus transaction for a given I2C data, which holds which physical I2C
- *bus we are using.
- * @details     This error flag is set to indicate when a I2C transaction has failed on a given I2C bus (encapsulated in
- *the I2C data structure).
- * @param[in]   value Value to which to set the error flag to.
- * @return      Returns an error message in case of error. See ErrCodes.h
- * @note
+ * @fn			static int32_t I2cSpeedBaud(const I2C_Bus *bus, uint16_t khz)
+ * @brief       BAUD for a clock by the ASF formula, -1 if the SERCOM core clock cannot reach it.
  */
-static void I2cSetTaskErrorStatus(uint8_t value)
+static int32_t I2cSpeedBaud(const I2C_Bus *bus, uint16_t khz)
 {
-    sensorTransmitError = value;
+    uint32_t fscl = 1000UL * khz;
+    uint32_t riseCycles = (bus->gclkHz / 1000UL) * I2C_RISE_TIME_NS / 1000000UL;
+    int32_t baud;
+
+    if (khz == 0 || fscl * (10 + riseCycles) >= bus->gclkHz) {
+        return -1;
+    }
+    baud = (int32_t)div_ceil(bus->gclkHz - fscl * (10 + riseCycles), 2 * fscl);
+    return (baud > 255) ? -1 : baud;
 }
 
 /**
-  * @fn			int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
-  * @brief       This is the main function to use to write data from an I2C device on a given I2C Bus. This function is blocking.
-  * @details     This function writes data from an I2C device, by writing the requested bytes.This function is blocking (bare-metal) or it
-                                 makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-                                 On FreeRtos, this function gets the mutex for the respective I2C bus.
-  * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
-  * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be
-                                 the delay an I2C device needs to make a measurement.
-  * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
-  * @return      Returns an error message in case of error.
-  * @note
-  */
-int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+ * @fn			static uint16_t I2cSpeedWanted(I2C_Bus *bus, uint8_t address)
+ * @brief       Clock a request for a device runs at, khzNow if the SERCOM cannot make the device's own.
+ */
+static uint16_t I2cSpeedWanted(I2C_Bus *bus, uint8_t address)
 {
-    int32_t error = ERROR_NONE;
-    SemaphoreHandle_t semHandle = NULL;
+    I2C_Speed_Profile *profile = I2cSpeedFind(bus, address);
+    uint16_t khz = (profile != NULL) ? profile->khz : bus->khzBase;
 
-    //---0. Get Mutex
-    error = I2cGetMutex(WAIT_I2C_LINE_MS);
-    if (ERROR_NONE != error) goto exit;
+    return (I2cSpeedBaud(bus, khz) < 0) ? bus->khzNow : khz;
+}
 
-    //---1. Get Semaphore Handle
-    error = I2cGetSemaphoreHandle(&semHandle);
-    if (ERROR_NONE != error) goto exit;
+/**
+ * @fn			static int32_t I2cSpeedSelect(I2C_Bus *bus, uint16_t khz)
+ * @brief       Reprograms the SERCOM clock. Task context only, with no job on the bus.
+ * @details     BAUD and SPEED are enable-protected, so the SERCOM is disabled around the change, once
+ *              the STOP of the previous request is out, and the bus state is forced back to idle.
+ *              Above 400 kHz the SERCOM is put in Fast-mode Plus. The STOP is polled
+ *              I2C_SPEED_IDLE_SPIN times, then again each tick for up to I2C_SPEED_IDLE_TICKS.
+ * @return      ERROR_NONE, or ERROR_BUSY if the bus stayed owned and the clock was left as it was
+ */
+static int32_t I2cSpeedSelect(I2C_Bus *bus, uint16_t khz)
+{
+    SercomI2cm *const hw = &bus->module.hw->I2CM;
+    int32_t baud = I2cSpeedBaud(bus, khz);
+    uint16_t spin = I2C_SPEED_IDLE_SPIN;
+    uint8_t ticks = 0;
+
+    while ((hw->STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk) == SERCOM_I2CM_STATUS_BUSSTATE(2)) {
+        if (--spin == 0) {
+            if (++ticks > I2C_SPEED_IDLE_TICKS) {
+                return ERROR_BUSY;
+            }
+            vTaskDelay(1);
+            spin = I2C_SPEED_IDLE_SPIN;
+        }
+    }
+    _i2c_master_wait_for_sync(&bus->module);
+    hw->CTRLA.reg &= ~SERCOM_I2CM_CTRLA_ENABLE;
+    _i2c_master_wait_for_sync(&bus->module);
+    hw->BAUD.reg = SERCOM_I2CM_BAUD_BAUD(baud);
+    hw->CTRLA.reg = (hw->CTRLA.reg & ~SERCOM_I2CM_CTRLA_SPEED_Msk) | SERCOM_I2CM_CTRLA_SPEED((khz > I2C_FAST_KHZ) ? 1 : 0);
+    hw->CTRLA.reg |= SERCOM_I2CM_CTRLA_ENABLE;
+    _i2c_master_wait_for_sync(&bus->module);
+    hw->STATUS.reg = SERCOM_I2CM_STATUS_BUSSTATE(1);
+    _i2c_master_wait_for_sync(&bus->module);
+
+    bus->khzNow = khz;
+    bus->speedSwitches++;
+    return ERROR_NONE;
+}
 
-    //---2. Initiate sending data
+/**
+ * @fn			static void I2cSpeedResult(I2C_Bus *bus, uint8_t address, int32_t result)
+ * @brief       Tracks the NACKs of a profiled device. Interrupts masked or ISR only.
+ * @details     After I2C_SPEED_NACK_FALLBACK bus errors in a row the device steps down from
+ *              Fast-mode Plus to Fast-mode to Standard-mode, never below the bus clock.
+ */
+static void I2cSpeedResult(I2C_Bus *bus, uint8_t address, int32_t result)
+{
+    I2C_Speed_Profile *profile = I2cSpeedFind(bus, address);
+    uint16_t floor;
 
-    error = I2cWriteData(data);
-    if (ERROR_NONE != error) {
-        goto exitError0;
+    if (profile == NULL || profile->pinned) {
+        return;
+    }
+    if (result != ERROR_ABORTED) {
+        if (result == ERROR_NONE) {
+            profile->nacks = 0;
+        }
+        return;
     }
+    if (++profile->nacks < I2C_SPEED_NACK_FALLBACK) {
+        return;
+    }
+    profile->nacks = 0;
+    floor = (profile->khzWanted < bus->khzBase) ? profile->khzWanted : bus->khzBase;
+    if (profile->khz > floor) {
+        profile->khz = (profile->khz > I2C_FAST_KHZ) ? I2C_FAST_KHZ : I2C_STANDARD_KHZ;
+        if (profile->khz < floor) {
+            profile->khz = floor;
+        }
+        profile->fallbacks++;
+        bus->speedFallbacks++;
+    }
+}
 
-    //---2. Wait for binary semaphore to tell us that we are done!
-    if (xSemaphoreTake(semHandle, xMaxBlockTime) == pdTRUE) {
-        /* The transmission ended as expected. We now delay until the I2C sensor is finished */
-        if (I2cGetTaskErrorStatus()) {
-            I2cSetTaskErrorStatus(false);
-            if (error != ERROR_NONE) {
-                error = ERROR_I2C_HANG_RESET;
-            } else {
-                error = ERROR_ABORTED;
+/**
+ * @fn			static void I2cQueueFinish(I2C_Bus *bus, int32_t result, BaseType_t *woken)
+ * @brief       Completes the request at the head of the queue and unlinks it. Interrupts masked or ISR only.
+ * @param[in]   result Result handed to the owner
+ * @param[out]  woken Set when a higher priority task was notified
+ */
+static void I2cQueueFinish(I2C_Bus *bus, int32_t result, BaseType_t *woken)
+{
+    I2C_Request *req = bus->queueHead;
+
+    bus->queueHead = req->next;
+    if (bus->queueHead == NULL) {
+        bus->queueTail = NULL;
+    }
+    bus->queueDepth--;
+    bus->queueStats.completed++;
+    if (result != ERROR_NONE) {
+        bus->queueStats.failed++;
+    }
+    I2cSpeedResult(bus, req->data.address, result);
+
+    req->next = NULL;
+    req->result = result;
+    req->done = true;
+    if (req->callback != NULL) {
+        req->callback(req, result);
+    }
+    if (req->notify != NULL) {
+        vTaskNotifyGiveFromISR(req->notify, woken);
+    }
+}
+
+/**
+ * @fn			static void I2cQueueStartNext(I2C_Bus *bus, BaseType_t *woken)
+ * @brief       Puts the head of the queue on the bus, completing requests that cannot start. Interrupts masked or ISR only.
+ * @details     A head that needs another clock is held instead, and the first task waiting on the
+ *              queue is woken to make the change (see I2cSpeedService()).
+ */
+static void I2cQueueStartNext(I2C_Bus *bus, BaseType_t *woken)
+{
+    while (bus->queueHead != NULL && !bus->speedSwitching) {
+        I2C_Request *req = bus->queueHead;
+        if (I2cSpeedWanted(bus, req->data.address) != bus->khzNow) {
+            bus->speedPending = true;
+            while (req != NULL && req->notify == NULL) {
+                req = req->next;
+            }
+            if (req != NULL) {
+                vTaskNotifyGiveFromISR(req->notify, woken);
             }
-            goto exitError0;
+            return;
         }
+        if (I2cQueueStartPhase(bus, req, req->data.lenOut == 0) == ERROR_NONE) {
+            return;
+        }
+        I2cQueueFinish(bus, ERROR_IO, woken);
+    }
+}
+
+/**
+ * @fn			static void I2cSpeedService(I2C_Bus *bus)
+ * @brief       Makes the clock change the queue head is held for, then restarts the queue. Task context only.
+ * @details     Run by every task submitting to or waiting on the bus, so the first of them to get
+ *              there makes the change, outside the interrupt and with no job on the bus. If the bus
+ *              does not go idle the held request completes with ERROR_BUSY.
+ */
+static void I2cSpeedService(I2C_Bus *bus)
+{
+    BaseType_t woken = pdFALSE;
+    I2C_Request *req;
+    uint16_t khz;
+    int32_t error;
+
+    taskENTER_CRITICAL();
+    req = bus->queueHead;
+    if (req == NULL) {
+        bus->speedPending = false;  // The held request was cancelled
+    }
+    if (!bus->speedPending || bus->speedSwitching) {
+        taskEXIT_CRITICAL();
+        return;
+    }
+    bus->speedSwitching = true;
+    khz = I2cSpeedWanted(bus, req->data.address);
+    taskEXIT_CRITICAL();
+
+    error = I2cSpeedSelect(bus, khz);
+
+    taskENTER_CRITICAL();
+    bus->speedSwitching = false;
+    bus->speedPending = false;
+    if (ERROR_NONE != error && bus->queueHead == req) {
+        bus->speedFailed++;
+        I2cQueueFinish(bus, error, &woken);
+    }
+    I2cQueueStartNext(bus, &woken);
+    taskEXIT_CRITICAL();
+
+    if (woken != pdFALSE) {
+        taskYIELD();
+    }
+}
+
+/**
+ * @fn			static void I2cQueueComplete(I2C_Bus *bus, int32_t status)
+ * @brief       Bus manager, run from the completion and error callbacks.
+ * @details     Moves the request on the bus from its write to its read, or completes it and
+ *              starts the next queued request right away, so queued transactions follow
+ *              each other with no task switch in between.
+ * @param[in]   status ERROR_NONE if the finished job succeeded
+ */
+static void I2cQueueComplete(I2C_Bus *bus, int32_t status)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    I2C_Request *req = bus->queueHead;
+
+    if (status == ERROR_NONE && !bus->readPhase && req->data.lenIn > 0) {
+        bool repeated = i2cRepeatedStart;
+        if (I2cQueueStartPhase(bus, req, true) == ERROR_NONE) {  // ADDR written on an owned bus: repeated START
+            if (repeated) {
+                bus->queueStats.repeatedStarts++;
+            }
+            return;
+        }
+        I2cReleaseBus(bus);
+        status = ERROR_IO;
+    }
+    I2cQueueFinish(bus, status, &xHigherPriorityTaskWoken);
+    if (bus->queueHead != NULL) {
+        bus->queueStats.chained++;
+        I2cQueueStartNext(bus, &xHigherPriorityTaskWoken);
+    }
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/**
+ * @fn			int32_t I2cSubmit(I2C_Request *req)
+ * @brief       Queues a transaction on the bus of its data without waiting for it.
+ * @details     The request is written, then read if lenIn is non-zero (no delay in between),
+ *              in submission order after every request already queued on the same bus. On completion, in
+ *              interrupt context, done and result are set, callback is called and notify is
+ *              given a task notification. The request and its buffers must stay valid until then.
+ *              The queue is what serializes a bus: requests run one at a time, whole, but those of
+ *              different tasks may interleave. A device sequence that must not be split (a
+ *              readback and restore, say) is guarded by its device driver, as PCA9685 does.
+ * @param[in]   req Request to queue; data, callback and notify are set by the caller
+ * @return      ERROR_NONE if queued, ERROR_INVALID_ARG for a malformed request or an unused bus
+ */
+int32_t I2cSubmit(I2C_Request *req)
+{
+    BaseType_t woken = pdFALSE;
+    I2C_Bus *bus;
+
+    if (req == NULL || (req->data.lenOut == 0 && req->data.lenIn == 0) || (req->data.lenOut != 0 && req->data.msgOut == NULL) ||
+        (req->data.lenIn != 0 && req->data.msgIn == NULL) || (bus = I2cGetBus(req->data.bus)) == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+
+    req->next = NULL;
+    req->done = false;
+    req->result = ERROR_NONE;
+
+    taskENTER_CRITICAL();
+    bus->queueStats.submitted++;
+    if (++bus->queueDepth > bus->queueStats.depthMax) {
+        bus->queueStats.depthMax = bus->queueDepth;
+    }
+    if (bus->queueTail != NULL) {
+        bus->queueTail->next = req;
     } else {
-        /* The call to ulTaskNotifyTake() timed out. */
-        error = ERR_TIMEOUT;
-        goto exitError0;
+        bus->queueHead = req;
+    }
+    bus->queueTail = req;
+    if (bus->queueHead == req) {
+        I2cQueueStartNext(bus, &woken);
     }
+    taskEXIT_CRITICAL();
 
-    //---8. Release Mutex
-    error |= I2cFreeMutex();
-// xSemaphoreGive(semHandle);
-exit:
-    return error;
+    if (woken != pdFALSE) {
+        taskYIELD();
+    }
+    I2cSpeedService(bus);
+    return ERROR_NONE;
+}
 
-exitError0:
-    error |= I2cFreeMutex();
-    // xSemaphoreGive(semHandle);
-    return error;
+/**
+ * @fn			void I2cCancel(I2C_Request *req)
+ * @brief       Withdraws a request that has not completed; it completes with ERROR_TIMEOUT.
+ * @details     A request already on the bus has its job aborted and the next request is started.
+ * @param[in]   req Request given to I2cSubmit()
+ */
+void I2cCancel(I2C_Request *req)
+{
+    BaseType_t woken = pdFALSE;
+    I2C_Bus *bus = I2cGetBus(req->data.bus);
+
+    taskENTER_CRITICAL();
+    if (!req->done) {
+        bus->queueStats.cancelled++;
+        if (req == bus->queueHead) {
+            if (bus->speedPending || bus->speedSwitching) {
+                // Held for a clock change, never put on the bus
+            } else if (bus->dmaActive != NULL) {
+                I2cDmaRelease(bus, true);
+            } else {
+                i2c_master_cancel_job(&bus->module);
+                I2cReleaseBus(bus);
+            }
+            I2cQueueFinish(bus, ERROR_TIMEOUT, &woken);
+            I2cQueueStartNext(bus, &woken);
+        } else {
+            I2C_Request *prev = bus->queueHead;
+            while (prev != NULL && prev->next != req) {
+                prev = prev->next;
+            }
+            if (prev != NULL) {
+                prev->next = req->next;
+                if (bus->queueTail == req) {
+                    bus->queueTail = prev;
+                }
+                bus->queueDepth--;
+            }
+            req->next = NULL;
+            req->result = ERROR_TIMEOUT;
+            req->done = true;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if (woken != pdFALSE) {
+        taskYIELD();
+    }
+}
+
+/**
+ * @fn			int32_t I2cWait(I2C_Request *req, const TickType_t xMaxBlockTime)
+ * @brief       Sleeps until a submitted request completes; cancels it on timeout.
+ * @details     The request's notify must be the calling task. Notifications left over from
+ *              other requests of the same task only cause an extra check.
+ * @param[in]   req Request given to I2cSubmit()
+ * @param[in]   xMaxBlockTime Longest wait, queueing time included
+ * @return      The request's result
+ */
+int32_t I2cWait(I2C_Request *req, const TickType_t xMaxBlockTime)
+{
+    TickType_t start = xTaskGetTickCount();
+    I2C_Bus *bus = I2cGetBus(req->data.bus);
+
+    while (!req->done) {
+        I2cSpeedService(bus);
+        if (req->done) {
+            break;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= xMaxBlockTime) {
+            I2cCancel(req);
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, xMaxBlockTime - elapsed);
+    }
+    return req->result;
+}
+
+/**
+ * @fn			int32_t I2cGetQueueStats(eI2cBuses bus, I2C_Queue_Stats *stats)
+ * @brief       Copies the transaction queue counters of a bus.
+ * @return      ERROR_NONE, or ERROR_NOT_INITIALIZED for an unused bus
+ */
+int32_t I2cGetQueueStats(eI2cBuses bus, I2C_Queue_Stats *stats)
+{
+    I2C_Bus *i2cBus = I2cGetBus(bus);
+
+    if (i2cBus == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    taskENTER_CRITICAL();
+    *stats = i2cBus->queueStats;
+    taskEXIT_CRITICAL();
+    return ERROR_NONE;
+}
+
+/**
+ * @fn			int32_t I2cGetDmaStats(eI2cBuses bus, I2C_Dma_Stats *stats)
+ * @brief       Copies the DMA path counters of a bus.
+ * @return      ERROR_NONE, or ERROR_NOT_INITIALIZED for an unused bus
+ */
+int32_t I2cGetDmaStats(eI2cBuses bus, I2C_Dma_Stats *stats)
+{
+    I2C_Bus *i2cBus = I2cGetBus(bus);
+
+    if (i2cBus == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    taskENTER_CRITICAL();
+    *stats = i2cBus->dmaStats;
+    taskEXIT_CRITICAL();
+    return ERROR_NONE;
+}
+
+/**
+ * @fn			void I2cSetRepeatedStart(bool enable)
+ * @brief       Selects how requests that write then read turn the bus around, on every bus.
+ * @param[in]   enable true for a repeated START (default), false for STOP and a new START
+ */
+void I2cSetRepeatedStart(bool enable)
+{
+    i2cRepeatedStart = enable;
+}
+
+/**
+ * @fn			bool I2cGetRepeatedStart(void)
+ * @brief       Returns true if write-then-read requests use a repeated START.
+ */
+bool I2cGetRepeatedStart(void)
+{
+    return i2cRepeatedStart;
+}
+
+/**
+ * @fn			int32_t I2cGetReadStats(eI2cBuses bus, I2C_Read_Stats *stats)
+ * @brief       Copies the register read latency counters of a bus.
+ * @return      ERROR_NONE, or ERROR_NOT_INITIALIZED for an unused bus
+ */
+int32_t I2cGetReadStats(eI2cBuses bus, I2C_Read_Stats *stats)
+{
+    I2C_Bus *i2cBus = I2cGetBus(bus);
+
+    if (i2cBus == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    taskENTER_CRITICAL();
+    *stats = i2cBus->readStats;
+    taskEXIT_CRITICAL();
+    return ERROR_NONE;
+}
+
+/**
+  * @fn			int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+  * @brief       This is the main function to use to write data from an I2C device on a given I2C Bus. This function is blocking.
+  * @details     This function writes data from an I2C device, by writing the requested bytes. The write goes through the
+                                 transaction queue of the device's bus and the current thread sleeps until it has finished, so other
+                                 threads' transactions can be queued behind it meanwhile.
+  * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
+  * @param[in]   xMaxBlockTime Maximum time for the thread to wait, queueing included.
+  * @return      Returns an error message in case of error.
+  * @note
+  */
+int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+{
+    I2C_Request req;
+
+    if (data == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+    memset(&req, 0, sizeof(req));
+    req.data = *data;
+    req.data.msgIn = NULL;
+    req.data.lenIn = 0;
+    req.notify = xTaskGetCurrentTaskHandle();
+
+    int32_t error = I2cSubmit(&req);
+    if (ERROR_NONE != error) {
+        return error;
+    }
+    return I2cWait(&req, xMaxBlockTime);
 }
 
 /**
   * @fn			int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
   * @brief       This is the main function to use to read data from an I2C device on a given I2C Bus. This function is blocking.
-  * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes. This
-                                 function is blocking (bare-metal) or it makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-                                 On FreeRtos, this function gets the mutex for the respective I2C bus.
+  * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes.
+                                 Without a delay both go to the bus as one queued request, joined by a repeated START so a register
+                                 read is a single transaction. With a delay the bus is released while the device works, so other
+                                 threads' transactions run in the gap.
   * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
   * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be the delay an I2C device needs to make a measurement.
-  * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
+  * @param[in]   xMaxBlockTime Maximum time for the thread to wait for each transfer, queueing included.
   * @return      Returns an error message in case of error. See ErrCodes.h
-  * @note        THIS IS THE FREERTOS VERSION! DO NOT Declare #define USE_FREERTOS if you wish to use the baremetal version!
   */
 int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
 {
-    int32_t error = ERROR_NONE;
-    SemaphoreHandle_t semHandle = NULL;
+    I2C_Request req;
+    int32_t error;
 
-    //---0. Get Mutex
-    error = I2cGetMutex(WAIT_I2C_LINE_MS);
-    if (ERROR_NONE != error) goto exit;
+    if (data == NULL || data->msgOut == NULL) {
+        return ERROR_INVALID_ARG;
+    }
+    memset(&req, 0, sizeof(req));
+    req.data = *data;
+    req.notify = xTaskGetCurrentTaskHandle();
+
+    if (delay != 0) {
+        req.data.lenIn = 0;  // Write first, read after the delay
+        error = I2cSubmit(&req);
+        if (ERROR_NONE == error) error = I2cWait(&req, xMaxBlockTime);
+        if (ERROR_NONE != error) {
+            return error;
+        }
+        vTaskDelay(delay);
+        req.data = *data;
+        req.data.lenOut = 0;
+    }
 
-    //---1. Get Semaphore Handle
-    error = I2cGetSemaphoreHandle(&semHandle);
-    if (ERROR_NONE != error) goto exit;
+    bool repeated = i2cRepeatedStart;
+    uint32_t start = CycleCounterNow();
+    error = I2cSubmit(&req);
+    if (ERROR_NONE == error) error = I2cWait(&req, xMaxBlockTime);
+    if (ERROR_NONE == error && delay == 0) {
+        I2C_Read_Stats *stats = &i2cBuses[data->bus].readStats;
+        uint32_t us = CycleCounterToUs(CycleCounterNow() - start);
+        taskENTER_CRITICAL();
+        if (repeated) {
+            stats->rsReads++;
+            stats->rsUsLast = us;
+            stats->rsUsTotal += us;
+        } else {
+            stats->stopReads++;
+            stats->stopUsLast = us;
+            stats->stopUsTotal += us;
+        }
+        taskEXIT_CRITICAL();
+    }
+    return error;
+}
 
-    //---2. Initiate sending data
+/**
+ * @fn			int32_t I2cSetDeviceSpeed(eI2cBuses bus, uint8_t address, uint16_t khz)
+ * @brief       Gives a device a clock of its own on its bus.
+ * @details     The bus is reprogrammed before each request for a device whose clock differs from
+ *              the one before, so slow and fast devices can share it. Setting a profile again
+ *              clears its fallback.
+ * @param[in]   khz Clock the device is rated for, up to I2C_FM_PLUS_KHZ; 0 returns it to the bus clock
+ * @return      ERROR_NONE, ERROR_INVALID_ARG above Fast-mode Plus, ERROR_BAUDRATE_UNAVAILABLE for a clock the
+ *              SERCOM cannot divide down to, ERROR_NO_MEMORY with every profile taken, or ERROR_NOT_INITIALIZED
+ *              for an unused bus
+ */
+int32_t I2cSetDeviceSpeed(eI2cBuses bus, uint8_t address, uint16_t khz)
+{
+    I2C_Bus *i2cBus = I2cGetBus(bus);
+    I2C_Speed_Profile *profile;
+    int32_t error = ERROR_NONE;
 
-    error = I2cWriteData(data);
-    if (ERROR_NONE != error) {
-        goto exitError0;
+    if (i2cBus == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    if (khz > I2C_FM_PLUS_KHZ) {
+        return ERROR_INVALID_ARG;
+    }
+    if (khz != 0 && I2cSpeedBaud(i2cBus, khz) < 0) {
+        return ERROR_BAUDRATE_UNAVAILABLE;
     }
 
-    //---2. Wait for binary semaphore to tell us that we are done!
-    if (xSemaphoreTake(semHandle, xMaxBlockTime) == pdTRUE) {
-        /* The transmission ended as expected. We now delay until the I2C sensor is finished */
-        if (I2cGetTaskErrorStatus()) {
-            I2cSetTaskErrorStatus(false);
-            error = ERROR_ABORTED;
-            goto exitError0;
+    taskENTER_CRITICAL();
+    profile = I2cSpeedFind(i2cBus, address);
+    if (profile == NULL && khz != 0) {
+        for (int i = 0; i < I2C_SPEED_PROFILES && profile == NULL; ++i) {
+            if (i2cBus->speedProfiles[i].khzWanted == 0) {
+                profile = &i2cBus->speedProfiles[i];
+                memset(profile, 0, sizeof(*profile));
+                profile->address = address;
+            }
         }
-        vTaskDelay(delay);
-    } else {
-        /* The call to ulTaskNotifyTake() timed out. */
-        error = ERR_TIMEOUT;
-        goto exitError0;
+        if (profile == NULL) {
+            error = ERROR_NO_MEMORY;
+        }
+    }
+    if (profile != NULL) {
+        profile->khzWanted = khz;
+        profile->khz = khz;
+        profile->nacks = 0;
     }
+    taskEXIT_CRITICAL();
+    return error;
+}
 
-    //---6. Initiate Read data
-    error = I2cReadData(data);
+/**
+ * @fn			int32_t I2cGetDeviceSpeed(eI2cBuses bus, uint8_t index, I2C_Speed_Profile *profile)
+ * @brief       Copies the index-th speed profile in use on a bus.
+ * @return      ERROR_NONE, ERROR_NOT_FOUND past the last profile, or ERROR_NOT_INITIALIZED for an unused bus
+ */
+int32_t I2cGetDeviceSpeed(eI2cBuses bus, uint8_t index, I2C_Speed_Profile *profile)
+{
+    I2C_Bus *i2cBus = I2cGetBus(bus);
+    int32_t error = ERROR_NOT_FOUND;
+
+    if (i2cBus == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    taskENTER_CRITICAL();
+    for (int i = 0; i < I2C_SPEED_PROFILES; ++i) {
+        if (i2cBus->speedProfiles[i].khzWanted != 0 && index-- == 0) {
+            *profile = i2cBus->speedProfiles[i];
+            error = ERROR_NONE;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return error;
+}
+
+/**
+ * @fn			int32_t I2cGetSpeedStats(eI2cBuses bus, I2C_Speed_Stats *stats)
+ * @brief       Copies the clock switching counters of a bus.
+ * @return      ERROR_NONE, or ERROR_NOT_INITIALIZED for an unused bus
+ */
+int32_t I2cGetSpeedStats(eI2cBuses bus, I2C_Speed_Stats *stats)
+{
+    I2C_Bus *i2cBus = I2cGetBus(bus);
+
+    if (i2cBus == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    taskENTER_CRITICAL();
+    stats->khz = i2cBus->khzNow;
+    stats->khzBase = i2cBus->khzBase;
+    stats->switches = i2cBus->speedSwitches;
+    stats->failed = i2cBus->speedFailed;
+    stats->fallbacks = i2cBus->speedFallbacks;
+    taskEXIT_CRITICAL();
+    return ERROR_NONE;
+}
+
+/**
+ * @fn			int32_t I2cBenchmark(const I2C_Data *data, uint16_t khz, uint16_t count, I2C_Bench_Result *result)
+ * @brief       Times a transfer repeated count times with its device held at one clock.
+ * @details     A write if data has nothing to read, otherwise a register read without delay. Each
+ *              transfer is timed from submission to wake-up, as a task sees it. The device's profile
+ *              is pinned meanwhile, so failures are counted rather than answered with a fallback,
+ *              and put back afterwards. Other tasks' requests to the device run at the same clock.
+ *              The profile is looked up again, under the critical section, each time it is touched,
+ *              since the interrupt and other tasks use it in between.
+ * @return      ERROR_NONE once the transfers ran, or the error of I2cSetDeviceSpeed()
+ */
+int32_t I2cBenchmark(const I2C_Data *data, uint16_t khz, uint16_t count, I2C_Bench_Result *result)
+{
+    I2C_Bus *i2cBus;
+    I2C_Speed_Profile *profile;
+    I2C_Speed_Profile saved;
+    bool hadProfile;
+    I2C_Data transfer;
+    uint32_t usTotal = 0;
+    int32_t error;
+
+    if (data == NULL || result == NULL || khz == 0) {
+        return ERROR_INVALID_ARG;
+    }
+    if ((i2cBus = I2cGetBus(data->bus)) == NULL) {
+        return ERROR_NOT_INITIALIZED;
+    }
+    taskENTER_CRITICAL();
+    profile = I2cSpeedFind(i2cBus, data->address);
+    hadProfile = profile != NULL;
+    if (hadProfile) {
+        saved = *profile;
+    }
+    taskEXIT_CRITICAL();
+    error = I2cSetDeviceSpeed((eI2cBuses)data->bus, data->address, khz);
     if (ERROR_NONE != error) {
-        goto exitError0;
-    }
-    //---7. Wait for notification
-    if (xSemaphoreTake(semHandle, xMaxBlockTime) == pdTRUE) {
-        /* The transmission ended as expected. We now delay until the I2C sensor is finished */
-        if (I2cGetTaskErrorStatus()) {
-            I2cSetTaskErrorStatus(false);
-            error = ERROR_ABORTED;
-            goto exitError0;
+        return error;
+    }
+    taskENTER_CRITICAL();
+    profile = I2cSpeedFind(i2cBus, data->address);
+    if (profile != NULL) {
+        profile->pinned = true;
+    }
+    taskEXIT_CRITICAL();
+
+    memset(result, 0, sizeof(*result));
+    result->khz = khz;
+    result->bytes = (data->lenIn != 0) ? data->lenIn : data->lenOut;
+    result->usMin = UINT32_MAX;
+    for (uint16_t i = 0; i < count; ++i) {
+        transfer = *data;
+        uint32_t start = CycleCounterNow();
+        if (transfer.lenIn != 0) {
+            error = I2cReadDataWait(&transfer, 0, pdMS_TO_TICKS(WAIT_I2C_LINE_MS));
+        } else {
+            error = I2cWriteDataWait(&transfer, pdMS_TO_TICKS(WAIT_I2C_LINE_MS));
+        }
+        uint32_t us = CycleCounterToUs(CycleCounterNow() - start);
+        if (ERROR_NONE != error) {
+            result->errors++;
+            continue;
         }
+        result->done++;
+        usTotal += us;
+        if (us < result->usMin) result->usMin = us;
+        if (us > result->usMax) result->usMax = us;
+    }
+    if (result->done != 0) {
+        result->usAvg = usTotal / result->done;
     } else {
-        /* The call to ulTaskNotifyTake() timed out. */
-        error = ERR_TIMEOUT;
-        goto exitError0;
+        result->usMin = 0;
     }
 
-    //---8. Release Mutex
-    error = I2cFreeMutex();
-// xSemaphoreGive(semHandle);
-exit:
-    return error;
-
-exitError0:
-    error = I2cFreeMutex();
-    // xSemaphoreGive(semHandle);
-    return error;
+    taskENTER_CRITICAL();
+    profile = I2cSpeedFind(i2cBus, data->address);
+    if (profile != NULL) {
+        if (hadProfile) {
+            *profile = saved;
+        } else {
+            profile->khzWanted = 0;
+        }
+    }
+    taskEXIT_CRITICAL();
+    return ERROR_NONE;
 }
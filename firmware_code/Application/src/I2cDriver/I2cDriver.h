@@ -23,6 +23,34 @@ extern "C" {
 
 #define I2C_INIT_ATTEMPTS 3
 #define WAIT_I2C_LINE_MS 300
+#define I2C_DMA_THRESHOLD 8           ///< Shortest transfer moved by DMA, register accesses stay in interrupt mode
+#define I2C_DMA_MAX_LEN 255           ///< Longest DMA transfer, the size of the SERCOM ADDR.LEN field
+#define I2C_IRQ_CYCLES_DEFAULT 200    ///< Assumed cost of one byte interrupt until one has been measured
+#define I2C_DMA_STOP_SPIN 500         ///< Polls of the bus state for the STOP that ends a DMA transfer
+#define I2C_SPEED_PROFILES 8          ///< Devices per bus with a clock of their own
+#define I2C_SPEED_NACK_FALLBACK 3     ///< Consecutive failed requests after which a device drops to the next slower clock
+#define I2C_SPEED_IDLE_SPIN 500       ///< Polls of the bus state for the STOP of the previous request before a clock change
+#define I2C_SPEED_IDLE_TICKS 2        ///< Ticks the bus may then stay owned before the request waiting for the change fails
+#define I2C_RISE_TIME_NS 215          ///< SCL/SDA rise time the BAUD is computed with (ASF default)
+#define I2C_FM_PLUS_KHZ 1000          ///< Fast-mode Plus
+#define I2C_FAST_KHZ 400              ///< Fast-mode
+#define I2C_STANDARD_KHZ 100          ///< Standard-mode
+
+/* Servo bus: the PCA9685 alone on its own SERCOM, at 400 kHz. Its pads clash with the ST7735 chip select
+ * (PA22), so it is off until the board routes the PCA9685 there; the servo devices then share the sensor bus. */
+#define I2C_SERVO_BUS_ENABLED 0
+#define I2C_SERVO_SERCOM SERCOM3
+#define I2C_SERVO_PINMUX_PAD0 PINMUX_PA22C_SERCOM3_PAD0
+#define I2C_SERVO_PINMUX_PAD1 PINMUX_PA23C_SERCOM3_PAD1
+#define I2C_SERVO_DMAC_ID_TX SERCOM3_DMAC_ID_TX
+#define I2C_SERVO_DMAC_ID_RX SERCOM3_DMAC_ID_RX
+
+#define I2C_SENSOR_BUS_KHZ 100        ///< Sensor bus clock of devices without a speed profile (ASF default)
+#if I2C_SERVO_BUS_ENABLED
+#define I2C_SERVO_BUS_KHZ 400         ///< Servo bus clock
+#else
+#define I2C_SERVO_BUS_KHZ I2C_SENSOR_BUS_KHZ
+#endif
 
 #define ERROR_NONE 0
 #define ERROR_INVALID_DATA -1
@@ -66,6 +94,19 @@ typedef enum eI2cBusState {
     I2C_BUS_MAX_STATES,  ///< Maximum number of allowable states of a bus
 } eI2cBusState;
 
+/// I2C buses of the board, each with its own SERCOM, queue and statistics
+typedef enum eI2cBuses {
+    I2C_BUS_SENSOR = 0,  ///< SERCOM0 on PA08/PA09: SHTC3, SGP40, APDS9960
+#if I2C_SERVO_BUS_ENABLED
+    I2C_BUS_SERVO,       ///< I2C_SERVO_SERCOM: PCA9685
+#endif
+    I2C_BUS_COUNT,       ///< Number of buses in use
+} eI2cBuses;
+
+#if !I2C_SERVO_BUS_ENABLED
+#define I2C_BUS_SERVO I2C_BUS_SENSOR  ///< Servo devices share the sensor bus
+#endif
+
 /// Structure that describes an I2C data, determining address to use, data buffer to send, etc.
 typedef struct I2C_Data {
     uint8_t address;        ///< Address of the I2C device
@@ -73,6 +114,7 @@ typedef struct I2C_Data {
     uint8_t *msgIn;         ///< Pointer to array buffer that we will get message to
     uint16_t lenIn;         ///< Length of message to read/write;
     uint16_t lenOut;        ///< Length of message to read/write;
+    uint8_t bus;            ///< eI2cBuses the device is on; statically allocated data defaults to the sensor bus
 
 } I2C_Data;
 
@@ -87,17 +129,107 @@ typedef struct I2C_Bus_State {
 
 } I2C_Bus_State;
 
+struct I2C_Request;
+/// Completion callback of a queued request, called in interrupt context
+typedef void (*I2C_Request_Callback)(struct I2C_Request *req, int32_t result);
+
+/// Transaction descriptor for the asynchronous queue (I2cSubmit). Owned by the caller, linked in place.
+typedef struct I2C_Request {
+    I2C_Data data;                  ///< Write msgOut (if lenOut), then read msgIn (if lenIn)
+    I2C_Request_Callback callback;  ///< Called on completion, may be NULL
+    TaskHandle_t notify;            ///< Task given a notification on completion, may be NULL
+    volatile bool done;             ///< Set once result is valid
+    volatile int32_t result;        ///< ERROR_NONE, or the error the transaction ended with
+    struct I2C_Request *next;       ///< Queue link, used by the driver
+} I2C_Request;
+
+/// Counters of the transaction queue
+typedef struct I2C_Queue_Stats {
+    uint32_t submitted;  ///< Requests queued
+    uint32_t completed;  ///< Requests finished, failed ones included
+    uint32_t failed;     ///< Requests that ended with an error
+    uint32_t chained;    ///< Requests started from the completion interrupt of the previous one
+    uint32_t cancelled;  ///< Requests withdrawn after a timeout
+    uint32_t repeatedStarts;  ///< Write-then-read requests that turned to the read with a repeated START
+    uint16_t depthMax;   ///< Most requests queued at once
+} I2C_Queue_Stats;
+
+/// Counters of the DMA transfer path, against the byte by byte interrupt path it replaces
+typedef struct I2C_Dma_Stats {
+    uint32_t dmaTransfers;    ///< Writes or reads moved by DMA
+    uint32_t dmaBytes;        ///< Bytes moved by DMA
+    uint32_t dmaFailed;       ///< DMA transfers that ended with an error
+    uint32_t irqTransfers;    ///< Queued writes or reads moved in interrupt mode
+    uint32_t irqInterrupts;   ///< Interrupt mode SERCOM interrupts behind irqCycles (halved with it)
+    uint32_t irqCycles;       ///< CPU cycles those interrupts took
+    uint16_t bytesLast;       ///< Length of the last DMA transfer
+    uint32_t dmaCyclesLast;   ///< CPU cycles of the last DMA transfer: setup and its interrupts
+    uint32_t irqCyclesLast;   ///< Cycles the same transfer would have taken in interrupt mode
+    int32_t savedUsLast;      ///< CPU time the last DMA transfer saved, negative if it cost more
+    int32_t savedUsTotal;     ///< CPU time saved by all DMA transfers
+} I2C_Dma_Stats;
+
+/// Latency of I2cReadDataWait() without delay on one bus, caller's view, with and without repeated START
+typedef struct I2C_Read_Stats {
+    uint32_t rsReads;       ///< Reads made as one transaction, write and read joined by a repeated START
+    uint32_t rsUsLast;
+    uint32_t rsUsTotal;
+    uint32_t stopReads;     ///< Reads made as a write transaction ended by STOP, then a read transaction
+    uint32_t stopUsLast;
+    uint32_t stopUsTotal;
+} I2C_Read_Stats;
+
+/// Clock of one device on a bus, switched to whenever a request for it follows one for another device
+typedef struct I2C_Speed_Profile {
+    uint8_t address;      ///< Address of the I2C device
+    uint16_t khzWanted;   ///< Clock the device is rated for, 0 for a free entry
+    uint16_t khz;         ///< Clock in use, lower than khzWanted after a fallback
+    uint8_t nacks;        ///< Consecutive failed requests at khz
+    bool pinned;          ///< Held at khz by I2cBenchmark(), no fallback
+    uint32_t fallbacks;   ///< Steps down to a slower clock
+} I2C_Speed_Profile;
+
+/// Clock switching counters of one bus
+typedef struct I2C_Speed_Stats {
+    uint16_t khz;         ///< Clock the bus runs at now
+    uint16_t khzBase;     ///< Clock of devices without a profile
+    uint32_t switches;    ///< BAUD reprogrammings between requests
+    uint32_t failed;      ///< Requests failed because the bus stayed owned through a change
+    uint32_t fallbacks;   ///< Profile steps down after repeated NACKs
+} I2C_Speed_Stats;
+
+/// Timing of repeated identical transfers at one clock, see I2cBenchmark()
+typedef struct I2C_Bench_Result {
+    uint16_t khz;         ///< Clock the transfers ran at
+    uint16_t bytes;       ///< Bytes per transfer, address byte excluded
+    uint16_t done;        ///< Transfers that succeeded
+    uint16_t errors;      ///< Transfers that failed
+    uint32_t usMin;
+    uint32_t usAvg;
+    uint32_t usMax;
+} I2C_Bench_Result;
+
 int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime);
 int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime);
-int32_t I2cGetMutex(TickType_t waitTime);
-int32_t I2cFreeMutex(void);
 int32_t I2cReadData(I2C_Data *data);
 int32_t I2cWriteData(I2C_Data *data);
 int32_t I2cInitializeDriver(void);
-void I2cDriverRegisterSensorBusCallbacks(void);
-void I2cSensorsError(struct i2c_master_module *const module);
-void I2cSensorsRxComplete(struct i2c_master_module *const module);
-void I2cSensorsTxComplete(struct i2c_master_module *const module);
+int32_t I2cSubmit(I2C_Request *req);
+int32_t I2cWait(I2C_Request *req, const TickType_t xMaxBlockTime);
+void I2cCancel(I2C_Request *req);
+const char *I2cGetBusName(eI2cBuses bus);
+int32_t I2cGetQueueStats(eI2cBuses bus, I2C_Queue_Stats *stats);
+int32_t I2cGetDmaStats(eI2cBuses bus, I2C_Dma_Stats *stats);
+void I2cSetRepeatedStart(bool enable);
+bool I2cGetRepeatedStart(void);
+int32_t I2cGetReadStats(eI2cBuses bus, I2C_Read_Stats *stats);
+int32_t I2cSetDeviceSpeed(eI2cBuses bus, uint8_t address, uint16_t khz);
+int32_t I2cGetDeviceSpeed(eI2cBuses bus, uint8_t index, I2C_Speed_Profile *profile);
+int32_t I2cGetSpeedStats(eI2cBuses bus, I2C_Speed_Stats *stats);
+int32_t I2cBenchmark(const I2C_Data *data, uint16_t khz, uint16_t count, I2C_Bench_Result *result);
+void I2cError(struct i2c_master_module *const module);
+void I2cRxComplete(struct i2c_master_module *const module);
+void I2cTxComplete(struct i2c_master_module *const module);
 
 #ifdef __cplusplus
 }
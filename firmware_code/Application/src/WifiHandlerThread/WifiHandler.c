@@ -12,6 +12,12 @@
 
 #include "WifiHandlerThread/WifiHandler.h"
 #include "ControlTask/ControlTask.h"
+#include "ControlTask/MotionQueue.h"
+#include "ControlTask/MotionRegistry.h"
+#include "ControlTask/MotionFile.h"
+#include "ControlTask/MotionVm.h"
+#include "ControlTask/MotionTiming.h"
+#include "ControlTask/MotionStream.h"
 #include "DisplayTask/ST7735.h" 
 #include "ControlTask/PCA9685.h"  
 #include "FreeRTOS.h" 
@@ -96,6 +102,9 @@ static void HTTP_DownloadFileInit(void);
 static void HTTP_DownloadFileTransaction(void);
 // ENV Sensor
 static void MQTT_HandleSensorMessages(void);
+static void MQTT_HandleTimingMessages(void);
+static void MQTT_HandleStreamMessages(void);
+static void MQTT_HandleServoHealthMessages(void);
 /******************************************************************************
  * Callback Functions
  ******************************************************************************/
@@ -400,93 +409,39 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
 /**
  * @brief Publishes servo angles for each step of the given motion state.
  * 
- * @details Selects the corresponding motion array based on the current robot state,
- * formats each step's servo angles into JSON, and publishes them via MQTT to Node-RED.
+ * @details Looks up the motion in the registry, formats each step's servo angles
+ * into JSON, and publishes them via MQTT to Node-RED.
  * Adds delay between steps as defined in the motion sequence.
  * 
  * @param state RobotState enum indicating which motion to publish.
  */
 static void PublishSequenceForState(RobotState state) {
-	const int (*motion)[9] = NULL;
-	int steps = 0;
-
-	switch (state) {
-		case STATE_FORWARD:
-		motion = Forward;
-		steps = 11;
-		break;
-		case STATE_BACKWARD:
-		motion = Backward;
-		steps = 11;
-		break;
-		case STATE_LEFT_SHIFT:
-		motion = LeftShift;
-		steps = 8;
-		break;
-		case STATE_RIGHT_SHIFT:
-		motion = RightShift;
-		steps = 8;
-		break;
-		case STATE_SAY_HI:
-		motion = SayHi;
-		steps = 7;
-		break;
-		case STATE_LIE:
-		motion = Lie;
-		steps = 2;
-		break;
-		case STATE_FIGHTING:
-		motion = Fighting;
-		steps = 11;
-		break;
-		case STATE_PUSHUP:
-		motion = PushUp;
-		steps = 11;
-		break;
-		case STATE_SLEEP:
-		motion = Sleep;
-		steps = 2;
-		break;
-		case STATE_DANCE1:
-		motion = Dance1;
-		steps = 18;
-		break;
-		case STATE_DANCE2:
-		motion = Dance2;
-		steps = 9;
-		break;
-		case STATE_DANCE3:
-		motion = Dance3;
-		steps = 10;
-		break;
-		case STATE_IDLE:
-		motion = Standby;
-		steps = 1;
-		break;
-		default:
+	const MotionEntry *entry = MotionRegistry_Get(state);
+	if (entry == NULL) {
 		return;
 	}
 
 	// Loop through each step of the motion
-	for (int i = 0; i < steps; ++i) {
-
-		
+	for (int i = 0; i < entry->count; ++i) {
+		const MotionStep *step = &entry->steps[i];
 		char json[128];
 		// Format current step's 8 servo angles into JSON string
 		int len = snprintf(json, sizeof(json),
 		"{\"servo1\":%d,\"servo2\":%d,\"servo3\":%d,\"servo4\":%d,"
 		"\"servo5\":%d,\"servo6\":%d,\"servo7\":%d,\"servo8\":%d}",
-		motion[i][0], motion[i][1], motion[i][2], motion[i][3],
-		motion[i][4], motion[i][5], motion[i][6], motion[i][7]);
+		pca9685_pulse_to_angle(step->pulse[0]), pca9685_pulse_to_angle(step->pulse[1]),
+		pca9685_pulse_to_angle(step->pulse[2]), pca9685_pulse_to_angle(step->pulse[3]),
+		pca9685_pulse_to_angle(step->pulse[4]), pca9685_pulse_to_angle(step->pulse[5]),
+		pca9685_pulse_to_angle(step->pulse[6]), pca9685_pulse_to_angle(step->pulse[7]));
 
 		// Publish to Node-RED via MQTT if formatting succeeded
 		if (len > 0) {
 			MQTT_Publish_ServoAngles(json);
 		}
 
-		vTaskDelay(pdMS_TO_TICKS(motion[i][50]));
-	}
+		vTaskDelay(pdMS_TO_TICKS(step->delay_ms));
 	}
+}
 
 // Callback for handling socket events
 static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
@@ -1107,9 +1062,12 @@ static void MQTT_HandleTransactions(void)
     MQTT_HandleImuMessages();
 	// ENV
 	MQTT_HandleSensorMessages();
+	MQTT_HandleTimingMessages();
+	MQTT_HandleStreamMessages();
+	MQTT_HandleServoHealthMessages();
 
-    // Handle MQTT messages
-    if (mqtt_inst.isConnected) mqtt_yield(&mqtt_inst, 100);
+    // Handle MQTT messages, polling fast while servo frames are streamed
+    if (mqtt_inst.isConnected) mqtt_yield(&mqtt_inst, MotionStream_Active() ? MOTION_STREAM_POLL_MS : 100);
 }
 
 static void MQTT_HandleImuMessages(void)
@@ -1176,6 +1134,94 @@ static void MQTT_HandleSensorMessages(void) {
 	}
 }
 
+// Servo frame timing, published periodically while motions are being played
+static void MQTT_HandleTimingMessages(void) {
+	static TickType_t lastPublish = 0;
+	static uint32_t lastSamples = 0;
+	MotionTimingSummary t;
+
+	if (!mqtt_inst.isConnected || xTaskGetTickCount() - lastPublish < pdMS_TO_TICKS(MOTION_TIMING_PUBLISH_MS)) {
+		return;
+	}
+	lastPublish = xTaskGetTickCount();
+
+	MotionTiming_GetSummary(&t);
+	if (t.samples == lastSamples) {
+		return;  // Nothing played since the last report
+	}
+	lastSamples = t.samples;
+
+	char payload[160];
+	int len = snprintf(payload, sizeof(payload),
+	                   "{\"frames\":%lu,\"min_us\":%lu,\"mean_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu,"
+	                   "\"sequences\":%lu,\"overruns\":%lu,\"overrun_max_us\":%lu}",
+	                   (unsigned long)t.samples, (unsigned long)t.minUs, (unsigned long)t.meanUs,
+	                   (unsigned long)t.p99Us, (unsigned long)t.maxUs, (unsigned long)t.sequences,
+	                   (unsigned long)t.overruns, (unsigned long)t.overrunUsMax);
+	if (len > 0 && len < (int)sizeof(payload)) {
+		mqtt_publish(&mqtt_inst, MOTION_TIMING_TOPIC, payload, len, 1, 0);
+	}
+}
+
+// Live stream statistics, published while frames are coming in
+static void MQTT_HandleStreamMessages(void) {
+	static TickType_t lastPublish = 0;
+	static uint32_t lastReceived = 0;
+	MotionStreamStats s;
+
+	if (!mqtt_inst.isConnected || xTaskGetTickCount() - lastPublish < pdMS_TO_TICKS(MOTION_STREAM_PUBLISH_MS)) {
+		return;
+	}
+	lastPublish = xTaskGetTickCount();
+
+	MotionStream_GetStats(&s);
+	if (s.received == lastReceived) {
+		return;
+	}
+	lastReceived = s.received;
+
+	char payload[200];
+	int len = snprintf(payload, sizeof(payload),
+	                   "{\"received\":%lu,\"played\":%lu,\"extrapolated\":%lu,\"held\":%lu,\"late\":%lu,"
+	                   "\"skipped\":%lu,\"timeouts\":%lu,\"latency_ms\":%lu,\"latency_max_ms\":%lu,"
+	                   "\"buffer_ms\":%lu,\"jitter_us\":%lu}",
+	                   (unsigned long)s.received, (unsigned long)s.played, (unsigned long)s.extrapolated,
+	                   (unsigned long)s.held, (unsigned long)s.late, (unsigned long)s.skipped,
+	                   (unsigned long)s.timeouts, (unsigned long)s.latencyMeanMs, (unsigned long)s.latencyMaxMs,
+	                   (unsigned long)s.bufferMeanMs, (unsigned long)s.jitterUs);
+	if (len > 0 && len < (int)sizeof(payload)) {
+		mqtt_publish(&mqtt_inst, MOTION_STREAM_TOPIC, payload, len, 0, 0);
+	}
+}
+
+// Servo driver resets and recoveries, published when something happened
+static void MQTT_HandleServoHealthMessages(void) {
+	static TickType_t lastPublish = 0;
+	static uint32_t lastEvents = 0;
+	PCA9685HealthStats h;
+
+	if (!mqtt_inst.isConnected || xTaskGetTickCount() - lastPublish < pdMS_TO_TICKS(SERVO_HEALTH_PUBLISH_MS)) {
+		return;
+	}
+	lastPublish = xTaskGetTickCount();
+
+	pca9685_get_health_stats(&h);
+	if (h.resets + h.readErrors == lastEvents) {
+		return;
+	}
+	lastEvents = h.resets + h.readErrors;
+
+	char payload[160];
+	int len = snprintf(payload, sizeof(payload),
+	                   "{\"checks\":%lu,\"read_errors\":%lu,\"resets\":%lu,\"restore_failures\":%lu,"
+	                   "\"recover_us\":%lu,\"recover_max_us\":%lu}",
+	                   (unsigned long)h.checks, (unsigned long)h.readErrors, (unsigned long)h.resets,
+	                   (unsigned long)h.restoreFailures, (unsigned long)h.recoverUsLast, (unsigned long)h.recoverUsMax);
+	if (len > 0 && len < (int)sizeof(payload)) {
+		mqtt_publish(&mqtt_inst, SERVO_HEALTH_TOPIC, payload, len, 1, 0);
+	}
+}
+
 
 /**
  * @fn      void SubscribeHandlerMotionTopic(MessageData *msgData)
@@ -1184,6 +1230,27 @@ static void MQTT_HandleSensorMessages(void) {
  *          and robot motion state accordingly. Also updates the LCD mode display.
  */
 void SubscribeHandlerMotionTopic(MessageData *msgData) {
+	const char *payload = (const char *)msgData->message->payload;
+
+	// Binary live servo frames share the topic; they start with a non-printable magic byte
+	if (MotionStream_Push((const uint8_t *)payload, msgData->message->payloadlen)) {
+		return;
+	}
+
+	// "vm:<source>" carries a motion program, e.g. "vm: loop 3; play hi; next"
+	// (kept on this topic since all MQTT message handler slots are in use)
+	if (msgData->message->payloadlen > 3 && strncmp(payload, "vm:", 3) == 0) {
+		uint16_t errorLine = 0;
+		if (MotionVm_LoadText(payload + 3, msgData->message->payloadlen - 3, &errorLine) == 0) {
+			MotionQueue_Post(STATE_VM_PROGRAM, MOTION_CLASS_USER);
+			drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
+			drawString(70, 100, "Program", WHITE, BLACK);
+		} else {
+			LogMessage(LOG_DEBUG_LVL, "Motion program error in statement %u\r\n", errorLine);
+		}
+		return;
+	}
+
 	// copy payload into a C-string
 	char modeBuf[16] = {0};
 	int len = msgData->message->payloadlen;
@@ -1202,74 +1269,35 @@ void SubscribeHandlerMotionTopic(MessageData *msgData) {
 	}
 	
 
-	if (strcmp(modeBuf, "forward") == 0) {
-		current_state = STATE_FORWARD;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Forward", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "backward") == 0) {
-		current_state = STATE_BACKWARD;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Backward", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "turn_left") == 0) {
-		current_state = STATE_LEFT_SHIFT;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Turn Left", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "turn_right") == 0) {
-		current_state = STATE_RIGHT_SHIFT;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Turn Right", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "idle") == 0) {
-		current_state = STATE_IDLE;
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "IDLE", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "say_hi") == 0) {
-		current_state = STATE_SAY_HI;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Say Hi", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "lie") == 0) {
-		current_state = STATE_LIE;
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Lie", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "fighting") == 0) {
-		current_state = STATE_FIGHTING;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Fighting", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "push_up") == 0) {
-		current_state =	STATE_PUSHUP;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Push Up", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "sleep") == 0) {
-		current_state =	STATE_SLEEP;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Sleep", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "wiggle") == 0) {
-		current_state =	STATE_DANCE1;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Wiggle", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "dance") == 0) {
-		current_state =	STATE_DANCE2;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Dance", WHITE, BLACK);
-		} else if (strcmp(modeBuf, "warmup") == 0) {
-		current_state =	STATE_DANCE3;
-		PublishSequenceForState(current_state);
-		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "Warm Up", WHITE, BLACK);
-		} else{
-		current_state = STATE_IDLE;
+	// An optional speed factor follows the name, e.g. "dance1 1.5"
+	uint16_t speed = MOTION_SPEED_ONE;
+	char *speedText = strchr(modeBuf, ' ');
+	if (speedText != NULL) {
+		*speedText++ = '\0';
+		if (!MotionPlayer_ParseSpeed(speedText, strlen(speedText), &speed)) {
+			LogMessage(LOG_DEBUG_LVL, "Invalid motion speed %s\r\n", speedText);
+			speed = MOTION_SPEED_ONE;
+		}
+	}
+
+	// Names not built in are looked up on the SD card; anything else falls back to idle
+	const MotionEntry *entry = MotionRegistry_Find(modeBuf);
+	if (entry == NULL && MotionFile_Request(modeBuf, strlen(modeBuf))) {
+		MotionQueue_PostSpeed(STATE_SD_FILE, MOTION_CLASS_USER, speed);
 		drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
-		drawString(70, 100, "IDLE", WHITE, BLACK);
+		drawString(70, 100, modeBuf, WHITE, BLACK);
+		return;
+	}
+	if (entry == NULL) {
+		entry = MotionRegistry_Get(STATE_IDLE);
+	}
+
+	MotionQueue_PostSpeed(entry->state, MOTION_CLASS_USER, speed);
+	if (entry->state != STATE_IDLE) {
+		PublishSequenceForState(entry->state);
 	}
+	drawRectangle(70, 100, _GRAMWIDTH - 1, 107, BLACK);
+	drawString(70, 100, (char *)entry->label, WHITE, BLACK);
 }
 
 
@@ -1378,7 +1406,7 @@ void vWifiTask(void *pvParameters)
             wifiStateMachine = DataToReceive;  // Update new state
         }
 
-        vTaskDelay(100);
+        vTaskDelay(MotionStream_Active() ? pdMS_TO_TICKS(MOTION_STREAM_POLL_MS) : 100);
     }
     return;
 }
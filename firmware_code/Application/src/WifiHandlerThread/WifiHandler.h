@@ -117,6 +117,15 @@ struct RgbColorPacket {
 #define MOTION_TOPIC    "robot/mode"
 // topic for servo angles to Node-RED
 #define SERVO_ANGLES_TOPIC "robot/servo_angles"
+// servo frame timing statistics
+#define MOTION_TIMING_TOPIC "robot/timing"
+#define MOTION_TIMING_PUBLISH_MS 5000
+// live servo stream statistics (frames themselves arrive on MOTION_TOPIC)
+#define MOTION_STREAM_TOPIC "robot/stream"
+#define MOTION_STREAM_PUBLISH_MS 2000
+// servo driver brownout detection
+#define SERVO_HEALTH_TOPIC "robot/servo_health"
+#define SERVO_HEALTH_PUBLISH_MS 5000
 // OTA
 #define OTA_COMMAND_TOPIC   "device/ota_command"
 
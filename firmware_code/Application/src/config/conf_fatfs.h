@@ -205,9 +205,15 @@
 /* A header file that defines sync object types on the O/S, such as
 /  windows.h, ucos_ii.h and semphr.h, must be included prior to ff.h. */
 
-#define _FS_REENTRANT    0        /* 0:Disable or 1:Enable */
+/* ControlTask streams motion files while the WiFi task (OTA download) and the
+/  CLI write the card, so each volume is guarded by a FreeRTOS mutex
+/  (FatFsSync/FatFsSync.c). */
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#define _FS_REENTRANT    1        /* 0:Disable or 1:Enable */
 #define _FS_TIMEOUT        1000    /* Timeout period in unit of time ticks */
-#define    _SYNC_t            HANDLE    /* O/S dependent type of sync object. e.g. HANDLE, OS_EVENT*, ID and etc.. */
+#define    _SYNC_t            SemaphoreHandle_t    /* O/S dependent type of sync object. e.g. HANDLE, OS_EVENT*, ID and etc.. */
 
 /* The _FS_REENTRANT option switches the reentrancy (thread safe) of the FatFs module.
 /
@@ -24,6 +24,11 @@
 #include "EnvTask/EnvSensorTask.h" 
 #include "DisplayTask/DisplayTask.h"  
 #include "ControlTask/ControlTask.h"
+#include "ControlTask/MotionQueue.h"
+#include "ControlTask/MotionFile.h"
+#include "ControlTask/MotionVm.h"
+#include "ControlTask/ServoCal.h"
+#include "ControlTask/MotionRecord.h"
 #include "GesTask/GesTask.h"
 #include "EnvTask/SHTC3.h"
 #include "EnvTask/SGP40.h"
@@ -36,7 +41,7 @@
 #define ENV_PRIORITY (tskIDLE_PRIORITY + 2)
 #define DISPLAY_TASK_SIZE 380 
 #define DISPLAY_PRIORITY (tskIDLE_PRIORITY + 1) 
-#define CONTROL_TASK_SIZE 430  /**< @brief Size for the control task */
+#define CONTROL_TASK_SIZE 558  /**< @brief Size for the control task */
 #define CONTROL_TASK_PRIORITY (tskIDLE_PRIORITY + 2) /**< @brief Priority for the control task */
 #define GES_TASK_SIZE          180  /**< @brief Size for the gesture task */
 #define GES_TASK_PRIORITY      (tskIDLE_PRIORITY + 2) /**< @brief Priority for the gesture task */
@@ -149,6 +154,21 @@ static void StartTasks(void) {
 	SerialConsoleWriteString(bufferPrint);
 
  	// Control
+	if (!MotionQueue_Init()) {
+		SerialConsoleWriteString("ERR: could not create motion command queue!\r\n");
+	}
+	if (!MotionFile_Init()) {
+		SerialConsoleWriteString("ERR: could not create motion file lock!\r\n");
+	}
+	if (!MotionVm_Init()) {
+		SerialConsoleWriteString("ERR: could not create motion program lock!\r\n");
+	}
+	if (!ServoCal_Init()) {
+		SerialConsoleWriteString("No servo calibration stored, using nominal pulses\r\n");
+	}
+	if (!MotionRecord_Init()) {
+		SerialConsoleWriteString("ERR: could not create motion recorder lock!\r\n");
+	}
 	if (xTaskCreate(ControlTask, "CONTROL_TASK", CONTROL_TASK_SIZE, NULL, CONTROL_TASK_PRIORITY, &controlTaskHandle) != pdPASS) {
 			SerialConsoleWriteString("ERR: Control task could not be initialized!\r\n");
 		}